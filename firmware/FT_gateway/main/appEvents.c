@@ -0,0 +1,132 @@
+/**
+ * @file appEvents.c
+ * @brief Application event bus on the default esp_event loop
+ * @details
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// ESP libraries
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+// Personal libraries
+#include "appEvents.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+	/* Variables */
+
+ESP_EVENT_DEFINE_BASE(APP_EVENTS);
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "app_events";
+
+// Event names for the log
+static const char * const g_event_names[APP_EVENT_COUNT] =
+{
+#define X(ID, ENUM, PAYLOAD) [ID] = #ENUM,
+	X_MACRO_APP_EVENT_LIST
+#undef X
+};
+
+// State snapshot, written by the posters
+static app_state_t g_state;
+static portMUX_TYPE app_events_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+	/* Static Functions */
+
+static void appEvents_updateState(app_event_id_t id, const void * data_p);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Creates the default event loop
+void appEvents_init(void)
+{
+	ESP_ERROR_CHECK(esp_event_loop_create_default());
+}
+
+// Updates the state snapshot and posts an event to the subscribers
+esp_err_t appEvents_post(app_event_id_t id, const void * data_p, size_t size)
+{
+	if (id >= APP_EVENT_COUNT)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	appEvents_updateState(id, data_p);
+
+	esp_err_t err = esp_event_post(APP_EVENTS, id, data_p, size, pdMS_TO_TICKS(APP_EVENTS_POST_TIMEOUT_MS));
+	if (err != ESP_OK)
+	{
+		ESP_LOGW(TAG, "appEvents_post: %s not delivered (%s)", g_event_names[id], esp_err_to_name(err));
+	}
+	return err;
+}
+
+// Registers a handler
+esp_err_t appEvents_subscribe(int32_t id, esp_event_handler_t handler, void * arg)
+{
+	return esp_event_handler_instance_register(APP_EVENTS, id, handler, arg, NULL);
+}
+
+// Copies the state snapshot
+void appEvents_getState(app_state_t * state_p)
+{
+	taskENTER_CRITICAL(&app_events_mux);
+	*state_p = g_state;
+	taskEXIT_CRITICAL(&app_events_mux);
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Applies an event to the state snapshot
+ * @details runs before the event is posted, a subscriber reading the
+ * state always sees the event it is handling
+ * @param id
+ * @param data_p payload
+ */
+static void appEvents_updateState(app_event_id_t id, const void * data_p)
+{
+	taskENTER_CRITICAL(&app_events_mux);
+	switch (id)
+	{
+		case APP_EVENT_WIFI_CONNECTING:
+			g_state.wifi_status = APP_WIFI_STATUS_CONNECTING;
+			break;
+
+		case APP_EVENT_WIFI_CONNECTED:
+			g_state.wifi_status = APP_WIFI_STATUS_CONNECT_SUCCESS;
+			g_state.ip = ((const app_event_wifi_connected_t *)data_p)->ip;
+			g_state.connects++;
+			break;
+
+		case APP_EVENT_WIFI_CONNECT_FAILED:
+			g_state.wifi_status = APP_WIFI_STATUS_CONNECT_FAILED;
+			g_state.ip.addr = 0;
+			g_state.last_reason = ((const app_event_wifi_connect_failed_t *)data_p)->reason;
+			break;
+
+		default:
+			break;
+	}
+	taskEXIT_CRITICAL(&app_events_mux);
+}
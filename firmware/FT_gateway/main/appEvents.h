@@ -0,0 +1,151 @@
+/**
+ * @file appEvents.h
+ * @brief Application event bus on the default esp_event loop
+ * @details
+ * Modules announce what happened with appEvents_post and any number of
+ * modules subscribe to it, the handlers run on the default event loop
+ * task like the WiFi and IP ones. The bus also keeps a snapshot of the
+ * state the events describe, updated before each event is posted, so a
+ * reader (e.g. an HTTP handler) gets a consistent copy without waiting
+ * for any event.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_APPEVENTS_H_
+#define MAIN_APPEVENTS_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stddef.h>
+#include <stdint.h>
+
+// ESP libraries
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_netif_ip_addr.h"
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+ESP_EVENT_DECLARE_BASE(APP_EVENTS);
+
+/**
+ * @brief Application events
+ * @details columns: ID, ENUM, PAYLOAD
+ */
+#define X_MACRO_APP_EVENT_LIST												\
+	X(0, APP_EVENT_WIFI_CONNECTING,		void							)	\
+	X(1, APP_EVENT_WIFI_CONNECTED,		app_event_wifi_connected_t		)	\
+	X(2, APP_EVENT_WIFI_CONNECT_FAILED,	app_event_wifi_connect_failed_t	)	\
+	X(3, APP_EVENT_TIME_STEPPED,		app_event_time_stepped_t		)
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief Event IDs
+ */
+typedef enum app_event_id_e
+{
+#define X(ID, ENUM, PAYLOAD) ENUM = ID,
+	X_MACRO_APP_EVENT_LIST
+#undef X
+	APP_EVENT_COUNT
+} app_event_id_t;
+
+/**
+ * @brief Station connection status, the web page polls these values
+ */
+typedef enum app_wifi_status_e
+{
+	APP_WIFI_STATUS_NONE = 0,
+	APP_WIFI_STATUS_CONNECTING,
+	APP_WIFI_STATUS_CONNECT_FAILED,
+	APP_WIFI_STATUS_CONNECT_SUCCESS,
+} app_wifi_status_t;
+
+/**
+ * @brief APP_EVENT_WIFI_CONNECTED payload
+ */
+typedef struct app_event_wifi_connected_s
+{
+	esp_ip4_addr_t	ip;
+} app_event_wifi_connected_t;
+
+/**
+ * @brief APP_EVENT_WIFI_CONNECT_FAILED payload
+ */
+typedef struct app_event_wifi_connect_failed_s
+{
+	uint8_t			reason;		///> wifi_err_reason_t of the last disconnection
+} app_event_wifi_connect_failed_t;
+
+/**
+ * @brief APP_EVENT_TIME_STEPPED payload, posted by the NTP task when it
+ * sets the clock instead of slewing it, the first sync included
+ */
+typedef struct app_event_time_stepped_s
+{
+	int64_t			offset_us;	///> positive when the clock went forward
+} app_event_time_stepped_t;
+
+/**
+ * @brief State described by the events
+ */
+typedef struct app_state_s
+{
+	app_wifi_status_t	wifi_status;
+	esp_ip4_addr_t		ip;				///> valid when connected
+	uint8_t				last_reason;	///> of the last failed connection
+	uint32_t			connects;		///> successful connections since boot
+} app_state_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Creates the default event loop
+ * @details must run before any module registers a handler, WiFi included
+ */
+void appEvents_init(void);
+
+/**
+ * @brief Updates the state snapshot and posts an event to the subscribers
+ * @param id event
+ * @param data_p payload, copied by the loop; NULL when the event has none
+ * @param size of the payload
+ * @return esp_err_t ESP_ERR_TIMEOUT when the loop queue stayed full for
+ * APP_EVENTS_POST_TIMEOUT_MS
+ */
+esp_err_t appEvents_post(app_event_id_t id, const void * data_p, size_t size);
+
+/**
+ * @brief Registers a handler, every subscriber of an event is called
+ * @param id event, or ESP_EVENT_ANY_ID
+ * @param handler runs on the default event loop task, keep it short
+ * @param arg passed to the handler
+ * @return esp_err_t
+ */
+esp_err_t appEvents_subscribe(int32_t id, esp_event_handler_t handler, void * arg);
+
+/**
+ * @brief Copies the state snapshot
+ * @param state_p destination
+ */
+void appEvents_getState(app_state_t * state_p);
+
+#endif /* MAIN_APPEVENTS_H_ */
@@ -0,0 +1,601 @@
+/**
+ * @file asyncLog.c
+ * @brief Deferred logger for the hot paths
+ * @details
+ * The ring is a bounded multi-producer queue: each slot carries a sequence
+ * number telling if it's free for the writer of a position or ready for
+ * the reader, a writer claims its position with a compare and swap and
+ * publishes the slot when the record is complete. There is a single
+ * reader, the asyncLog task. The ESP_LOGx lines use a second ring of the
+ * same kind, holding text instead of the format and its arguments.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// ESP libraries
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+// Personal libraries
+#include "asyncLog.h"
+#include "tasks_common.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+_Static_assert((ASYNC_LOG_RING_SIZE & (ASYNC_LOG_RING_SIZE - 1)) == 0, "ASYNC_LOG_RING_SIZE must be a power of 2");
+_Static_assert((ASYNC_LOG_TEXT_RING_SIZE & (ASYNC_LOG_TEXT_RING_SIZE - 1)) == 0, "ASYNC_LOG_TEXT_RING_SIZE must be a power of 2");
+
+	/* Structures */
+
+/**
+ * @brief One queued message
+ */
+typedef struct async_log_record_s
+{
+	uint32_t		time_ms;
+	const char *	tag;
+	const char *	format;
+	uint16_t		suppressed;		///> messages of the call site dropped before this one
+	uint8_t			level;
+	uint8_t			nargs;
+	uint32_t		args[ASYNC_LOG_MAX_ARGS];
+} async_log_record_t;
+
+/**
+ * @brief Ring slot
+ * @details sequence == position: free for the writer of that position,
+ * sequence == position + 1: ready for the reader
+ */
+typedef struct async_log_slot_s
+{
+	uint32_t			sequence;
+	async_log_record_t	record;
+} async_log_slot_t;
+
+/**
+ * @brief Text ring slot, an ESP_LOGx line formatted by its caller
+ * @details same sequence rule, the sequence must stay the first member
+ */
+typedef struct async_log_text_slot_s
+{
+	uint32_t	sequence;
+	uint32_t	time_ms;
+	bool		printed;		///> already on the UART, only kept for /sys/log
+	char		text[ASYNC_LOG_LINE_LEN];
+} async_log_text_slot_t;
+
+/**
+ * @brief Line kept for /sys/log
+ */
+typedef struct async_log_line_s
+{
+	uint32_t	number;			///> 0 for an empty slot
+	char		text[ASYNC_LOG_LINE_LEN];
+} async_log_line_t;
+
+
+	/* Variables */
+
+// Slot sequences are set on asyncLog_start, messages before it are dropped
+static async_log_slot_t g_ring[ASYNC_LOG_RING_SIZE];
+static bool g_ring_ready;
+static uint32_t g_write_pos;
+static uint32_t g_read_pos;
+static uint32_t g_dropped;
+
+// ESP_LOGx lines, the sequences are set on asyncLog_start too
+static async_log_text_slot_t g_text_ring[ASYNC_LOG_TEXT_RING_SIZE];
+static uint32_t g_text_write_pos;
+static uint32_t g_text_read_pos;
+
+// Console output of esp_log before the hook, the task writes through it
+static vprintf_like_t g_uart_vprintf = vprintf;
+
+// Line numbers and history, under async_log_mutex
+static uint32_t g_line_number;
+static async_log_line_t g_history[ASYNC_LOG_HISTORY_LINES];
+static int64_t g_last_read_us;
+
+static const char g_level_letters[] = { 'N', 'E', 'W', 'I', 'D', 'V' };
+
+
+	/* FreeRTOS Structures */
+
+TASK_STORAGE(asyncLog_task, ASYNC_LOG_TASK_STACK_SIZE)
+static TaskHandle_t async_log_task_handle;
+
+// Protects the history, read by the HTTP server
+static SemaphoreHandle_t async_log_mutex;
+#if CONFIG_GW_STATIC_ALLOCATION
+static StaticSemaphore_t async_log_mutex_struct;
+#endif
+
+
+	/* Static Functions */
+
+static void * asyncLog_claim(void * slots, size_t slot_size, uint32_t ring_size, uint32_t * write_pos_p, uint32_t * pos_p);
+static void * asyncLog_peek(void * slots, size_t slot_size, uint32_t ring_size, uint32_t read_pos);
+static void asyncLog_release(uint32_t * sequence_p, uint32_t * read_pos_p, uint32_t ring_size);
+static void asyncLog_wake(uint32_t pos, const uint32_t * read_pos_p, uint32_t ring_size);
+static bool asyncLog_isError(const char * format);
+static int asyncLog_vprintf(const char * format, va_list args);
+static void asyncLog_out(const char * format, ...);
+static void asyncLog_print(const async_log_record_t * record_p, char * line, size_t size);
+static void asyncLog_printText(const char * text, bool printed, char * line, size_t size);
+static void asyncLog_keep(const char * line);
+static void asyncLog_task(void * pvParameters);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Starts the drain task
+void asyncLog_start(void)
+{
+	if (async_log_task_handle != NULL)
+	{
+		return;
+	}
+
+	for (uint32_t i = 0; i < ASYNC_LOG_RING_SIZE; i++)
+	{
+		g_ring[i].sequence = i;
+	}
+	for (uint32_t i = 0; i < ASYNC_LOG_TEXT_RING_SIZE; i++)
+	{
+		g_text_ring[i].sequence = i;
+	}
+	__atomic_store_n(&g_ring_ready, true, __ATOMIC_RELEASE);
+
+#if CONFIG_GW_STATIC_ALLOCATION
+	async_log_mutex = xSemaphoreCreateMutexStatic(&async_log_mutex_struct);
+#else
+	async_log_mutex = xSemaphoreCreateMutex();
+#endif
+
+	TASK_CREATE(	asyncLog_task,
+					&asyncLog_task,
+					ASYNC_LOG_TASK_STACK_SIZE,
+					ASYNC_LOG_TASK_PRIORITY,
+					&async_log_task_handle,
+					ASYNC_LOG_TASK_CORE_ID);
+
+	// From now on ESP_LOGx only formats, the task writes to the UART
+	g_uart_vprintf = esp_log_set_vprintf(asyncLog_vprintf);
+}
+
+// Queues a message
+void asyncLog_write(async_log_site_t * site_p, esp_log_level_t level, const char * tag, const char * format, int nargs, ...)
+{
+	uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+	async_log_slot_t * slot_p;
+	uint16_t suppressed;
+	uint32_t pos;
+	va_list args;
+
+	if (!__atomic_load_n(&g_ring_ready, __ATOMIC_ACQUIRE))
+	{
+		__atomic_fetch_add(&g_dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	// Rate limit of the call site
+	if (now_ms - site_p->window_ms >= ASYNC_LOG_RATE_WINDOW_MS)
+	{
+		site_p->window_ms = now_ms;
+		site_p->count = 0;
+	}
+	if (site_p->count >= ASYNC_LOG_RATE_BURST)
+	{
+		site_p->suppressed++;
+		return;
+	}
+	site_p->count++;
+	suppressed = site_p->suppressed;
+	site_p->suppressed = 0;
+
+	slot_p = asyncLog_claim(g_ring, sizeof(g_ring[0]), ASYNC_LOG_RING_SIZE, &g_write_pos, &pos);
+	if (slot_p == NULL)
+	{
+		__atomic_fetch_add(&g_dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	slot_p->record.time_ms = now_ms;
+	slot_p->record.tag = tag;
+	slot_p->record.format = format;
+	slot_p->record.suppressed = suppressed;
+	slot_p->record.level = level;
+	slot_p->record.nargs = (nargs > ASYNC_LOG_MAX_ARGS) ? ASYNC_LOG_MAX_ARGS : nargs;
+	// int, long and pointers are all 32 bit on this target
+	va_start(args, nargs);
+	for (int i = 0; i < slot_p->record.nargs; i++)
+	{
+		slot_p->record.args[i] = va_arg(args, uint32_t);
+	}
+	va_end(args);
+	__atomic_store_n(&slot_p->sequence, pos + 1, __ATOMIC_RELEASE);
+
+	asyncLog_wake(pos, &g_read_pos, ASYNC_LOG_RING_SIZE);
+}
+
+// Copies the lines formatted after a given one
+uint32_t asyncLog_readSince(uint32_t since, char * buffer, size_t size, uint32_t * dropped_p)
+{
+	size_t used = 0;
+	uint32_t last = since;
+
+	*dropped_p = __atomic_load_n(&g_dropped, __ATOMIC_RELAXED);
+	if (size > 0)
+	{
+		buffer[0] = '\0';
+	}
+	if (async_log_mutex == NULL)
+	{
+		return since;
+	}
+
+	xSemaphoreTake(async_log_mutex, portMAX_DELAY);
+	// Lines weren't kept while nobody read them, the old ones would be out of order
+	if (g_last_read_us == 0 || esp_timer_get_time() - g_last_read_us >= ASYNC_LOG_STREAM_IDLE_S * 1000000LL)
+	{
+		memset(g_history, 0x00, sizeof(g_history));
+	}
+	g_last_read_us = esp_timer_get_time();
+
+	// A number ahead of ours comes from before a restart
+	if (since > g_line_number)
+	{
+		since = 0;
+		last = 0;
+	}
+
+	// Oldest first, the slot after the newest line
+	for (uint32_t i = 1; i <= ASYNC_LOG_HISTORY_LINES; i++)
+	{
+		const async_log_line_t * line_p = &g_history[(g_line_number + i) % ASYNC_LOG_HISTORY_LINES];
+		size_t len;
+
+		if (line_p->number <= since)
+		{
+			continue;
+		}
+		len = strlen(line_p->text);
+		if (used + len + 2 > size)
+		{
+			break;
+		}
+		memcpy(&buffer[used], line_p->text, len);
+		used += len;
+		buffer[used++] = '\n';
+		buffer[used] = '\0';
+		last = line_p->number;
+	}
+	xSemaphoreGive(async_log_mutex);
+
+	return last;
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Claims the next position of a ring
+ * @param slots ring, each slot starting with its sequence
+ * @param slot_size
+ * @param ring_size slots, power of 2
+ * @param write_pos_p next position of the ring
+ * @param pos_p claimed position, the slot is published by setting its sequence to pos + 1
+ * @return the slot, NULL when the ring is full
+ */
+static void * asyncLog_claim(void * slots, size_t slot_size, uint32_t ring_size, uint32_t * write_pos_p, uint32_t * pos_p)
+{
+	uint32_t pos = __atomic_load_n(write_pos_p, __ATOMIC_RELAXED);
+
+	for (;;)
+	{
+		uint8_t * slot_p = (uint8_t *)slots + (pos & (ring_size - 1)) * slot_size;
+		int32_t diff = (int32_t)(__atomic_load_n((uint32_t *)slot_p, __ATOMIC_ACQUIRE) - pos);
+
+		if (diff == 0)
+		{
+			if (__atomic_compare_exchange_n(write_pos_p, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				*pos_p = pos;
+				return slot_p;
+			}
+		}
+		else if (diff < 0)
+		{
+			// Full, the reader hasn't freed this slot yet
+			return NULL;
+		}
+		else
+		{
+			pos = __atomic_load_n(write_pos_p, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/**
+ * @brief Returns the oldest slot of a ring without taking it
+ * @param slots
+ * @param slot_size
+ * @param ring_size
+ * @param read_pos
+ * @return the slot, NULL when empty or its writer hasn't finished
+ */
+static void * asyncLog_peek(void * slots, size_t slot_size, uint32_t ring_size, uint32_t read_pos)
+{
+	uint8_t * slot_p = (uint8_t *)slots + (read_pos & (ring_size - 1)) * slot_size;
+
+	if (__atomic_load_n((uint32_t *)slot_p, __ATOMIC_ACQUIRE) != read_pos + 1)
+	{
+		return NULL;
+	}
+	return slot_p;
+}
+
+/**
+ * @brief Frees the oldest slot of a ring for the writers of the next turn
+ * @param sequence_p sequence of the slot
+ * @param read_pos_p
+ * @param ring_size
+ */
+static void asyncLog_release(uint32_t * sequence_p, uint32_t * read_pos_p, uint32_t ring_size)
+{
+	uint32_t pos = *read_pos_p;
+
+	__atomic_store_n(sequence_p, pos + ring_size, __ATOMIC_RELEASE);
+	__atomic_store_n(read_pos_p, pos + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Wakes the task past half a ring, the period may not be enough
+ * @param pos position just published
+ * @param read_pos_p
+ * @param ring_size
+ */
+static void asyncLog_wake(uint32_t pos, const uint32_t * read_pos_p, uint32_t ring_size)
+{
+	if (async_log_task_handle != NULL && !xPortInIsrContext()
+		&& pos + 1 - __atomic_load_n(read_pos_p, __ATOMIC_RELAXED) >= ring_size / 2)
+	{
+		xTaskNotifyGive(async_log_task_handle);
+	}
+}
+
+/**
+ * @brief Whether an esp_log format is of an ESP_LOGE line
+ * @param format "E (%lu) %s: ...", after the color when enabled
+ * @return bool
+ */
+static bool asyncLog_isError(const char * format)
+{
+	if (format[0] == '\033')
+	{
+		// ANSI color, "\033[0;31m"
+		while (*format != '\0' && *format != 'm')
+		{
+			format++;
+		}
+		if (*format == 'm')
+		{
+			format++;
+		}
+	}
+	return format[0] == 'E' && format[1] == ' ';
+}
+
+/**
+ * @brief esp_log output hook, queues the formatted ESP_LOGx line
+ * @details the arguments may live on the caller's stack, so the line is
+ * formatted here, straight into its slot. From ISRs or on a full ring it
+ * goes to the UART at once rather than being lost. Errors, which may come
+ * right before an abort, and lines longer than a slot are written to the
+ * UART at once too, whole; the slot keeps them for /sys/log only.
+ * @param format
+ * @param args
+ * @return characters of the line
+ */
+static int asyncLog_vprintf(const char * format, va_list args)
+{
+	async_log_text_slot_t * slot_p = NULL;
+	va_list direct;
+	uint32_t pos;
+	int len;
+
+	if (!xPortInIsrContext())
+	{
+		slot_p = asyncLog_claim(g_text_ring, sizeof(g_text_ring[0]), ASYNC_LOG_TEXT_RING_SIZE, &g_text_write_pos, &pos);
+	}
+	if (slot_p == NULL)
+	{
+		// Not kept for /sys/log
+		__atomic_fetch_add(&g_dropped, 1, __ATOMIC_RELAXED);
+		return g_uart_vprintf(format, args);
+	}
+
+	// The arguments are read twice when the line also goes out now
+	va_copy(direct, args);
+	slot_p->time_ms = (uint32_t)(esp_timer_get_time() / 1000);
+	len = vsnprintf(slot_p->text, sizeof(slot_p->text), format, args);
+	slot_p->printed = asyncLog_isError(format) || len >= (int)sizeof(slot_p->text);
+	if (slot_p->printed)
+	{
+		len = g_uart_vprintf(format, direct);
+	}
+	va_end(direct);
+	__atomic_store_n(&slot_p->sequence, pos + 1, __ATOMIC_RELEASE);
+
+	asyncLog_wake(pos, &g_text_read_pos, ASYNC_LOG_TEXT_RING_SIZE);
+	return len;
+}
+
+/**
+ * @brief Writes to the UART through the esp_log output of before the hook
+ * @param format
+ */
+static void asyncLog_out(const char * format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	g_uart_vprintf(format, args);
+	va_end(args);
+}
+
+/**
+ * @brief Formats a message and writes it to the console
+ * @param record_p
+ * @param line destination, without the console decoration
+ * @param size of the line
+ */
+static void asyncLog_print(const async_log_record_t * record_p, char * line, size_t size)
+{
+	const uint32_t * a = record_p->args;
+	char letter = (record_p->level < sizeof(g_level_letters)) ? g_level_letters[record_p->level] : '?';
+	int len;
+
+	len = snprintf(line, size, "%c (%lu) %s: ", letter, record_p->time_ms, record_p->tag);
+	if (len < 0 || (size_t)len >= size)
+	{
+		return;
+	}
+
+	// Unused arguments are ignored by the format
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+	len += snprintf(&line[len], size - len, record_p->format, a[0], a[1], a[2], a[3], a[4], a[5]);
+#pragma GCC diagnostic pop
+
+	if (record_p->suppressed > 0 && (size_t)len < size)
+	{
+		snprintf(&line[len], size - len, " (%u suppressed)", record_p->suppressed);
+	}
+
+	// esp_log_write would come back through the hook, the tag level is checked here
+	if (record_p->level <= esp_log_level_get(record_p->tag))
+	{
+		asyncLog_out("%s\n", line);
+	}
+}
+
+/**
+ * @brief Writes an ESP_LOGx line to the console
+ * @param text as formatted by esp_log, colors and '\n' included
+ * @param printed already written by the caller, only the line is made
+ * @param line destination, without the colors and the '\n'
+ * @param size of the line
+ */
+static void asyncLog_printText(const char * text, bool printed, char * line, size_t size)
+{
+	size_t len = strlen(text);
+	size_t used = 0;
+
+	if (!printed)
+	{
+		asyncLog_out("%s", text);
+	}
+
+	for (size_t i = 0; i < len && used + 1 < size; i++)
+	{
+		if (text[i] == '\033')
+		{
+			// ANSI color, "\033[0;32m"
+			while (i < len && text[i] != 'm')
+			{
+				i++;
+			}
+			continue;
+		}
+		if (text[i] != '\n')
+		{
+			line[used++] = text[i];
+		}
+	}
+	line[used] = '\0';
+}
+
+/**
+ * @brief Numbers a line and keeps it while a client reads /sys/log
+ * @param line
+ */
+static void asyncLog_keep(const char * line)
+{
+	xSemaphoreTake(async_log_mutex, portMAX_DELAY);
+	g_line_number++;
+
+	if (g_last_read_us != 0 && esp_timer_get_time() - g_last_read_us < ASYNC_LOG_STREAM_IDLE_S * 1000000LL)
+	{
+		async_log_line_t * line_p = &g_history[g_line_number % ASYNC_LOG_HISTORY_LINES];
+
+		line_p->number = g_line_number;
+		snprintf(line_p->text, sizeof(line_p->text), "%s", line);
+	}
+	xSemaphoreGive(async_log_mutex);
+}
+
+/**
+ * @brief Drains the ring every ASYNC_LOG_DRAIN_MS or when woken
+ * @param pvParameters
+ */
+static void asyncLog_task(void * pvParameters)
+{
+	async_log_slot_t * slot_p;
+	async_log_text_slot_t * text_p;
+	async_log_record_t record;
+	char line[ASYNC_LOG_LINE_LEN];
+
+	for (;;)
+	{
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ASYNC_LOG_DRAIN_MS));
+
+		for (;;)
+		{
+			slot_p = asyncLog_peek(g_ring, sizeof(g_ring[0]), ASYNC_LOG_RING_SIZE, g_read_pos);
+			text_p = asyncLog_peek(g_text_ring, sizeof(g_text_ring[0]), ASYNC_LOG_TEXT_RING_SIZE, g_text_read_pos);
+			if (slot_p == NULL && text_p == NULL)
+			{
+				break;
+			}
+
+			// Oldest first across both rings
+			if (text_p == NULL || (slot_p != NULL && (int32_t)(slot_p->record.time_ms - text_p->time_ms) <= 0))
+			{
+				memcpy(&record, &slot_p->record, sizeof(async_log_record_t));
+				asyncLog_release(&slot_p->sequence, &g_read_pos, ASYNC_LOG_RING_SIZE);
+				asyncLog_print(&record, line, sizeof(line));
+			}
+			else
+			{
+				asyncLog_printText(text_p->text, text_p->printed, line, sizeof(line));
+				asyncLog_release(&text_p->sequence, &g_text_read_pos, ASYNC_LOG_TEXT_RING_SIZE);
+			}
+			asyncLog_keep(line);
+		}
+	}
+}
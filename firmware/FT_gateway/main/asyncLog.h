@@ -0,0 +1,120 @@
+/**
+ * @file asyncLog.h
+ * @brief Deferred logger for the hot paths
+ * @details
+ * ASYNC_LOGx only copies the format pointer and up to ASYNC_LOG_MAX_ARGS
+ * 32 bit arguments into a lock-free ring, the asyncLog task formats them
+ * and writes them to the UART, away from the caller. Each call site
+ * lets through ASYNC_LOG_RATE_BURST messages per ASYNC_LOG_RATE_WINDOW_MS,
+ * the next one that goes through tells how many were suppressed. A full
+ * ring drops the message and counts it.
+ * Since the formatting happens later, the format must be a literal and
+ * the arguments 32 bit integers or pointers to strings that never change
+ * (no %lld, %f or stack buffers).
+ * ESP_LOGx goes through the same task: asyncLog_start hooks the esp_log
+ * output, each line is formatted by the caller into a second ring of
+ * ASYNC_LOG_TEXT_RING_SIZE lines and written to the UART by the task, in
+ * time order with the ASYNC_LOGx messages. When that ring is full, and
+ * from ISRs, the line goes straight to the UART as before. So do errors,
+ * which may precede an abort, and lines longer than ASYNC_LOG_LINE_LEN,
+ * whole; they may then show ahead of older lines still queued.
+ * While a client reads /sys/log, the last formatted lines of both are
+ * also kept for it.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_ASYNCLOG_H_
+#define MAIN_ASYNCLOG_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stddef.h>
+#include <stdint.h>
+
+// ESP libraries
+#include "esp_log.h"
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief Rate limiter of one call site, one per ASYNC_LOGx expansion
+ * @details updated without a lock, concurrent callers may let one more
+ * message through
+ */
+typedef struct async_log_site_s
+{
+	uint32_t	window_ms;		///> start of the current window
+	uint16_t	count;			///> messages in the window
+	uint16_t	suppressed;		///> dropped since the last one that went through
+} async_log_site_t;
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+#define ASYNC_LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define ASYNC_LOG_NARGS(...) ASYNC_LOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+
+#define ASYNC_LOG(level, tag, format, ...)																\
+	do {																								\
+		_Static_assert(ASYNC_LOG_NARGS(__VA_ARGS__) <= ASYNC_LOG_MAX_ARGS, "too many arguments");	\
+		static async_log_site_t async_log_site;															\
+		if (LOG_LOCAL_LEVEL >= (level)) {																\
+			asyncLog_write(&async_log_site, (level), (tag), format,										\
+							ASYNC_LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__);								\
+		}																								\
+	} while (0)
+
+#define ASYNC_LOGE(tag, format, ...)	ASYNC_LOG(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ASYNC_LOGW(tag, format, ...)	ASYNC_LOG(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ASYNC_LOGI(tag, format, ...)	ASYNC_LOG(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ASYNC_LOGD(tag, format, ...)	ASYNC_LOG(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Starts the drain task and takes over the esp_log output
+ * @details messages written before are dropped, call it first on app_main
+ */
+void asyncLog_start(void);
+
+/**
+ * @brief Queues a message, use the ASYNC_LOGx macros
+ * @details never blocks, callable from ISRs
+ * @param site_p rate limiter of the call site
+ * @param level
+ * @param tag literal
+ * @param format literal
+ * @param nargs
+ */
+void asyncLog_write(async_log_site_t * site_p, esp_log_level_t level, const char * tag, const char * format, int nargs, ...)
+	__attribute__((format(printf, 4, 6)));
+
+/**
+ * @brief Copies the lines formatted after a given one
+ * @details keeps the history on for ASYNC_LOG_STREAM_IDLE_S more seconds
+ * @param since last line number the client has, 0 for every kept line
+ * @param buffer lines, '\n' terminated
+ * @param size of the buffer
+ * @param dropped_p messages lost on a full ring since the boot, ESP_LOGx
+ * lines written straight to the UART included
+ * @return uint32_t number of the last line copied, since when nothing new
+ */
+uint32_t asyncLog_readSince(uint32_t since, char * buffer, size_t size, uint32_t * dropped_p);
+
+#endif /* MAIN_ASYNCLOG_H_ */
@@ -0,0 +1,114 @@
+/**
+ * @file bootProfile.c
+ * @brief Boot time markers
+ * @details
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+
+// ESP libraries
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+// Personal libraries
+#include "bootProfile.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "boot_profile";
+
+static const char * const g_names[BOOT_MARKER_COUNT] =
+{
+#define X(ID, ENUM, NAME, TARGET) [ID] = NAME,
+	X_MACRO_BOOT_MARKER_LIST
+#undef X
+};
+
+static const uint32_t g_targets_ms[BOOT_MARKER_COUNT] =
+{
+#define X(ID, ENUM, NAME, TARGET) [ID] = TARGET,
+	X_MACRO_BOOT_MARKER_LIST
+#undef X
+};
+
+// Time of each marker, 0 until reached
+static int64_t g_times_us[BOOT_MARKER_COUNT];
+static portMUX_TYPE boot_profile_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Records the first time a marker is reached
+void bootProfile_mark(boot_marker_t id)
+{
+	int64_t now_us = esp_timer_get_time();
+	bool first = false;
+
+	if (id >= BOOT_MARKER_COUNT)
+	{
+		return;
+	}
+
+	taskENTER_CRITICAL(&boot_profile_mux);
+	if (g_times_us[id] == 0)
+	{
+		g_times_us[id] = now_us;
+		first = true;
+	}
+	taskEXIT_CRITICAL(&boot_profile_mux);
+
+	if (!first)
+	{
+		return;
+	}
+
+	if (g_targets_ms[id] > 0 && now_us > g_targets_ms[id] * 1000LL)
+	{
+		ESP_LOGW(TAG, "%s at %lld ms, target %lu ms", g_names[id], now_us / 1000, g_targets_ms[id]);
+	}
+	else
+	{
+		ESP_LOGI(TAG, "%s at %lld ms", g_names[id], now_us / 1000);
+	}
+}
+
+// Tells if a marker was reached
+bool bootProfile_isMarked(boot_marker_t id)
+{
+	bool marked;
+
+	taskENTER_CRITICAL(&boot_profile_mux);
+	marked = (g_times_us[id] != 0);
+	taskEXIT_CRITICAL(&boot_profile_mux);
+
+	return marked;
+}
+
+// Reads a marker
+void bootProfile_get(boot_marker_t id, boot_marker_info_t * info_p)
+{
+	info_p->name = g_names[id];
+	info_p->target_ms = g_targets_ms[id];
+
+	taskENTER_CRITICAL(&boot_profile_mux);
+	info_p->time_us = (g_times_us[id] != 0) ? g_times_us[id] : -1;
+	taskEXIT_CRITICAL(&boot_profile_mux);
+}
@@ -0,0 +1,102 @@
+/**
+ * @file bootProfile.h
+ * @brief Boot time markers
+ * @details
+ * Each marker keeps the esp_timer time it was first reached, later calls
+ * are ignored so the markers can sit on paths that also run after the
+ * boot (reconnections, server restarts). esp_timer starts with the
+ * application, the ROM and 2nd stage bootloader time comes before zero.
+ * A marker with a target logs a warning when it's reached late, the
+ * whole list is served on /sys/boot.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_BOOTPROFILE_H_
+#define MAIN_BOOTPROFILE_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+/**
+ * @brief Boot markers, in the order they are usually reached
+ * @details columns: ID, ENUM, NAME, TARGET MS (0 for none)
+ */
+#define X_MACRO_BOOT_MARKER_LIST																	\
+	X(0, BOOT_MARKER_APP_MAIN,			"app_main",			0							)	\
+	X(1, BOOT_MARKER_NVS_READY,			"nvs_ready",		0							)	\
+	X(2, BOOT_MARKER_HTTP_READY,		"http_ready",		BOOT_HTTP_READY_TARGET_MS	)	\
+	X(3, BOOT_MARKER_APP_MAIN_DONE,		"app_main_done",	0							)	\
+	X(4, BOOT_MARKER_WIFI_STARTED,		"wifi_started",		0							)	\
+	X(5, BOOT_MARKER_AP_STARTED,		"ap_started",		BOOT_AP_STARTED_TARGET_MS	)	\
+	X(6, BOOT_MARKER_HTTP_FIRST_BYTE,	"http_first_byte",	0							)	\
+	X(7, BOOT_MARKER_STA_GOT_IP,		"sta_got_ip",		0							)	\
+	X(8, BOOT_MARKER_NTP_SYNCED,		"ntp_synced",		0							)
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief Marker IDs
+ */
+typedef enum boot_marker_e
+{
+#define X(ID, ENUM, NAME, TARGET) ENUM = ID,
+	X_MACRO_BOOT_MARKER_LIST
+#undef X
+	BOOT_MARKER_COUNT
+} boot_marker_t;
+
+/**
+ * @brief One marker
+ */
+typedef struct boot_marker_info_s
+{
+	const char *	name;
+	int64_t			time_us;		///> since the application start, -1 when not reached
+	uint32_t		target_ms;		///> 0 for none
+} boot_marker_info_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Records the first time a marker is reached
+ * @details any task, not from an ISR
+ * @param id
+ */
+void bootProfile_mark(boot_marker_t id);
+
+/**
+ * @brief Tells if a marker was reached
+ * @param id
+ * @return true once bootProfile_mark was called for it
+ */
+bool bootProfile_isMarked(boot_marker_t id);
+
+/**
+ * @brief Reads a marker
+ * @param id
+ * @param info_p destination
+ */
+void bootProfile_get(boot_marker_t id, boot_marker_info_t * info_p);
+
+#endif /* MAIN_BOOTPROFILE_H_ */
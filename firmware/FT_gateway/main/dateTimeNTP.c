@@ -17,18 +17,29 @@
 
 // C libraries
 #include <stdio.h>          // for printf
+#include <stdlib.h>         // for setenv, llabs
 #include <string.h>         // for string manipulation
 #include <errno.h>
+#include <sys/time.h>       // for gettimeofday, settimeofday, adjtime
+#include <time.h>
 
 // ESP libraries
 #include "sys/socket.h"     // for socket
-#include "netdb.h"          // for gethostnameby
 #include "unistd.h"         // for closing sockets
+#include "fcntl.h"          // for non-blocking sockets
+#include "sys/select.h"     // for select
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 // Personal libraries
+#include "appEvents.h"
+#include "bootProfile.h"
 #include "dateTimeNTP.h"
+#include "dnsCache.h"
 #include "tasks_common.h"
+#include "timebase.h"
 #include "wifiApp.h"
 
 
@@ -37,6 +48,39 @@
 **		DECLARATIONS	 **
 **************************/
 
+	/* Structures */
+
+/**
+ * @brief The four timestamps of an exchange, in microseconds since 1970
+ * 
+ */
+typedef struct
+{
+    int64_t t1;     // request left the client
+    int64_t t2;     // request reached the server
+    int64_t t3;     // reply left the server
+    int64_t t4;     // reply reached the client
+} ntp_sample_t;
+
+/**
+ * @brief One server during a poll
+ * 
+ */
+typedef struct
+{
+    const char *        host;
+    struct sockaddr_in  addr;           // last resolved address, kept when DNS fails
+    uint32_t            orig_s;         // transmit time sent, must come back as originate time
+    uint32_t            orig_f;
+    bool                sent;
+    bool                replied;
+    ntp_sample_t        sample;
+    int64_t             offset_us;
+    int64_t             delay_us;
+    int64_t             distance_us;    // half the delay plus the server root distance
+} ntp_server_t;
+
+
 	/* Variables */
 
 /**
@@ -58,10 +102,32 @@ typedef struct sockaddr SA;
 static const int ip_protocol = 0;
 
 /**
- * @brief Variables to store Date and Time from NTP server
+ * @brief Clock discipline status and poll interval state
+ * 
+ */
+static ntp_stats_t g_stats;
+static ntp_server_stats_t g_server_stats[NTP_SERVER_COUNT];
+static uint8_t g_poll_exp = NTP_POLL_MIN_EXP;
+static uint8_t g_stable_count;
+static portMUX_TYPE ntp_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Configured servers
+ * 
+ */
+static ntp_server_t g_servers[NTP_SERVER_COUNT] =
+{
+#define X(ID, HOST) [ID] = { .host = HOST },
+    X_MACRO_NTP_SERVER_LIST
+#undef X
+};
+
+/**
+ * @brief Update task, created once and woken up on every WiFi connection
  * 
  */
-char date_str[DATE_LEN]={0}, time_str[TIME_LEN]={0};
+static TaskHandle_t ntp_task_handle = NULL;
+TASK_STORAGE(router_fetchDateTime, NTP_DATE_TIME_TASK_STACK_SIZE)
 
 
 /* Static Functions */
@@ -70,7 +136,7 @@ char date_str[DATE_LEN]={0}, time_str[TIME_LEN]={0};
  * @brief Event callback function
  * 
  */
-static void dateTimeNTP_wifiApp_connectedEvents(void);
+static void dateTimeNTP_wifiApp_connectedEvents(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
 
 /**
  * @brief Callback function for NTP date and time queries
@@ -79,53 +145,122 @@ static void dateTimeNTP_wifiApp_connectedEvents(void);
 static void dateTimeNTP_update_task(void *pvParameter);
 
 /**
- * @brief function that fetches datetime from pool.ntp.org
+ * @brief function that queries the NTP servers and disciplines the clock
+ * 
+ * @return uint32_t seconds until the next poll
+ */
+static uint32_t ntp_fetchData(void);
+
+/**
+ * @brief Queries every server in parallel from a single socket
+ * 
+ */
+static uint8_t ntp_exchange(void);
+
+/**
+ * @brief Checks a reply and stores its timestamps
+ * 
+ */
+static void ntp_receive(const ntp_packet *packet_p, const struct sockaddr_in *from_p, int64_t t4);
+
+/**
+ * @brief Intersection of the server intervals
+ * 
+ */
+static uint8_t ntp_select(int64_t *offset_p, int64_t *delay_p);
+
+/**
+ * @brief Steps or slews the system clock
  * 
  */
-static void ntp_fetchData(void);
+static bool ntp_discipline(int64_t offset_us);
+
+/**
+ * @brief NTP timestamp conversions
+ * 
+ */
+static int64_t ntp_toUs(uint32_t sec, uint32_t frac);
+static void ntp_fromUs(int64_t us, uint32_t *sec_p, uint32_t *frac_p);
+static int64_t ntp_nowUs(void);
 
 
 
 /**************************
 **	   APP FUNCTIONS 	 **
 **************************/
-char* dateTimeNTP_getTime(void)
+void dateTimeNTP_getStats(ntp_stats_t * stats_p)
 {
-    return time_str;
+	taskENTER_CRITICAL(&ntp_stats_mux);
+	*stats_p = g_stats;
+	taskEXIT_CRITICAL(&ntp_stats_mux);
 }
 
-char* dateTimeNTP_getData(void)
+void dateTimeNTP_getServerStats(uint8_t index, ntp_server_stats_t * stats_p)
 {
-    return date_str;
+	if (index >= NTP_SERVER_COUNT) {
+		memset(stats_p, 0, sizeof(ntp_server_stats_t));
+		return;
+	}
+	taskENTER_CRITICAL(&ntp_stats_mux);
+	*stats_p = g_server_stats[index];
+	taskEXIT_CRITICAL(&ntp_stats_mux);
 }
 
 void dateTimeNTP_setup(void)
 {
-	// Set the wifi connected event callback function
-	wifiApp_setCallback(dateTimeNTP_wifiApp_connectedEvents);
+	// Set timezone once, the clock itself is kept in UTC
+	setenv("TZ", NTP_TIMEZONE, 1);
+	tzset();
+
+	g_stats.poll_s = 1 << NTP_POLL_MIN_EXP;
+	for (uint8_t i = 0; i < NTP_SERVER_COUNT; i++) {
+		snprintf(g_server_stats[i].host, NTP_SERVER_NAME_LEN, "%s", g_servers[i].host);
+	}
+
+	// Poll on every station connection
+	appEvents_subscribe(APP_EVENT_WIFI_CONNECTED, dateTimeNTP_wifiApp_connectedEvents, NULL);
 }
 
-static void dateTimeNTP_wifiApp_connectedEvents(void)
+static void dateTimeNTP_wifiApp_connectedEvents(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
 	ESP_LOGI(TAG, "WiFi Application Connected!");
 
+	// Resolve the servers while the task is starting
+	for (uint8_t i = 0; i < NTP_SERVER_COUNT; i++)
+	{
+		dnsCache_prefetch(g_servers[i].host);
+	}
+
+	if (ntp_task_handle != NULL)
+	{
+		// Already running, poll right away instead of waiting for the interval
+		xTaskNotifyGive(ntp_task_handle);
+		return;
+	}
+
 	// Start the fetch dateTime Task
-	xTaskCreatePinnedToCore(	&dateTimeNTP_update_task,
-								"router_fetchDateTime",
-								NTP_DATE_TIME_TASK_STACK_SIZE,
-								NULL,
-								NTP_DATE_TIME_TASK_PRIORITY,
-								NULL,
-								NTP_DATE_TIME_TASK_CORE_ID);
+	TASK_CREATE(	router_fetchDateTime,
+					&dateTimeNTP_update_task,
+					NTP_DATE_TIME_TASK_STACK_SIZE,
+					NTP_DATE_TIME_TASK_PRIORITY,
+					&ntp_task_handle,
+					NTP_DATE_TIME_TASK_CORE_ID);
 }
 
 static void dateTimeNTP_update_task(void *pvParameter)
 {
+    uint32_t wait_s;
+
     for(;;)
 	{
-        ntp_fetchData();
+        wait_s = 1 << NTP_POLL_MIN_EXP;
+        if (wifiApp_getConnState() == WIFI_CONN_CONNECTED) {
+            wait_s = ntp_fetchData();
+        }
 		// displayOled_printDateTime(date_str, time_str);
-        vTaskDelay(30000 / portTICK_PERIOD_MS); // Sync every 30 seconds
+
+        // A new connection wakes the task up before the interval ends
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_s * 1000));
     }
 }
 
@@ -135,79 +270,431 @@ static void dateTimeNTP_update_task(void *pvParameter)
 **	  SOCKET FUNCTIONS 	 **
 **************************/
 
-// function that fetches datetime from pool.ntp.org
-static void ntp_fetchData(void)
+// function that queries the NTP servers and disciplines the clock
+static uint32_t ntp_fetchData(void)
 {
-    int sockfd;
-    struct sockaddr_in serv_addr;
-    struct hostent *server;
-    ntp_packet packet;
-    int n;
-    time_t txTm;
-    struct tm *local_time;
+    static timebase_cache_t log_cache;
+    char stamp[TIMEBASE_TEXT_LEN];
+    int64_t offset_us;
+    int64_t delay_us;
+    uint8_t replies;
+    uint8_t truechimers;
+    bool stepped;
+
+    taskENTER_CRITICAL(&ntp_stats_mux);
+    g_stats.polls++;
+    taskEXIT_CRITICAL(&ntp_stats_mux);
+
+    replies = ntp_exchange();
+    truechimers = (replies > 0) ? ntp_select(&offset_us, &delay_us) : 0;
+
+    if (truechimers == 0) {
+        ESP_LOGE(TAG, "No usable reply (%d replies, no majority)", replies);
+        taskENTER_CRITICAL(&ntp_stats_mux);
+        g_stats.failures++;
+        g_stats.truechimers = 0;
+        taskEXIT_CRITICAL(&ntp_stats_mux);
+        g_stable_count = 0;
+        // Retry sooner, the interval is kept for when the servers answer again
+        return 1 << NTP_POLL_MIN_EXP;
+    }
 
-    memset(&serv_addr, 0, sizeof(serv_addr));
-    memset(&packet, 0, sizeof(ntp_packet));
+    stepped = ntp_discipline(offset_us);
+
+    // Adaptive poll: double the interval after a run of stable samples, fall back on a step
+    if (stepped) {
+        g_poll_exp = NTP_POLL_MIN_EXP;
+        g_stable_count = 0;
+    } else if (llabs(offset_us) < NTP_STABLE_OFFSET_US) {
+        if (++g_stable_count >= NTP_POLL_STABLE_COUNT && g_poll_exp < NTP_POLL_MAX_EXP) {
+            g_poll_exp++;
+            g_stable_count = 0;
+        }
+    } else {
+        if (g_poll_exp > NTP_POLL_MIN_EXP) {
+            g_poll_exp--;
+        }
+        g_stable_count = 0;
+    }
 
+    taskENTER_CRITICAL(&ntp_stats_mux);
+    g_stats.synced = true;
+    g_stats.replies++;
+    g_stats.steps += stepped;
+    g_stats.offset_us = offset_us;
+    g_stats.delay_us = delay_us;
+    g_stats.poll_s = 1 << g_poll_exp;
+    g_stats.last_sync_s = esp_timer_get_time() / 1000000;
+    g_stats.truechimers = truechimers;
+    taskEXIT_CRITICAL(&ntp_stats_mux);
+    bootProfile_mark(BOOT_MARKER_NTP_SYNCED);
+
+    ESP_LOGI(TAG, "offset %lld us, delay %lld us (error < %lld us), %d/%d servers agree, %s, next poll in %d s",
+                    offset_us, delay_us, delay_us / 2, truechimers, replies, stepped ? "stepped" : "slewed", 1 << g_poll_exp);
+    timebase_format(&log_cache, TIMEBASE_FMT_STAMP, stamp, sizeof(stamp));
+    ESP_LOGI(TAG, "Time: %s", stamp);
+
+    return 1 << g_poll_exp;
+}
+
+/**
+ * @brief Queries every server in parallel from a single socket
+ * @details all requests go out back to back on a non-blocking socket, the
+ * replies are collected with select until they are all in or
+ * NTP_RECV_TIMEOUT_MS is over. The socket is closed on every path.
+ * @return uint8_t number of valid replies
+ */
+static uint8_t ntp_exchange(void)
+{
+    uint32_t server_addr;
+    struct sockaddr_in from_addr;
+    socklen_t from_len;
+    ntp_packet packet;
+    int64_t deadline_us;
+    uint8_t pending = 0;
+    uint8_t replies = 0;
+    int sockfd;
+    int n;
 
     // Create a UDP socket
     sockfd = socket(AF_INET, UDP_SOCKET, ip_protocol);
     if (sockfd < 0) {
         ESP_LOGE(TAG, "ERROR opening socket");
-        return;
+        return 0;
+    }
+    fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL, 0) | O_NONBLOCK);
+
+    for (uint8_t i = 0; i < NTP_SERVER_COUNT; i++) {
+        ntp_server_t *server_p = &g_servers[i];
+
+        server_p->sent = false;
+        server_p->replied = false;
+
+        // Get server address information, the last one is kept when DNS fails
+        if (dnsCache_resolve(server_p->host, &server_addr) == ESP_OK) {
+            server_p->addr.sin_family = AF_INET;
+            server_p->addr.sin_addr.s_addr = server_addr;
+            server_p->addr.sin_port = htons(NTP_PORT);
+        } else {
+            ESP_LOGW(TAG, "ERROR, no such host %s", server_p->host);
+        }
+        if (server_p->addr.sin_family != AF_INET) {
+            continue;
+        }
+
+        // Initialize NTP packet, our transmit time comes back as the originate time
+        memset(&packet, 0, sizeof(ntp_packet));
+        packet.li_vn_mode = (NTP_VERSION << 3) | NTP_MODE_CLIENT;
+        server_p->sample.t1 = ntp_nowUs();
+        ntp_fromUs(server_p->sample.t1, &server_p->orig_s, &server_p->orig_f);
+        packet.txTm_s = htonl(server_p->orig_s);
+        packet.txTm_f = htonl(server_p->orig_f);
+
+        // Send NTP request
+        n = sendto(sockfd, &packet, sizeof(ntp_packet), 0, (SA *)&server_p->addr, sizeof(server_p->addr));
+        if (n < 0) {
+            ESP_LOGE(TAG, "ERROR writing to socket for %s (errno %d)", server_p->host, errno);
+            continue;
+        }
+        server_p->sent = true;
+        pending++;
+
+        taskENTER_CRITICAL(&ntp_stats_mux);
+        g_server_stats[i].polls++;
+        taskEXIT_CRITICAL(&ntp_stats_mux);
     }
 
-    // Get server address information
-    server = gethostbyname(NTP_SERVER);
-    if (server == NULL) {
-        ESP_LOGE(TAG, "ERROR, no such host\n");
-        return;
+    // Receive NTP responses until all are in or the time is over
+    deadline_us = esp_timer_get_time() + NTP_RECV_TIMEOUT_MS * 1000LL;
+    while (replies < pending) {
+        int64_t left_us = deadline_us - esp_timer_get_time();
+        if (left_us <= 0) {
+            break;
+        }
+
+        struct timeval timeout = { .tv_sec = left_us / 1000000, .tv_usec = left_us % 1000000 };
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(sockfd, &read_fds);
+        n = select(sockfd + 1, &read_fds, NULL, NULL, &timeout);
+        if (n < 0) {
+            ESP_LOGE(TAG, "ERROR on select (errno %d)", errno);
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        // Drain everything that is already there
+        for (;;) {
+            from_len = sizeof(from_addr);
+            n = recvfrom(sockfd, &packet, sizeof(ntp_packet), 0, (SA *)&from_addr, &from_len);
+            if (n < 0) {
+                break;
+            }
+            if (n >= (int)sizeof(ntp_packet)) {
+                ntp_receive(&packet, &from_addr, ntp_nowUs());
+            }
+        }
+
+        replies = 0;
+        for (uint8_t i = 0; i < NTP_SERVER_COUNT; i++) {
+            replies += g_servers[i].replied;
+        }
     }
 
-    serv_addr.sin_family = AF_INET;
-    memcpy(&serv_addr.sin_addr.s_addr, server->h_addr, server->h_length);
-    serv_addr.sin_port = htons(NTP_PORT);
+    close(sockfd);
 
-    // Initialize NTP packet
-    packet.li_vn_mode = 0x1B; // li = 0, vn = 3, mode = 3
+    // Reach registers and timeouts
+    taskENTER_CRITICAL(&ntp_stats_mux);
+    for (uint8_t i = 0; i < NTP_SERVER_COUNT; i++) {
+        ntp_server_stats_t *stats_p = &g_server_stats[i];
+        stats_p->reach = (stats_p->reach << 1) | g_servers[i].replied;
+        if (g_servers[i].sent && !g_servers[i].replied) {
+            stats_p->timeouts++;
+        }
+    }
+    taskEXIT_CRITICAL(&ntp_stats_mux);
 
-    // Send NTP request
-    n = sendto(sockfd, &packet, sizeof(ntp_packet), 0, (struct sockaddr *)&serv_addr, sizeof(serv_addr));
-    if (n < 0) {
-        ESP_LOGE(TAG, "ERROR writing to socket");
+    return replies;
+}
+
+/**
+ * @brief Checks a reply and stores its timestamps
+ * @details the reply is matched by source address and originate time, a
+ * late answer to an earlier poll is ignored
+ * @param packet_p reply in network order
+ * @param from_p source address
+ * @param t4 time it was received
+ */
+static void ntp_receive(const ntp_packet *packet_p, const struct sockaddr_in *from_p, int64_t t4)
+{
+    for (uint8_t i = 0; i < NTP_SERVER_COUNT; i++) {
+        ntp_server_t *server_p = &g_servers[i];
+        ntp_server_stats_t *stats_p = &g_server_stats[i];
+
+        if (!server_p->sent || server_p->replied
+            || from_p->sin_addr.s_addr != server_p->addr.sin_addr.s_addr
+            || ntohl(packet_p->origTm_s) != server_p->orig_s || ntohl(packet_p->origTm_f) != server_p->orig_f) {
+            continue;
+        }
+
+        // Sanity checks: server mode and synchronized
+        if ((packet_p->li_vn_mode & 0x07) != NTP_MODE_SERVER
+            || (packet_p->li_vn_mode >> 6) == NTP_LI_ALARM
+            || packet_p->stratum == 0 || packet_p->stratum > NTP_STRATUM_MAX
+            || packet_p->txTm_s == 0) {
+            ESP_LOGW(TAG, "Invalid reply from %s (mode %d, stratum %d)", server_p->host, packet_p->li_vn_mode & 0x07, packet_p->stratum);
+            taskENTER_CRITICAL(&ntp_stats_mux);
+            stats_p->invalid++;
+            taskEXIT_CRITICAL(&ntp_stats_mux);
+            return;
+        }
+
+        ntp_sample_t *sample_p = &server_p->sample;
+        sample_p->t2 = ntp_toUs(ntohl(packet_p->rxTm_s), ntohl(packet_p->rxTm_f));
+        sample_p->t3 = ntp_toUs(ntohl(packet_p->txTm_s), ntohl(packet_p->txTm_f));
+        sample_p->t4 = t4;
+
+        // RFC 4330: offset = ((T2 - T1) + (T3 - T4)) / 2, delay = (T4 - T1) - (T3 - T2)
+        server_p->offset_us = ((sample_p->t2 - sample_p->t1) + (sample_p->t3 - sample_p->t4)) / 2;
+        server_p->delay_us = (sample_p->t4 - sample_p->t1) - (sample_p->t3 - sample_p->t2);
+        if (server_p->delay_us < 0) {
+            server_p->delay_us = 0;
+        }
+
+        // Root delay and dispersion are 16.16 fixed point seconds
+        int64_t root_delay_us = ((uint64_t)ntohl(packet_p->rootDelay) * 1000000ULL) >> 16;
+        int64_t root_disp_us = ((uint64_t)ntohl(packet_p->rootDispersion) * 1000000ULL) >> 16;
+        server_p->distance_us = server_p->delay_us / 2 + root_delay_us / 2 + root_disp_us;
+        server_p->replied = true;
+
+        taskENTER_CRITICAL(&ntp_stats_mux);
+        stats_p->replies++;
+        stats_p->stratum = packet_p->stratum;
+        stats_p->offset_us = server_p->offset_us;
+        stats_p->delay_us = server_p->delay_us;
+        taskEXIT_CRITICAL(&ntp_stats_mux);
         return;
     }
+}
 
-    // Receive NTP response
-    n = recvfrom(sockfd, &packet, sizeof(ntp_packet), 0, NULL, NULL);
-    if (n < 0) {
-        ESP_LOGE(TAG, "ERROR reading from socket");
-        return;
+/**
+ * @brief Intersection of the server intervals
+ * @details Marzullo's algorithm as in RFC 5905: each reply gives the
+ * interval offset +- distance the true time must be in. The smallest
+ * number of falsetickers f for which n - f intervals share a common
+ * point is searched; servers outside that intersection are falsetickers.
+ * The offset is the median of the truechimers.
+ * @param offset_p combined offset
+ * @param delay_p delay of the server giving the median
+ * @return uint8_t number of truechimers, 0 when there is no majority
+ */
+static uint8_t ntp_select(int64_t *offset_p, int64_t *delay_p)
+{
+    int64_t edges[NTP_SERVER_COUNT * 2];
+    int8_t types[NTP_SERVER_COUNT * 2];
+    uint8_t chimers[NTP_SERVER_COUNT];
+    uint8_t n = 0;
+    uint8_t edge_count = 0;
+    uint8_t count = 0;
+    int64_t low = 0;
+    int64_t high = 0;
+    bool found = false;
+
+    // Interval edges sorted by value, lower edges first on ties
+    for (uint8_t i = 0; i < NTP_SERVER_COUNT; i++) {
+        ntp_server_t *server_p = &g_servers[i];
+        if (!server_p->replied) {
+            continue;
+        }
+        n++;
+        for (int8_t type = -1; type <= 1; type += 2) {
+            int64_t value = server_p->offset_us + type * server_p->distance_us;
+            uint8_t pos = edge_count++;
+            while (pos > 0 && (edges[pos - 1] > value || (edges[pos - 1] == value && types[pos - 1] > type))) {
+                edges[pos] = edges[pos - 1];
+                types[pos] = types[pos - 1];
+                pos--;
+            }
+            edges[pos] = value;
+            types[pos] = type;
+        }
     }
 
-    // Parse NTP response
-    packet.txTm_s = ntohl(packet.txTm_s);
-    packet.txTm_f = ntohl(packet.txTm_f);
+    for (uint8_t f = 0; f <= (n - 1) / 2 && !found; f++) {
+        int depth = 0;
+
+        // Lowest point covered by n - f intervals
+        for (uint8_t e = 0; e < edge_count; e++) {
+            depth -= types[e];
+            if (depth >= n - f) {
+                low = edges[e];
+                break;
+            }
+        }
+        // Highest point covered by n - f intervals
+        depth = 0;
+        for (int8_t e = edge_count - 1; e >= 0; e--) {
+            depth += types[e];
+            if (depth >= n - f) {
+                high = edges[e];
+                break;
+            }
+        }
+        found = (depth >= n - f && low <= high);
+    }
 
-    // Calculate Unix timestamp
-    txTm = packet.txTm_s - NTP_TIMESTAMP_DELTA;
+    if (!found) {
+        return 0;
+    }
 
-    // Set timezone (example for UTC)
-    setenv("TZ", "UTC+3", 1);
-    tzset(); 
+    // Truechimers overlap the intersection, sorted by offset for the median
+    taskENTER_CRITICAL(&ntp_stats_mux);
+    for (uint8_t i = 0; i < NTP_SERVER_COUNT; i++) {
+        ntp_server_t *server_p = &g_servers[i];
+        g_server_stats[i].selected = false;
+        if (!server_p->replied) {
+            continue;
+        }
+        if (server_p->offset_us - server_p->distance_us > high || server_p->offset_us + server_p->distance_us < low) {
+            g_server_stats[i].falsetickers++;
+            continue;
+        }
+        g_server_stats[i].selected = true;
+
+        uint8_t pos = count++;
+        while (pos > 0 && g_servers[chimers[pos - 1]].offset_us > server_p->offset_us) {
+            chimers[pos] = chimers[pos - 1];
+            pos--;
+        }
+        chimers[pos] = i;
+    }
+    taskEXIT_CRITICAL(&ntp_stats_mux);
 
-    // Convert Unix timestamp to local time
-    local_time = localtime(&txTm);
+    if (count == 0) {
+        return 0;
+    }
 
-    // Format date and time separately
-    memset(date_str, 0, DATE_LEN);
-    strftime(date_str, sizeof(date_str), "%d/%m/%Y", local_time);
-    memset(time_str, 0, TIME_LEN);
-    strftime(time_str, sizeof(time_str), "%H:%M", local_time);
+    if (count % 2) {
+        *offset_p = g_servers[chimers[count / 2]].offset_us;
+    } else {
+        *offset_p = (g_servers[chimers[count / 2 - 1]].offset_us + g_servers[chimers[count / 2]].offset_us) / 2;
+    }
+    *delay_p = g_servers[chimers[count / 2]].delay_us;
 
-    // Print the date and time
-    printf("Date: %s\n", date_str);
-    printf("Time: %s\n", time_str);
+    return count;
+}
 
-    close(sockfd);
-}
\ No newline at end of file
+/**
+ * @brief Steps or slews the system clock
+ * @details the first sync and offsets above NTP_STEP_THRESHOLD_US are
+ * stepped with settimeofday, smaller ones are slewed by adjtime so the time
+ * never jumps under the scheduled actions
+ * @param offset_us
+ * @return true if the clock was stepped
+ */
+static bool ntp_discipline(int64_t offset_us)
+{
+    int64_t now_us = ntp_nowUs() + offset_us;
+
+    if (!g_stats.synced || llabs(offset_us) > NTP_STEP_THRESHOLD_US) {
+        struct timeval tv = { .tv_sec = now_us / 1000000, .tv_usec = now_us % 1000000 };
+        settimeofday(&tv, NULL);
+        timebase_step(now_us);
+
+        // The schedules check the jump against their own time
+        app_event_time_stepped_t stepped = { .offset_us = offset_us };
+        appEvents_post(APP_EVENT_TIME_STEPPED, &stepped, sizeof(stepped));
+        return true;
+    }
+
+    struct timeval delta = { .tv_sec = offset_us / 1000000, .tv_usec = offset_us % 1000000 };
+    if (adjtime(&delta, NULL) != 0) {
+        ESP_LOGW(TAG, "adjtime refused %lld us", offset_us);
+    }
+    // The timebase is steered on its own line, towards the same corrected time
+    timebase_slew(now_us, 1 << g_poll_exp);
+    return false;
+}
+
+/**
+ * @brief Converts an NTP timestamp to microseconds since 1970
+ * @details seconds below 2^31 belong to era 1 (after 2036)
+ * @param sec
+ * @param frac
+ * @return int64_t
+ */
+static int64_t ntp_toUs(uint32_t sec, uint32_t frac)
+{
+    int64_t seconds = sec;
+
+    if ((sec & 0x80000000UL) == 0) {
+        seconds += 0x100000000LL;
+    }
+    return (seconds - NTP_TIMESTAMP_DELTA) * 1000000LL + (((uint64_t)frac * 1000000ULL) >> 32);
+}
+
+/**
+ * @brief Converts microseconds since 1970 to an NTP timestamp
+ * @param us
+ * @param sec_p
+ * @param frac_p
+ */
+static void ntp_fromUs(int64_t us, uint32_t *sec_p, uint32_t *frac_p)
+{
+    *sec_p = (uint32_t)(us / 1000000 + NTP_TIMESTAMP_DELTA);
+    *frac_p = (uint32_t)(((uint64_t)(us % 1000000) << 32) / 1000000);
+}
+
+/**
+ * @brief Current system time in microseconds since 1970
+ * @return int64_t
+ */
+static int64_t ntp_nowUs(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
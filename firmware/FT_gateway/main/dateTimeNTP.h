@@ -14,6 +14,15 @@
 #define __DATE_TIME_NTP_LIB__
 
 
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+
 /**************************
 **		DEFINITIONS		 **
 **************************/
@@ -23,10 +32,45 @@
 #define NTP_PORT    123
 
 #define NTP_TIMESTAMP_DELTA 2208988800UL // Seconds from 1900 to 1970
-#define NTP_SERVER "pool.ntp.org" // or any other NTP server
+#define NTP_TIMEZONE "UTC+3"      // POSIX TZ, UTC+3 means three hours behind UTC
+
+#define NTP_RECV_TIMEOUT_MS     2000    // a lost reply doesn't block the task longer than this
+#define NTP_POLL_MIN_EXP        6       // poll interval 2^6 = 64 s
+#define NTP_POLL_MAX_EXP        10      // poll interval 2^10 = 1024 s
+#define NTP_POLL_STABLE_COUNT   4       // stable samples in a row before the poll interval doubles
+#define NTP_STABLE_OFFSET_US    50000   // offsets below this count as stable
+#define NTP_STEP_THRESHOLD_US   128000  // offsets above this are stepped, below slewed with adjtime
+
+#define NTP_SERVER_NAME_LEN 32          // longest server host name
 
-#define DATE_LEN    11
-#define TIME_LEN    6
+#define NTP_MODE_CLIENT     3
+#define NTP_MODE_SERVER     4
+#define NTP_VERSION         4
+#define NTP_LI_ALARM        3           // leap indicator of an unsynchronized server
+#define NTP_STRATUM_MAX     15
+
+/**
+ * @brief Servers queried in parallel on every poll, any host name or
+ * dotted address works (e.g. 127.0.0.1 for a local stand-in)
+ * 
+ */
+#define X_MACRO_NTP_SERVER_LIST   \
+    X(0, "0.pool.ntp.org"       ) \
+    X(1, "1.pool.ntp.org"       ) \
+    X(2, "2.pool.ntp.org"       ) \
+    X(3, "time.google.com"      )
+
+/**
+ * @brief Number of configured servers
+ * 
+ */
+enum
+{
+#define X(ID, HOST) NTP_SERVER_ID_ ## ID,
+    X_MACRO_NTP_SERVER_LIST
+#undef X
+    NTP_SERVER_COUNT
+};
 
 
 
@@ -59,6 +103,43 @@ typedef struct
 
 } ntp_packet;
 
+/**
+ * @brief Clock discipline status
+ * 
+ */
+typedef struct
+{
+    bool     synced;         // the clock was set at least once
+    uint32_t polls;          // requests sent
+    uint32_t replies;        // valid replies
+    uint32_t failures;       // timeouts, invalid replies and socket errors
+    uint32_t steps;          // times the clock was stepped instead of slewed
+    int32_t  offset_us;      // last measured offset, positive when the local clock is behind
+    uint32_t delay_us;       // last measured round-trip delay, the offset error is within delay / 2
+    uint16_t poll_s;         // current poll interval
+    uint32_t last_sync_s;    // uptime of the last valid reply
+    uint8_t  truechimers;    // servers agreeing on the last poll
+} ntp_stats_t;
+
+/**
+ * @brief Statistics of one server
+ * 
+ */
+typedef struct
+{
+    char     host[NTP_SERVER_NAME_LEN];
+    uint32_t polls;          // requests sent
+    uint32_t replies;        // valid replies
+    uint32_t timeouts;       // no reply before NTP_RECV_TIMEOUT_MS
+    uint32_t invalid;        // replies failing the sanity checks
+    uint32_t falsetickers;   // times it was left out of the intersection
+    uint8_t  reach;          // shift register, one bit per poll, 1 = valid reply
+    uint8_t  stratum;
+    bool     selected;       // was a truechimer on the last poll
+    int32_t  offset_us;      // last offset
+    uint32_t delay_us;       // last round-trip delay
+} ntp_server_stats_t;
+
 
 
 /**************************
@@ -72,17 +153,18 @@ typedef struct
 void dateTimeNTP_setup(void);
 
 /**
- * @brief Get the last updated Time stored from ntp server
+ * @brief Copies the clock discipline status
  * 
- * @return char* 
+ * @param stats_p destination
  */
-char* dateTimeNTP_getTime(void);
+void dateTimeNTP_getStats(ntp_stats_t * stats_p);
 
 /**
- * @brief Get the last updated Date stored from ntp server
+ * @brief Copies the statistics of one server
  * 
- * @return char* 
+ * @param index position on X_MACRO_NTP_SERVER_LIST
+ * @param stats_p destination
  */
-char* dateTimeNTP_getData(void);
+void dateTimeNTP_getServerStats(uint8_t index, ntp_server_stats_t * stats_p);
 
 #endif //__DATE_TIME_NTP_LIB__
\ No newline at end of file
@@ -0,0 +1,847 @@
+/**
+ * @file deviceRegistry.c
+ * @brief Zigbee end devices known by the gateway
+ * @details
+ * The hash tables hold the device position + 1, 0 is an empty entry.
+ * Removals shift the following entries back instead of leaving
+ * tombstones, so probes never get longer with use.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdio.h>
+#include <string.h>
+
+// ESP libraries
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+
+// Personal libraries
+#include "deviceRegistry.h"
+#include "tasks_common.h"
+#include "telemetryStore.h"
+#include "zigbeeNcp.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+#define DEVICE_REGISTRY_TABLE_SIZE	(1 << DEVICE_REGISTRY_TABLE_BITS)
+#define DEVICE_REGISTRY_TABLE_MASK	(DEVICE_REGISTRY_TABLE_SIZE - 1)
+#define DEVICE_REGISTRY_PAGES		((DEVICE_REGISTRY_MAX + DEVICE_REGISTRY_PAGE_RECORDS - 1) / DEVICE_REGISTRY_PAGE_RECORDS)
+
+_Static_assert(DEVICE_REGISTRY_TABLE_SIZE >= 2 * DEVICE_REGISTRY_MAX, "hash tables over half full");
+_Static_assert(DEVICE_REGISTRY_MAX < UINT16_MAX, "positions are 16 bit");
+
+	/* Structures */
+
+/**
+ * @brief Device saved on NVS, ieee 0 for an empty place
+ */
+typedef struct __attribute__((packed)) device_record_s
+{
+	uint64_t	ieee;
+	uint16_t	short_addr;
+	uint8_t		type;
+	uint8_t		reserved;
+} device_record_t;
+
+/**
+ * @brief Hash tables
+ */
+typedef enum device_index_e
+{
+	DEVICE_INDEX_IEEE = 0,
+	DEVICE_INDEX_SHORT,
+	DEVICE_INDEX_COUNT
+} device_index_t;
+
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "device_registry";
+
+static const char * const g_type_names[DEVICE_TYPE_COUNT] =
+{
+#define X(ID, ENUM, NAME) [ID] = NAME,
+	X_MACRO_DEVICE_TYPE_LIST
+#undef X
+};
+
+static const char * const g_attr_names[DEVICE_ATTR_COUNT] =
+{
+#define X(ID, ENUM, NAME) [ID] = NAME,
+	X_MACRO_DEVICE_ATTR_LIST
+#undef X
+};
+
+// Devices, one array per field
+static uint16_t g_count;
+static uint64_t g_ieee[DEVICE_REGISTRY_MAX];
+static uint16_t g_short[DEVICE_REGISTRY_MAX];
+static uint8_t g_type[DEVICE_REGISTRY_MAX];
+static uint32_t g_last_seen_s[DEVICE_REGISTRY_MAX];
+static int8_t g_rssi[DEVICE_REGISTRY_MAX];
+static uint8_t g_lqi[DEVICE_REGISTRY_MAX];
+static int32_t g_attrs[DEVICE_ATTR_COUNT][DEVICE_REGISTRY_MAX];
+
+// Position + 1 of the device, 0 for empty
+static uint16_t g_tables[DEVICE_INDEX_COUNT][DEVICE_REGISTRY_TABLE_SIZE];
+
+// Pages to write, and the figures
+static uint32_t g_dirty[(DEVICE_REGISTRY_PAGES + 31) / 32];
+static device_registry_stats_t g_stats;
+static uint64_t g_lookup_cycles;
+
+// Devices, tables and figures
+static portMUX_TYPE device_registry_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+	/* FreeRTOS Structures */
+
+TASK_STORAGE(deviceRegistry_task, DEVICE_REGISTRY_TASK_STACK_SIZE)
+static TaskHandle_t device_registry_task_handle;
+
+
+	/* Static Functions */
+
+static uint32_t deviceRegistry_home(device_index_t index, uint16_t pos);
+static int deviceRegistry_find(device_index_t index, uint64_t key);
+static void deviceRegistry_insert(device_index_t index, uint16_t pos);
+static void deviceRegistry_erase(device_index_t index, uint64_t key);
+static void deviceRegistry_move(device_index_t index, uint64_t key, uint16_t from, uint16_t to);
+static void deviceRegistry_markDirty(uint16_t pos);
+static void deviceRegistry_scheduleFlush(void);
+static void deviceRegistry_read(uint16_t pos, device_info_t * info_p);
+static void deviceRegistry_ncpEvent(uint16_t id, const uint8_t * payload, uint16_t len);
+static void deviceRegistry_task(void * pvParameters);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Loads the devices saved on NVS
+esp_err_t deviceRegistry_init(void)
+{
+	device_record_t page[DEVICE_REGISTRY_PAGE_RECORDS];
+	nvs_handle_t handle;
+	char key[8];
+	esp_err_t err;
+
+	if (device_registry_task_handle == NULL)
+	{
+		TASK_CREATE(	deviceRegistry_task,
+						&deviceRegistry_task,
+						DEVICE_REGISTRY_TASK_STACK_SIZE,
+						DEVICE_REGISTRY_TASK_PRIORITY,
+						&device_registry_task_handle,
+						DEVICE_REGISTRY_TASK_CORE_ID);
+		if (zigbeeNcp_subscribe(deviceRegistry_ncpEvent) != ESP_OK)
+		{
+			ESP_LOGE(TAG, "deviceRegistry_init: no NCP handler left, devices won't be updated");
+		}
+	}
+
+	memset(g_tables, 0x00, sizeof(g_tables));
+	g_count = 0;
+
+	err = nvs_open(DEVICE_REGISTRY_NVS_NAMESPACE, NVS_READONLY, &handle);
+	if (err == ESP_ERR_NVS_NOT_FOUND)
+	{
+		ESP_LOGI(TAG, "no devices saved");
+		return ESP_OK;
+	}
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "deviceRegistry_init: nvs_open failed (%s)", esp_err_to_name(err));
+		return err;
+	}
+
+	for (int p = 0; p < DEVICE_REGISTRY_PAGES; p++)
+	{
+		size_t length = sizeof(page);
+
+		snprintf(key, sizeof(key), "p%03d", p);
+		if (nvs_get_blob(handle, key, page, &length) != ESP_OK)
+		{
+			continue;
+		}
+		for (size_t i = 0; i < length / sizeof(device_record_t); i++)
+		{
+			if (page[i].ieee != 0 && g_count < DEVICE_REGISTRY_MAX
+				&& deviceRegistry_find(DEVICE_INDEX_IEEE, page[i].ieee) < 0)
+			{
+				uint16_t pos = g_count++;
+
+				g_ieee[pos] = page[i].ieee;
+				g_short[pos] = page[i].short_addr;
+				g_type[pos] = (page[i].type < DEVICE_TYPE_COUNT) ? page[i].type : DEVICE_TYPE_UNKNOWN;
+				g_last_seen_s[pos] = 0;
+				g_rssi[pos] = 0;
+				g_lqi[pos] = 0;
+				for (int a = 0; a < DEVICE_ATTR_COUNT; a++)
+				{
+					g_attrs[a][pos] = DEVICE_ATTR_UNKNOWN;
+				}
+				deviceRegistry_insert(DEVICE_INDEX_IEEE, pos);
+				if (g_short[pos] != DEVICE_SHORT_NONE)
+				{
+					deviceRegistry_insert(DEVICE_INDEX_SHORT, pos);
+				}
+			}
+		}
+	}
+	nvs_close(handle);
+
+	ESP_LOGI(TAG, "%u devices loaded", g_count);
+	return ESP_OK;
+}
+
+// Adds a device or updates its short address and type
+esp_err_t deviceRegistry_add(uint64_t ieee, uint16_t short_addr, device_type_t type)
+{
+	bool changed = false;
+	int other;
+	int pos;
+
+	if (ieee == 0 || type >= DEVICE_TYPE_COUNT)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	taskENTER_CRITICAL(&device_registry_mux);
+	pos = deviceRegistry_find(DEVICE_INDEX_IEEE, ieee);
+	if (pos < 0)
+	{
+		if (g_count >= DEVICE_REGISTRY_MAX)
+		{
+			taskEXIT_CRITICAL(&device_registry_mux);
+			return ESP_ERR_NO_MEM;
+		}
+		pos = g_count++;
+		g_ieee[pos] = ieee;
+		g_short[pos] = DEVICE_SHORT_NONE;
+		g_type[pos] = type;
+		g_last_seen_s[pos] = 0;
+		g_rssi[pos] = 0;
+		g_lqi[pos] = 0;
+		for (int a = 0; a < DEVICE_ATTR_COUNT; a++)
+		{
+			g_attrs[a][pos] = DEVICE_ATTR_UNKNOWN;
+		}
+		deviceRegistry_insert(DEVICE_INDEX_IEEE, pos);
+		deviceRegistry_markDirty(pos);
+		changed = true;
+	}
+
+	if (g_short[pos] != short_addr)
+	{
+		// The address belongs to this device now
+		other = (short_addr != DEVICE_SHORT_NONE) ? deviceRegistry_find(DEVICE_INDEX_SHORT, short_addr) : -1;
+		if (other >= 0)
+		{
+			deviceRegistry_erase(DEVICE_INDEX_SHORT, short_addr);
+			g_short[other] = DEVICE_SHORT_NONE;
+			deviceRegistry_markDirty(other);
+		}
+		if (g_short[pos] != DEVICE_SHORT_NONE)
+		{
+			deviceRegistry_erase(DEVICE_INDEX_SHORT, g_short[pos]);
+		}
+		g_short[pos] = short_addr;
+		if (short_addr != DEVICE_SHORT_NONE)
+		{
+			deviceRegistry_insert(DEVICE_INDEX_SHORT, pos);
+		}
+		deviceRegistry_markDirty(pos);
+		changed = true;
+	}
+	if (g_type[pos] != type)
+	{
+		g_type[pos] = type;
+		deviceRegistry_markDirty(pos);
+		changed = true;
+	}
+	taskEXIT_CRITICAL(&device_registry_mux);
+
+	if (changed)
+	{
+		deviceRegistry_scheduleFlush();
+	}
+	return ESP_OK;
+}
+
+// Removes a device
+esp_err_t deviceRegistry_remove(uint64_t ieee)
+{
+	uint16_t last;
+	int pos;
+
+	taskENTER_CRITICAL(&device_registry_mux);
+	pos = deviceRegistry_find(DEVICE_INDEX_IEEE, ieee);
+	if (pos < 0)
+	{
+		taskEXIT_CRITICAL(&device_registry_mux);
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	deviceRegistry_erase(DEVICE_INDEX_IEEE, ieee);
+	if (g_short[pos] != DEVICE_SHORT_NONE)
+	{
+		deviceRegistry_erase(DEVICE_INDEX_SHORT, g_short[pos]);
+	}
+
+	// The last device takes its place, the arrays stay dense
+	last = --g_count;
+	if (pos != last)
+	{
+		g_ieee[pos] = g_ieee[last];
+		g_short[pos] = g_short[last];
+		g_type[pos] = g_type[last];
+		g_last_seen_s[pos] = g_last_seen_s[last];
+		g_rssi[pos] = g_rssi[last];
+		g_lqi[pos] = g_lqi[last];
+		for (int a = 0; a < DEVICE_ATTR_COUNT; a++)
+		{
+			g_attrs[a][pos] = g_attrs[a][last];
+		}
+		deviceRegistry_move(DEVICE_INDEX_IEEE, g_ieee[pos], last, pos);
+		if (g_short[pos] != DEVICE_SHORT_NONE)
+		{
+			deviceRegistry_move(DEVICE_INDEX_SHORT, g_short[pos], last, pos);
+		}
+		deviceRegistry_markDirty(pos);
+	}
+	g_ieee[last] = 0;
+	deviceRegistry_markDirty(last);
+	taskEXIT_CRITICAL(&device_registry_mux);
+
+	deviceRegistry_scheduleFlush();
+	return ESP_OK;
+}
+
+// Finds a device by IEEE address
+bool deviceRegistry_findByIeee(uint64_t ieee, device_info_t * info_p)
+{
+	int pos;
+
+	taskENTER_CRITICAL(&device_registry_mux);
+	pos = deviceRegistry_find(DEVICE_INDEX_IEEE, ieee);
+	if (pos >= 0 && info_p != NULL)
+	{
+		deviceRegistry_read(pos, info_p);
+	}
+	taskEXIT_CRITICAL(&device_registry_mux);
+
+	return pos >= 0;
+}
+
+// Finds a device by short address
+bool deviceRegistry_findByShort(uint16_t short_addr, device_info_t * info_p)
+{
+	int pos;
+
+	taskENTER_CRITICAL(&device_registry_mux);
+	pos = deviceRegistry_find(DEVICE_INDEX_SHORT, short_addr);
+	if (pos >= 0 && info_p != NULL)
+	{
+		deviceRegistry_read(pos, info_p);
+	}
+	taskEXIT_CRITICAL(&device_registry_mux);
+
+	return pos >= 0;
+}
+
+// Records a frame received from a device
+bool deviceRegistry_seen(uint16_t short_addr, int8_t rssi, uint8_t lqi)
+{
+	uint32_t now_s = esp_timer_get_time() / 1000000;
+	int pos;
+
+	taskENTER_CRITICAL(&device_registry_mux);
+	pos = deviceRegistry_find(DEVICE_INDEX_SHORT, short_addr);
+	if (pos >= 0)
+	{
+		// 0 is never, the first second counts as 1
+		g_last_seen_s[pos] = (now_s > 0) ? now_s : 1;
+		g_rssi[pos] = rssi;
+		g_lqi[pos] = lqi;
+	}
+	taskEXIT_CRITICAL(&device_registry_mux);
+
+	return pos >= 0;
+}
+
+// Records a reported attribute
+bool deviceRegistry_setAttr(uint16_t short_addr, device_attr_t attr, int32_t value)
+{
+	uint64_t ieee = 0;
+	int pos;
+
+	if (attr >= DEVICE_ATTR_COUNT)
+	{
+		return false;
+	}
+
+	taskENTER_CRITICAL(&device_registry_mux);
+	pos = deviceRegistry_find(DEVICE_INDEX_SHORT, short_addr);
+	if (pos >= 0)
+	{
+		g_attrs[attr][pos] = value;
+		ieee = g_ieee[pos];
+	}
+	taskEXIT_CRITICAL(&device_registry_mux);
+
+	// History, outside the lock
+	if (pos >= 0)
+	{
+		telemetryStore_append(ieee, attr, value);
+	}
+	return pos >= 0;
+}
+
+// Number of devices
+uint16_t deviceRegistry_count(void)
+{
+	return g_count;
+}
+
+// Reads a device by position
+bool deviceRegistry_getAt(uint16_t index, device_info_t * info_p)
+{
+	bool found;
+
+	taskENTER_CRITICAL(&device_registry_mux);
+	found = (index < g_count);
+	if (found)
+	{
+		deviceRegistry_read(index, info_p);
+	}
+	taskEXIT_CRITICAL(&device_registry_mux);
+
+	return found;
+}
+
+// Writes the changed pages now
+esp_err_t deviceRegistry_flush(void)
+{
+	device_record_t page[DEVICE_REGISTRY_PAGE_RECORDS];
+	nvs_handle_t handle;
+	esp_err_t err;
+	char key[8];
+
+	err = nvs_open(DEVICE_REGISTRY_NVS_NAMESPACE, NVS_READWRITE, &handle);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "deviceRegistry_flush: nvs_open failed (%s)", esp_err_to_name(err));
+		return err;
+	}
+
+	for (int p = 0; p < DEVICE_REGISTRY_PAGES && err == ESP_OK; p++)
+	{
+		bool dirty;
+		bool empty = true;
+
+		// Copied and cleared together, a change during the write dirties it again
+		taskENTER_CRITICAL(&device_registry_mux);
+		dirty = (g_dirty[p / 32] & (1UL << (p % 32))) != 0;
+		if (dirty)
+		{
+			g_dirty[p / 32] &= ~(1UL << (p % 32));
+			g_stats.dirty_pages--;
+			for (int i = 0; i < DEVICE_REGISTRY_PAGE_RECORDS; i++)
+			{
+				uint16_t pos = p * DEVICE_REGISTRY_PAGE_RECORDS + i;
+
+				memset(&page[i], 0x00, sizeof(device_record_t));
+				if (pos < g_count)
+				{
+					page[i].ieee = g_ieee[pos];
+					page[i].short_addr = g_short[pos];
+					page[i].type = g_type[pos];
+					empty = false;
+				}
+			}
+		}
+		taskEXIT_CRITICAL(&device_registry_mux);
+
+		if (!dirty)
+		{
+			continue;
+		}
+
+		snprintf(key, sizeof(key), "p%03d", p);
+		if (empty)
+		{
+			err = nvs_erase_key(handle, key);
+			if (err == ESP_ERR_NVS_NOT_FOUND)
+			{
+				err = ESP_OK;
+			}
+		}
+		else
+		{
+			err = nvs_set_blob(handle, key, page, sizeof(page));
+		}
+		if (err == ESP_OK)
+		{
+			g_stats.page_writes++;
+		}
+		else
+		{
+			ESP_LOGE(TAG, "page %d not saved (%s)", p, esp_err_to_name(err));
+			taskENTER_CRITICAL(&device_registry_mux);
+			deviceRegistry_markDirty(p * DEVICE_REGISTRY_PAGE_RECORDS);
+			taskEXIT_CRITICAL(&device_registry_mux);
+		}
+	}
+
+	if (err == ESP_OK)
+	{
+		err = nvs_commit(handle);
+	}
+	nvs_close(handle);
+
+	// Retried later
+	if (err != ESP_OK)
+	{
+		deviceRegistry_scheduleFlush();
+	}
+
+	return err;
+}
+
+// Copies the registry figures
+void deviceRegistry_getStats(device_registry_stats_t * stats_p)
+{
+	taskENTER_CRITICAL(&device_registry_mux);
+	memcpy(stats_p, &g_stats, sizeof(device_registry_stats_t));
+	stats_p->count = g_count;
+	stats_p->lookup_cycles_avg = (g_stats.lookups > 0) ? g_lookup_cycles / g_stats.lookups : 0;
+	taskEXIT_CRITICAL(&device_registry_mux);
+
+	stats_p->capacity = DEVICE_REGISTRY_MAX;
+	stats_p->bytes_per_device = (sizeof(g_ieee) + sizeof(g_short) + sizeof(g_type) + sizeof(g_last_seen_s)
+									+ sizeof(g_rssi) + sizeof(g_lqi) + sizeof(g_attrs) + sizeof(g_tables))
+								/ DEVICE_REGISTRY_MAX;
+}
+
+// Name of a type
+const char * deviceRegistry_typeName(device_type_t type)
+{
+	return (type < DEVICE_TYPE_COUNT) ? g_type_names[type] : g_type_names[DEVICE_TYPE_UNKNOWN];
+}
+
+// Type from its name
+device_type_t deviceRegistry_typeFromName(const char * name)
+{
+	for (int i = 0; i < DEVICE_TYPE_COUNT; i++)
+	{
+		if (strcmp(g_type_names[i], name) == 0)
+		{
+			return i;
+		}
+	}
+	return DEVICE_TYPE_UNKNOWN;
+}
+
+// Name of an attribute
+const char * deviceRegistry_attrName(device_attr_t attr)
+{
+	return (attr < DEVICE_ATTR_COUNT) ? g_attr_names[attr] : "?";
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Hash of a key, Fibonacci hashing on the top bits
+ * @param index table
+ * @param key IEEE or short address
+ * @return uint32_t entry the probe starts from
+ */
+static inline uint32_t deviceRegistry_hash(device_index_t index, uint64_t key)
+{
+	if (index == DEVICE_INDEX_IEEE)
+	{
+		return (key * 0x9E3779B97F4A7C15ULL) >> (64 - DEVICE_REGISTRY_TABLE_BITS);
+	}
+	return (uint32_t)((uint32_t)key * 0x9E3779B1U) >> (32 - DEVICE_REGISTRY_TABLE_BITS);
+}
+
+/**
+ * @brief Entry a device's probe starts from
+ * @param index table
+ * @param pos device
+ * @return uint32_t
+ */
+static uint32_t deviceRegistry_home(device_index_t index, uint16_t pos)
+{
+	return deviceRegistry_hash(index, (index == DEVICE_INDEX_IEEE) ? g_ieee[pos] : g_short[pos]);
+}
+
+/**
+ * @brief Looks a key up, the lock must be held
+ * @param index table
+ * @param key
+ * @return int device position, -1 when not found
+ */
+static int deviceRegistry_find(device_index_t index, uint64_t key)
+{
+	uint32_t start = esp_cpu_get_cycle_count();
+	uint32_t i = deviceRegistry_hash(index, key);
+	uint16_t probe = 1;
+	int pos = -1;
+
+	for (;; i = (i + 1) & DEVICE_REGISTRY_TABLE_MASK, probe++)
+	{
+		uint16_t entry = g_tables[index][i];
+
+		if (entry == 0)
+		{
+			break;
+		}
+		if (((index == DEVICE_INDEX_IEEE) ? g_ieee[entry - 1] : g_short[entry - 1]) == key)
+		{
+			pos = entry - 1;
+			break;
+		}
+	}
+
+	uint32_t cycles = esp_cpu_get_cycle_count() - start;
+	g_stats.lookups++;
+	g_lookup_cycles += cycles;
+	if (cycles > g_stats.lookup_cycles_max)
+	{
+		g_stats.lookup_cycles_max = cycles;
+	}
+	if (probe > g_stats.max_probe)
+	{
+		g_stats.max_probe = probe;
+	}
+
+	return pos;
+}
+
+/**
+ * @brief Indexes a device, its key must not be there yet, the lock must be held
+ * @param index table
+ * @param pos device
+ */
+static void deviceRegistry_insert(device_index_t index, uint16_t pos)
+{
+	uint32_t i = deviceRegistry_home(index, pos);
+
+	// Never full, the table has twice the room of the devices
+	while (g_tables[index][i] != 0)
+	{
+		i = (i + 1) & DEVICE_REGISTRY_TABLE_MASK;
+	}
+	g_tables[index][i] = pos + 1;
+}
+
+/**
+ * @brief Removes a key, shifting back the entries that probed past it
+ * @details the lock must be held
+ * @param index table
+ * @param key
+ */
+static void deviceRegistry_erase(device_index_t index, uint64_t key)
+{
+	uint32_t i = deviceRegistry_hash(index, key);
+	uint32_t j;
+
+	for (;; i = (i + 1) & DEVICE_REGISTRY_TABLE_MASK)
+	{
+		uint16_t entry = g_tables[index][i];
+
+		if (entry == 0)
+		{
+			return;
+		}
+		if (((index == DEVICE_INDEX_IEEE) ? g_ieee[entry - 1] : g_short[entry - 1]) == key)
+		{
+			break;
+		}
+	}
+
+	g_tables[index][i] = 0;
+	for (j = (i + 1) & DEVICE_REGISTRY_TABLE_MASK; g_tables[index][j] != 0; j = (j + 1) & DEVICE_REGISTRY_TABLE_MASK)
+	{
+		uint32_t home = deviceRegistry_home(index, g_tables[index][j] - 1);
+
+		// The entry stays when its home is cyclically in (i, j]
+		if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j))
+		{
+			g_tables[index][i] = g_tables[index][j];
+			g_tables[index][j] = 0;
+			i = j;
+		}
+	}
+}
+
+/**
+ * @brief Points the entry of a key to the new position of its device
+ * @details the lock must be held
+ * @param index table
+ * @param key
+ * @param from position the device had
+ * @param to position it has now
+ */
+static void deviceRegistry_move(device_index_t index, uint64_t key, uint16_t from, uint16_t to)
+{
+	uint32_t i = deviceRegistry_hash(index, key);
+
+	for (; g_tables[index][i] != 0; i = (i + 1) & DEVICE_REGISTRY_TABLE_MASK)
+	{
+		if (g_tables[index][i] == from + 1)
+		{
+			g_tables[index][i] = to + 1;
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Marks the page of a device to be written, the lock must be held
+ * @param pos
+ */
+static void deviceRegistry_markDirty(uint16_t pos)
+{
+	uint16_t p = pos / DEVICE_REGISTRY_PAGE_RECORDS;
+
+	if ((g_dirty[p / 32] & (1UL << (p % 32))) == 0)
+	{
+		g_dirty[p / 32] |= 1UL << (p % 32);
+		g_stats.dirty_pages++;
+	}
+}
+
+/**
+ * @brief Wakes the writer task, the write follows DEVICE_REGISTRY_FLUSH_S later
+ * @details changes made before it writes go in the same write
+ */
+static void deviceRegistry_scheduleFlush(void)
+{
+	if (device_registry_task_handle != NULL)
+	{
+		xTaskNotifyGive(device_registry_task_handle);
+	}
+}
+
+/**
+ * @brief Copies a device, the lock must be held
+ * @param pos
+ * @param info_p destination
+ */
+static void deviceRegistry_read(uint16_t pos, device_info_t * info_p)
+{
+	info_p->ieee = g_ieee[pos];
+	info_p->short_addr = g_short[pos];
+	info_p->type = g_type[pos];
+	info_p->last_seen_s = g_last_seen_s[pos];
+	info_p->rssi = g_rssi[pos];
+	info_p->lqi = g_lqi[pos];
+	for (int a = 0; a < DEVICE_ATTR_COUNT; a++)
+	{
+		info_p->attrs[a] = g_attrs[a][pos];
+	}
+}
+
+/**
+ * @brief NCP event handler, on the zigbeeNcp task
+ * @details payloads are little endian, see the ZIGBEE_NCP_EVT_* IDs
+ * @param id
+ * @param payload
+ * @param len
+ */
+static void deviceRegistry_ncpEvent(uint16_t id, const uint8_t * payload, uint16_t len)
+{
+	uint16_t short_addr;
+
+	if (len < 2)
+	{
+		return;
+	}
+	short_addr = payload[0] | (payload[1] << 8);
+
+	switch (id)
+	{
+		case ZIGBEE_NCP_EVT_DEVICE_ANNCE:
+		{
+			device_info_t info;
+			uint64_t ieee = 0;
+
+			if (len < 10)
+			{
+				break;
+			}
+			for (int i = 7; i >= 0; i--)
+			{
+				ieee = (ieee << 8) | payload[i];
+			}
+			short_addr = payload[8] | (payload[9] << 8);
+			// Only the short address changes on a rejoin, the type stays
+			if (deviceRegistry_findByIeee(ieee, &info) && info.short_addr != short_addr)
+			{
+				ESP_LOGI(TAG, "device %016llx is now 0x%04x", ieee, short_addr);
+				deviceRegistry_add(ieee, short_addr, info.type);
+			}
+			break;
+		}
+
+		case ZIGBEE_NCP_EVT_FRAME_RX:
+			if (len >= 4)
+			{
+				deviceRegistry_seen(short_addr, (int8_t)payload[2], payload[3]);
+			}
+			break;
+
+		case ZIGBEE_NCP_EVT_ATTR_REPORT:
+			if (len >= 7)
+			{
+				int32_t value = (int32_t)(payload[3] | (payload[4] << 8) | (payload[5] << 16) | ((uint32_t)payload[6] << 24));
+
+				deviceRegistry_setAttr(short_addr, (device_attr_t)payload[2], value);
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+/**
+ * @brief Writes the changed pages, DEVICE_REGISTRY_FLUSH_S after the first change
+ * @details own task at low priority, the flash write no longer holds the
+ * esp_timer callbacks
+ * @param pvParameters
+ */
+static void deviceRegistry_task(void * pvParameters)
+{
+	for (;;)
+	{
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		vTaskDelay(pdMS_TO_TICKS(DEVICE_REGISTRY_FLUSH_S * 1000));
+		// The changes since the first one go in this write
+		ulTaskNotifyTake(pdTRUE, 0);
+		deviceRegistry_flush();
+	}
+}
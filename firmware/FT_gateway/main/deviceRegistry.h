@@ -0,0 +1,244 @@
+/**
+ * @file deviceRegistry.h
+ * @brief Zigbee end devices known by the gateway
+ * @details
+ * Devices are kept in parallel arrays (one per field), dense: a removed
+ * device is replaced by the last one. Two open addressing hash tables with
+ * linear probing index them by IEEE and by short address, so the receive
+ * path finds a device in a probe or two whatever the count. Lookups and
+ * updates only hold a spinlock, any task can call them.
+ * The identity (IEEE, short address, type) is saved on NVS in pages of
+ * DEVICE_REGISTRY_PAGE_RECORDS devices, only the changed pages and
+ * DEVICE_REGISTRY_FLUSH_S after the first change, by the deviceRegistry
+ * task at low priority. The attributes and the link figures are RAM only,
+ * they change on every frame.
+ * deviceRegistry_init subscribes to the NCP events: a device announce
+ * updates the short address of a known device, received frames and
+ * attribute reports feed deviceRegistry_seen and deviceRegistry_setAttr.
+ * Unknown devices are ignored, they are added by hand (/devices.json).
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_DEVICEREGISTRY_H_
+#define MAIN_DEVICEREGISTRY_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+// ESP libraries
+#include "esp_err.h"
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+#define DEVICE_REGISTRY_NVS_NAMESPACE	"devices"
+
+// Short address of a device that hasn't (re)joined yet
+#define DEVICE_SHORT_NONE				0xFFFF
+// Attribute never reported
+#define DEVICE_ATTR_UNKNOWN				INT32_MIN
+
+/**
+ * @brief Device types
+ * @details columns: ID, ENUM, NAME
+ */
+#define X_MACRO_DEVICE_TYPE_LIST								\
+	X(0, DEVICE_TYPE_UNKNOWN,			"unknown"			)	\
+	X(1, DEVICE_TYPE_VALVE,				"valve"				)	\
+	X(2, DEVICE_TYPE_FLOW_SENSOR,		"flow_sensor"		)	\
+	X(3, DEVICE_TYPE_PRESSURE_SENSOR,	"pressure_sensor"	)
+
+/**
+ * @brief Last known attributes of a device
+ * @details columns: ID, ENUM, NAME
+ */
+#define X_MACRO_DEVICE_ATTR_LIST								\
+	X(0, DEVICE_ATTR_VALVE_OPEN,		"valve_open"		)	\
+	X(1, DEVICE_ATTR_BATTERY_PCT,		"battery_pct"		)	\
+	X(2, DEVICE_ATTR_FLOW_ML_MIN,		"flow_ml_min"		)	\
+	X(3, DEVICE_ATTR_PRESSURE_MBAR,		"pressure_mbar"		)
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief Device type IDs
+ */
+typedef enum device_type_e
+{
+#define X(ID, ENUM, NAME) ENUM = ID,
+	X_MACRO_DEVICE_TYPE_LIST
+#undef X
+	DEVICE_TYPE_COUNT
+} device_type_t;
+
+/**
+ * @brief Attribute IDs
+ */
+typedef enum device_attr_e
+{
+#define X(ID, ENUM, NAME) ENUM = ID,
+	X_MACRO_DEVICE_ATTR_LIST
+#undef X
+	DEVICE_ATTR_COUNT
+} device_attr_t;
+
+/**
+ * @brief Copy of one device
+ */
+typedef struct device_info_s
+{
+	uint64_t		ieee;
+	uint16_t		short_addr;		///> DEVICE_SHORT_NONE when unknown
+	device_type_t	type;
+	uint32_t		last_seen_s;	///> uptime of the last frame, 0 for never
+	int8_t			rssi;
+	uint8_t			lqi;
+	int32_t			attrs[DEVICE_ATTR_COUNT];
+} device_info_t;
+
+/**
+ * @brief Registry figures
+ */
+typedef struct device_registry_stats_s
+{
+	uint16_t	count;
+	uint16_t	capacity;
+	uint16_t	bytes_per_device;	///> arrays and both tables, over the capacity
+	uint16_t	max_probe;			///> longest probe of the lookups so far
+	uint32_t	lookups;
+	uint32_t	lookup_cycles_avg;
+	uint32_t	lookup_cycles_max;
+	uint32_t	dirty_pages;
+	uint32_t	page_writes;		///> since the boot
+} device_registry_stats_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Loads the devices saved on NVS, starts the writer task and
+ * subscribes to the NCP events
+ * @details after nvs_flash_init
+ * @return esp_err_t
+ */
+esp_err_t deviceRegistry_init(void);
+
+/**
+ * @brief Adds a device or updates its short address and type
+ * @details a device with the same short address loses it, it left the
+ * network or rejoined with another one
+ * @param ieee not 0
+ * @param short_addr DEVICE_SHORT_NONE when unknown
+ * @param type
+ * @return esp_err_t ESP_ERR_NO_MEM when full
+ */
+esp_err_t deviceRegistry_add(uint64_t ieee, uint16_t short_addr, device_type_t type);
+
+/**
+ * @brief Removes a device
+ * @param ieee
+ * @return esp_err_t ESP_ERR_NOT_FOUND
+ */
+esp_err_t deviceRegistry_remove(uint64_t ieee);
+
+/**
+ * @brief Finds a device by IEEE address
+ * @param ieee
+ * @param info_p destination, may be NULL
+ * @return true when known
+ */
+bool deviceRegistry_findByIeee(uint64_t ieee, device_info_t * info_p);
+
+/**
+ * @brief Finds a device by short address
+ * @param short_addr
+ * @param info_p destination, may be NULL
+ * @return true when known
+ */
+bool deviceRegistry_findByShort(uint16_t short_addr, device_info_t * info_p);
+
+/**
+ * @brief Records a frame received from a device
+ * @param short_addr
+ * @param rssi
+ * @param lqi
+ * @return true when known, unknown senders are left to the caller
+ */
+bool deviceRegistry_seen(uint16_t short_addr, int8_t rssi, uint8_t lqi);
+
+/**
+ * @brief Records a reported attribute
+ * @details also appended to the telemetry history (telemetryStore.h)
+ * @param short_addr
+ * @param attr
+ * @param value
+ * @return true when known
+ */
+bool deviceRegistry_setAttr(uint16_t short_addr, device_attr_t attr, int32_t value);
+
+/**
+ * @brief Number of devices
+ * @return uint16_t
+ */
+uint16_t deviceRegistry_count(void);
+
+/**
+ * @brief Reads a device by position, for listing them
+ * @details a removal in between moves the last device to its place
+ * @param index 0 to deviceRegistry_count() - 1
+ * @param info_p destination
+ * @return false past the end
+ */
+bool deviceRegistry_getAt(uint16_t index, device_info_t * info_p);
+
+/**
+ * @brief Writes the changed pages now
+ * @return esp_err_t
+ */
+esp_err_t deviceRegistry_flush(void);
+
+/**
+ * @brief Copies the registry figures
+ * @param stats_p destination
+ */
+void deviceRegistry_getStats(device_registry_stats_t * stats_p);
+
+/**
+ * @brief Name of a type
+ * @param type
+ * @return const char* "unknown" when out of range
+ */
+const char * deviceRegistry_typeName(device_type_t type);
+
+/**
+ * @brief Type from its name
+ * @param name
+ * @return device_type_t DEVICE_TYPE_UNKNOWN when not found
+ */
+device_type_t deviceRegistry_typeFromName(const char * name);
+
+/**
+ * @brief Name of an attribute
+ * @param attr
+ * @return const char*
+ */
+const char * deviceRegistry_attrName(device_attr_t attr);
+
+#endif /* MAIN_DEVICEREGISTRY_H_ */
@@ -0,0 +1,343 @@
+/**
+ * @file dnsCache.c
+ * @brief Resolver cache shared by the outbound clients (NTP, OTA pull, MQTT)
+ * @details
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <string.h>
+
+// ESP libraries
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "lwip/dns.h"
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+#include "lwip/tcpip.h"
+#include "sdkconfig.h"
+
+// Personal libraries
+#include "dnsCache.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+	/* Structures */
+
+/**
+ * @brief One cached host
+ */
+typedef struct dns_cache_entry_s
+{
+	char		host[DNS_CACHE_HOST_LEN];
+	uint32_t	addr;			///> network byte order, valid when has_addr
+	int64_t		expires_us;		///> a refresh is started after this
+	int64_t		used_us;		///> last lookup, the least recently used entry is replaced
+	bool		has_addr;
+	bool		refreshing;		///> a lookup is running on the tcpip thread
+} dns_cache_entry_t;
+
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "dns_cache";
+
+// Cache table, written by the callers and the tcpip thread
+static dns_cache_entry_t g_entries[DNS_CACHE_SIZE];
+static portMUX_TYPE dns_cache_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+	/* FreeRTOS Structures */
+
+// One bit per entry, set when its lookup ends
+static EventGroupHandle_t dns_cache_event_group;
+#if CONFIG_GW_STATIC_ALLOCATION
+static StaticEventGroup_t dns_cache_event_group_struct;
+#endif
+
+
+	/* Static Functions */
+
+static int dnsCache_find(const char * host);
+static int dnsCache_alloc(const char * host, int64_t now_us);
+static int dnsCache_start(const char * host, uint32_t * addr_p, bool * has_addr_p, bool * waiting_p);
+static void dnsCache_lookup(void * arg);
+static void dnsCache_found(const char * name, const ip_addr_t * ipaddr, void * arg);
+static void dnsCache_store(int index, const ip_addr_t * ipaddr);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Creates the cache synchronization objects
+void dnsCache_init(void)
+{
+	if (dns_cache_event_group == NULL)
+	{
+#if CONFIG_GW_STATIC_ALLOCATION
+		dns_cache_event_group = xEventGroupCreateStatic(&dns_cache_event_group_struct);
+#else
+		dns_cache_event_group = xEventGroupCreate();
+#endif
+	}
+}
+
+// Resolves a host name through the cache
+esp_err_t dnsCache_resolve(const char * host, uint32_t * addr_p)
+{
+	bool has_addr;
+	bool waiting;
+	int index;
+
+	if (host == NULL || addr_p == NULL || strlen(host) >= DNS_CACHE_HOST_LEN)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	index = dnsCache_start(host, addr_p, &has_addr, &waiting);
+	if (index < 0)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+	if (has_addr)
+	{
+		// Fresh, or stale while the refresh runs in background
+		return ESP_OK;
+	}
+	if (!waiting)
+	{
+		// Failed recently, don't hammer the server
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	// First lookup of this host, wait for the tcpip thread
+	xEventGroupWaitBits(dns_cache_event_group, 1U << index, pdFALSE, pdTRUE, pdMS_TO_TICKS(DNS_CACHE_WAIT_MS));
+
+	esp_err_t err = ESP_ERR_TIMEOUT;
+	taskENTER_CRITICAL(&dns_cache_mux);
+	// The entry may have been reused while waiting, look it up again
+	index = dnsCache_find(host);
+	if (index >= 0 && g_entries[index].has_addr)
+	{
+		*addr_p = g_entries[index].addr;
+		err = ESP_OK;
+	}
+	else if (index >= 0 && !g_entries[index].refreshing)
+	{
+		err = ESP_ERR_NOT_FOUND;
+	}
+	taskEXIT_CRITICAL(&dns_cache_mux);
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGW(TAG, "dnsCache_resolve: %s failed (%s)", host, esp_err_to_name(err));
+	}
+	return err;
+}
+
+// Starts resolving a host in background without waiting
+void dnsCache_prefetch(const char * host)
+{
+	uint32_t addr;
+	bool has_addr;
+	bool waiting;
+
+	if (host != NULL && strlen(host) < DNS_CACHE_HOST_LEN)
+	{
+		dnsCache_start(host, &addr, &has_addr, &waiting);
+	}
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Finds a host on the table, the lock must be held
+ * @param host
+ * @return int index, -1 when not found
+ */
+static int dnsCache_find(const char * host)
+{
+	for (int i = 0; i < DNS_CACHE_SIZE; i++)
+	{
+		if (g_entries[i].host[0] != '\0' && strcmp(g_entries[i].host, host) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Takes an empty or the least recently used entry, the lock must be held
+ * @details entries being resolved are never replaced
+ * @param host
+ * @param now_us
+ * @return int index, -1 when every entry is being resolved
+ */
+static int dnsCache_alloc(const char * host, int64_t now_us)
+{
+	int index = -1;
+
+	for (int i = 0; i < DNS_CACHE_SIZE; i++)
+	{
+		if (g_entries[i].refreshing)
+		{
+			continue;
+		}
+		if (index < 0 || g_entries[i].host[0] == '\0' || g_entries[i].used_us < g_entries[index].used_us)
+		{
+			index = i;
+			if (g_entries[i].host[0] == '\0')
+			{
+				break;
+			}
+		}
+	}
+
+	if (index >= 0)
+	{
+		memset(&g_entries[index], 0x00, sizeof(dns_cache_entry_t));
+		strcpy(g_entries[index].host, host);
+		g_entries[index].used_us = now_us;
+	}
+	return index;
+}
+
+/**
+ * @brief Looks a host up on the table and starts a refresh when it expired
+ * @param host
+ * @param addr_p last address known
+ * @param has_addr_p true when addr_p was filled
+ * @param waiting_p true while a lookup runs
+ * @return int index of the entry, -1 when the table is full
+ */
+static int dnsCache_start(const char * host, uint32_t * addr_p, bool * has_addr_p, bool * waiting_p)
+{
+	int64_t now_us = esp_timer_get_time();
+	bool start = false;
+	int index;
+
+	taskENTER_CRITICAL(&dns_cache_mux);
+	index = dnsCache_find(host);
+	if (index < 0)
+	{
+		index = dnsCache_alloc(host, now_us);
+	}
+	if (index >= 0)
+	{
+		dns_cache_entry_t * entry_p = &g_entries[index];
+
+		entry_p->used_us = now_us;
+		if (!entry_p->refreshing && now_us >= entry_p->expires_us)
+		{
+			entry_p->refreshing = true;
+			start = true;
+		}
+		*has_addr_p = entry_p->has_addr;
+		*addr_p = entry_p->addr;
+		*waiting_p = entry_p->refreshing;
+	}
+	taskEXIT_CRITICAL(&dns_cache_mux);
+
+	if (start)
+	{
+		xEventGroupClearBits(dns_cache_event_group, 1U << index);
+		if (tcpip_callback(dnsCache_lookup, (void *)(uintptr_t)index) != ERR_OK)
+		{
+			ESP_LOGE(TAG, "dnsCache_start: tcpip_callback failed for %s", host);
+			dnsCache_store(index, NULL);
+			*waiting_p = false;
+		}
+	}
+
+	return index;
+}
+
+/**
+ * @brief Starts a lookup, runs on the tcpip thread
+ * @details lwIP answers right away for dotted addresses and for hosts still
+ * valid on its own table, otherwise dnsCache_found is called later
+ * @param arg entry index
+ */
+static void dnsCache_lookup(void * arg)
+{
+	int index = (uintptr_t)arg;
+	char host[DNS_CACHE_HOST_LEN];
+	ip_addr_t ipaddr;
+	err_t err;
+
+	taskENTER_CRITICAL(&dns_cache_mux);
+	strcpy(host, g_entries[index].host);
+	taskEXIT_CRITICAL(&dns_cache_mux);
+
+	err = dns_gethostbyname(host, &ipaddr, dnsCache_found, arg);
+	if (err == ERR_OK)
+	{
+		dnsCache_store(index, &ipaddr);
+	}
+	else if (err != ERR_INPROGRESS)
+	{
+		dnsCache_store(index, NULL);
+	}
+}
+
+/**
+ * @brief lwIP DNS answer callback, runs on the tcpip thread
+ * @param name
+ * @param ipaddr NULL when the lookup failed
+ * @param arg entry index
+ */
+static void dnsCache_found(const char * name, const ip_addr_t * ipaddr, void * arg)
+{
+	dnsCache_store((uintptr_t)arg, ipaddr);
+}
+
+/**
+ * @brief Stores the result of a lookup and wakes the waiting callers
+ * @details a failure keeps the last address, it is retried after
+ * DNS_CACHE_NEGATIVE_AGE_S
+ * @param index
+ * @param ipaddr NULL when the lookup failed
+ */
+static void dnsCache_store(int index, const ip_addr_t * ipaddr)
+{
+	int64_t now_us = esp_timer_get_time();
+	dns_cache_entry_t * entry_p = &g_entries[index];
+
+	taskENTER_CRITICAL(&dns_cache_mux);
+	entry_p->refreshing = false;
+	if (ipaddr != NULL && IP_IS_V4(ipaddr))
+	{
+		entry_p->addr = ip_addr_get_ip4_u32(ipaddr);
+		entry_p->has_addr = true;
+		entry_p->expires_us = now_us + DNS_CACHE_MAX_AGE_S * 1000000LL;
+	}
+	else
+	{
+		entry_p->expires_us = now_us + DNS_CACHE_NEGATIVE_AGE_S * 1000000LL;
+	}
+	taskEXIT_CRITICAL(&dns_cache_mux);
+
+	xEventGroupSetBits(dns_cache_event_group, 1U << index);
+
+	ESP_LOGD(TAG, "%s %s", entry_p->host, (ipaddr != NULL) ? "resolved" : "failed");
+}
@@ -0,0 +1,64 @@
+/**
+ * @file dnsCache.h
+ * @brief Resolver cache shared by the outbound clients (NTP, OTA pull, MQTT)
+ * @details
+ * Lookups go through the lwIP raw DNS API on the tcpip thread, so no
+ * client task ever blocks on a DNS round trip once a host is known. lwIP
+ * keeps the record TTL in its own table; this cache adds a bounded age on
+ * top of it (DNS_CACHE_MAX_AGE_S) and refreshes expired entries in the
+ * background while the last good address keeps being served.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_DNSCACHE_H_
+#define MAIN_DNSCACHE_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdint.h>
+
+// ESP libraries
+#include "esp_err.h"
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Creates the cache synchronization objects
+ * @details must run before any other call
+ */
+void dnsCache_init(void);
+
+/**
+ * @brief Resolves a host name (or dotted IPv4 address) through the cache
+ * @details
+ * - fresh entry: returned right away
+ * - expired entry: the last address is returned and a refresh is started
+ * - unknown host: waits up to DNS_CACHE_WAIT_MS for the first answer
+ * A failed lookup is not retried before DNS_CACHE_NEGATIVE_AGE_S.
+ * @param host host name, shorter than DNS_CACHE_HOST_LEN
+ * @param addr_p IPv4 address in network byte order
+ * @return ESP_OK, ESP_ERR_NOT_FOUND, ESP_ERR_TIMEOUT, ESP_ERR_NO_MEM when
+ * every entry is being resolved, ESP_ERR_INVALID_ARG
+ */
+esp_err_t dnsCache_resolve(const char * host, uint32_t * addr_p);
+
+/**
+ * @brief Starts resolving a host in background without waiting
+ * @details useful before a client needs the address, e.g. right after
+ * the station gets an IP
+ * @param host host name
+ */
+void dnsCache_prefetch(const char * host);
+
+#endif /* MAIN_DNSCACHE_H_ */
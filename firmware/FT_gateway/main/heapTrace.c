@@ -0,0 +1,170 @@
+/**
+ * @file heapTrace.c
+ * @brief Heap allocation tracing by scenario phase
+ * @details
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdio.h>
+#include <string.h>
+
+// ESP libraries
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+// Personal libraries
+#include "heapTrace.h"
+
+#if CONFIG_GW_HEAP_TRACE
+
+#include "esp_heap_trace.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "heap_trace";
+
+// Tracer records, must be on internal RAM
+static heap_trace_record_t g_records[HEAP_TRACE_RECORDS];
+static bool g_initialized;
+
+// Running phase, only touched from the httpd task
+static bool g_running;
+static char g_name[HEAP_TRACE_NAME_LEN];
+static int64_t g_start_us;
+static size_t g_free_start;
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Starts a phase
+esp_err_t heapTrace_start(const char * name)
+{
+	if (g_running)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	if (!g_initialized)
+	{
+		ESP_ERROR_CHECK(heap_trace_init_standalone(g_records, HEAP_TRACE_RECORDS));
+		g_initialized = true;
+	}
+
+	snprintf(g_name, sizeof(g_name), "%s", name);
+	ESP_LOGI(TAG, "phase %s started", g_name);
+
+	g_start_us = esp_timer_get_time();
+	g_free_start = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+	heap_caps_monitor_local_minimum_free_size_start();
+
+	esp_err_t err = heap_trace_start(HEAP_TRACE_LEAKS);
+	if (err != ESP_OK)
+	{
+		heap_caps_monitor_local_minimum_free_size_stop();
+		return err;
+	}
+	g_running = true;
+
+	return ESP_OK;
+}
+
+// Stops the running phase
+esp_err_t heapTrace_stop(heap_trace_report_t * report_p)
+{
+	heap_trace_summary_t summary;
+	heap_trace_record_t record;
+	size_t min_free;
+
+	if (!g_running)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	heap_trace_stop();
+	// While monitoring, the minimum is the one since the phase start
+	min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+	heap_caps_monitor_local_minimum_free_size_stop();
+	g_running = false;
+
+	heap_trace_summary(&summary);
+
+	memset(report_p, 0x00, sizeof(heap_trace_report_t));
+	memcpy(report_p->name, g_name, sizeof(report_p->name));
+	report_p->duration_ms = (esp_timer_get_time() - g_start_us) / 1000;
+	report_p->allocs = summary.total_allocations;
+	report_p->frees = summary.total_frees;
+	report_p->peak_bytes = (g_free_start > min_free) ? g_free_start - min_free : 0;
+	report_p->leaked_count = summary.count;
+	report_p->overflowed = summary.has_overflowed;
+	for (size_t i = 0; i < summary.count; i++)
+	{
+		if (heap_trace_get(i, &record) == ESP_OK)
+		{
+			report_p->leaked_bytes += record.size;
+		}
+	}
+
+	ESP_LOGI(TAG, "phase %s: %lu allocs, %lu frees, peak %lu, %u leaks of %lu bytes%s",
+					report_p->name, report_p->allocs, report_p->frees, report_p->peak_bytes,
+					report_p->leaked_count, report_p->leaked_bytes,
+					report_p->overflowed ? " (records overflowed)" : "");
+
+	return ESP_OK;
+}
+
+// Reads a live allocation of the last stopped phase
+bool heapTrace_getLeak(size_t index, heap_trace_leak_t * leak_p)
+{
+	heap_trace_record_t record;
+
+	if (g_running || !g_initialized || heap_trace_get(index, &record) != ESP_OK)
+	{
+		return false;
+	}
+
+	leak_p->size = record.size;
+	for (int i = 0; i < HEAP_TRACE_CALLERS; i++)
+	{
+		leak_p->callers[i] = (uint32_t)(uintptr_t)record.alloced_by[i];
+	}
+	return true;
+}
+
+#else
+
+// Starts a phase
+esp_err_t heapTrace_start(const char * name)
+{
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+// Stops the running phase
+esp_err_t heapTrace_stop(heap_trace_report_t * report_p)
+{
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+// Reads a live allocation of the last stopped phase
+bool heapTrace_getLeak(size_t index, heap_trace_leak_t * leak_p)
+{
+	return false;
+}
+
+#endif /* CONFIG_GW_HEAP_TRACE */
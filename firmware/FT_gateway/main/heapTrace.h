@@ -0,0 +1,106 @@
+/**
+ * @file heapTrace.h
+ * @brief Heap allocation tracing by scenario phase
+ * @details
+ * Wraps the IDF standalone heap tracer in leak mode. A phase starts the
+ * tracer and the local minimum free heap monitor, stopping it gives the
+ * allocations and frees done meanwhile, the most heap taken above the
+ * start and every allocation still alive with its callers. The phases are
+ * driven from a host over /sys/heap (see tools/heap_scenario.py), the
+ * callers are turned into modules there, with the ELF file.
+ * Needs CONFIG_GW_HEAP_TRACE, otherwise every call answers
+ * ESP_ERR_NOT_SUPPORTED.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_HEAPTRACE_H_
+#define MAIN_HEAPTRACE_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ESP libraries
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+#ifdef CONFIG_HEAP_TRACING_STACK_DEPTH
+#define HEAP_TRACE_CALLERS		CONFIG_HEAP_TRACING_STACK_DEPTH
+#else
+#define HEAP_TRACE_CALLERS		1
+#endif
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief Figures of a finished phase
+ */
+typedef struct heap_trace_report_s
+{
+	char		name[HEAP_TRACE_NAME_LEN];
+	uint32_t	duration_ms;
+	uint32_t	allocs;
+	uint32_t	frees;
+	uint32_t	peak_bytes;		///> most heap taken above the phase start
+	uint32_t	leaked_bytes;	///> allocated during the phase and still alive
+	uint16_t	leaked_count;
+	bool		overflowed;		///> more live allocations than HEAP_TRACE_RECORDS, the leaks are partial
+} heap_trace_report_t;
+
+/**
+ * @brief Allocation still alive at the end of a phase
+ */
+typedef struct heap_trace_leak_s
+{
+	uint32_t	size;
+	uint32_t	callers[HEAP_TRACE_CALLERS];	///> return addresses, innermost first
+} heap_trace_leak_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Starts a phase
+ * @param name reported back by heapTrace_stop
+ * @return esp_err_t ESP_ERR_INVALID_STATE when a phase is running
+ */
+esp_err_t heapTrace_start(const char * name);
+
+/**
+ * @brief Stops the running phase
+ * @details the live allocations stay readable with heapTrace_getLeak until
+ * the next phase starts
+ * @param report_p destination
+ * @return esp_err_t ESP_ERR_INVALID_STATE when no phase is running
+ */
+esp_err_t heapTrace_stop(heap_trace_report_t * report_p);
+
+/**
+ * @brief Reads a live allocation of the last stopped phase
+ * @param index from 0 to leaked_count - 1
+ * @param leak_p destination
+ * @return true when there is one
+ */
+bool heapTrace_getLeak(size_t index, heap_trace_leak_t * leak_p);
+
+#endif /* MAIN_HEAPTRACE_H_ */
@@ -11,6 +11,7 @@
 **************************/
 
 // C libraries
+#include <errno.h>
 
 // ESP libraries
 #include "freertos/FreeRTOS.h"
@@ -18,8 +19,10 @@
 #include "esp_http_server.h"
 #include "esp_log.h"
 #include "freertos/idf_additions.h"
+#include "lwip/sockets.h"
 
 // Personal libraries
+#include "bootProfile.h"
 #include "httpServer.h"
 #include "tasks_common.h"
 
@@ -34,43 +37,39 @@
 // Tag used for ESP serial console messages
 static const char TAG[] = "http_server";
 
-// WiFi connect status
-http_server_wifi_connect_status_e g_wifi_connect_status = NONE;
-
 // HTTP server task handle
 static httpd_handle_t http_server_handle = NULL; ///> used on start and stop server
 
+// Set while one task starts or stops the server, app_main and the WiFi task both start it
+static bool http_server_busy;
+
 // Embedded files: JQuery, index.html, app.css, app.js and favicon.ico files
 #define X(uri_handler, file, http_resp_type, start, end) \
 	extern const uint8_t uri_handler##_start[]	asm(#start); \
 	extern const uint8_t uri_handler##_end[]	asm(#end);
 	X_MACRO_HTTP_SERVER_URI_HANDLER_LIST
 #undef X
+
+// One URI handler per web page file, plus the API routes
+#define X(uri_handler, file, http_resp_type, start, end) + 1
+static const size_t http_server_file_handlers = 0 X_MACRO_HTTP_SERVER_URI_HANDLER_LIST;
+#undef X
+static size_t http_server_api_handlers = 0;
 	
 	/* Function Pointers */
 void (* httpServer_uri_setApiRoutes_fp)(void);
 
 
-	/* FreeRTOS Structures */
-
-// HTTP server monitor task handle
-static TaskHandle_t task_http_server_monitor = NULL;
-
-// Queue handle used to manipulate the main queue of events
-static QueueHandle_t http_server_monitor_queue_handle;
-
-
 	/* Static Functions */
 
-// FreeRTOS functions
-static void httpServer_freeRTOS_monitor(void * parameter);
-static void httpServer_freeRTOS_setup(void);
-static void httpServer_freeRTOS_endTask(void);
-
 // App functions
 static void httpServer_configure(httpd_config_t * config);
+static esp_err_t httpServer_sessionOpen(httpd_handle_t hd, int sockfd);
+static int httpServer_firstSend(httpd_handle_t hd, int sockfd, const char * buf, size_t buf_len, int flags);
 static void httpServer_uri_setFilesHandlersAndRoutes(void);
 static void httpServer_uri_setRoutesFromOtherFiles(void);
+static void httpServer_lock(void);
+static void httpServer_unlock(void);
 
 
 
@@ -78,16 +77,11 @@ static void httpServer_uri_setRoutesFromOtherFiles(void);
 ** UPPERLAYER FUNCTIONS	 **
 **************************/
 
-// Returns the g_wifi_connect_status
-http_server_wifi_connect_status_e * httpServer_get_wifiConnectStatus(void)
-{
-	return &g_wifi_connect_status;
-}
-
 // Function to get routers from another file to be declared here.
-void httpServer_setApiRoutes(void (*apiFunction)(void))
+void httpServer_setApiRoutes(void (*apiFunction)(void), size_t count)
 {
 	httpServer_uri_setApiRoutes_fp = apiFunction;
+	http_server_api_handlers = count;
 }
 
 // Function to register an HTTP uri.
@@ -99,92 +93,13 @@ void httpServer_uri_registerHandler(const char* route, httpd_method_t method, es
 		.handler	= handler,
 		.user_ctx	= NULL,
 	};
-	httpd_register_uri_handler(http_server_handle, &(uri_handler));
-}
-
-
-/**************************
-**	FreeRTOS FUNCTIONS	 **
-**************************/
-
-/**
- * @brief HTTP server monitor task used to track events of the HTTP server
- * @param pvParameters parameter which can be passed to the task.
- */
-static void httpServer_freeRTOS_monitor(void * parameter)
-{
-	http_server_queue_message_t msg;
-	
-	for(;;)
+	esp_err_t err = httpd_register_uri_handler(http_server_handle, &(uri_handler));
+	if (err != ESP_OK)
 	{
-		if(xQueueReceive(http_server_monitor_queue_handle, &msg, portMAX_DELAY))
-		{
-			switch (msg.msgId)
-			{
-				case HTTP_WIFI_CONNECT_INIT:
-					ESP_LOGI(TAG, "HTTP_WIFI_CONNECT_INIT");
-					
-					g_wifi_connect_status = HTTP_WIFI_STATUS_CONNECTING;
-					
-					break;
-					
-				case HTTP_WIFI_CONNECT_SUCCESS:
-					ESP_LOGI(TAG, "HTTP_WIFI_CONNECT_SUCCESS");
-					
-					g_wifi_connect_status = HTTP_WIFI_STATUS_CONNECT_SUCCESS;
-					
-					break;
-					
-				case HTTP_WIFI_CONNECT_FAIL:
-					ESP_LOGI(TAG, "HTTP_WIFI_CONNECT_FAIL");
-					
-					g_wifi_connect_status = HTTP_WIFI_STATUS_CONNECT_FAILED;
-					break;
-					
-				default:
-					break;
-			}
-		}
+		ESP_LOGE(TAG, "httpServer_uri_registerHandler: %s not registered: %s", route, esp_err_to_name(err));
 	}
 }
 
-/**
- * Setup the FreeRTOS environment for HTTP server.
- */
-static void httpServer_freeRTOS_setup(void)
-{
-	// Create HTTP server monitor task
-	xTaskCreatePinnedToCore(&httpServer_freeRTOS_monitor,
-							"httpServer_monitor",
-							HTTP_SERVER_MONITOR_STACK_SIZE,
-							NULL,
-							HTTP_SERVER_MONITOR_PRIORITY,
-							&task_http_server_monitor,
-							HTTP_SERVER_MONITOR_CORE_ID);
-	
-	// Create the message queue
-	http_server_monitor_queue_handle = xQueueCreate(3, sizeof(http_server_queue_message_t));
-}
-
-static void httpServer_freeRTOS_endTask(void)
-{
-	if(task_http_server_monitor)
-	{
-		vTaskDelete(task_http_server_monitor);
-		ESP_LOGI(TAG, "httpServer_freeRTOS_endTask: stopping HTTP server monitor");
-		task_http_server_monitor = NULL;
-	}
-}
-
-// Sends a message to the queue
-BaseType_t httpServer_monitor_sendMessage(http_server_state_e msgId)
-{
-	http_server_queue_message_t msg;
-	msg.msgId = msgId;
-	return xQueueSend(http_server_monitor_queue_handle, &msg, portMAX_DELAY);
-}
-
-
 
 /**************************
 **	   APP FUNCTIONS	 **
@@ -226,18 +141,58 @@ static void httpServer_configure(httpd_config_t * config)
 	// Bump up the stack size (default is 4096)
 	config->stack_size = HTTP_SERVER_STACK_SIZE;
 	
-	// Increase uri handlers
-	config->max_uri_handlers = HTTP_SERVER_MAX_URI_HANDLERS;
+	// One slot per web page file and API route
+	config->max_uri_handlers = http_server_file_handlers + http_server_api_handlers;
 	
 	// Increase the timeout limits
 	config->recv_wait_timeout = HTTP_SERVER_TIMEOUT_LIMIT;
 	config->send_wait_timeout = HTTP_SERVER_TIMEOUT_LIMIT;
 	
+	// Catches the first byte sent after the boot
+	config->open_fn = httpServer_sessionOpen;
+	
 	ESP_LOGI(TAG, "httpServer_configure: Starting server on port: '%d' with task priority: '%d'",
 					config->server_port,
 					config->task_priority);
 }
 
+/**
+ * Session open callback, the sessions opened until the first answer send
+ * through httpServer_firstSend.
+ * @param hd server
+ * @param sockfd session socket
+ * @return ESP_OK, the session is kept
+ */
+static esp_err_t httpServer_sessionOpen(httpd_handle_t hd, int sockfd)
+{
+	if (!bootProfile_isMarked(BOOT_MARKER_HTTP_FIRST_BYTE))
+	{
+		httpd_sess_set_send_override(hd, sockfd, httpServer_firstSend);
+	}
+	return ESP_OK;
+}
+
+/**
+ * Send function of the first sessions, the httpd default one plus the
+ * BOOT_MARKER_HTTP_FIRST_BYTE marker
+ * @return bytes sent or HTTPD_SOCK_ERR_*
+ */
+static int httpServer_firstSend(httpd_handle_t hd, int sockfd, const char * buf, size_t buf_len, int flags)
+{
+	if (buf == NULL)
+	{
+		return HTTPD_SOCK_ERR_INVALID;
+	}
+
+	int ret = send(sockfd, buf, buf_len, flags);
+	if (ret < 0)
+	{
+		return (errno == EAGAIN || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+	}
+	bootProfile_mark(BOOT_MARKER_HTTP_FIRST_BYTE);
+	return ret;
+}
+
 /**
  * Registers the URI handlers
  */
@@ -259,23 +214,43 @@ static void httpServer_uri_setRoutesFromOtherFiles(void)
 	}
 }
  
+/**
+ * @brief Waits for the other task starting or stopping the server
+ * @details the server isn't up yet when this is first needed, too early
+ * for a mutex created on demand
+ */
+static void httpServer_lock(void)
+{
+	bool idle = false;
+
+	while (!__atomic_compare_exchange_n(&http_server_busy, &idle, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	{
+		idle = false;
+		vTaskDelay(1);
+	}
+}
+
+static void httpServer_unlock(void)
+{
+	__atomic_store_n(&http_server_busy, false, __ATOMIC_RELEASE);
+}
+
 /**
  * Starts the HTTP server.
  */
 void httpServer_start(void)
 {
+	httpServer_lock();
 	if (http_server_handle == NULL)
 	{
 		// Initializing and configurating the structure
 		httpd_config_t config = HTTPD_DEFAULT_CONFIG();
 		httpServer_configure(&config);
 		
-		// Create HTTP server monitor task and the message queue
-		httpServer_freeRTOS_setup();
-		
 		//Start the httpd server
 		if (httpd_start(&http_server_handle, &config) == ESP_OK)
 		{
+			bootProfile_mark(BOOT_MARKER_HTTP_READY);
 			ESP_LOGI(TAG, "httpServer_configure: Registering URI handlers");
 			httpServer_uri_setFilesHandlersAndRoutes();
 			httpServer_uri_setRoutesFromOtherFiles();
@@ -284,6 +259,7 @@ void httpServer_start(void)
 			http_server_handle = NULL;
 		}
 	}
+	httpServer_unlock();
 }
 
 /**
@@ -291,12 +267,12 @@ void httpServer_start(void)
  */
 void httpServer_stop(void)
 {
+	httpServer_lock();
 	if (http_server_handle)
 	{
 		httpd_stop(http_server_handle);
 		ESP_LOGI(TAG, "httpServer_stop: stopping HTTP server");
 		http_server_handle = NULL;
 	}
-	// Stop monitor task
-	httpServer_freeRTOS_endTask();
+	httpServer_unlock();
 }
\ No newline at end of file
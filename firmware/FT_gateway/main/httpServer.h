@@ -24,22 +24,11 @@
 #define URI_FUNCTION_HANDLER_NAME(uri_handler) http_server_ ## uri_handler ## _handler
 #define BINARY_START(bin,uri_handler,s) #bin###uri_handler###s
 
-#define HTTP_SERVER_MAX_URI_HANDLERS	20
-
 /**
  * @brief Server timeout in seconds
  */
 #define HTTP_SERVER_TIMEOUT_LIMIT		10 //seconds
 
-/**
- * @brief Creating Server State list with X_MACRO 
- * 
- */
-#define X_MACRO_HTTP_SERVER_STATE_LIST	\
-	X(0, HTTP_WIFI_CONNECT_INIT			) \
-	X(1, HTTP_WIFI_CONNECT_SUCCESS		) \
-	X(2, HTTP_WIFI_CONNECT_FAIL			)
-
 /**
  * @brief Creating Routes with X_MACRO
  * 
@@ -52,52 +41,13 @@
 	X(app_js,				"/app.js",				"application/javascript", _binary_app_js_start, 				_binary_app_js_end				) \
 	X(favicon_ico,			"/favicon_ico",			"image/x-icon"			, _binary_favicon_ico_start, 			_binary_favicon_ico_end			)
 
-/**************************
-**		STRUCTURES		 **
-**************************/
-
-/**
- * Connection status for WiFi
- */
-typedef enum http_server_wifi_connect_status
-{
-	NONE = 0,
-	HTTP_WIFI_STATUS_CONNECTING,
-	HTTP_WIFI_STATUS_CONNECT_FAILED,
-	HTTP_WIFI_STATUS_CONNECT_SUCCESS,
-} http_server_wifi_connect_status_e;
-
-/**
- * Messages for the HTTP monitor
- */
-typedef enum http_server_state
-{
-	#define X(ID, ENUM) ENUM=ID, 
-		X_MACRO_HTTP_SERVER_STATE_LIST
-	#undef X
-} http_server_state_e;
-
-/**
- * Structure for the message queue
- */
-typedef struct http_server_queue_message_s
-{
-	http_server_state_e msgId;
-} http_server_queue_message_t;
-
 /**************************
 **		FUNCTIONS		 **
 **************************/
 
 /**
- * @brief Sends a message to the queue
- * @param msgId message ID from the http_server_state_e enum.
- * @return pdTRUE if an item was successfully sent to the queue, otherwise pdFALSE.
- */
-BaseType_t httpServer_monitor_sendMessage(http_server_state_e msgId);
- 
-/**
- * Starts the HTTP server.
+ * Starts the HTTP server, nothing when already running. Safe from any task,
+ * a concurrent call waits for the first one.
  */
 void httpServer_start(void);
 
@@ -116,21 +66,16 @@ void ota_fw_update_reset_callback(void *arg);
 ** UPPERLAYER FUNCTIONS	 **
 **************************/
 
-/**
- * @brief Returns the g_wifi_connect_status
- * 
- * @return http_server_wifi_connect_status_e * 
- */
-http_server_wifi_connect_status_e * httpServer_get_wifiConnectStatus(void);
-
 /**
  * Function to get routers from another file to be declared here.
  * Separating the include files routes, from the api ones.
  * 
  * @param apiFunction a function from an upper layer, where other
  * uri routes are declared with the httpServer_uri_registerHandler function.
+ * @param count routes apiFunction registers, the handler table is sized
+ * from it and the web page files
  */
-void httpServer_setApiRoutes(void (*function)(void));
+void httpServer_setApiRoutes(void (*function)(void), size_t count);
 
 /**
  * Function to register an HTTP uri.
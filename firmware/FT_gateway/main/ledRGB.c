@@ -12,10 +12,16 @@
 **************************/
 
 // C libraries
+#include <math.h>
 #include <stdio.h>
 
 // ESP libraries
 #include "driver/ledc.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/timers.h"
+#include "sdkconfig.h"
 
 // Personal libraries
 #include "ledRGB.h"
@@ -25,19 +31,111 @@
 **		DECLARATIONS	 **
 **************************/
 
+/**
+ * @brief Tag used for ESP serial console messages
+ */
+static const char TAG[] = "led_rgb";
+
 /**
  * @brief RGB LED Configuration Array
  */
 ledRGB_info_t led_channels[RGB_LED_CHANNEL_NUM];
 
 /**
- * @brief Static function to set Led color
- * 
- * @param red 
- * @param green 
- * @param blue 
+ * @brief Pattern steps, the colors of the former solid states are kept
+ */
+static const led_step_t ledRGB_steps_LED_PATTERN_WIFI_APP_STARTED[] =
+{
+	{ 255, 102, 255,  300,   0 },
+};
+static const led_step_t ledRGB_steps_LED_PATTERN_WIFI_DISCONNECTED[] =
+{
+	{ 204, 255,  51,  300,   0 },
+};
+static const led_step_t ledRGB_steps_LED_PATTERN_WIFI_CONNECTED[] =
+{
+	{   0, 255, 153,  300,   0 },
+};
+static const led_step_t ledRGB_steps_LED_PATTERN_WIFI_DISCONNECT[] =
+{
+	{ 199,   0,   0,  300,   0 },
+};
+static const led_step_t ledRGB_steps_LED_PATTERN_WIFI_RECONNECTING[] =
+{
+	{ 255, 160,   0,  100, 400 },
+	{   0,   0,   0,  100, 400 },
+};
+static const led_step_t ledRGB_steps_LED_PATTERN_OTA_IN_PROGRESS[] =
+{
+	{   0,   0, 255, 1000,   0 },
+	{   0,   0,  24, 1000,   0 },
+};
+static const led_step_t ledRGB_steps_LED_PATTERN_OTA_FAILED[] =
+{
+	{ 255,   0,   0,    0, 150 },
+	{   0,   0,   0,    0, 150 },
+};
+
+/**
+ * @brief Pattern table
+ */
+static const struct
+{
+	const led_step_t *	steps;
+	uint8_t				count;
+	bool				state;
+	uint8_t				repeat;
+} led_patterns[LED_PATTERN_COUNT] =
+{
+#define X(ID, ENUM, STATE, REPEAT) \
+	[ID] = { ledRGB_steps_##ENUM, sizeof(ledRGB_steps_##ENUM) / sizeof(led_step_t), STATE, REPEAT },
+	X_MACRO_LED_PATTERN_LIST
+#undef X
+};
+
+/**
+ * @brief Perceived brightness (0-255) to duty
+ */
+static uint16_t led_gamma[256];
+
+/**
+ * @brief Pattern engine state, only touched from the timer service task
+ */
+static led_pattern_t g_pattern;
+static led_pattern_t g_base = LED_PATTERN_WIFI_APP_STARTED;
+static uint8_t g_step;
+static uint8_t g_round;
+static uint8_t g_pending;
+static uint16_t g_duty[RGB_LED_CHANNEL_NUM];
+
+/**
+ * @brief Bumped on every pattern change, late fade ends and holds are dropped
+ */
+static volatile uint32_t g_generation;
+
+/**
+ * @brief Generation each channel started its fade under, read by the fade end interrupt
  */
-static void ledRGB_setColor(uint8_t red, uint8_t green, uint8_t blue);
+static volatile uint32_t g_fade_generation[RGB_LED_CHANNEL_NUM];
+
+/**
+ * @brief One-shot timer for the hold time of a step
+ */
+static TimerHandle_t led_hold_timer;
+#if CONFIG_GW_STATIC_ALLOCATION
+static StaticTimer_t led_hold_timer_struct;
+#endif
+
+/**
+ * @brief Pattern engine functions
+ */
+static void ledRGB_patternStart(void * param, uint32_t pattern);
+static void ledRGB_stepStart(void);
+static void ledRGB_stepHold(void);
+static void ledRGB_stepNext(void);
+static void ledRGB_fadeEnd(void * param, uint32_t generation);
+static void ledRGB_holdEnd(TimerHandle_t timer);
+static bool ledRGB_fadeEnd_isr(const ledc_cb_param_t * param, void * user_arg);
 
 
 
@@ -106,8 +204,8 @@ static void ledRGB_setColor(uint8_t red, uint8_t green, uint8_t blue);
 	 // Configure timer zero
 	 ledc_timer_config_t ledc_timer =
 	 {
-		 .duty_resolution	= LEDC_TIMER_8_BIT,
-		 .freq_hz			= 100, //hertz
+		 .duty_resolution	= LED_PWM_RESOLUTION,
+		 .freq_hz			= LED_PWM_FREQ_HZ, //hertz
 		 .speed_mode		= LED_PWM_SPEED,
 		 .timer_num			= LED_PWM_TIMER_INDEX
 	 };
@@ -118,49 +216,253 @@ static void ledRGB_setColor(uint8_t red, uint8_t green, uint8_t blue);
 	 	ledRGB_config(LEDC_CHANNEL_##channel, pin, speedMode, timerIndex);
 	 	X_MACRO_LED
 	 #undef X
- }
- 
 
-/**
- * @brief Sets the RGB color.
- * 
- * @param red 
- * @param green 
- * @param blue 
- */
- static void ledRGB_setColor(uint8_t red, uint8_t green, uint8_t blue)
- {
-	 ledc_set_duty(led_channels[0].mode, led_channels[0].channel, red);
-	 ledc_update_duty(led_channels[0].mode, led_channels[0].channel);
+	 // Gamma curve, so fades look linear to the eye
+	 for (int i = 0; i < 256; i++)
+	 {
+		 led_gamma[i] = (uint16_t)(powf(i / 255.0f, LED_GAMMA) * LED_PWM_DUTY_MAX + 0.5f);
+	 }
 
-	 ledc_set_duty(led_channels[1].mode, led_channels[1].channel, green);
-	 ledc_update_duty(led_channels[1].mode, led_channels[1].channel);
-	 
-	 ledc_set_duty(led_channels[2].mode, led_channels[2].channel, blue);
-	 ledc_update_duty(led_channels[2].mode, led_channels[2].channel);
+	 // Hardware fades, the end of each one raises an interrupt
+	 ledc_fade_func_install(0);
+	 ledc_cbs_t callbacks = { .fade_cb = ledRGB_fadeEnd_isr };
+	 for (int i = 0; i < RGB_LED_CHANNEL_NUM; i++)
+	 {
+		 ledc_cb_register(led_channels[i].mode, led_channels[i].channel, &callbacks, (void *)(uintptr_t)i);
+	 }
+
+#if CONFIG_GW_STATIC_ALLOCATION
+	 led_hold_timer = xTimerCreateStatic("led_hold", 1, pdFALSE, NULL, ledRGB_holdEnd, &led_hold_timer_struct);
+#else
+	 led_hold_timer = xTimerCreate("led_hold", 1, pdFALSE, NULL, ledRGB_holdEnd);
+#endif
  }
+
+// Plays a pattern
+void ledRGB_setPattern(led_pattern_t pattern)
+{
+	if (pattern >= LED_PATTERN_COUNT)
+	{
+		return;
+	}
+	// Every change runs on the timer service task, no lock needed
+	if (xTimerPendFunctionCall(ledRGB_patternStart, NULL, pattern, 0) != pdPASS)
+	{
+		ESP_LOGW(TAG, "ledRGB_setPattern: timer queue full, pattern %d dropped", pattern);
+	}
+}
+
+// Ends an activity pattern and shows the gateway state again
+void ledRGB_restore(void)
+{
+	if (xTimerPendFunctionCall(ledRGB_patternStart, NULL, LED_PATTERN_COUNT, 0) != pdPASS)
+	{
+		ESP_LOGW(TAG, "ledRGB_restore: timer queue full");
+	}
+}
  
+
 // Color to indicate Wifi application has started.
 void ledRGB_wifiApp_started(void)
 {
-	ledRGB_setColor(255, 102, 255);
+	ledRGB_setPattern(LED_PATTERN_WIFI_APP_STARTED);
 }
 
 // Color to indicate HTTP server has started.
 void ledRGB_wifi_disconnected(void)
 {
-	ledRGB_setColor(204, 255, 51);
+	ledRGB_setPattern(LED_PATTERN_WIFI_DISCONNECTED);
 }
 
 // Color to indicate that the ESP32 is connected to an access point.
 void ledRGB_wifi_connected(void)
 {
-	ledRGB_setColor(0, 255, 153);
+	ledRGB_setPattern(LED_PATTERN_WIFI_CONNECTED);
 }
 
 
 // Color to indicate that the ESP32 has disconnected from access point.
 void ledRGB_wifi_disconnect(void)
 {
-	ledRGB_setColor(199, 0, 0);
-}
\ No newline at end of file
+	ledRGB_setPattern(LED_PATTERN_WIFI_DISCONNECT);
+}
+
+// Blinks while the station retries the connection.
+void ledRGB_wifi_reconnecting(void)
+{
+	ledRGB_setPattern(LED_PATTERN_WIFI_RECONNECTING);
+}
+
+
+
+/**************************
+**	  PATTERN ENGINE	 **
+**************************/
+
+/**
+ * @brief Starts a pattern from its first step, runs on the timer service task
+ * @param param unused
+ * @param pattern LED_PATTERN_COUNT resumes the last state pattern
+ */
+static void ledRGB_patternStart(void * param, uint32_t pattern)
+{
+	if (pattern >= LED_PATTERN_COUNT)
+	{
+		pattern = g_base;
+	}
+
+	g_generation++;
+	xTimerStop(led_hold_timer, 0);
+
+	// Fades still running stop where they are
+	for (int i = 0; i < RGB_LED_CHANNEL_NUM; i++)
+	{
+		if (g_pending > 0)
+		{
+			ledc_fade_stop(led_channels[i].mode, led_channels[i].channel);
+			g_duty[i] = ledc_get_duty(led_channels[i].mode, led_channels[i].channel);
+		}
+	}
+
+	if (led_patterns[pattern].state)
+	{
+		g_base = pattern;
+	}
+	g_pattern = pattern;
+	g_step = 0;
+	g_round = 0;
+	ledRGB_stepStart();
+}
+
+/**
+ * @brief Starts the fades of the current step
+ * @details channels already at the target are left alone, so a step
+ * only waits for the fade ends that will really come
+ */
+static void ledRGB_stepStart(void)
+{
+	const led_step_t * step_p = &led_patterns[g_pattern].steps[g_step];
+	const uint8_t color[RGB_LED_CHANNEL_NUM] = { step_p->red, step_p->green, step_p->blue };
+
+	g_pending = 0;
+	for (int i = 0; i < RGB_LED_CHANNEL_NUM; i++)
+	{
+		uint16_t target = led_gamma[color[i]];
+
+		if (target == g_duty[i])
+		{
+			continue;
+		}
+		g_duty[i] = target;
+
+		if (step_p->fade_ms == 0)
+		{
+			ledc_set_duty(led_channels[i].mode, led_channels[i].channel, target);
+			ledc_update_duty(led_channels[i].mode, led_channels[i].channel);
+		}
+		else
+		{
+			ledc_set_fade_with_time(led_channels[i].mode, led_channels[i].channel, target, step_p->fade_ms);
+			g_fade_generation[i] = g_generation;
+			ledc_fade_start(led_channels[i].mode, led_channels[i].channel, LEDC_FADE_NO_WAIT);
+			g_pending++;
+		}
+	}
+
+	if (g_pending == 0)
+	{
+		ledRGB_stepHold();
+	}
+}
+
+/**
+ * @brief Holds the color of the current step
+ */
+static void ledRGB_stepHold(void)
+{
+	uint16_t hold_ms = led_patterns[g_pattern].steps[g_step].hold_ms;
+
+	if (hold_ms == 0)
+	{
+		ledRGB_stepNext();
+		return;
+	}
+
+	vTimerSetTimerID(led_hold_timer, (void *)(uintptr_t)g_generation);
+	xTimerChangePeriod(led_hold_timer, pdMS_TO_TICKS(hold_ms) > 0 ? pdMS_TO_TICKS(hold_ms) : 1, 0);
+}
+
+/**
+ * @brief Moves to the next step, round or pattern
+ */
+static void ledRGB_stepNext(void)
+{
+	uint8_t count = led_patterns[g_pattern].count;
+	uint8_t repeat = led_patterns[g_pattern].repeat;
+
+	// A solid color stays as it is, nothing runs until the next change
+	if (count == 1 && repeat == 0)
+	{
+		return;
+	}
+
+	if (++g_step >= count)
+	{
+		g_step = 0;
+		g_round++;
+		if (repeat > 0 && g_round >= repeat)
+		{
+			ledRGB_patternStart(NULL, g_base);
+			return;
+		}
+	}
+	ledRGB_stepStart();
+}
+
+/**
+ * @brief One channel finished its fade, runs on the timer service task
+ * @param param unused
+ * @param generation of the pattern that started the fade
+ */
+static void ledRGB_fadeEnd(void * param, uint32_t generation)
+{
+	if (generation != g_generation || g_pending == 0)
+	{
+		return;
+	}
+	if (--g_pending == 0)
+	{
+		ledRGB_stepHold();
+	}
+}
+
+/**
+ * @brief Hold timer callback, runs on the timer service task
+ * @param timer
+ */
+static void ledRGB_holdEnd(TimerHandle_t timer)
+{
+	if ((uint32_t)(uintptr_t)pvTimerGetTimerID(timer) == g_generation)
+	{
+		ledRGB_stepNext();
+	}
+}
+
+/**
+ * @brief LEDC fade end interrupt, defers the work to the timer service task
+ * @details passes the generation the fade started under, a fade stopped by
+ * a pattern change is not counted against the new pattern
+ * @param param
+ * @param user_arg index of the channel on led_channels
+ * @return true when a higher priority task was woken
+ */
+static bool IRAM_ATTR ledRGB_fadeEnd_isr(const ledc_cb_param_t * param, void * user_arg)
+{
+	BaseType_t woken = pdFALSE;
+
+	if (param->event == LEDC_FADE_END_EVT)
+	{
+		xTimerPendFunctionCallFromISR(ledRGB_fadeEnd, NULL, g_fade_generation[(uintptr_t)user_arg], &woken);
+	}
+	return woken == pdTRUE;
+}
@@ -15,6 +15,7 @@
 **************************/
 
 // C libraries
+#include <stdbool.h>
 #include <stdio.h>
 
 // Personal libraries
@@ -31,6 +32,10 @@
 
 #define LED_PWM_SPEED LEDC_LOW_SPEED_MODE
 #define LED_PWM_TIMER_INDEX LEDC_TIMER_1
+#define LED_PWM_FREQ_HZ 100
+#define LED_PWM_RESOLUTION LEDC_TIMER_10_BIT	///> finer than 8 bits, the gamma curve needs the low end
+#define LED_PWM_DUTY_MAX ((1 << 10) - 1)
+#define LED_GAMMA 2.2f							///> perceived brightness to duty
 
 /**
  * @brief X MACRO for LED
@@ -40,12 +45,53 @@
 	X(1, RGB_LED_GREEN_GPIO,	LED_PWM_SPEED, LED_PWM_TIMER_INDEX) \
 	X(2, RGB_LED_BLUE_GPIO,		LED_PWM_SPEED, LED_PWM_TIMER_INDEX)
 
+/**
+ * @brief X MACRO for the LED patterns
+ * @details columns: ID, ENUM, STATE, REPEAT
+ * - STATE: the pattern shows a gateway state and is resumed when an
+ *   alert ends
+ * - REPEAT: rounds played, 0 loops until another pattern is set;
+ *   a finite pattern resumes the last state pattern when it ends
+ * The steps of each pattern are ledRGB_steps_<ENUM> on ledRGB.c
+ */
+#define X_MACRO_LED_PATTERN_LIST \
+	X(0, LED_PATTERN_WIFI_APP_STARTED,		true,	0) \
+	X(1, LED_PATTERN_WIFI_DISCONNECTED,		true,	0) \
+	X(2, LED_PATTERN_WIFI_CONNECTED,		true,	0) \
+	X(3, LED_PATTERN_WIFI_DISCONNECT,		true,	0) \
+	X(4, LED_PATTERN_WIFI_RECONNECTING,		true,	0) \
+	X(5, LED_PATTERN_OTA_IN_PROGRESS,		false,	0) \
+	X(6, LED_PATTERN_OTA_FAILED,			false,	3)
+
 
 
 /**************************
 **		STRUCTURES		 **
 **************************/
 
+/**
+ * @brief LED patterns
+ */
+typedef enum led_pattern_e
+{
+#define X(ID, ENUM, STATE, REPEAT) ENUM = ID,
+	X_MACRO_LED_PATTERN_LIST
+#undef X
+	LED_PATTERN_COUNT
+} led_pattern_t;
+
+/**
+ * @brief One step of a pattern: fade to the color, then hold it
+ */
+typedef struct led_step_s
+{
+	uint8_t		red;
+	uint8_t		green;
+	uint8_t		blue;
+	uint16_t	fade_ms;	///> 0 switches at once
+	uint16_t	hold_ms;
+} led_step_t;
+
 /**
  * @brief RGB LED configuration
  */
@@ -69,6 +115,17 @@ typedef struct ledRGB_info_s
  */
 void ledRGB_ledPWM_init(void);
 
+/**
+ * Plays a pattern, on the LEDC hardware fades; returns at once, the
+ * transitions run from the fade end interrupt and the timer service task.
+ */
+void ledRGB_setPattern(led_pattern_t pattern);
+
+/**
+ * Ends an activity pattern (OTA) and shows the gateway state again.
+ */
+void ledRGB_restore(void);
+
 /**
  * Color to indicate Wifi application has started.
  */
@@ -90,4 +147,9 @@ void ledRGB_wifi_connected(void);
  */
 void ledRGB_wifi_disconnect(void);
 
+/**
+ * Blinks while the station retries the connection.
+ */
+void ledRGB_wifi_reconnecting(void);
+
 #endif /* MAIN_LIB_LEDRGB_H_ */
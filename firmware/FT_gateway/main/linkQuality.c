@@ -0,0 +1,349 @@
+/**
+ * @file linkQuality.c
+ * @brief Link quality sampler of the station connection
+ * @details
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <string.h>
+
+// ESP libraries
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/stats.h"
+
+// Personal libraries
+#include "linkQuality.h"
+#include "tasks_common.h"
+#include "wifiApp.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "link_quality";
+
+// Ring buffer, head is where the next sample goes
+static link_quality_sample_t g_ring[LINK_QUALITY_RING_SIZE];
+static uint16_t g_ring_head;
+static uint16_t g_ring_count;
+
+// Counters since the last sample, written by the event and httpd tasks
+static uint16_t g_disconnects;
+static uint16_t g_beacon_loss;
+static uint8_t g_last_reason;
+static uint32_t g_transfer_bytes;
+static int64_t g_transfer_us;
+
+// Protects the ring buffer and the counters
+static portMUX_TYPE link_quality_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+	/* FreeRTOS Structures */
+
+TASK_STORAGE(linkQuality_task, LINK_QUALITY_TASK_STACK_SIZE)
+
+
+	/* Static Functions */
+
+static uint16_t linkQuality_phyRate(wifi_phy_mode_t phy_mode, wifi_bandwidth_t bandwidth);
+static bool linkQuality_tcpRetrans(uint32_t * total_p);
+static void linkQuality_sample(link_quality_sample_t * sample_p, uint32_t * retrans_last_p);
+static void linkQuality_task(void * pvParameters);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Starts the sampler task
+void linkQuality_start(void)
+{
+	TASK_CREATE(	linkQuality_task,
+					&linkQuality_task,
+					LINK_QUALITY_TASK_STACK_SIZE,
+					LINK_QUALITY_TASK_PRIORITY,
+					NULL,
+					LINK_QUALITY_TASK_CORE_ID);
+}
+
+// Records a station disconnection
+void linkQuality_recordDisconnect(uint8_t reason)
+{
+	taskENTER_CRITICAL(&link_quality_mux);
+	g_disconnects++;
+	if (reason == WIFI_REASON_BEACON_TIMEOUT)
+	{
+		g_beacon_loss++;
+	}
+	g_last_reason = reason;
+	taskEXIT_CRITICAL(&link_quality_mux);
+}
+
+// Records a finished TCP transfer
+void linkQuality_recordTransfer(uint32_t bytes, int64_t duration_us)
+{
+	if (duration_us <= 0)
+	{
+		return;
+	}
+
+	taskENTER_CRITICAL(&link_quality_mux);
+	g_transfer_bytes += bytes;
+	g_transfer_us += duration_us;
+	taskEXIT_CRITICAL(&link_quality_mux);
+}
+
+// Copies the samples, oldest first
+uint16_t linkQuality_getSamples(link_quality_sample_t * samples_p, uint16_t max)
+{
+	uint16_t count;
+
+	taskENTER_CRITICAL(&link_quality_mux);
+	count = (g_ring_count < max) ? g_ring_count : max;
+	// Skip the oldest ones that don't fit
+	uint16_t index = (g_ring_head + LINK_QUALITY_RING_SIZE - count) % LINK_QUALITY_RING_SIZE;
+	for (uint16_t i = 0; i < count; i++)
+	{
+		samples_p[i] = g_ring[index];
+		index = (index + 1) % LINK_QUALITY_RING_SIZE;
+	}
+	taskEXIT_CRITICAL(&link_quality_mux);
+
+	return count;
+}
+
+// Computes the statistics over the ring buffer
+void linkQuality_getSummary(link_quality_summary_t * summary_p)
+{
+	// Called from the httpd task only, too big for its stack
+	static link_quality_sample_t samples[LINK_QUALITY_RING_SIZE];
+	uint16_t count = linkQuality_getSamples(samples, LINK_QUALITY_RING_SIZE);
+	uint16_t connected = 0;
+	uint16_t transfers = 0;
+	int32_t rssi_total = 0;
+	uint32_t throughput_total = 0;
+	uint32_t retrans;
+
+	memset(summary_p, 0x00, sizeof(link_quality_summary_t));
+	summary_p->samples = count;
+	summary_p->rssi_min = INT8_MAX;
+	summary_p->rssi_max = INT8_MIN;
+	summary_p->throughput_kbps_min = UINT16_MAX;
+	summary_p->tcp_retrans_valid = linkQuality_tcpRetrans(&retrans);
+
+	for (uint16_t i = 0; i < count; i++)
+	{
+		const link_quality_sample_t * sample_p = &samples[i];
+
+		summary_p->disconnects += sample_p->disconnects;
+		summary_p->beacon_loss += sample_p->beacon_loss;
+		if (sample_p->last_reason != 0)
+		{
+			summary_p->last_reason = sample_p->last_reason;
+		}
+		if (summary_p->tcp_retrans_valid)
+		{
+			summary_p->tcp_retrans += sample_p->tcp_retrans;
+		}
+
+		if (sample_p->throughput_kbps > 0)
+		{
+			transfers++;
+			throughput_total += sample_p->throughput_kbps;
+			if (sample_p->throughput_kbps < summary_p->throughput_kbps_min)
+			{
+				summary_p->throughput_kbps_min = sample_p->throughput_kbps;
+			}
+			if (sample_p->throughput_kbps > summary_p->throughput_kbps_max)
+			{
+				summary_p->throughput_kbps_max = sample_p->throughput_kbps;
+			}
+		}
+
+		if (!sample_p->connected)
+		{
+			continue;
+		}
+		connected++;
+		rssi_total += sample_p->rssi;
+		if (sample_p->rssi < summary_p->rssi_min)
+		{
+			summary_p->rssi_min = sample_p->rssi;
+		}
+		if (sample_p->rssi > summary_p->rssi_max)
+		{
+			summary_p->rssi_max = sample_p->rssi;
+		}
+		summary_p->rssi_last = sample_p->rssi;
+		summary_p->phy_mode_last = sample_p->phy_mode;
+		summary_p->phy_rate_mbps_last = sample_p->phy_rate_mbps;
+	}
+
+	if (connected > 0)
+	{
+		summary_p->rssi_avg = rssi_total / connected;
+		summary_p->connected_pct = (connected * 100) / count;
+	}
+	else
+	{
+		summary_p->rssi_min = 0;
+		summary_p->rssi_max = 0;
+	}
+
+	if (transfers > 0)
+	{
+		summary_p->throughput_kbps_avg = throughput_total / transfers;
+	}
+	else
+	{
+		summary_p->throughput_kbps_min = 0;
+	}
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Nominal rate of a PHY mode, the driver doesn't expose the current one
+ * @param phy_mode
+ * @param bandwidth
+ * @return uint16_t Mbps, MCS7 with short guard interval for HT
+ */
+static uint16_t linkQuality_phyRate(wifi_phy_mode_t phy_mode, wifi_bandwidth_t bandwidth)
+{
+	switch (phy_mode)
+	{
+		case WIFI_PHY_MODE_LR:
+			return 1;
+		case WIFI_PHY_MODE_11B:
+			return 11;
+		case WIFI_PHY_MODE_11G:
+			return 54;
+		case WIFI_PHY_MODE_HT20:
+		case WIFI_PHY_MODE_HT40:
+			return (bandwidth == WIFI_BW_HT40) ? 150 : 72;
+		default:
+			return 0;
+	}
+}
+
+/**
+ * @brief Total of TCP segments retransmitted since boot
+ * @param total_p destination
+ * @return false without lwIP statistics
+ */
+static bool linkQuality_tcpRetrans(uint32_t * total_p)
+{
+#if LWIP_STATS && MIB2_STATS
+	*total_p = lwip_stats.mib2.tcpretranssegs;
+	return true;
+#else
+	*total_p = 0;
+	return false;
+#endif
+}
+
+/**
+ * @brief Fills a sample and clears the counters of the period
+ * @param sample_p destination
+ * @param retrans_last_p TCP retransmissions total on the previous sample
+ */
+static void linkQuality_sample(link_quality_sample_t * sample_p, uint32_t * retrans_last_p)
+{
+	wifi_ap_record_t ap_info;
+	wifi_phy_mode_t phy_mode;
+	wifi_bandwidth_t bandwidth = WIFI_BW_HT20;
+	uint32_t retrans;
+
+	memset(sample_p, 0x00, sizeof(link_quality_sample_t));
+	sample_p->time_s = esp_timer_get_time() / 1000000;
+
+	if (wifiApp_getConnState() == WIFI_CONN_CONNECTED && esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK)
+	{
+		sample_p->connected = true;
+		sample_p->rssi = ap_info.rssi;
+		if (esp_wifi_sta_get_negotiated_phymode(&phy_mode) == ESP_OK)
+		{
+			esp_wifi_get_bandwidth(WIFI_IF_STA, &bandwidth);
+			sample_p->phy_mode = phy_mode;
+			sample_p->phy_rate_mbps = linkQuality_phyRate(phy_mode, bandwidth);
+		}
+	}
+
+	if (linkQuality_tcpRetrans(&retrans))
+	{
+		uint32_t delta = retrans - *retrans_last_p;
+		sample_p->tcp_retrans = (delta < LINK_QUALITY_UNAVAILABLE) ? delta : LINK_QUALITY_UNAVAILABLE - 1;
+		*retrans_last_p = retrans;
+	}
+	else
+	{
+		sample_p->tcp_retrans = LINK_QUALITY_UNAVAILABLE;
+	}
+
+	taskENTER_CRITICAL(&link_quality_mux);
+	sample_p->disconnects = g_disconnects;
+	sample_p->beacon_loss = g_beacon_loss;
+	sample_p->last_reason = g_last_reason;
+	if (g_transfer_us > 0)
+	{
+		// bytes * 8 / us = Mbps, * 1000 = kbps
+		sample_p->throughput_kbps = (g_transfer_bytes * 8000ULL) / g_transfer_us;
+	}
+	g_disconnects = 0;
+	g_beacon_loss = 0;
+	g_last_reason = 0;
+	g_transfer_bytes = 0;
+	g_transfer_us = 0;
+	taskEXIT_CRITICAL(&link_quality_mux);
+}
+
+/**
+ * @brief Sampler task
+ * @details
+ * @param pvParameters
+ */
+static void linkQuality_task(void * pvParameters)
+{
+	link_quality_sample_t sample;
+	uint32_t retrans_last;
+
+	linkQuality_tcpRetrans(&retrans_last);
+
+	ESP_LOGI(TAG, "Sampling every %d s, %d samples kept", LINK_QUALITY_SAMPLE_PERIOD_S, LINK_QUALITY_RING_SIZE);
+
+	for (;;)
+	{
+		vTaskDelay(pdMS_TO_TICKS(LINK_QUALITY_SAMPLE_PERIOD_S * 1000));
+
+		linkQuality_sample(&sample, &retrans_last);
+
+		taskENTER_CRITICAL(&link_quality_mux);
+		g_ring[g_ring_head] = sample;
+		g_ring_head = (g_ring_head + 1) % LINK_QUALITY_RING_SIZE;
+		if (g_ring_count < LINK_QUALITY_RING_SIZE)
+		{
+			g_ring_count++;
+		}
+		taskEXIT_CRITICAL(&link_quality_mux);
+	}
+}
@@ -0,0 +1,125 @@
+/**
+ * @file linkQuality.h
+ * @brief Link quality sampler of the station connection
+ * @details
+ * A low priority task records the radio state every LINK_QUALITY_SAMPLE_PERIOD_S
+ * into a fixed ring buffer: RSSI, negotiated PHY mode and its nominal rate,
+ * disconnections (beacon loss apart), TCP retransmissions and the throughput
+ * of the TCP transfers that ended on the period. The summary lets slow
+ * gateway complaints be matched against the radio environment.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_LINKQUALITY_H_
+#define MAIN_LINKQUALITY_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+// Value of a sample tcp_retrans when lwIP isn't built with statistics
+#define LINK_QUALITY_UNAVAILABLE	UINT16_MAX
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief One sample, the counters are relative to the previous one
+ * @details
+ */
+typedef struct link_quality_sample_s
+{
+	uint32_t	time_s;				///> uptime when it was taken
+	int8_t		rssi;				///> 0 when not connected
+	uint8_t		phy_mode;			///> wifi_phy_mode_t
+	uint8_t		connected;
+	uint8_t		last_reason;		///> wifi_err_reason_t of the last disconnection, 0 if none
+	uint16_t	phy_rate_mbps;		///> nominal rate of the PHY mode and bandwidth
+	uint16_t	disconnects;
+	uint16_t	beacon_loss;		///> disconnections by beacon timeout
+	uint16_t	tcp_retrans;		///> TCP segments retransmitted
+	uint16_t	throughput_kbps;	///> 0 when no transfer ended on the period
+} link_quality_sample_t;
+
+/**
+ * @brief Statistics over the samples on the ring buffer
+ * @details
+ */
+typedef struct link_quality_summary_s
+{
+	uint16_t	samples;
+	uint8_t		connected_pct;
+	int8_t		rssi_min;
+	int8_t		rssi_avg;
+	int8_t		rssi_max;
+	int8_t		rssi_last;
+	uint8_t		phy_mode_last;
+	uint16_t	phy_rate_mbps_last;
+	uint32_t	disconnects;
+	uint32_t	beacon_loss;
+	uint8_t		last_reason;
+	uint32_t	tcp_retrans;
+	bool		tcp_retrans_valid;	///> false without lwIP statistics
+	uint16_t	throughput_kbps_min;
+	uint16_t	throughput_kbps_avg;
+	uint16_t	throughput_kbps_max;
+} link_quality_summary_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Starts the sampler task
+ * @details
+ */
+void linkQuality_start(void);
+
+/**
+ * @brief Records a station disconnection
+ * @details called from the WiFi event handler
+ * @param reason wifi_err_reason_t
+ */
+void linkQuality_recordDisconnect(uint8_t reason);
+
+/**
+ * @brief Records a finished TCP transfer
+ * @details only the time spent on the socket should be counted
+ * @param bytes received or sent
+ * @param duration_us
+ */
+void linkQuality_recordTransfer(uint32_t bytes, int64_t duration_us);
+
+/**
+ * @brief Copies the samples, oldest first
+ * @param samples_p destination
+ * @param max size of the destination
+ * @return uint16_t number of samples copied
+ */
+uint16_t linkQuality_getSamples(link_quality_sample_t * samples_p, uint16_t max);
+
+/**
+ * @brief Computes the statistics over the ring buffer
+ * @param summary_p destination
+ */
+void linkQuality_getSummary(link_quality_summary_t * summary_p);
+
+#endif /* MAIN_LINKQUALITY_H_ */
@@ -21,9 +21,21 @@
 #include "nvs_flash.h"
 
 // Personal libraries
+#include "appEvents.h"
+#include "asyncLog.h"
+#include "bootProfile.h"
+#include "dnsCache.h"
 #include "ledRGB.h"
+#include "linkQuality.h"
+#include "mqttUplink.h"
 #include "router.h"
+#include "sysStats.h"
+#include "taskProfiler.h"
 #include "dateTimeNTP.h"
+#include "deviceRegistry.h"
+#include "telemetryStore.h"
+#include "valveSchedule.h"
+#include "zigbeeNcp.h"
 
 
 /**************************
@@ -37,6 +49,11 @@
 
 void app_main(void)
 {
+	bootProfile_mark(BOOT_MARKER_APP_MAIN);
+	
+	// Deferred logger, before any module logs through it
+	asyncLog_start();
+	
 	// Initialize NVS (Non Volatile Storage)
 	esp_err_t ret = nvs_flash_init();
 	if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
@@ -45,15 +62,51 @@ void app_main(void)
 		ret = nvs_flash_init();
 	}
 	ESP_ERROR_CHECK(ret);
+	bootProfile_mark(BOOT_MARKER_NVS_READY);
 	
 	// Initialize the LEDS
 	ledRGB_ledPWM_init();
 
-	// Web Router
+	// Default event loop, before any module subscribes
+	appEvents_init();
+
+	// Resolver cache, used by the outbound clients
+	dnsCache_init();
+
+	// Web Router, the HTTP server listens before the WiFi driver is up
 	router_setup();
 
 	// NTP clock setup
 	dateTimeNTP_setup();
+
+	// Backend uplink, it starts on the first WiFi connection too
+	mqttUplink_setup();
+	
+	// Link quality sampler
+	linkQuality_start();
+
+	// Attribute history, before the devices report
+	telemetryStore_init();
+
+	// Known Zigbee devices, before the radio reports them
+	deviceRegistry_init();
+
+	// UART link to the Zigbee co-processor
+	zigbeeNcp_start();
+
+	// Valve schedules, they start on the first NTP sync
+	valveSchedule_init();
+
+	// CPU, stack, heap and socket figures for /sys/stats
+	sysStats_start();
+
+	// Task load profiler, only with CONFIG_GW_TASK_PROFILER
+	taskProfiler_start();
+
+	// Memory the boot left
+	sysStats_logBudget();
+	
+	bootProfile_mark(BOOT_MARKER_APP_MAIN_DONE);
 }
 
 
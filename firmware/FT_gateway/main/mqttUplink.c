@@ -0,0 +1,1037 @@
+/**
+ * @file mqttUplink.c
+ * @brief Telemetry and events to the backend over MQTT
+ * @details
+ * Three positions follow the telemetry log: g_read after the samples
+ * sent, g_committed after the ones acknowledged, in order, and g_saved,
+ * the copy on NVS. The events list has the same three in event counts.
+ * Every message awaiting its PUBACK keeps the positions after it; the
+ * client task hands the acknowledged message ids over and the uplink task
+ * moves g_committed past the acknowledged messages at the front. The
+ * client outbox sends the messages again after a reconnection; one it
+ * dropped (expired, or lost with a reset) holds the front until
+ * MQTT_UPLINK_ACK_TIMEOUT_S, then everything after g_committed goes again.
+ * The batches are rate limited by a token bucket, in thousandths of a
+ * batch, refilled at MQTT_UPLINK_DRAIN_BATCHES_S.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdio.h>
+#include <string.h>
+
+// ESP libraries
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mqtt_client.h"
+#include "nvs.h"
+
+// Personal libraries
+#include "appEvents.h"
+#include "dnsCache.h"
+#include "mqttUplink.h"
+#include "tasks_common.h"
+#include "telemetryCodec.h"
+#include "telemetryStore.h"
+#include "timebase.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+#define MQTT_UPLINK_TOPIC_LEN			48
+#define MQTT_UPLINK_BATCH_HEADER		8		// "TB", version, columns, base time
+// Longest sample of a batch: series index, a new series on a new device and the codec sample
+#define MQTT_UPLINK_SAMPLE_MAX			(2 * TELEMETRY_CODEC_VARINT_MAX + sizeof(uint64_t) + 1 + TELEMETRY_CODEC_MAX_BYTES(1))
+#define MQTT_UPLINK_EVENTS_PER_MESSAGE	16
+// Longest event object with its NUL: separator, longest name, both times at 10 digits, and "ip" or "offset_ms" (as long)
+#define MQTT_UPLINK_EVENT_JSON_MAX		(sizeof(",{\"event\":\"\",\"ts\":4294967295,\"up\":4294967295,\"offset_ms\":-2147483648}") \
+										+ sizeof(mqtt_uplink_event_names_t) - 1)
+#define MQTT_UPLINK_TOKEN				1000	// a batch
+#define MQTT_UPLINK_ACKS				(MQTT_UPLINK_INFLIGHT * 2)
+
+	/* Structures */
+
+/**
+ * @brief Codec state of a device attribute in the batch being built
+ */
+typedef struct mqtt_uplink_series_s
+{
+	uint32_t	ts;
+	uint32_t	delta;
+	int32_t		value;
+	uint8_t		device;		// on the batch device list
+	uint8_t		attr;
+} mqtt_uplink_series_t;
+
+/**
+ * @brief Telemetry batch being built
+ */
+typedef struct mqtt_uplink_batch_s
+{
+	uint8_t					buf[MQTT_UPLINK_BATCH_BYTES];
+	uint16_t				len;
+	uint16_t				series_count;
+	uint8_t					device_count;
+	uint32_t				samples;
+	uint32_t				base_ts;
+	uint64_t				devices[MQTT_UPLINK_BATCH_DEVICES];
+	mqtt_uplink_series_t	series[MQTT_UPLINK_BATCH_SERIES];
+} mqtt_uplink_batch_t;
+
+/**
+ * @brief Sized as the longest event name with its NUL, for MQTT_UPLINK_EVENT_JSON_MAX
+ */
+typedef union mqtt_uplink_event_names_u
+{
+#define X(ID, ENUM, PAYLOAD) char name_ ## ID[sizeof(#ENUM) - sizeof("APP_EVENT_") + 1];
+	X_MACRO_APP_EVENT_LIST
+#undef X
+} mqtt_uplink_event_names_t;
+
+/**
+ * @brief Application event waiting to be sent
+ */
+typedef struct mqtt_uplink_event_s
+{
+	uint32_t	ts;			// epoch seconds, 0 before the first NTP sync
+	uint32_t	uptime_s;
+	int32_t		value;		// IP address, reason or clock step in ms, by event
+	uint8_t		id;			// app_event_id_t
+} mqtt_uplink_event_t;
+
+/**
+ * @brief Message awaiting its PUBACK, with the positions after it
+ */
+typedef struct mqtt_uplink_inflight_s
+{
+	int					msg_id;
+	bool				acked;
+	bool				events;
+	telemetry_cursor_t	cursor;
+	uint32_t			event_pos;
+	uint32_t			samples;		// or events
+	uint16_t			bytes;
+	int64_t				sent_us;
+} mqtt_uplink_inflight_t;
+
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "mqtt-uplink";
+
+// Event names without the APP_EVENT_ prefix
+static const char * const g_event_names[APP_EVENT_COUNT] =
+{
+#define X(ID, ENUM, PAYLOAD) [ID] = #ENUM + sizeof("APP_EVENT_") - 1,
+	X_MACRO_APP_EVENT_LIST
+#undef X
+};
+
+// Created by the task once the broker host resolves
+static esp_mqtt_client_handle_t g_client;
+static char g_broker_uri[sizeof("mqtt://255.255.255.255:65535")];
+static uint32_t g_broker_addr;
+static bool g_resolve;
+static int64_t g_resolve_us;
+static char g_client_id[MQTT_UPLINK_CLIENT_ID_LEN];
+static char g_topic_telemetry[MQTT_UPLINK_TOPIC_LEN];
+static char g_topic_events[MQTT_UPLINK_TOPIC_LEN];
+static char g_topic_status[MQTT_UPLINK_TOPIC_LEN];
+
+// Telemetry log positions, only the task moves them
+static telemetry_cursor_t g_read;
+static telemetry_cursor_t g_committed;
+static telemetry_cursor_t g_saved;
+
+// Messages awaiting their PUBACK, oldest first, only the task touches them
+static mqtt_uplink_inflight_t g_inflight[MQTT_UPLINK_INFLIGHT];
+static uint8_t g_inflight_count;
+
+// Message ids acknowledged, from the client task
+static int g_acks[MQTT_UPLINK_ACKS];
+static uint8_t g_ack_count;
+static bool g_connected;
+
+// Events from the event loop, counted since the boot
+static mqtt_uplink_event_t g_events[MQTT_UPLINK_EVENTS];
+static uint32_t g_events_head;
+static uint32_t g_events_sent;
+static uint32_t g_events_committed;
+
+// Messages being built
+static mqtt_uplink_batch_t g_batch;
+static mqtt_uplink_event_t g_event_batch[MQTT_UPLINK_EVENTS_PER_MESSAGE];
+static char g_events_json[MQTT_UPLINK_EVENTS_PER_MESSAGE * MQTT_UPLINK_EVENT_JSON_MAX + 4];
+
+// Rate limit, and the backlog drain being timed
+static uint32_t g_tokens = MQTT_UPLINK_INFLIGHT * MQTT_UPLINK_TOKEN;
+static int64_t g_refill_us;
+static int64_t g_last_batch_us;
+static uint32_t g_seen_connects;
+static bool g_draining;
+static int64_t g_drain_start_us;
+static uint32_t g_drain_start_samples;
+
+static mqtt_uplink_stats_t g_stats;
+static portMUX_TYPE uplink_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+	/* FreeRTOS Structures */
+
+TASK_STORAGE(mqttUplink_task, MQTT_UPLINK_TASK_STACK_SIZE)
+static TaskHandle_t uplink_task_handle;
+
+
+	/* Static Functions */
+
+static void mqttUplink_wifiApp_connectedEvents(void * arg, esp_event_base_t event_base, int32_t event_id, void * event_data);
+static void mqttUplink_appEvents(void * arg, esp_event_base_t event_base, int32_t event_id, void * event_data);
+static void mqttUplink_clientEvents(void * arg, esp_event_base_t event_base, int32_t event_id, void * event_data);
+static void mqttUplink_task(void * pvParameters);
+static bool mqttUplink_resolve(void);
+static void mqttUplink_startClient(void);
+static void mqttUplink_pump(void);
+static void mqttUplink_takeAcks(void);
+static void mqttUplink_rewind(void);
+static bool mqttUplink_publishBatch(void);
+static bool mqttUplink_addSample(const telemetry_sample_t * sample_p, void * ctx);
+static bool mqttUplink_publishEvents(void);
+static int mqttUplink_eventJson(const mqtt_uplink_event_t * event_p, bool first, char * item, size_t size);
+static void mqttUplink_track(int msg_id, const mqtt_uplink_inflight_t * entry_p);
+static void mqttUplink_timeDrain(int64_t now_us);
+static void mqttUplink_loadCursor(void);
+static void mqttUplink_saveCursor(void);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Loads the cursor and waits for the station connection
+void mqttUplink_setup(void)
+{
+	uint8_t mac[6] = { 0 };
+
+	mqttUplink_loadCursor();
+
+	esp_read_mac(mac, ESP_MAC_WIFI_STA);
+	snprintf(g_client_id, sizeof(g_client_id), "ft-gw-%02x%02x%02x%02x%02x%02x",
+				mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+	snprintf(g_topic_telemetry, sizeof(g_topic_telemetry), "%s/%s/telemetry", MQTT_UPLINK_TOPIC_PREFIX, g_client_id);
+	snprintf(g_topic_events, sizeof(g_topic_events), "%s/%s/events", MQTT_UPLINK_TOPIC_PREFIX, g_client_id);
+	snprintf(g_topic_status, sizeof(g_topic_status), "%s/%s/status", MQTT_UPLINK_TOPIC_PREFIX, g_client_id);
+
+	// Every event is kept for the backend, the connection also starts the client
+	appEvents_subscribe(ESP_EVENT_ANY_ID, mqttUplink_appEvents, NULL);
+	appEvents_subscribe(APP_EVENT_WIFI_CONNECTED, mqttUplink_wifiApp_connectedEvents, NULL);
+}
+
+// Copies the uplink figures
+void mqttUplink_getStats(mqtt_uplink_stats_t * stats_p)
+{
+	telemetry_cursor_t committed;
+
+	taskENTER_CRITICAL(&uplink_mux);
+	*stats_p = g_stats;
+	stats_p->connected = g_connected;
+	stats_p->events_pending = g_events_head - g_events_committed;
+	committed = g_committed;
+	taskEXIT_CRITICAL(&uplink_mux);
+
+	snprintf(stats_p->client_id, sizeof(stats_p->client_id), "%s", g_client_id);
+	stats_p->backlog_bytes = telemetryStore_pending(&committed);
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Starts the uplink task on the first station connection
+ * @details the client reconnects on its own afterwards, a new station
+ * connection only cuts its wait short
+ */
+static void mqttUplink_wifiApp_connectedEvents(void * arg, esp_event_base_t event_base, int32_t event_id, void * event_data)
+{
+	if (MQTT_UPLINK_BROKER_HOST[0] == '\0')
+	{
+		ESP_LOGW(TAG, "no broker set on menuconfig, uplink off");
+		return;
+	}
+	if (g_client != NULL)
+	{
+		esp_mqtt_client_reconnect(g_client);
+		return;
+	}
+	if (uplink_task_handle != NULL)
+	{
+		// Still resolving the broker, try now
+		g_resolve_us = 0;
+		xTaskNotifyGive(uplink_task_handle);
+		return;
+	}
+
+	// The task resolves the broker and creates the client, the lookup may wait
+	TASK_CREATE(	mqttUplink_task,
+					&mqttUplink_task,
+					MQTT_UPLINK_TASK_STACK_SIZE,
+					MQTT_UPLINK_TASK_PRIORITY,
+					&uplink_task_handle,
+					MQTT_UPLINK_TASK_CORE_ID);
+}
+
+/**
+ * @brief Keeps the application events for the backend
+ * @details the oldest one not acknowledged is dropped when the list is full
+ */
+static void mqttUplink_appEvents(void * arg, esp_event_base_t event_base, int32_t event_id, void * event_data)
+{
+	mqtt_uplink_event_t event =
+	{
+		.ts = timebase_isSynced() ? timebase_nowUs() / 1000000 : 0,
+		.uptime_s = esp_timer_get_time() / 1000000,
+		.id = event_id,
+	};
+	int64_t offset_ms;
+
+	switch (event_id)
+	{
+		case APP_EVENT_WIFI_CONNECTED:
+			event.value = ((app_event_wifi_connected_t *)event_data)->ip.addr;
+			break;
+
+		case APP_EVENT_WIFI_CONNECT_FAILED:
+			event.value = ((app_event_wifi_connect_failed_t *)event_data)->reason;
+			break;
+
+		case APP_EVENT_TIME_STEPPED:
+			offset_ms = ((app_event_time_stepped_t *)event_data)->offset_us / 1000;
+			event.value = (offset_ms > INT32_MAX) ? INT32_MAX : (offset_ms < INT32_MIN) ? INT32_MIN : offset_ms;
+			break;
+
+		default:
+			if (event_id < 0 || event_id >= APP_EVENT_COUNT)
+			{
+				return;
+			}
+			break;
+	}
+
+	taskENTER_CRITICAL(&uplink_mux);
+	if (g_events_head - g_events_committed >= MQTT_UPLINK_EVENTS)
+	{
+		g_events_committed++;
+		if ((int32_t)(g_events_sent - g_events_committed) < 0)
+		{
+			g_events_sent = g_events_committed;
+		}
+		g_stats.events_dropped++;
+	}
+	g_events[g_events_head % MQTT_UPLINK_EVENTS] = event;
+	g_events_head++;
+	taskEXIT_CRITICAL(&uplink_mux);
+
+	if (uplink_task_handle != NULL)
+	{
+		xTaskNotifyGive(uplink_task_handle);
+	}
+}
+
+/**
+ * @brief Client events, on the esp-mqtt task
+ * @details the acknowledged ids are only queued, the uplink task matches them
+ */
+static void mqttUplink_clientEvents(void * arg, esp_event_base_t event_base, int32_t event_id, void * event_data)
+{
+	esp_mqtt_event_handle_t event = event_data;
+
+	switch ((esp_mqtt_event_id_t)event_id)
+	{
+		case MQTT_EVENT_CONNECTED:
+			ESP_LOGI(TAG, "connected to %s", g_broker_uri);
+			esp_mqtt_client_enqueue(g_client, g_topic_status, "online", 0, 1, 1, true);
+			taskENTER_CRITICAL(&uplink_mux);
+			g_connected = true;
+			g_stats.connects++;
+			taskEXIT_CRITICAL(&uplink_mux);
+			break;
+
+		case MQTT_EVENT_DISCONNECTED:
+			ESP_LOGW(TAG, "disconnected");
+			taskENTER_CRITICAL(&uplink_mux);
+			g_connected = false;
+			taskEXIT_CRITICAL(&uplink_mux);
+			// The broker may have moved, the task looks it up again
+			g_resolve = true;
+			break;
+
+		case MQTT_EVENT_PUBLISHED:
+			taskENTER_CRITICAL(&uplink_mux);
+			if (g_ack_count == MQTT_UPLINK_ACKS)
+			{
+				// Only stale ids fill it, a resend after the timeout covers a live one lost here
+				memmove(&g_acks[0], &g_acks[1], (MQTT_UPLINK_ACKS - 1) * sizeof(int));
+				g_ack_count--;
+			}
+			g_acks[g_ack_count++] = event->msg_id;
+			taskEXIT_CRITICAL(&uplink_mux);
+			break;
+
+		case MQTT_EVENT_ERROR:
+			ESP_LOGW(TAG, "client error");
+			return;
+
+		default:
+			return;
+	}
+
+	if (uplink_task_handle != NULL)
+	{
+		xTaskNotifyGive(uplink_task_handle);
+	}
+}
+
+/**
+ * @brief Uplink task, sends the events and the telemetry batches
+ * @details woken up by the PUBACKs and the events, or every MQTT_UPLINK_POLL_MS
+ * @param pvParameters
+ */
+static void mqttUplink_task(void * pvParameters)
+{
+	int64_t saved_us = esp_timer_get_time();
+	int64_t now_us;
+
+	g_refill_us = saved_us;
+	for (;;)
+	{
+		if (g_client == NULL)
+		{
+			mqttUplink_startClient();
+		}
+		else if (g_resolve && !g_connected)
+		{
+			g_resolve = false;
+			// The next reconnection goes to the new address
+			if (mqttUplink_resolve())
+			{
+				esp_mqtt_client_set_uri(g_client, g_broker_uri);
+			}
+		}
+
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_UPLINK_POLL_MS));
+		mqttUplink_pump();
+
+		now_us = esp_timer_get_time();
+		if ((g_committed.seq != g_saved.seq || g_committed.offset != g_saved.offset)
+			&& now_us - saved_us >= MQTT_UPLINK_CURSOR_SAVE_S * 1000000LL)
+		{
+			mqttUplink_saveCursor();
+			saved_us = now_us;
+		}
+	}
+}
+
+/**
+ * @brief Looks the broker host up through the DNS cache
+ * @details esp-mqtt gets the address, its own lookup would bypass the cache
+ * @return true when the address changed
+ */
+static bool mqttUplink_resolve(void)
+{
+	esp_ip4_addr_t ip;
+	uint32_t addr;
+	esp_err_t err;
+
+	err = dnsCache_resolve(MQTT_UPLINK_BROKER_HOST, &addr);
+	if (err != ESP_OK)
+	{
+		ESP_LOGW(TAG, "broker %s not resolved (%s)", MQTT_UPLINK_BROKER_HOST, esp_err_to_name(err));
+		return false;
+	}
+	if (addr == g_broker_addr)
+	{
+		return false;
+	}
+
+	g_broker_addr = addr;
+	ip.addr = addr;
+	snprintf(g_broker_uri, sizeof(g_broker_uri), "mqtt://" IPSTR ":%d", IP2STR(&ip), MQTT_UPLINK_BROKER_PORT);
+	return true;
+}
+
+/**
+ * @brief Resolves the broker and starts the client, uplink task
+ * @details a failed lookup is tried again MQTT_UPLINK_RESOLVE_S later, or
+ * on the next station connection
+ */
+static void mqttUplink_startClient(void)
+{
+	int64_t now_us = esp_timer_get_time();
+
+	if (g_resolve_us != 0 && now_us - g_resolve_us < MQTT_UPLINK_RESOLVE_S * 1000000LL)
+	{
+		return;
+	}
+	g_resolve_us = now_us;
+	if (!mqttUplink_resolve())
+	{
+		return;
+	}
+
+	esp_mqtt_client_config_t config =
+	{
+		.broker.address.uri = g_broker_uri,
+		.credentials.client_id = g_client_id,
+		.session =
+		{
+			.keepalive = MQTT_UPLINK_KEEPALIVE_S,
+			.last_will =
+			{
+				.topic = g_topic_status,
+				.msg = "offline",
+				.qos = 1,
+				.retain = 1,
+			},
+		},
+		// A QoS 1 message is kept whole in the outbox only when it fits the output buffer
+		.buffer =
+		{
+			.size = 1024,
+			.out_size = MQTT_UPLINK_BATCH_BYTES + MQTT_UPLINK_TOPIC_LEN + 16,
+		},
+		.task =
+		{
+			.priority = MQTT_CLIENT_TASK_PRIORITY,
+			.stack_size = MQTT_CLIENT_TASK_STACK_SIZE,
+		},
+		// Room for the window twice, the messages sent again after a reconnection included
+		.outbox.limit = 2 * MQTT_UPLINK_INFLIGHT * (MQTT_UPLINK_BATCH_BYTES + MQTT_UPLINK_TOPIC_LEN + 16),
+	};
+	esp_mqtt_client_handle_t client = esp_mqtt_client_init(&config);
+
+	if (client == NULL)
+	{
+		ESP_LOGE(TAG, "client not created");
+		return;
+	}
+	esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqttUplink_clientEvents, NULL);
+	esp_mqtt_client_start(client);
+	g_client = client;
+	g_stats.started = true;
+	ESP_LOGI(TAG, "%s to %s (%s), from block %lu byte %u", g_client_id, MQTT_UPLINK_BROKER_HOST, g_broker_uri,
+				g_committed.seq, g_committed.offset);
+}
+
+/**
+ * @brief Takes the acknowledgements and fills the window, within the rate
+ * @details a batch that isn't full only goes MQTT_UPLINK_LINGER_S after
+ * the previous one
+ */
+static void mqttUplink_pump(void)
+{
+	int64_t now_us = esp_timer_get_time();
+	uint64_t tokens;
+	uint32_t pending;
+	uint32_t events;
+	bool connected;
+
+	mqttUplink_takeAcks();
+	if (g_inflight_count > 0 && now_us - g_inflight[0].sent_us > MQTT_UPLINK_ACK_TIMEOUT_S * 1000000LL)
+	{
+		mqttUplink_rewind();
+	}
+
+	taskENTER_CRITICAL(&uplink_mux);
+	connected = g_connected;
+	events = g_events_head - g_events_sent;
+	taskEXIT_CRITICAL(&uplink_mux);
+
+	tokens = g_tokens + (uint64_t)(now_us - g_refill_us) * MQTT_UPLINK_DRAIN_BATCHES_S / 1000;
+	g_tokens = (tokens < MQTT_UPLINK_INFLIGHT * MQTT_UPLINK_TOKEN) ? tokens : MQTT_UPLINK_INFLIGHT * MQTT_UPLINK_TOKEN;
+	g_refill_us = now_us;
+	if (!connected)
+	{
+		return;
+	}
+	mqttUplink_timeDrain(now_us);
+
+	// The events first, they are few and small
+	if (events > 0 && g_inflight_count < MQTT_UPLINK_INFLIGHT && g_tokens >= MQTT_UPLINK_TOKEN)
+	{
+		mqttUplink_publishEvents();
+	}
+
+	while (g_inflight_count < MQTT_UPLINK_INFLIGHT && g_tokens >= MQTT_UPLINK_TOKEN)
+	{
+		pending = telemetryStore_pending(&g_read);
+		if (pending == 0
+			|| (pending < MQTT_UPLINK_BATCH_BYTES && now_us - g_last_batch_us < MQTT_UPLINK_LINGER_S * 1000000LL)
+			|| !mqttUplink_publishBatch())
+		{
+			break;
+		}
+	}
+}
+
+/**
+ * @brief Marks the acknowledged messages, the positions move past the
+ * acknowledged ones at the front
+ */
+static void mqttUplink_takeAcks(void)
+{
+	int acks[MQTT_UPLINK_ACKS];
+	uint8_t count;
+	mqtt_uplink_inflight_t * entry_p;
+
+	taskENTER_CRITICAL(&uplink_mux);
+	count = g_ack_count;
+	memcpy(acks, g_acks, count * sizeof(int));
+	g_ack_count = 0;
+	taskEXIT_CRITICAL(&uplink_mux);
+
+	for (uint8_t a = 0; a < count; a++)
+	{
+		for (uint8_t i = 0; i < g_inflight_count; i++)
+		{
+			if (g_inflight[i].msg_id == acks[a])
+			{
+				g_inflight[i].acked = true;
+			}
+		}
+	}
+
+	while (g_inflight_count > 0 && g_inflight[0].acked)
+	{
+		entry_p = &g_inflight[0];
+		taskENTER_CRITICAL(&uplink_mux);
+		if (entry_p->events)
+		{
+			if ((int32_t)(entry_p->event_pos - g_events_committed) > 0)
+			{
+				g_events_committed = entry_p->event_pos;
+			}
+			g_stats.events += entry_p->samples;
+		}
+		else
+		{
+			g_committed = entry_p->cursor;
+			g_stats.samples += entry_p->samples;
+			g_stats.bytes += entry_p->bytes;
+		}
+		g_stats.acked++;
+		g_inflight_count--;
+		g_stats.inflight = g_inflight_count;
+		taskEXIT_CRITICAL(&uplink_mux);
+		memmove(&g_inflight[0], &g_inflight[1], g_inflight_count * sizeof(mqtt_uplink_inflight_t));
+	}
+}
+
+/**
+ * @brief Forgets the messages awaiting their PUBACK, what follows the
+ * acknowledged positions goes again
+ */
+static void mqttUplink_rewind(void)
+{
+	uint32_t batches = 0;
+
+	for (uint8_t i = 0; i < g_inflight_count; i++)
+	{
+		batches += g_inflight[i].events ? 0 : 1;
+	}
+	ESP_LOGW(TAG, "%u messages not acknowledged in %d s, sent again", g_inflight_count, MQTT_UPLINK_ACK_TIMEOUT_S);
+
+	g_read = g_committed;
+	g_inflight_count = 0;
+	taskENTER_CRITICAL(&uplink_mux);
+	g_events_sent = g_events_committed;
+	g_stats.resent += batches;
+	g_stats.inflight = 0;
+	taskEXIT_CRITICAL(&uplink_mux);
+}
+
+/**
+ * @brief Builds a batch from the read position and publishes it
+ * @return false when there was nothing to send or the client refused it,
+ * the read position only moves once it is published
+ */
+static bool mqttUplink_publishBatch(void)
+{
+	mqtt_uplink_inflight_t entry = { 0 };
+	telemetry_cursor_t cursor = g_read;
+	uint32_t lost = 0;
+	int msg_id;
+
+	g_batch.buf[0] = 'T';
+	g_batch.buf[1] = 'B';
+	g_batch.buf[2] = 1;
+	g_batch.buf[3] = 1;
+	g_batch.len = MQTT_UPLINK_BATCH_HEADER;
+	g_batch.series_count = 0;
+	g_batch.device_count = 0;
+	g_batch.samples = 0;
+
+	if (telemetryStore_read(&cursor, mqttUplink_addSample, &g_batch, &lost) != ESP_OK)
+	{
+		return false;
+	}
+	if (lost > 0)
+	{
+		taskENTER_CRITICAL(&uplink_mux);
+		g_stats.lost_blocks += lost;
+		taskEXIT_CRITICAL(&uplink_mux);
+	}
+	if (g_batch.samples == 0)
+	{
+		// Only erased or unreadable records on the way
+		g_read = cursor;
+		return false;
+	}
+
+	msg_id = esp_mqtt_client_publish(g_client, g_topic_telemetry, (const char *)g_batch.buf, g_batch.len, 1, 0);
+	if (msg_id < 0)
+	{
+		taskENTER_CRITICAL(&uplink_mux);
+		g_stats.publish_errors++;
+		taskEXIT_CRITICAL(&uplink_mux);
+		return false;
+	}
+
+	entry.cursor = cursor;
+	entry.samples = g_batch.samples;
+	entry.bytes = g_batch.len;
+	mqttUplink_track(msg_id, &entry);
+	g_read = cursor;
+	g_last_batch_us = entry.sent_us;
+	return true;
+}
+
+/**
+ * @brief Adds a sample to the batch, telemetryStore_read callback
+ * @param sample_p
+ * @param ctx mqtt_uplink_batch_t
+ * @return false when the batch is full, the sample goes in the next one
+ */
+static bool mqttUplink_addSample(const telemetry_sample_t * sample_p, void * ctx)
+{
+	mqtt_uplink_batch_t * batch_p = ctx;
+	mqtt_uplink_series_t * series_p = NULL;
+	uint16_t index;
+	uint8_t device;
+	size_t n;
+
+	for (device = 0; device < batch_p->device_count && batch_p->devices[device] != sample_p->ieee; device++);
+	for (index = 0; index < batch_p->series_count; index++)
+	{
+		if (batch_p->series[index].device == device && batch_p->series[index].attr == sample_p->attr)
+		{
+			series_p = &batch_p->series[index];
+			break;
+		}
+	}
+	if ((series_p == NULL && batch_p->series_count >= MQTT_UPLINK_BATCH_SERIES)
+		|| (device == batch_p->device_count && batch_p->device_count >= MQTT_UPLINK_BATCH_DEVICES)
+		|| batch_p->len + MQTT_UPLINK_SAMPLE_MAX > sizeof(batch_p->buf))
+	{
+		return false;
+	}
+
+	// The first sample sets the base time
+	if (batch_p->samples == 0)
+	{
+		batch_p->base_ts = sample_p->ts;
+		for (uint8_t i = 0; i < sizeof(uint32_t); i++)
+		{
+			batch_p->buf[4 + i] = (sample_p->ts >> (8 * i)) & 0xFF;
+		}
+	}
+
+	batch_p->len += telemetryCodec_putVarint(index, batch_p->buf + batch_p->len, sizeof(batch_p->buf) - batch_p->len);
+	if (series_p == NULL)
+	{
+		batch_p->len += telemetryCodec_putVarint(device, batch_p->buf + batch_p->len, sizeof(batch_p->buf) - batch_p->len);
+		if (device == batch_p->device_count)
+		{
+			batch_p->devices[batch_p->device_count++] = sample_p->ieee;
+			for (uint8_t i = 0; i < sizeof(uint64_t); i++)
+			{
+				batch_p->buf[batch_p->len++] = (sample_p->ieee >> (8 * i)) & 0xFF;
+			}
+		}
+		batch_p->buf[batch_p->len++] = sample_p->attr;
+
+		series_p = &batch_p->series[batch_p->series_count++];
+		series_p->ts = batch_p->base_ts;
+		series_p->delta = 0;
+		series_p->value = 0;
+		series_p->device = device;
+		series_p->attr = sample_p->attr;
+	}
+
+	telemetry_codec_t codec =
+	{
+		.ts = series_p->ts,
+		.delta = series_p->delta,
+		.values = { series_p->value },
+		.columns = 1,
+	};
+	n = telemetryCodec_encode(&codec, sample_p->ts, &sample_p->value, batch_p->buf + batch_p->len,
+								sizeof(batch_p->buf) - batch_p->len);
+	batch_p->len += n;
+	series_p->ts = codec.ts;
+	series_p->delta = codec.delta;
+	series_p->value = codec.values[0];
+	batch_p->samples++;
+	return true;
+}
+
+/**
+ * @brief Publishes the events not sent yet as a JSON list
+ * @return false when the client refused it
+ */
+static bool mqttUplink_publishEvents(void)
+{
+	mqtt_uplink_inflight_t entry = { .events = true };
+	char item[MQTT_UPLINK_EVENT_JSON_MAX];
+	uint32_t from;
+	uint32_t count;
+	uint32_t i;
+	size_t len;
+	int msg_id;
+	int n;
+
+	taskENTER_CRITICAL(&uplink_mux);
+	from = g_events_sent;
+	count = g_events_head - from;
+	count = (count < MQTT_UPLINK_EVENTS_PER_MESSAGE) ? count : MQTT_UPLINK_EVENTS_PER_MESSAGE;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		g_event_batch[i] = g_events[(from + i) % MQTT_UPLINK_EVENTS];
+	}
+	taskEXIT_CRITICAL(&uplink_mux);
+
+	// Whole objects only, the ones left out go in the next message
+	g_events_json[0] = '[';
+	len = 1;
+	for (i = 0; i < count; i++)
+	{
+		n = mqttUplink_eventJson(&g_event_batch[i], len == 1, item, sizeof(item));
+		if (n < 0)
+		{
+			ESP_LOGE(TAG, "event %u longer than MQTT_UPLINK_EVENT_JSON_MAX, dropped", g_event_batch[i].id);
+			continue;
+		}
+		// "]" and the NUL
+		if (len + n + 2 > sizeof(g_events_json))
+		{
+			break;
+		}
+		memcpy(g_events_json + len, item, n);
+		len += n;
+	}
+	count = i;
+	g_events_json[len++] = ']';
+	g_events_json[len] = '\0';
+
+	msg_id = esp_mqtt_client_publish(g_client, g_topic_events, g_events_json, len, 1, 0);
+	if (msg_id < 0)
+	{
+		taskENTER_CRITICAL(&uplink_mux);
+		g_stats.publish_errors++;
+		taskEXIT_CRITICAL(&uplink_mux);
+		return false;
+	}
+
+	entry.event_pos = from + count;
+	entry.samples = count;
+	mqttUplink_track(msg_id, &entry);
+
+	// The list may have dropped some meanwhile, the position only goes forward
+	taskENTER_CRITICAL(&uplink_mux);
+	if ((int32_t)(entry.event_pos - g_events_sent) > 0)
+	{
+		g_events_sent = entry.event_pos;
+	}
+	taskEXIT_CRITICAL(&uplink_mux);
+	return true;
+}
+
+/**
+ * @brief Formats an event as a JSON object
+ * @param event_p
+ * @param first without the separator
+ * @param item destination
+ * @param size of the destination
+ * @return int length, -1 when it didn't fit
+ */
+static int mqttUplink_eventJson(const mqtt_uplink_event_t * event_p, bool first, char * item, size_t size)
+{
+	esp_ip4_addr_t ip;
+	int len;
+	int n;
+
+	len = snprintf(item, size, "%s{\"event\":\"%s\",\"ts\":%lu,\"up\":%lu",
+					first ? "" : ",", g_event_names[event_p->id], event_p->ts, event_p->uptime_s);
+	if (len < 0 || (size_t)len >= size)
+	{
+		return -1;
+	}
+
+	switch (event_p->id)
+	{
+		case APP_EVENT_WIFI_CONNECTED:
+			ip.addr = event_p->value;
+			n = snprintf(item + len, size - len, ",\"ip\":\"" IPSTR "\"}", IP2STR(&ip));
+			break;
+
+		case APP_EVENT_WIFI_CONNECT_FAILED:
+			n = snprintf(item + len, size - len, ",\"reason\":%ld}", event_p->value);
+			break;
+
+		case APP_EVENT_TIME_STEPPED:
+			n = snprintf(item + len, size - len, ",\"offset_ms\":%ld}", event_p->value);
+			break;
+
+		default:
+			n = snprintf(item + len, size - len, "}");
+			break;
+	}
+	if (n < 0 || (size_t)n >= size - len)
+	{
+		return -1;
+	}
+	return len + n;
+}
+
+/**
+ * @brief Adds a published message to the window and spends a token
+ * @param msg_id given by the client
+ * @param entry_p positions after the message, sent_us is set here
+ */
+static void mqttUplink_track(int msg_id, const mqtt_uplink_inflight_t * entry_p)
+{
+	mqtt_uplink_inflight_t * slot_p = &g_inflight[g_inflight_count];
+
+	*slot_p = *entry_p;
+	slot_p->msg_id = msg_id;
+	slot_p->acked = false;
+	slot_p->sent_us = esp_timer_get_time();
+	g_inflight_count++;
+	g_tokens -= MQTT_UPLINK_TOKEN;
+
+	taskENTER_CRITICAL(&uplink_mux);
+	g_stats.published++;
+	g_stats.inflight = g_inflight_count;
+	taskEXIT_CRITICAL(&uplink_mux);
+}
+
+/**
+ * @brief Times the drain of a backlog found on a connection
+ * @details it ends when less than a batch is left and all is acknowledged
+ * @param now_us
+ */
+static void mqttUplink_timeDrain(int64_t now_us)
+{
+	uint32_t connects;
+	uint32_t samples;
+
+	taskENTER_CRITICAL(&uplink_mux);
+	connects = g_stats.connects;
+	samples = g_stats.samples;
+	taskEXIT_CRITICAL(&uplink_mux);
+
+	if (connects != g_seen_connects)
+	{
+		g_seen_connects = connects;
+		if (telemetryStore_pending(&g_committed) >= MQTT_UPLINK_BATCH_BYTES)
+		{
+			g_draining = true;
+			g_drain_start_us = now_us;
+			g_drain_start_samples = samples;
+		}
+	}
+
+	if (g_draining && g_inflight_count == 0 && telemetryStore_pending(&g_read) < MQTT_UPLINK_BATCH_BYTES)
+	{
+		g_draining = false;
+		taskENTER_CRITICAL(&uplink_mux);
+		g_stats.drain_samples = samples - g_drain_start_samples;
+		g_stats.drain_ms = (now_us - g_drain_start_us) / 1000;
+		taskEXIT_CRITICAL(&uplink_mux);
+		ESP_LOGI(TAG, "backlog of %lu samples sent in %lu ms", samples - g_drain_start_samples,
+					(uint32_t)((now_us - g_drain_start_us) / 1000));
+	}
+}
+
+/**
+ * @brief Reads the acknowledged position saved on NVS
+ * @details none saved, the whole log is sent
+ */
+static void mqttUplink_loadCursor(void)
+{
+	nvs_handle_t handle;
+	size_t length = sizeof(telemetry_cursor_t);
+	esp_err_t err;
+
+	err = nvs_open(MQTT_UPLINK_NVS_NAMESPACE, NVS_READONLY, &handle);
+	if (err == ESP_OK)
+	{
+		if (nvs_get_blob(handle, MQTT_UPLINK_NVS_KEY, &g_committed, &length) != ESP_OK
+			|| length != sizeof(telemetry_cursor_t))
+		{
+			memset(&g_committed, 0x00, sizeof(telemetry_cursor_t));
+		}
+		nvs_close(handle);
+	}
+	else if (err != ESP_ERR_NVS_NOT_FOUND)
+	{
+		ESP_LOGE(TAG, "mqttUplink_loadCursor: nvs_open failed (%s)", esp_err_to_name(err));
+	}
+	g_read = g_committed;
+	g_saved = g_committed;
+}
+
+/**
+ * @brief Writes the acknowledged position on NVS
+ */
+static void mqttUplink_saveCursor(void)
+{
+	telemetry_cursor_t cursor = g_committed;
+	nvs_handle_t handle;
+	esp_err_t err;
+
+	err = nvs_open(MQTT_UPLINK_NVS_NAMESPACE, NVS_READWRITE, &handle);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "mqttUplink_saveCursor: nvs_open failed (%s)", esp_err_to_name(err));
+		return;
+	}
+	err = nvs_set_blob(handle, MQTT_UPLINK_NVS_KEY, &cursor, sizeof(telemetry_cursor_t));
+	if (err == ESP_OK)
+	{
+		err = nvs_commit(handle);
+	}
+	nvs_close(handle);
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "mqttUplink_saveCursor: %s", esp_err_to_name(err));
+		return;
+	}
+	g_saved = cursor;
+}
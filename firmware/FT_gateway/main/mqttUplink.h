@@ -0,0 +1,103 @@
+/**
+ * @file mqttUplink.h
+ * @brief Telemetry and events to the backend over MQTT
+ * @details
+ * The client starts on the first station connection. Telemetry is not
+ * queued in RAM: the uplink keeps a cursor on the telemetry store and
+ * sends what was written after it, so an outage only leaves the cursor
+ * behind and the flash log is the backlog. The samples go out in
+ * compressed batches (telemetryCodec.h) of up to MQTT_UPLINK_BATCH_BYTES,
+ * QoS 1, with up to MQTT_UPLINK_INFLIGHT of them awaiting their PUBACK.
+ * The cursor moves over a batch once it and the ones before it are
+ * acknowledged and is saved on NVS; after a disconnection or a reset the
+ * batches not acknowledged are sent again, the backend may see a sample
+ * twice. A backlog drains at MQTT_UPLINK_DRAIN_BATCHES_S at most.
+ *
+ *     <prefix>/<id>/telemetry	batches, QoS 1
+ *     <prefix>/<id>/events		JSON list of the application events, QoS 1
+ *     <prefix>/<id>/status		"online", or "offline" by the broker (will), retained
+ *
+ * Batch: "TB", version 1, 1 column, the base time as a little endian
+ * uint32, then per sample a varint series index and a codec sample of
+ * that series from the base time and value 0. A series index not seen
+ * yet in the batch is followed by a varint device index and the
+ * attribute, a device index not seen yet by the IEEE address (8 bytes,
+ * little endian). tools/uplink_bench.py decodes them.
+ * The events wait in RAM, MQTT_UPLINK_EVENTS of them; the oldest go first
+ * when it is full.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_MQTTUPLINK_H_
+#define MAIN_MQTTUPLINK_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+#define MQTT_UPLINK_NVS_NAMESPACE		"uplink"
+#define MQTT_UPLINK_NVS_KEY				"cursor"
+#define MQTT_UPLINK_CLIENT_ID_LEN		20		// "ft-gw-" and the station MAC
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief Uplink figures
+ */
+typedef struct mqtt_uplink_stats_s
+{
+	bool		started;
+	bool		connected;
+	char		client_id[MQTT_UPLINK_CLIENT_ID_LEN];
+	uint32_t	connects;
+	uint32_t	published;			///> telemetry and events messages
+	uint32_t	acked;
+	uint32_t	resent;				///> batches sent again after a disconnection
+	uint32_t	publish_errors;		///> refused by the client, outbox full included
+	uint8_t		inflight;
+	uint32_t	samples;			///> acknowledged
+	uint32_t	bytes;				///> telemetry payload acknowledged
+	uint32_t	backlog_bytes;		///> store records after the cursor
+	uint32_t	lost_blocks;		///> erased by the store before they were sent
+	uint32_t	events;				///> acknowledged
+	uint16_t	events_pending;
+	uint32_t	events_dropped;		///> RAM list full
+	uint32_t	drain_samples;		///> last backlog drained after a connection
+	uint32_t	drain_ms;
+} mqtt_uplink_stats_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Loads the cursor and waits for the station connection
+ * @details the client and the uplink task start on the first one
+ */
+void mqttUplink_setup(void);
+
+/**
+ * @brief Copies the uplink figures
+ * @param stats_p destination
+ */
+void mqttUplink_getStats(mqtt_uplink_stats_t * stats_p);
+
+#endif /* MAIN_MQTTUPLINK_H_ */
@@ -12,6 +12,7 @@
 #include "esp_log.h"
 
 #include "httpServer.h"
+#include "ledRGB.h"
 #include "otaUpdate.h"
 #include "esp_timer.h"
 
@@ -29,7 +30,7 @@ const esp_timer_create_args_t fw_update_reset_args = {
 		.dispatch_method = ESP_TIMER_TASK,
 		.name = "fw_update_reset"
 };
-esp_timer_handle_t fw_update_reset;
+esp_timer_handle_t fw_update_reset = NULL;
 
 /**
  * Checks the g_fw_update_status and creates the fw_update_reset timer if g_fw_update_status is true.
@@ -39,9 +40,20 @@ void ota_fw_update_reset_timer(void)
 	if (g_fw_update_status == OTA_UPDATE_SUCCESSFUL)
 	{
 		ESP_LOGI(TAG, "ota_fw_update_reset_timer: FW updated successful starting FW update reset timer");
-		// Give the web page a chance to receive an acknowledge back and initialize the timer
-		ESP_ERROR_CHECK(esp_timer_create(&fw_update_reset_args, &fw_update_reset));
-		ESP_ERROR_CHECK(esp_timer_start_once(fw_update_reset, 8000000));
+		// Give the web page a chance to receive an acknowledge back, the timer is created once
+		if (fw_update_reset == NULL)
+		{
+			ESP_ERROR_CHECK(esp_timer_create(&fw_update_reset_args, &fw_update_reset));
+		}
+		// A second update within the delay restarts it, its page gets the acknowledge too
+		esp_err_t err = esp_timer_is_active(fw_update_reset)
+							? esp_timer_restart(fw_update_reset, 8000000)
+							: esp_timer_start_once(fw_update_reset, 8000000);
+		if (err != ESP_OK)
+		{
+			ESP_LOGE(TAG, "ota_fw_update_reset_timer: %s, restarting now", esp_err_to_name(err));
+			esp_restart();
+		}
 	}
 	else
 	{
@@ -74,6 +86,7 @@ esp_err_t ota_begin_partition(const esp_partition_t *partition, esp_ota_handle_t
         return ESP_FAIL;
     }
     ESP_LOGI(TAG, "Writing to partition subtype %d at offset 0x%lx", partition->subtype, partition->address);
+    ledRGB_setPattern(LED_PATTERN_OTA_IN_PROGRESS);
     return ESP_OK;
 }
 
@@ -176,9 +189,11 @@ void ota_update_status(bool flash_successful) {
     if (flash_successful) {
         ESP_LOGI(TAG, "OTA_UPDATE_SUCCESSFUL");
         g_fw_update_status = OTA_UPDATE_SUCCESSFUL;
+        ledRGB_restore();
         ota_fw_update_reset_timer();
     } else {
         ESP_LOGI(TAG, "OTA_UPDATE_FAILED");
         g_fw_update_status = OTA_UPDATE_FAILED;
+        ledRGB_setPattern(LED_PATTERN_OTA_FAILED);
     }
 }
\ No newline at end of file
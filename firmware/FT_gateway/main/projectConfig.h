@@ -34,9 +34,132 @@
 #define WIFI_AP_GATEWAY			"192.168.0.1"		// AP default gateway
 #define WIFI_AP_NETMASK			"255.255.255.0"     // AP netmask
 #define WIFI_AP_BANDWIDTH		WIFI_BW_HT20		// AP bandwidth = 20 MHz, the 40 will be for station
-#define WIFI_STA_POWER_SAVE		WIFI_PS_NONE		// Power save is not being used
 #define WIFI_SSID_LENGTH		32					// IEEE standard maximum
 #define WIFI_PASSWORD_LENGTH	64					// IEEE standard maximum
 #define MAX_CONNECTION_RETRIES	5					// retry numbers on disconnect
 
+// SOFT AP POLICY
+#define WIFI_AP_SHUTDOWN_DELAY_S			120		// drop to STA only this long after getting an IP with no AP clients, 0 = AP always on
+#define WIFI_AP_ENABLE_BUTTON_GPIO			0		// button that brings the AP back (BOOT button on most boards), -1 = none
+#define WIFI_AP_ENABLE_BUTTON_LEVEL			0		// level read while the button is pressed
+#define WIFI_AP_ENABLE_BUTTON_DEBOUNCE_MS	300		// presses closer than this are ignored
+#define WIFI_AP_CSA_COUNT					3		// beacons announcing a SoftAP channel change before it happens
+#define WIFI_AP_BEACON_AIRTIME_US			2200	// ~250 byte beacon at 1 Mbps plus long preamble, used to report the airtime freed
+
+// WI-FI POWER PROFILES
+#define WIFI_POWER_DEFAULT_PROFILE		WIFI_POWER_LOW_LATENCY	// used until one is saved, no power save like before
+#define WIFI_POWER_MEASURE_PINGS		20		// pings to the gateway per profile on a measurement sweep
+#define WIFI_POWER_MEASURE_INTERVAL_MS	1000	// time between pings, long enough for the radio to go back to sleep
+#define WIFI_POWER_MEASURE_TIMEOUT_MS	3000	// covers a WIFI_PS_MAX_MODEM listen interval
+
+// LINK QUALITY
+#define LINK_QUALITY_SAMPLE_PERIOD_S	10		// time between samples
+#define LINK_QUALITY_RING_SIZE			60		// samples kept, 10 minutes of history
+
+// DNS CACHE
+#define DNS_CACHE_SIZE					8		// hosts kept, least recently used is replaced
+#define DNS_CACHE_HOST_LEN				64		// longest host name kept, with the terminator
+#define DNS_CACHE_MAX_AGE_S				300		// an address older than this is refreshed in background
+#define DNS_CACHE_NEGATIVE_AGE_S		30		// a failed lookup isn't retried before this
+#define DNS_CACHE_WAIT_MS				3000	// longest wait for the first answer of a host
+
+// APPLICATION EVENTS
+#define APP_EVENTS_POST_TIMEOUT_MS		100		// longest wait for room on the default event loop queue
+
+// SYSTEM STATS
+#define SYS_STATS_PERIOD_S				10		// time between samples, /sys/stats only copies the last one
+#define SYS_STATS_MAX_TASKS				24		// tasks listed, IDF ones included
+
+// BOOT PROFILE, times since the application start (after the bootloader)
+#define BOOT_HTTP_READY_TARGET_MS		500		// HTTP server listening
+#define BOOT_AP_STARTED_TARGET_MS		1000	// SoftAP up, first point a client can get a byte
+
+// HEAP TRACE, only with CONFIG_GW_HEAP_TRACE
+#define HEAP_TRACE_RECORDS				300		// live allocations a phase can report, about 40 bytes each
+#define HEAP_TRACE_NAME_LEN				24		// longest phase name, with the terminator
+
+// ASYNC LOG
+#define ASYNC_LOG_RING_SIZE				64		// queued messages, power of 2, 44 bytes each
+#define ASYNC_LOG_MAX_ARGS				6		// 32 bit arguments of one message
+#define ASYNC_LOG_DRAIN_MS				50		// drain period, the task is also woken when the ring is half full
+#define ASYNC_LOG_RATE_BURST			5		// messages one call site can log per window
+#define ASYNC_LOG_RATE_WINDOW_MS		1000	// rate limit window
+#define ASYNC_LOG_LINE_LEN				128		// longest formatted line, longer ones are cut
+#define ASYNC_LOG_TEXT_RING_SIZE		16		// ESP_LOGx lines waiting for the UART, power of 2, 136 bytes each
+#define ASYNC_LOG_HISTORY_LINES			32		// lines kept for /sys/log
+#define ASYNC_LOG_STREAM_IDLE_S			10		// history stops being kept this long after the last /sys/log read
+
+// ZIGBEE NCP UART
+#define ZIGBEE_NCP_UART_PORT			2		// UART_NUM_2, 0 is the console
+#define ZIGBEE_NCP_TX_GPIO				17
+#define ZIGBEE_NCP_RX_GPIO				16
+#define ZIGBEE_NCP_RTS_GPIO				-1		// -1 = no hardware flow control
+#define ZIGBEE_NCP_CTS_GPIO				-1
+#define ZIGBEE_NCP_BAUD_RATE			460800
+#define ZIGBEE_NCP_RX_BUFFER			4096	// UART driver receive ring, filled from the FIFO interrupt
+#define ZIGBEE_NCP_TX_BUFFER			2048	// UART driver transmit ring, writes return once copied there
+#define ZIGBEE_NCP_RX_TIMEOUT_SYMBOLS	2		// idle line time before the received bytes are handed over
+#define ZIGBEE_NCP_MAX_PAYLOAD			256		// longest frame payload
+#define ZIGBEE_NCP_WINDOW				4		// requests waiting for a response at once
+#define ZIGBEE_NCP_TIMEOUT_MS			1000	// default wait for a response
+#define ZIGBEE_NCP_POLL_MS				20		// timeouts are checked at least this often
+#define ZIGBEE_NCP_MAX_HANDLERS			4		// event subscribers
+#define ZIGBEE_NCP_ECHO_ID				0xFFFE	// answered with the same payload by tools/ncp_standin.py
+#define ZIGBEE_NCP_BENCH_MAX_FRAMES		5000	// longest benchmark, it holds the HTTP server
+#define ZIGBEE_NCP_CMD_ON_OFF			0x0006	// ZCL On/Off to a device, payload short(2) endpoint(1) on(1)
+#define ZIGBEE_NCP_EVT_DEVICE_ANNCE		0x1001	// a device joined or rejoined, payload ieee(8) short(2)
+#define ZIGBEE_NCP_EVT_FRAME_RX			0x1002	// frame from a device, payload short(2) rssi(1) lqi(1)
+#define ZIGBEE_NCP_EVT_ATTR_REPORT		0x1003	// reported attribute, payload short(2) attr(1) value(4), attr as device_attr_t
+
+// DEVICE REGISTRY
+#define DEVICE_REGISTRY_MAX				512		// devices kept, about 40 bytes each with the tables
+#define DEVICE_REGISTRY_TABLE_BITS		10		// 1024 entries per hash table, at least twice DEVICE_REGISTRY_MAX
+#define DEVICE_REGISTRY_PAGE_RECORDS	16		// devices per NVS blob, a change rewrites its page only
+#define DEVICE_REGISTRY_FLUSH_S			30		// changed pages are written this long after the first change
+
+// VALVE SCHEDULE
+#define VALVE_SCHEDULE_MAX				128		// rules kept, about 76 bytes each with the timer, the NVS copy and a command slot
+#define VALVE_SCHEDULE_RESYNC_S			60		// larger clock jumps rebuild the wheel instead of catching up
+#define VALVE_SCHEDULE_ENDPOINT			1		// Zigbee endpoint of the valve On/Off cluster
+#define VALVE_SCHEDULE_CMD_TIMEOUT_MS	2000	// wait for the response, a full NCP window is retried on the next pass
+#define VALVE_SCHEDULE_CMD_RETRIES		3		// sends of a command refused or not answered before giving up
+#define VALVE_SCHEDULE_BENCH_MAX		4000	// benchmark timers, 12 bytes of heap each
+#define VALVE_SCHEDULE_BENCH_MAX_DAYS	28		// longest simulated time of the benchmark
+
+// TELEMETRY STORE
+#define TELEMETRY_PARTITION_LABEL		"telemetry"	// data partition of personal_partition.csv
+#define TELEMETRY_BLOCK_SIZE			4096	// one flash sector per block, erased as a whole
+#define TELEMETRY_MAX_BLOCKS			64		// blocks indexed, 16 bytes of RAM each, the partition may be smaller
+#define TELEMETRY_BLOCK_DEVICES			64		// devices per block, 8 bytes of RAM each, a new one past this opens the next block
+#define TELEMETRY_BLOCK_SERIES			256		// device attributes per block, 12 bytes of RAM each for their codec state
+#define TELEMETRY_BUFFER_RECORDS		64		// samples waiting in RAM, 24 bytes each, the task writes at half
+#define TELEMETRY_FLUSH_S				10		// longest wait of a sample before it is written
+#define TELEMETRY_QUERY_MAX_POINTS		2000	// a query step grows to keep the points under this
+
+// MQTT UPLINK
+#define MQTT_UPLINK_BROKER_HOST			CONFIG_GW_MQTT_BROKER_HOST	// menuconfig, empty leaves the uplink off
+#define MQTT_UPLINK_BROKER_PORT			CONFIG_GW_MQTT_BROKER_PORT
+#define MQTT_UPLINK_RESOLVE_S			30		// a broker host that didn't resolve is tried again after this
+#define MQTT_UPLINK_TOPIC_PREFIX		"ft"	// topics are <prefix>/<client id>/telemetry, events and status
+#define MQTT_UPLINK_KEEPALIVE_S			60
+#define MQTT_UPLINK_BATCH_BYTES			4096	// telemetry payload, the client output buffer and each outbox entry are as large
+#define MQTT_UPLINK_BATCH_SERIES		256		// device attributes per batch, 16 bytes of RAM each, a new one past this closes it
+#define MQTT_UPLINK_BATCH_DEVICES		64		// devices per batch, 8 bytes of RAM each
+#define MQTT_UPLINK_LINGER_S			30		// a batch that isn't full waits this long after the previous one
+#define MQTT_UPLINK_INFLIGHT			4		// QoS 1 messages awaiting their PUBACK, the client outbox holds them
+#define MQTT_UPLINK_ACK_TIMEOUT_S		60		// an older message was dropped by the client outbox, sent again
+#define MQTT_UPLINK_DRAIN_BATCHES_S		4		// most batches per second, bursts up to MQTT_UPLINK_INFLIGHT
+#define MQTT_UPLINK_EVENTS				32		// events waiting in RAM, 16 bytes each, the oldest are dropped
+#define MQTT_UPLINK_CURSOR_SAVE_S		60		// acknowledged position written to NVS at most this often
+#define MQTT_UPLINK_POLL_MS				500		// the PUBACKs also wake the task up
+
+// SAVED WI-FI NETWORKS
+#define WIFI_NETWORKS_MAX_SAVED				8		// how many networks the credential store keeps
+#define WIFI_NETWORKS_DEFAULT_PRIORITY		1		// priority used when none is given
+#define WIFI_NETWORKS_PRIORITY_WEIGHT_DBM	10		// each priority step is worth this many dBm on ranking
+#define WIFI_NETWORKS_MIN_RSSI				-90		// candidates weaker than this are ignored
+#define WIFI_NETWORKS_RESCAN_DELAY_S		60		// wait before scanning again once every candidate failed
+#define WIFI_SCAN_MAX_RECORDS				20		// scan records kept on the scan cache
+#define WIFI_SCAN_CACHE_MAX_AGE_S			300		// /wifiScan.json refreshes an older cache by itself
+
 #endif //__PROJECT_CONFIG_LIB__
\ No newline at end of file
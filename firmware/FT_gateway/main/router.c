@@ -13,6 +13,7 @@
 
 // C libraries
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 // ESP libraries
@@ -20,17 +21,37 @@
 #include "esp_http_server.h"
 #include "esp_http_client.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "cJSON.h"
 #include "esp_netif.h"
 #include "esp_netif_ip_addr.h"
 #include "esp_netif_types.h"
 #include "esp_wifi.h"
 #include "esp_wifi_types_generic.h"
+#include "sdkconfig.h"
 
 // Personal libraries
+#include "appEvents.h"
+#include "asyncLog.h"
+#include "bootProfile.h"
+#include "dateTimeNTP.h"
+#include "deviceRegistry.h"
+#include "valveSchedule.h"
+#include "heapTrace.h"
 #include "httpServer.h"
+#include "ledRGB.h"
+#include "linkQuality.h"
+#include "mqttUplink.h"
 #include "otaUpdate.h"
 #include "router.h"
+#include "sysStats.h"
+#include "telemetryCodec.h"
+#include "telemetryStore.h"
+#include "timebase.h"
+#include "wifiNetworks.h"
+#include "wifiPower.h"
+#include "wifiScan.h"
+#include "zigbeeNcp.h"
 
 
 
@@ -38,6 +59,22 @@
 **		DECLARATIONS	 **
 **************************/
 
+	/* Structures */
+
+/**
+ * @brief Telemetry points waiting to be sent as one chunk
+ */
+typedef struct router_points_s
+{
+	httpd_req_t *		req;
+	bool				first;
+	bool				binary;		// telemetryCodec.h samples instead of JSON
+	telemetry_codec_t	codec;
+	size_t				len;
+	char				buf[BUFFER_MAX_SIZE * 10];
+} router_points_t;
+
+
 	/* Variables */
 
 // Tag used for ESP serial console messages
@@ -61,6 +98,37 @@ static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(get_wifi_connect_info_json)(httpd
 static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(wifi_disconnect_json)(httpd_req_t *req);
 esp_err_t APP_URI_FUNCTION_HANDLER_NAME(http_server_OTA_update_handler)(httpd_req_t *req);
 esp_err_t APP_URI_FUNCTION_HANDLER_NAME(http_server_OTA_status_handler)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(get_wifi_networks_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(set_wifi_network_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(delete_wifi_network_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(wifi_scan_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(wifi_app_stats_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(get_wifi_power_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(set_wifi_power_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(link_quality_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(ntp_status_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(sys_stats_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(heap_trace_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(boot_profile_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(log_tail)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(ncp_stats_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(ncp_bench_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(get_devices_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(set_device_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(delete_device_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(get_schedules_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(set_schedule_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(delete_schedule_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(schedule_bench_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(telemetry_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(telemetry_stats_json)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(telemetry_bin)(httpd_req_t *req);
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(uplink_stats_json)(httpd_req_t *req);
+static esp_err_t router_parseTelemetryQuery(httpd_req_t *req, telemetry_query_t * query_p);
+static void router_sendPoint(const telemetry_point_t * point_p, void * ctx);
+static bool router_parseIeee(cJSON * json, uint64_t * ieee_p);
+static int router_recvBody(httpd_req_t *req, char * buffer, size_t size);
+static esp_err_t router_sendResult(httpd_req_t *req, esp_err_t err);
 static void router_uri_register(void);
 
 
@@ -71,12 +139,17 @@ static void router_uri_register(void);
 
 void router_setup(void)
 {
-	// Allocate the api routes inside the httpServer code
-	httpServer_setApiRoutes(&router_uri_register);
+	// Allocate the api routes inside the httpServer code, one handler each
+	#define X(id, handler, route, method, ansType) + 1
+		httpServer_setApiRoutes(&router_uri_register, 0 X_MACRO_API_ROUTES_LIST);
+	#undef X
 	
-	// Start WiFi
+	// Start WiFi, the driver comes up on the WiFi task
 	wifiApp_start();
 	
+	// The TCP/IP stack is up, serve while the WiFi driver starts
+	httpServer_start();
+	
 	// Clean localTimeJSON buffer
 	memset(localTimeJSON, 0, BUFFER_MAX_SIZE);
 }
@@ -101,20 +174,28 @@ esp_err_t APP_URI_FUNCTION_HANDLER_NAME(http_server_OTA_update_handler)(httpd_re
     int recv_len;
     bool is_req_body_started = false;
     bool flash_successful = false;
+    int64_t recv_start_us;
+    int64_t recv_total_us = 0;
 
     const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
 
     do {
+        recv_start_us = esp_timer_get_time();
         recv_len = httpd_req_recv(req, ota_buff, MIN(content_length, sizeof(ota_buff)));
+        recv_total_us += esp_timer_get_time() - recv_start_us;
         if (recv_len < 0) {
             if (recv_len == HTTPD_SOCK_ERR_TIMEOUT) {
                 ESP_LOGI(TAG, "Socket Timeout");
                 continue;
             }
             ESP_LOGI(TAG, "OTA other Error %d", recv_len);
+            if (is_req_body_started) {
+                ledRGB_setPattern(LED_PATTERN_OTA_FAILED);
+            }
             return ESP_FAIL;
         }
-        ESP_LOGI(TAG, "OTA RX: %d of %d", content_received, content_length);
+        // Once per 1 KB chunk, the console would slow the upload down
+        ASYNC_LOGI(TAG, "OTA RX: %d of %d", content_received, content_length);
 
         esp_err_t err;
         if (!is_req_body_started) {
@@ -124,10 +205,16 @@ esp_err_t APP_URI_FUNCTION_HANDLER_NAME(http_server_OTA_update_handler)(httpd_re
         } else {
             err = ota_process_next_chunk(ota_buff, recv_len, &content_received, ota_handle);
         }
-        if (err != ESP_OK) return ESP_FAIL;
+        if (err != ESP_OK) {
+            ledRGB_setPattern(LED_PATTERN_OTA_FAILED);
+            return ESP_FAIL;
+        }
 
     } while (recv_len > 0 && content_received < content_length);
 
+    // Only the time on the socket, flash writes don't count for the link throughput
+    linkQuality_recordTransfer(content_received, recv_total_us);
+
     flash_successful = ota_finalize_and_set_boot(ota_handle, update_partition);
     ota_update_status(flash_successful);
 
@@ -162,26 +249,21 @@ esp_err_t APP_URI_FUNCTION_HANDLER_NAME(http_server_OTA_status_handler)(httpd_re
  */
 static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(wifi_connect_json)(httpd_req_t *req)
 {	
-	// char localJSONObjBuffer[BUFFER_MAX_SIZE];
-	size_t lenBodyJson = 0;
-	size_t lenPass;
-	size_t lenSSID;
-
-	char * ssid_p;
-	char * pwd_p;
-	wifi_config_t * wifi_config_p = NULL;
+	char body[BODY_MAX_SIZE];
+	int lenBodyJson;
 	
 	ESP_LOGI(TAG, "/wifiConnect.json requested");
-	
-	memset(localJSONObjBuffer,0, BUFFER_MAX_SIZE);
 
-	// Get Request Body
-	lenBodyJson = req->content_len;
-	httpd_req_recv(req, localJSONObjBuffer, lenBodyJson);
-	printf("Data sent by the client: %.*s\n",lenBodyJson, localJSONObjBuffer);
+	// Get Request Body, a 32 char SSID and a 64 char password take about 120 bytes
+	lenBodyJson = router_recvBody(req, body, sizeof(body));
+	if (lenBodyJson < 0) {
+		return router_sendResult(req, ESP_ERR_INVALID_SIZE);
+	}
+	// The body carries the password, only its length is logged
+	ASYNC_LOGI(TAG, "/wifiConnect.json body: %d bytes", lenBodyJson);
 
 	// Parse the JSON data (example using cJSON)
-	cJSON *body_json = cJSON_Parse(localJSONObjBuffer);
+	cJSON *body_json = cJSON_Parse(body);
 	if (!body_json) {
 		ESP_LOGE(TAG, "Failed to parse JSON data");
 		cJSON_Delete(body_json);
@@ -204,28 +286,23 @@ static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(wifi_connect_json)(httpd_req_t *r
 	}
 
 
-	// Get SSID from body
-	ssid_p = wifiApp_getStationSSID();
-	memset(ssid_p, 0x00, WIFI_SSID_LENGTH);
-	ssid_p = ssid_json->valuestring;
-	lenSSID = strlen(ssid_p);
-	
-	// Get Password from body
-	pwd_p = wifiApp_getStationPassword();
-	memset(pwd_p, 0x00, WIFI_PASSWORD_LENGTH);
-	pwd_p = pwd_json->valuestring;
-	lenPass = strlen(pwd_p);
-	
-	// Update the WiFi networks configuration and let the WiFi applications know
-	wifi_config_p = wifiApp_getWifiConfig();
-	memset(wifi_config_p, 0x00, sizeof(wifi_config_t));
-	memcpy(wifi_config_p->sta.ssid, ssid_p, lenSSID);
-	memcpy(wifi_config_p->sta.password, pwd_p, lenPass);
-	wifiApp_sendMessage(WIFI_APP_CONNECTING_FROM_HTTP_SERVER);
+	if (strlen(ssid_json->valuestring) > WIFI_SSID_LENGTH || strlen(pwd_json->valuestring) > WIFI_PASSWORD_LENGTH) {
+		ESP_LOGE(TAG, "'c_ssid' or 'c_pwd' too long");
+		cJSON_Delete(body_json);
+		return ESP_FAIL;
+	}
+
+	// The credentials travel with the event, the WiFi application updates its configuration
+	wifi_app_event_payload_t payload;
+	memset(&payload, 0x00, sizeof(payload));
+	strcpy(payload.credentials.ssid, ssid_json->valuestring);
+	strcpy(payload.credentials.password, pwd_json->valuestring);
+	esp_err_t err = (wifiApp_sendEvent(WIFI_APP_CONNECTING_FROM_HTTP_SERVER, &payload) == pdTRUE) ? ESP_OK : ESP_ERR_TIMEOUT;
 
 	cJSON_Delete(body_json);
 	
-	return ESP_OK;
+	// A full WiFi application queue drops the request, the page has to know
+	return router_sendResult(req, err);
 }
 
 
@@ -242,7 +319,10 @@ static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(wifi_connect_status_json)(httpd_r
 	
 	memset(localJSONObjBuffer, 0, BUFFER_MAX_SIZE);
 	
-	sprintf(localJSONObjBuffer, "{\"wifi_connect_status_json\":%d}", *httpServer_get_wifiConnectStatus());
+	app_state_t state;
+	appEvents_getState(&state);
+	
+	sprintf(localJSONObjBuffer, "{\"wifi_connect_status_json\":%d}", state.wifi_status);
 	httpd_resp_set_type(req, "application/json");
 	httpd_resp_send(req, localJSONObjBuffer, strlen(localJSONObjBuffer));
 	
@@ -266,7 +346,10 @@ static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(get_wifi_connect_info_json)(httpd
 	char netmask[IP4ADDR_STRLEN_MAX];
 	char gateway[IP4ADDR_STRLEN_MAX];
 
-	if (*httpServer_get_wifiConnectStatus() == HTTP_WIFI_STATUS_CONNECT_SUCCESS)
+	app_state_t state;
+	appEvents_getState(&state);
+	
+	if (state.wifi_status == APP_WIFI_STATUS_CONNECT_SUCCESS)
 	{
 		wifi_ap_record_t wifi_data;
 		ESP_ERROR_CHECK(esp_wifi_sta_get_ap_info(&wifi_data));
@@ -297,7 +380,1315 @@ static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(wifi_disconnect_json)(httpd_req_t
 {
 	ESP_LOGI(TAG, "/wifiDisconnect.json requested");
 	
-	wifiApp_sendMessage(WIFI_APP_USER_REQUESTED_STA_DISCONNECT);
+	return router_sendResult(req, (wifiApp_sendMessage(WIFI_APP_USER_REQUESTED_STA_DISCONNECT) == pdTRUE) ? ESP_OK : ESP_ERR_TIMEOUT);
+}
+
+/**
+ * wifiNetworks.json GET handler lists the saved networks (passwords are never sent)
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK, otherwise ESP_FAIL if the answer can't be built
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(get_wifi_networks_json)(httpd_req_t *req)
+{
+	wifi_network_t network;
+	char * answer_p;
+	
+	ESP_LOGI(TAG, "GET /wifiNetworks.json requested");
+	
+	cJSON * root_json = cJSON_CreateObject();
+	cJSON * list_json = cJSON_AddArrayToObject(root_json, "networks");
+	
+	for (uint8_t i = 0; wifiNetworks_get(i, &network) == ESP_OK; i++)
+	{
+		cJSON * item_json = cJSON_CreateObject();
+		cJSON_AddStringToObject(item_json, "ssid", network.ssid);
+		cJSON_AddNumberToObject(item_json, "priority", network.priority);
+		cJSON_AddItemToArray(list_json, item_json);
+	}
+	cJSON_AddNumberToObject(root_json, "max", WIFI_NETWORKS_MAX_SAVED);
+	
+	answer_p = cJSON_PrintUnformatted(root_json);
+	cJSON_Delete(root_json);
+	if (!answer_p) {
+		return ESP_FAIL;
+	}
+	
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, answer_p, strlen(answer_p));
+	cJSON_free(answer_p);
+	
+	return ESP_OK;
+}
+
+/**
+ * wifiNetworks.json POST handler adds a network or updates an existing one.
+ * Body: {"ssid":"...","pwd":"...","priority":N}, priority is optional
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(set_wifi_network_json)(httpd_req_t *req)
+{
+	char body[BODY_MAX_SIZE];
+	uint8_t priority = WIFI_NETWORKS_DEFAULT_PRIORITY;
+	esp_err_t err = ESP_ERR_INVALID_ARG;
+	
+	ESP_LOGI(TAG, "POST /wifiNetworks.json requested");
+	
+	if (router_recvBody(req, body, sizeof(body)) < 0) {
+		return router_sendResult(req, ESP_ERR_INVALID_SIZE);
+	}
+	
+	cJSON *body_json = cJSON_Parse(body);
+	cJSON *ssid_json = cJSON_GetObjectItemCaseSensitive(body_json, "ssid");
+	cJSON *pwd_json = cJSON_GetObjectItemCaseSensitive(body_json, "pwd");
+	cJSON *priority_json = cJSON_GetObjectItemCaseSensitive(body_json, "priority");
+	
+	if (cJSON_IsNumber(priority_json) && priority_json->valueint >= 0 && priority_json->valueint <= UINT8_MAX) {
+		priority = priority_json->valueint;
+	}
+	if (cJSON_IsString(ssid_json) && cJSON_IsString(pwd_json)) {
+		err = wifiNetworks_set(ssid_json->valuestring, pwd_json->valuestring, priority);
+	} else {
+		ESP_LOGE(TAG, "Missing 'ssid' or 'pwd' in JSON data");
+	}
+	cJSON_Delete(body_json);
+	
+	return router_sendResult(req, err);
+}
+
+/**
+ * wifiNetworks.json DELETE handler removes a saved network.
+ * Body: {"ssid":"..."}
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(delete_wifi_network_json)(httpd_req_t *req)
+{
+	char body[BODY_MAX_SIZE];
+	esp_err_t err = ESP_ERR_INVALID_ARG;
+	
+	ESP_LOGI(TAG, "DELETE /wifiNetworks.json requested");
+	
+	if (router_recvBody(req, body, sizeof(body)) < 0) {
+		return router_sendResult(req, ESP_ERR_INVALID_SIZE);
+	}
+	
+	cJSON *body_json = cJSON_Parse(body);
+	cJSON *ssid_json = cJSON_GetObjectItemCaseSensitive(body_json, "ssid");
+	if (cJSON_IsString(ssid_json)) {
+		err = wifiNetworks_remove(ssid_json->valuestring);
+	}
+	cJSON_Delete(body_json);
+	
+	return router_sendResult(req, err);
+}
+
+/**
+ * wifiScan.json handler answers with the cached scan result and its age.
+ * A new scan is requested (never waited for) with ?refresh=1, when nothing
+ * was scanned yet or when the cache is older than WIFI_SCAN_CACHE_MAX_AGE_S.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK, otherwise ESP_FAIL if the answer can't be built
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(wifi_scan_json)(httpd_req_t *req)
+{
+	static wifi_scan_entry_t entries[WIFI_SCAN_MAX_RECORDS];
+	char query[BUFFER_MAX_SIZE];
+	char value[8];
+	bool refresh = false;
+	int64_t age_ms;
+	uint16_t count;
+	char * answer_p;
+	
+	ESP_LOGI(TAG, "/wifiScan.json requested");
+	
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+		&& httpd_query_key_value(query, "refresh", value, sizeof(value)) == ESP_OK)
+	{
+		refresh = (strcmp(value, "1") == 0 || strcmp(value, "true") == 0);
+	}
+	
+	// Handlers run one at a time on the httpd task, the static buffer is safe
+	count = wifiScan_get(entries, &age_ms);
+	if (refresh || age_ms < 0 || age_ms > WIFI_SCAN_CACHE_MAX_AGE_S * 1000LL) {
+		wifiScan_request();
+	}
+	
+	cJSON * root_json = cJSON_CreateObject();
+	cJSON_AddNumberToObject(root_json, "age_ms", age_ms);
+	cJSON_AddBoolToObject(root_json, "scanning", wifiScan_isRunning());
+	cJSON * list_json = cJSON_AddArrayToObject(root_json, "aps");
+	for (uint16_t i = 0; i < count; i++)
+	{
+		cJSON * item_json = cJSON_CreateObject();
+		cJSON_AddStringToObject(item_json, "ssid", entries[i].ssid);
+		cJSON_AddNumberToObject(item_json, "rssi", entries[i].rssi);
+		cJSON_AddNumberToObject(item_json, "ch", entries[i].channel);
+		cJSON_AddNumberToObject(item_json, "auth", entries[i].authmode);
+		cJSON_AddItemToArray(list_json, item_json);
+	}
+	
+	answer_p = cJSON_PrintUnformatted(root_json);
+	cJSON_Delete(root_json);
+	if (!answer_p) {
+		return ESP_FAIL;
+	}
+	
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, answer_p, strlen(answer_p));
+	cJSON_free(answer_p);
+	
+	return ESP_OK;
+}
+
+/**
+ * wifiAppStats.json handler answers with the WiFi application queue counters.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(wifi_app_stats_json)(httpd_req_t *req)
+{
+	char statsJSON[320];
+	wifi_app_stats_t stats;
+	
+	ESP_LOGI(TAG, "/wifiAppStats.json requested");
+	
+	wifiApp_getStats(&stats);
+	snprintf(statsJSON, sizeof(statsJSON),
+			"{\"state\":%d,\"sent\":%lu,\"coalesced\":%lu,\"deferred\":%lu,\"dropped\":%lu,\"rejected\":%lu,\"dispatched\":%lu,"
+			"\"queue_depth_max\":%lu,\"queue_length\":%d,\"latency_avg_us\":%lu,\"latency_max_us\":%lu,\"handler_max_us\":%lu}",
+			wifiApp_getConnState(), stats.sent, stats.coalesced, stats.deferred, stats.dropped, stats.rejected, stats.dispatched,
+			stats.queue_depth_max, WIFI_APP_QUEUE_LENGTH, stats.latency_avg_us, stats.latency_max_us, stats.handler_max_us);
+	
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, statsJSON, strlen(statsJSON));
+	
+	return ESP_OK;
+}
+
+/**
+ * wifiPower.json GET handler answers with the selected power profile, the
+ * settings of every profile and the round-trip time of the last measurement.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(get_wifi_power_json)(httpd_req_t *req)
+{
+	wifi_power_rtt_t rtt;
+	char * answer_p;
+	
+	ESP_LOGI(TAG, "GET /wifiPower.json requested");
+	
+	cJSON * root_json = cJSON_CreateObject();
+	cJSON_AddStringToObject(root_json, "profile", wifiPower_getSettings(wifiPower_getProfile())->name);
+	cJSON_AddBoolToObject(root_json, "measuring", wifiPower_isMeasuring());
+	cJSON_AddBoolToObject(root_json, "modem_sleep", wifiPower_isModemSleeping());
+#ifdef CONFIG_PM_ENABLE
+	cJSON_AddBoolToObject(root_json, "pm", true);
+#else
+	cJSON_AddBoolToObject(root_json, "pm", false);
+#endif
+	cJSON * list_json = cJSON_AddArrayToObject(root_json, "profiles");
+	for (uint8_t i = 0; i < WIFI_POWER_PROFILE_MAX; i++)
+	{
+		const wifi_power_profile_t * settings_p = wifiPower_getSettings(i);
+		cJSON * item_json = cJSON_CreateObject();
+		cJSON_AddStringToObject(item_json, "name", settings_p->name);
+		cJSON_AddNumberToObject(item_json, "ps", settings_p->ps);
+		cJSON_AddNumberToObject(item_json, "listen_interval", settings_p->listen_interval);
+		cJSON_AddNumberToObject(item_json, "cpu_max_mhz", settings_p->cpu_max_mhz);
+		cJSON_AddNumberToObject(item_json, "cpu_min_mhz", settings_p->cpu_min_mhz);
+		cJSON_AddBoolToObject(item_json, "light_sleep", settings_p->light_sleep);
+		cJSON_AddNumberToObject(item_json, "beacon_interval", settings_p->beacon_interval);
+		cJSON_AddNumberToObject(item_json, "est_ma", settings_p->est_ma);
+		
+		wifiPower_getRtt(i, &rtt);
+		cJSON * rtt_json = cJSON_AddObjectToObject(item_json, "rtt");
+		cJSON_AddNumberToObject(rtt_json, "replies", rtt.replies);
+		cJSON_AddNumberToObject(rtt_json, "timeouts", rtt.timeouts);
+		cJSON_AddNumberToObject(rtt_json, "min_ms", rtt.rtt_min_ms);
+		cJSON_AddNumberToObject(rtt_json, "avg_ms", rtt.rtt_avg_ms);
+		cJSON_AddNumberToObject(rtt_json, "max_ms", rtt.rtt_max_ms);
+		cJSON_AddItemToArray(list_json, item_json);
+	}
+	
+	answer_p = cJSON_PrintUnformatted(root_json);
+	cJSON_Delete(root_json);
+	if (!answer_p) {
+		return ESP_FAIL;
+	}
+	
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, answer_p, strlen(answer_p));
+	cJSON_free(answer_p);
+	
+	return ESP_OK;
+}
+
+/**
+ * wifiPower.json POST handler selects a power profile or starts a measurement.
+ * Body: {"profile":"balanced"} or {"measure":true}
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(set_wifi_power_json)(httpd_req_t *req)
+{
+	char body[BODY_MAX_SIZE];
+	esp_err_t err = ESP_ERR_INVALID_ARG;
+	
+	ESP_LOGI(TAG, "POST /wifiPower.json requested");
+	
+	if (router_recvBody(req, body, sizeof(body)) < 0) {
+		return router_sendResult(req, ESP_ERR_INVALID_SIZE);
+	}
+	
+	cJSON *body_json = cJSON_Parse(body);
+	cJSON *profile_json = cJSON_GetObjectItemCaseSensitive(body_json, "profile");
+	cJSON *measure_json = cJSON_GetObjectItemCaseSensitive(body_json, "measure");
+	
+	if (cJSON_IsString(profile_json)) {
+		err = wifiPower_select(wifiPower_find(profile_json->valuestring));
+	} else if (cJSON_IsTrue(measure_json)) {
+		err = wifiPower_measureStart();
+	}
+	cJSON_Delete(body_json);
+	
+	return router_sendResult(req, err);
+}
+
+/**
+ * linkQuality.json handler answers with the link quality summary, the
+ * samples themselves are added with ?history=1.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(link_quality_json)(httpd_req_t *req)
+{
+	static link_quality_sample_t samples[LINK_QUALITY_RING_SIZE];
+	link_quality_summary_t summary;
+	char query[BUFFER_MAX_SIZE];
+	char value[8];
+	bool history = false;
+	char * answer_p;
+	
+	ESP_LOGI(TAG, "/linkQuality.json requested");
+	
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+		&& httpd_query_key_value(query, "history", value, sizeof(value)) == ESP_OK)
+	{
+		history = (strcmp(value, "1") == 0 || strcmp(value, "true") == 0);
+	}
+	
+	linkQuality_getSummary(&summary);
+	
+	cJSON * root_json = cJSON_CreateObject();
+	cJSON_AddNumberToObject(root_json, "period_s", LINK_QUALITY_SAMPLE_PERIOD_S);
+	cJSON_AddNumberToObject(root_json, "samples", summary.samples);
+	cJSON_AddNumberToObject(root_json, "connected_pct", summary.connected_pct);
+	cJSON * rssi_json = cJSON_AddObjectToObject(root_json, "rssi");
+	cJSON_AddNumberToObject(rssi_json, "min", summary.rssi_min);
+	cJSON_AddNumberToObject(rssi_json, "avg", summary.rssi_avg);
+	cJSON_AddNumberToObject(rssi_json, "max", summary.rssi_max);
+	cJSON_AddNumberToObject(rssi_json, "last", summary.rssi_last);
+	cJSON_AddNumberToObject(root_json, "phy_mode", summary.phy_mode_last);
+	cJSON_AddNumberToObject(root_json, "phy_rate_mbps", summary.phy_rate_mbps_last);
+	cJSON_AddNumberToObject(root_json, "disconnects", summary.disconnects);
+	cJSON_AddNumberToObject(root_json, "beacon_loss", summary.beacon_loss);
+	cJSON_AddNumberToObject(root_json, "last_reason", summary.last_reason);
+	if (summary.tcp_retrans_valid) {
+		cJSON_AddNumberToObject(root_json, "tcp_retrans", summary.tcp_retrans);
+	} else {
+		cJSON_AddNullToObject(root_json, "tcp_retrans");
+	}
+	cJSON * throughput_json = cJSON_AddObjectToObject(root_json, "throughput_kbps");
+	cJSON_AddNumberToObject(throughput_json, "min", summary.throughput_kbps_min);
+	cJSON_AddNumberToObject(throughput_json, "avg", summary.throughput_kbps_avg);
+	cJSON_AddNumberToObject(throughput_json, "max", summary.throughput_kbps_max);
+	
+	if (history)
+	{
+		// Handlers run one at a time on the httpd task, the static buffer is safe
+		uint16_t count = linkQuality_getSamples(samples, LINK_QUALITY_RING_SIZE);
+		cJSON * list_json = cJSON_AddArrayToObject(root_json, "history");
+		for (uint16_t i = 0; i < count; i++)
+		{
+			// [time_s, rssi, phy_rate_mbps, disconnects, beacon_loss, last_reason, tcp_retrans, throughput_kbps]
+			const int values[] = { samples[i].time_s, samples[i].rssi, samples[i].phy_rate_mbps, samples[i].disconnects,
+									samples[i].beacon_loss, samples[i].last_reason, samples[i].tcp_retrans, samples[i].throughput_kbps };
+			cJSON_AddItemToArray(list_json, cJSON_CreateIntArray(values, sizeof(values) / sizeof(values[0])));
+		}
+	}
+	
+	answer_p = cJSON_PrintUnformatted(root_json);
+	cJSON_Delete(root_json);
+	if (!answer_p) {
+		return ESP_FAIL;
+	}
+	
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, answer_p, strlen(answer_p));
+	cJSON_free(answer_p);
+	
+	return ESP_OK;
+}
+
+/**
+ * ntpStatus.json handler answers with the clock discipline status and the
+ * statistics of every NTP server.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(ntp_status_json)(httpd_req_t *req)
+{
+	static timebase_cache_t date_cache;
+	static timebase_cache_t time_cache;
+	ntp_stats_t stats;
+	ntp_server_stats_t server;
+	char text[TIMEBASE_TEXT_LEN];
+	char * answer_p;
+	
+	ESP_LOGI(TAG, "/ntpStatus.json requested");
+	
+	dateTimeNTP_getStats(&stats);
+	
+	cJSON * root_json = cJSON_CreateObject();
+	cJSON_AddBoolToObject(root_json, "synced", stats.synced);
+	timebase_format(&date_cache, TIMEBASE_FMT_DATE, text, sizeof(text));
+	cJSON_AddStringToObject(root_json, "date", text);
+	timebase_format(&time_cache, TIMEBASE_FMT_TIME, text, sizeof(text));
+	cJSON_AddStringToObject(root_json, "time", text);
+	cJSON_AddNumberToObject(root_json, "epoch_ms", timebase_nowUs() / 1000);
+	cJSON_AddNumberToObject(root_json, "offset_us", stats.offset_us);
+	cJSON_AddNumberToObject(root_json, "delay_us", stats.delay_us);
+	cJSON_AddNumberToObject(root_json, "error_us", stats.delay_us / 2);
+	cJSON_AddNumberToObject(root_json, "poll_s", stats.poll_s);
+	cJSON_AddNumberToObject(root_json, "polls", stats.polls);
+	cJSON_AddNumberToObject(root_json, "replies", stats.replies);
+	cJSON_AddNumberToObject(root_json, "failures", stats.failures);
+	cJSON_AddNumberToObject(root_json, "steps", stats.steps);
+	cJSON_AddNumberToObject(root_json, "last_sync_s", stats.last_sync_s);
+	cJSON_AddNumberToObject(root_json, "truechimers", stats.truechimers);
+	cJSON * list_json = cJSON_AddArrayToObject(root_json, "servers");
+	for (uint8_t i = 0; i < NTP_SERVER_COUNT; i++)
+	{
+		dateTimeNTP_getServerStats(i, &server);
+		cJSON * item_json = cJSON_CreateObject();
+		cJSON_AddStringToObject(item_json, "host", server.host);
+		cJSON_AddNumberToObject(item_json, "stratum", server.stratum);
+		cJSON_AddNumberToObject(item_json, "reach", server.reach);
+		cJSON_AddBoolToObject(item_json, "selected", server.selected);
+		cJSON_AddNumberToObject(item_json, "offset_us", server.offset_us);
+		cJSON_AddNumberToObject(item_json, "delay_us", server.delay_us);
+		cJSON_AddNumberToObject(item_json, "polls", server.polls);
+		cJSON_AddNumberToObject(item_json, "replies", server.replies);
+		cJSON_AddNumberToObject(item_json, "timeouts", server.timeouts);
+		cJSON_AddNumberToObject(item_json, "invalid", server.invalid);
+		cJSON_AddNumberToObject(item_json, "falsetickers", server.falsetickers);
+		cJSON_AddItemToArray(list_json, item_json);
+	}
+	
+	answer_p = cJSON_PrintUnformatted(root_json);
+	cJSON_Delete(root_json);
+	if (!answer_p) {
+		return ESP_FAIL;
+	}
+	
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, answer_p, strlen(answer_p));
+	cJSON_free(answer_p);
+	
+	return ESP_OK;
+}
+
+/**
+ * sys/stats handler answers with the last system snapshot: CPU load per
+ * task and core, stack high water marks, heap and sockets.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(sys_stats_json)(httpd_req_t *req)
+{
+	// Called from the httpd task only, too big for its stack
+	static sys_stats_t stats;
+	static const char * const heap_names[SYS_STATS_HEAP_COUNT] =
+	{
+#define X(ID, NAME, CAPS) [ID] = NAME,
+		X_MACRO_SYS_STATS_HEAP_LIST
+#undef X
+	};
+	char * answer_p;
+	
+	ESP_LOGI(TAG, "/sys/stats requested");
+	
+	sysStats_get(&stats);
+	
+	cJSON * root_json = cJSON_CreateObject();
+	cJSON_AddNumberToObject(root_json, "uptime_s", stats.uptime_s);
+	cJSON_AddNumberToObject(root_json, "period_ms", stats.period_ms);
+	cJSON * cores_json = cJSON_AddArrayToObject(root_json, "core_busy_pct");
+	for (int i = 0; i < portNUM_PROCESSORS; i++)
+	{
+		cJSON_AddItemToArray(cores_json, cJSON_CreateNumber(stats.core_busy_permille[i] / 10.0));
+	}
+	cJSON * tasks_json = cJSON_AddArrayToObject(root_json, "tasks");
+	for (uint8_t i = 0; i < stats.task_count; i++)
+	{
+		cJSON * item_json = cJSON_CreateObject();
+		cJSON_AddStringToObject(item_json, "name", stats.tasks[i].name);
+		cJSON_AddNumberToObject(item_json, "core", stats.tasks[i].core);
+		cJSON_AddNumberToObject(item_json, "priority", stats.tasks[i].priority);
+		cJSON_AddNumberToObject(item_json, "cpu_pct", stats.tasks[i].cpu_permille / 10.0);
+		cJSON_AddNumberToObject(item_json, "stack_free", stats.tasks[i].stack_free);
+		cJSON_AddItemToArray(tasks_json, item_json);
+	}
+	cJSON * heap_json = cJSON_AddObjectToObject(root_json, "heap");
+	for (int i = 0; i < SYS_STATS_HEAP_COUNT; i++)
+	{
+		const sys_stats_heap_t * heap_p = &stats.heap[i];
+		cJSON * item_json = cJSON_AddObjectToObject(heap_json, heap_names[i]);
+		cJSON_AddNumberToObject(item_json, "free", heap_p->free);
+		cJSON_AddNumberToObject(item_json, "min_free", heap_p->min_free);
+		cJSON_AddNumberToObject(item_json, "largest_block", heap_p->largest_block);
+		// Share of the free memory that can't be taken in one piece
+		cJSON_AddNumberToObject(item_json, "fragmentation_pct",
+								(heap_p->free > 0) ? 100 - (uint64_t)heap_p->largest_block * 100 / heap_p->free : 0);
+	}
+	cJSON * sockets_json = cJSON_AddObjectToObject(root_json, "sockets");
+	cJSON_AddNumberToObject(sockets_json, "open", stats.sockets_open);
+	cJSON_AddNumberToObject(sockets_json, "max", stats.sockets_max);
+	
+	answer_p = cJSON_PrintUnformatted(root_json);
+	cJSON_Delete(root_json);
+	if (!answer_p) {
+		return ESP_FAIL;
+	}
+	
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, answer_p, strlen(answer_p));
+	cJSON_free(answer_p);
+	
+	return ESP_OK;
+}
+
+/**
+ * sys/heap handler ends the running heap trace phase, answers its figures
+ * and live allocations, then starts the phase named on the body, if any:
+ * {"phase":"status_polls"}. Only with CONFIG_GW_HEAP_TRACE.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(heap_trace_json)(httpd_req_t *req)
+{
+	char body[BUFFER_MAX_SIZE];
+	char phase[HEAP_TRACE_NAME_LEN] = "";
+	char chunk[BUFFER_MAX_SIZE * 2];
+	heap_trace_report_t report;
+	heap_trace_leak_t leak;
+	esp_err_t err;
+	int len;
+	
+	ESP_LOGI(TAG, "/sys/heap requested");
+	
+	if (router_recvBody(req, body, sizeof(body)) < 0) {
+		return router_sendResult(req, ESP_ERR_INVALID_SIZE);
+	}
+	if (req->content_len > 0) {
+		cJSON * body_json = cJSON_Parse(body);
+		cJSON * phase_json = cJSON_GetObjectItemCaseSensitive(body_json, "phase");
+		if (cJSON_IsString(phase_json)) {
+			snprintf(phase, sizeof(phase), "%s", phase_json->valuestring);
+		}
+		cJSON_Delete(body_json);
+	}
+	
+	err = heapTrace_stop(&report);
+	if (err == ESP_ERR_NOT_SUPPORTED) {
+		return router_sendResult(req, err);
+	}
+	
+	// Chunks, a phase may leave up to HEAP_TRACE_RECORDS allocations
+	httpd_resp_set_type(req, "application/json");
+	if (err == ESP_OK) {
+		snprintf(chunk, sizeof(chunk), "{\"stopped\":{\"phase\":\"%s\",\"duration_ms\":%lu,\"allocs\":%lu,\"frees\":%lu,",
+					report.name, report.duration_ms, report.allocs, report.frees);
+		httpd_resp_sendstr_chunk(req, chunk);
+		snprintf(chunk, sizeof(chunk), "\"peak_bytes\":%lu,\"leaked_bytes\":%lu,\"leaked_count\":%u,\"overflowed\":%s,\"leaks\":[",
+					report.peak_bytes, report.leaked_bytes, report.leaked_count, report.overflowed ? "true" : "false");
+		httpd_resp_sendstr_chunk(req, chunk);
+		for (size_t i = 0; i < report.leaked_count && heapTrace_getLeak(i, &leak); i++)
+		{
+			len = snprintf(chunk, sizeof(chunk), "%s[%lu", (i > 0) ? "," : "", leak.size);
+			for (int j = 0; j < HEAP_TRACE_CALLERS; j++)
+			{
+				len += snprintf(chunk + len, sizeof(chunk) - len, ",\"0x%08lx\"", leak.callers[j]);
+			}
+			snprintf(chunk + len, sizeof(chunk) - len, "]");
+			httpd_resp_sendstr_chunk(req, chunk);
+		}
+		httpd_resp_sendstr_chunk(req, "]},");
+	} else {
+		httpd_resp_sendstr_chunk(req, "{\"stopped\":null,");
+	}
+	snprintf(chunk, sizeof(chunk), (phase[0] != '\0') ? "\"started\":\"%s\"}" : "\"started\":null}", phase);
+	httpd_resp_sendstr_chunk(req, chunk);
+	httpd_resp_sendstr_chunk(req, NULL);
+	
+	// After the answer, its buffers are not part of the next phase
+	if (phase[0] != '\0') {
+		err = heapTrace_start(phase);
+		if (err != ESP_OK) {
+			ESP_LOGE(TAG, "heap trace phase %s not started (%s)", phase, esp_err_to_name(err));
+		}
+	}
+	
+	return ESP_OK;
+}
+
+/**
+ * sys/boot handler answers the boot markers, in ms since the application
+ * start (null when not reached), with their targets.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(boot_profile_json)(httpd_req_t *req)
+{
+	boot_marker_info_t info;
+	char * answer_p;
+	
+	ESP_LOGI(TAG, "/sys/boot requested");
+	
+	cJSON * root_json = cJSON_CreateObject();
+	cJSON * list_json = cJSON_AddArrayToObject(root_json, "markers");
+	for (int i = 0; i < BOOT_MARKER_COUNT; i++)
+	{
+		bootProfile_get(i, &info);
+		cJSON * item_json = cJSON_CreateObject();
+		cJSON_AddStringToObject(item_json, "name", info.name);
+		if (info.time_us >= 0) {
+			cJSON_AddNumberToObject(item_json, "ms", info.time_us / 1000.0);
+		} else {
+			cJSON_AddNullToObject(item_json, "ms");
+		}
+		if (info.target_ms > 0) {
+			cJSON_AddNumberToObject(item_json, "target_ms", info.target_ms);
+			cJSON_AddBoolToObject(item_json, "met", info.time_us >= 0 && info.time_us <= info.target_ms * 1000LL);
+		}
+		cJSON_AddItemToArray(list_json, item_json);
+	}
+	
+	answer_p = cJSON_PrintUnformatted(root_json);
+	cJSON_Delete(root_json);
+	if (!answer_p) {
+		return ESP_FAIL;
+	}
+	
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, answer_p, strlen(answer_p));
+	cJSON_free(answer_p);
+	
+	return ESP_OK;
+}
+
+/**
+ * sys/log handler answers the log lines formatted after ?since=N, as text.
+ * The first call turns the line history on, a client polls it with the
+ * X-Log-Seq header of the last answer.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(log_tail)(httpd_req_t *req)
+{
+	static char lines[ASYNC_LOG_HISTORY_LINES * ASYNC_LOG_LINE_LEN];
+	char query[BUFFER_MAX_SIZE];
+	char value[12];
+	char seq[12];
+	char dropped[12];
+	uint32_t since = 0;
+	uint32_t dropped_count;
+	uint32_t last;
+	
+	// Not logged, the web page polls it every second
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK
+		&& httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK)
+	{
+		since = strtoul(value, NULL, 10);
+	}
+	
+	// Handlers run one at a time on the httpd task, the static buffer is safe
+	last = asyncLog_readSince(since, lines, sizeof(lines), &dropped_count);
+	snprintf(seq, sizeof(seq), "%lu", last);
+	snprintf(dropped, sizeof(dropped), "%lu", dropped_count);
+	
+	httpd_resp_set_type(req, "text/plain");
+	httpd_resp_set_hdr(req, "X-Log-Seq", seq);
+	httpd_resp_set_hdr(req, "X-Log-Dropped", dropped);
+	httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+	httpd_resp_send(req, lines, strlen(lines));
+	
+	return ESP_OK;
+}
+
+/**
+ * sys/ncp handler answers the Zigbee NCP link counters.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(ncp_stats_json)(httpd_req_t *req)
+{
+	zigbee_ncp_stats_t stats;
+	char statsJSON[BUFFER_MAX_SIZE * 3];
+	
+	ESP_LOGI(TAG, "/sys/ncp requested");
+	
+	zigbeeNcp_getStats(&stats);
+	snprintf(statsJSON, sizeof(statsJSON),
+				"{\"tx_frames\":%lu,\"rx_frames\":%lu,\"crc_errors\":%lu,\"framing_errors\":%lu,"
+				"\"overflows\":%lu,\"timeouts\":%lu,\"unmatched\":%lu,\"in_flight\":%u,"
+				"\"rtt_avg_us\":%lu,\"rtt_max_us\":%lu}",
+				stats.tx_frames, stats.rx_frames, stats.crc_errors, stats.framing_errors,
+				stats.overflows, stats.timeouts, stats.unmatched, stats.in_flight,
+				(stats.responses > 0) ? (uint32_t)(stats.rtt_sum_us / stats.responses) : 0, stats.rtt_max_us);
+	
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, statsJSON, strlen(statsJSON));
+	
+	return ESP_OK;
+}
+
+/**
+ * sys/ncp/bench handler sends {"frames":N,"len":L} echo requests to the
+ * stand-in NCP, keeping the window full, and answers the throughput and
+ * round trip times. The HTTP server waits for the whole run.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(ncp_bench_json)(httpd_req_t *req)
+{
+	char body[BUFFER_MAX_SIZE];
+	char benchJSON[BUFFER_MAX_SIZE * 2];
+	zigbee_ncp_bench_t result;
+	uint32_t frames = 1000;
+	uint16_t len = 32;
+	esp_err_t err;
+	
+	ESP_LOGI(TAG, "/sys/ncp/bench requested");
+	
+	if (router_recvBody(req, body, sizeof(body)) < 0) {
+		return router_sendResult(req, ESP_ERR_INVALID_SIZE);
+	}
+	if (req->content_len > 0) {
+		cJSON * body_json = cJSON_Parse(body);
+		cJSON * frames_json = cJSON_GetObjectItemCaseSensitive(body_json, "frames");
+		cJSON * len_json = cJSON_GetObjectItemCaseSensitive(body_json, "len");
+		if (cJSON_IsNumber(frames_json) && frames_json->valueint > 0) {
+			frames = frames_json->valueint;
+		}
+		if (cJSON_IsNumber(len_json) && len_json->valueint >= 0 && len_json->valueint <= ZIGBEE_NCP_MAX_PAYLOAD) {
+			len = len_json->valueint;
+		}
+		cJSON_Delete(body_json);
+	}
+	
+	err = zigbeeNcp_benchmark(frames, len, &result);
+	if (err != ESP_OK) {
+		return router_sendResult(req, err);
+	}
+	
+	snprintf(benchJSON, sizeof(benchJSON),
+				"{\"frames\":%lu,\"len\":%u,\"errors\":%lu,\"elapsed_ms\":%lu,\"frames_per_s\":%lu,"
+				"\"rtt_avg_us\":%lu,\"rtt_max_us\":%lu}",
+				result.frames, len, result.errors, result.elapsed_ms, result.frames_per_s,
+				result.rtt_avg_us, result.rtt_max_us);
+	
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, benchJSON, strlen(benchJSON));
+	
+	return ESP_OK;
+}
+
+/**
+ * GET devices.json handler lists the known Zigbee devices with their last
+ * known attributes (null when never reported), after the registry figures.
+ * Sent in chunks, one per device.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(get_devices_json)(httpd_req_t *req)
+{
+	device_registry_stats_t stats;
+	device_info_t device;
+	uint32_t now_s = esp_timer_get_time() / 1000000;
+	char chunk[BUFFER_MAX_SIZE * 3];
+	int len;
+	
+	ESP_LOGI(TAG, "GET /devices.json requested");
+	
+	deviceRegistry_getStats(&stats);
+	httpd_resp_set_type(req, "application/json");
+	snprintf(chunk, sizeof(chunk),
+				"{\"count\":%u,\"capacity\":%u,\"bytes_per_device\":%u,\"lookups\":%lu,"
+				"\"lookup_cycles_avg\":%lu,\"lookup_cycles_max\":%lu,\"max_probe\":%u,"
+				"\"dirty_pages\":%lu,\"page_writes\":%lu,\"devices\":[",
+				stats.count, stats.capacity, stats.bytes_per_device, stats.lookups,
+				stats.lookup_cycles_avg, stats.lookup_cycles_max, stats.max_probe,
+				stats.dirty_pages, stats.page_writes);
+	httpd_resp_sendstr_chunk(req, chunk);
+	
+	for (uint16_t i = 0; deviceRegistry_getAt(i, &device); i++)
+	{
+		len = snprintf(chunk, sizeof(chunk), "%s{\"ieee\":\"%016llx\",\"short\":%d,\"type\":\"%s\",",
+						(i > 0) ? "," : "", device.ieee,
+						(device.short_addr != DEVICE_SHORT_NONE) ? device.short_addr : -1,
+						deviceRegistry_typeName(device.type));
+		if (device.last_seen_s > 0) {
+			len += snprintf(chunk + len, sizeof(chunk) - len, "\"seen_s_ago\":%lu,\"rssi\":%d,\"lqi\":%u",
+							now_s - device.last_seen_s, device.rssi, device.lqi);
+		} else {
+			len += snprintf(chunk + len, sizeof(chunk) - len, "\"seen_s_ago\":null");
+		}
+		for (int a = 0; a < DEVICE_ATTR_COUNT; a++)
+		{
+			if (device.attrs[a] != DEVICE_ATTR_UNKNOWN) {
+				len += snprintf(chunk + len, sizeof(chunk) - len, ",\"%s\":%ld", deviceRegistry_attrName(a), device.attrs[a]);
+			} else {
+				len += snprintf(chunk + len, sizeof(chunk) - len, ",\"%s\":null", deviceRegistry_attrName(a));
+			}
+		}
+		snprintf(chunk + len, sizeof(chunk) - len, "}");
+		httpd_resp_sendstr_chunk(req, chunk);
+	}
+	httpd_resp_sendstr_chunk(req, "]}");
+	httpd_resp_sendstr_chunk(req, NULL);
+	
+	return ESP_OK;
+}
+
+/**
+ * POST devices.json handler adds a device by hand, or changes its short
+ * address or type: {"ieee":"00124b0001020304","short":4660,"type":"valve"}
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(set_device_json)(httpd_req_t *req)
+{
+	char body[BODY_MAX_SIZE];
+	esp_err_t err = ESP_ERR_INVALID_ARG;
+	uint16_t short_addr = DEVICE_SHORT_NONE;
+	device_type_t type = DEVICE_TYPE_UNKNOWN;
+	uint64_t ieee;
+	
+	ESP_LOGI(TAG, "POST /devices.json requested");
+	
+	if (router_recvBody(req, body, sizeof(body)) < 0) {
+		return router_sendResult(req, ESP_ERR_INVALID_SIZE);
+	}
+	
+	cJSON *body_json = cJSON_Parse(body);
+	cJSON *short_json = cJSON_GetObjectItemCaseSensitive(body_json, "short");
+	cJSON *type_json = cJSON_GetObjectItemCaseSensitive(body_json, "type");
+	if (cJSON_IsNumber(short_json) && short_json->valueint >= 0 && short_json->valueint < DEVICE_SHORT_NONE) {
+		short_addr = short_json->valueint;
+	}
+	if (cJSON_IsString(type_json)) {
+		type = deviceRegistry_typeFromName(type_json->valuestring);
+	}
+	if (router_parseIeee(cJSON_GetObjectItemCaseSensitive(body_json, "ieee"), &ieee)) {
+		err = deviceRegistry_add(ieee, short_addr, type);
+	}
+	cJSON_Delete(body_json);
+	
+	return router_sendResult(req, err);
+}
+
+/**
+ * DELETE devices.json handler forgets a device: {"ieee":"00124b0001020304"}
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(delete_device_json)(httpd_req_t *req)
+{
+	char body[BODY_MAX_SIZE];
+	esp_err_t err = ESP_ERR_INVALID_ARG;
+	uint64_t ieee;
+	
+	ESP_LOGI(TAG, "DELETE /devices.json requested");
+	
+	if (router_recvBody(req, body, sizeof(body)) < 0) {
+		return router_sendResult(req, ESP_ERR_INVALID_SIZE);
+	}
+	
+	cJSON *body_json = cJSON_Parse(body);
+	if (router_parseIeee(cJSON_GetObjectItemCaseSensitive(body_json, "ieee"), &ieee)) {
+		err = deviceRegistry_remove(ieee);
+	}
+	cJSON_Delete(body_json);
+	
+	return router_sendResult(req, err);
+}
+
+/**
+ * GET schedules.json handler lists the valve rules after the engine
+ * figures, with the seconds to the next edge of each one (null before the
+ * first NTP sync). Sent in chunks, one per rule.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(get_schedules_json)(httpd_req_t *req)
+{
+	valve_schedule_stats_t stats;
+	valve_rule_info_t info;
+	uint32_t now_s = timebase_nowUs() / 1000000;
+	char chunk[BUFFER_MAX_SIZE * 2];
+	bool first = true;
+	int len;
+	
+	ESP_LOGI(TAG, "GET /schedules.json requested");
+	
+	valveSchedule_getStats(&stats);
+	httpd_resp_set_type(req, "application/json");
+	snprintf(chunk, sizeof(chunk),
+				"{\"running\":%s,\"rules\":%u,\"pending\":%lu,\"fired\":%lu,\"resyncs\":%lu,"
+				"\"commands\":%lu,\"failed\":%lu,\"unreachable\":%lu,\"schedules\":[",
+				stats.running ? "true" : "false", stats.rules, stats.pending, stats.fired, stats.resyncs,
+				stats.commands, stats.failed, stats.unreachable);
+	httpd_resp_sendstr_chunk(req, chunk);
+	
+	for (uint16_t id = 0; id < VALVE_SCHEDULE_MAX; id++)
+	{
+		if (!valveSchedule_getRule(id, &info)) {
+			continue;
+		}
+		len = snprintf(chunk, sizeof(chunk),
+						"%s{\"id\":%u,\"ieee\":\"%016llx\",\"days\":%u,\"start\":\"%02u:%02u\",\"duration_min\":%u,\"open\":%s,",
+						first ? "" : ",", id, info.rule.ieee, info.rule.days, info.rule.start_min / 60, info.rule.start_min % 60,
+						info.rule.duration_min, info.open ? "true" : "false");
+		if (info.next_s != 0) {
+			snprintf(chunk + len, sizeof(chunk) - len, "\"next_in_s\":%ld}", (int32_t)(info.next_s - now_s));
+		} else {
+			snprintf(chunk + len, sizeof(chunk) - len, "\"next_in_s\":null}");
+		}
+		httpd_resp_sendstr_chunk(req, chunk);
+		first = false;
+	}
+	httpd_resp_sendstr_chunk(req, "]}");
+	httpd_resp_sendstr_chunk(req, NULL);
+	
+	return ESP_OK;
+}
+
+/**
+ * POST schedules.json handler adds a valve rule, days is a mask with
+ * bit 0 for Sunday: {"ieee":"00124b0001020304","days":62,"start":"06:30","duration_min":20}
+ * Answers the ID of the new rule.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(set_schedule_json)(httpd_req_t *req)
+{
+	char body[BODY_MAX_SIZE];
+	char resultJSON[BUFFER_MAX_SIZE];
+	esp_err_t err = ESP_ERR_INVALID_ARG;
+	valve_rule_t rule = { 0 };
+	unsigned int hour;
+	unsigned int minute;
+	uint16_t id;
+	
+	ESP_LOGI(TAG, "POST /schedules.json requested");
+	
+	if (router_recvBody(req, body, sizeof(body)) < 0) {
+		return router_sendResult(req, ESP_ERR_INVALID_SIZE);
+	}
+	
+	cJSON *body_json = cJSON_Parse(body);
+	cJSON *days_json = cJSON_GetObjectItemCaseSensitive(body_json, "days");
+	cJSON *start_json = cJSON_GetObjectItemCaseSensitive(body_json, "start");
+	cJSON *duration_json = cJSON_GetObjectItemCaseSensitive(body_json, "duration_min");
+	if (router_parseIeee(cJSON_GetObjectItemCaseSensitive(body_json, "ieee"), &rule.ieee)
+		&& cJSON_IsNumber(days_json) && days_json->valueint > 0 && days_json->valueint <= VALVE_SCHEDULE_DAYS_ALL
+		&& cJSON_IsString(start_json) && sscanf(start_json->valuestring, "%u:%u", &hour, &minute) == 2
+		&& hour < 24 && minute < 60
+		&& cJSON_IsNumber(duration_json) && duration_json->valueint > 0) {
+		rule.days = days_json->valueint;
+		rule.start_min = hour * 60 + minute;
+		rule.duration_min = (duration_json->valueint <= VALVE_SCHEDULE_MAX_DURATION_MIN) ? duration_json->valueint : 0;
+		err = valveSchedule_add(&rule, &id);
+	}
+	cJSON_Delete(body_json);
+	
+	if (err != ESP_OK) {
+		return router_sendResult(req, err);
+	}
+	
+	snprintf(resultJSON, sizeof(resultJSON), "{\"result\":\"%s\",\"id\":%u}", esp_err_to_name(err), id);
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, resultJSON, strlen(resultJSON));
+	
+	return ESP_OK;
+}
+
+/**
+ * DELETE schedules.json handler removes a valve rule: {"id":3}
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(delete_schedule_json)(httpd_req_t *req)
+{
+	char body[BODY_MAX_SIZE];
+	esp_err_t err = ESP_ERR_INVALID_ARG;
+	
+	ESP_LOGI(TAG, "DELETE /schedules.json requested");
+	
+	if (router_recvBody(req, body, sizeof(body)) < 0) {
+		return router_sendResult(req, ESP_ERR_INVALID_SIZE);
+	}
+	
+	cJSON *body_json = cJSON_Parse(body);
+	cJSON *id_json = cJSON_GetObjectItemCaseSensitive(body_json, "id");
+	if (cJSON_IsNumber(id_json) && id_json->valueint >= 0 && id_json->valueint < VALVE_SCHEDULE_MAX) {
+		err = valveSchedule_remove(id_json->valueint);
+	}
+	cJSON_Delete(body_json);
+	
+	return router_sendResult(req, err);
+}
+
+/**
+ * POST schedules/bench handler times a timer wheel of random weekly
+ * timers over some simulated days: {"timers":2000,"days":7}
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(schedule_bench_json)(httpd_req_t *req)
+{
+	char body[BUFFER_MAX_SIZE];
+	char benchJSON[BUFFER_MAX_SIZE * 2];
+	valve_schedule_bench_t result;
+	uint32_t timers = 2000;
+	uint32_t days = 7;
+	esp_err_t err;
+	
+	ESP_LOGI(TAG, "/schedules/bench requested");
+	
+	if (router_recvBody(req, body, sizeof(body)) < 0) {
+		return router_sendResult(req, ESP_ERR_INVALID_SIZE);
+	}
+	if (req->content_len > 0) {
+		cJSON * body_json = cJSON_Parse(body);
+		cJSON * timers_json = cJSON_GetObjectItemCaseSensitive(body_json, "timers");
+		cJSON * days_json = cJSON_GetObjectItemCaseSensitive(body_json, "days");
+		if (cJSON_IsNumber(timers_json) && timers_json->valueint > 0) {
+			timers = timers_json->valueint;
+		}
+		if (cJSON_IsNumber(days_json) && days_json->valueint > 0) {
+			days = days_json->valueint;
+		}
+		cJSON_Delete(body_json);
+	}
+	
+	err = valveSchedule_benchmark(timers, days, &result);
+	if (err != ESP_OK) {
+		return router_sendResult(req, err);
+	}
+	
+	snprintf(benchJSON, sizeof(benchJSON),
+				"{\"timers\":%lu,\"days\":%lu,\"fired\":%lu,\"insert_ns\":%lu,\"fire_ns\":%lu,\"elapsed_ms\":%lu}",
+				result.timers, result.days, result.fired, result.insert_ns, result.fire_ns, result.elapsed_ms);
+	
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, benchJSON, strlen(benchJSON));
+	
+	return ESP_OK;
+}
+
+/**
+ * GET telemetry.json handler streams the history of one attribute of a
+ * device, one [ts,min,max,avg,count] point per step, followed by what the
+ * query read. Parameters: ieee, attr (name as on devices.json), from and
+ * to in epoch seconds (the last day by default), step in seconds (raised
+ * to keep the points under TELEMETRY_QUERY_MAX_POINTS).
+ * /telemetry.json?ieee=00124b0001020304&attr=flow_ml_min&step=300
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(telemetry_json)(httpd_req_t *req)
+{
+	static router_points_t points;
+	telemetry_query_t query = { 0 };
+	telemetry_query_result_t result;
+	char chunk[BUFFER_MAX_SIZE * 2];
+	esp_err_t err;
+	
+	ESP_LOGI(TAG, "GET /telemetry.json requested");
+	
+	err = router_parseTelemetryQuery(req, &query);
+	if (err != ESP_OK) {
+		return router_sendResult(req, err);
+	}
+	
+	// Handlers run one at a time on the httpd task, the static buffer is safe
+	snprintf(points.buf, sizeof(points.buf), "{\"ieee\":\"%016llx\",\"attr\":\"%s\",\"from\":%lu,\"to\":%lu,\"points\":[",
+				query.ieee, deviceRegistry_attrName(query.attr), query.from_ts, query.to_ts);
+	points.req = req;
+	points.first = true;
+	points.binary = false;
+	points.len = strlen(points.buf);
+	
+	httpd_resp_set_type(req, "application/json");
+	err = telemetryStore_query(&query, router_sendPoint, &points, &result);
+	if (err != ESP_OK) {
+		return router_sendResult(req, err);
+	}
+	httpd_resp_send_chunk(req, points.buf, points.len);
+	
+	snprintf(chunk, sizeof(chunk),
+				"],\"step_s\":%lu,\"samples\":%lu,\"blocks_read\":%u,\"blocks_skipped\":%u,\"elapsed_us\":%lu}",
+				result.step_s, result.samples, result.blocks_read, result.blocks_skipped, result.elapsed_us);
+	httpd_resp_sendstr_chunk(req, chunk);
+	httpd_resp_sendstr_chunk(req, NULL);
+	
+	return ESP_OK;
+}
+
+/**
+ * GET telemetry/stats handler answers the telemetry store figures.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(telemetry_stats_json)(httpd_req_t *req)
+{
+	char statsJSON[BUFFER_MAX_SIZE * 4];
+	telemetry_stats_t stats;
+	
+	ESP_LOGI(TAG, "/telemetry/stats requested");
+	
+	telemetryStore_getStats(&stats);
+	snprintf(statsJSON, sizeof(statsJSON),
+				"{\"mounted\":%s,\"blocks\":%u,\"blocks_used\":%u,\"records\":%lu,\"bytes\":%lu,"
+				"\"buffered\":%lu,\"oldest_ts\":%lu,\"head_seq\":%lu,\"appended\":%lu,\"dropped\":%lu,"
+				"\"unsynced\":%lu,\"write_errors\":%lu,\"flush_us_max\":%lu,\"erase_us_max\":%lu}",
+				stats.mounted ? "true" : "false", stats.blocks, stats.blocks_used, stats.records, stats.bytes,
+				stats.buffered, stats.oldest_ts, stats.head_seq, stats.appended, stats.dropped,
+				stats.unsynced, stats.write_errors, stats.flush_us_max, stats.erase_us_max);
+	
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, statsJSON, strlen(statsJSON));
+	
+	return ESP_OK;
+}
+
+/**
+ * GET telemetry.bin handler streams the same points as telemetry.json,
+ * compressed (telemetryCodec.h, tools/telemetry_decode.py): "TC", version
+ * 1, 4 columns, the from time as a little endian uint32 and then one
+ * sample per point, columns min, max, avg and count.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(telemetry_bin)(httpd_req_t *req)
+{
+	static router_points_t points;
+	telemetry_query_t query = { 0 };
+	esp_err_t err;
+	
+	ESP_LOGI(TAG, "GET /telemetry.bin requested");
+	
+	err = router_parseTelemetryQuery(req, &query);
+	if (err != ESP_OK) {
+		return router_sendResult(req, err);
+	}
+	
+	// Handlers run one at a time on the httpd task, the static buffer is safe
+	points.buf[0] = 'T';
+	points.buf[1] = 'C';
+	points.buf[2] = 1;
+	points.buf[3] = 4;
+	for (int i = 0; i < 4; i++)
+	{
+		points.buf[4 + i] = (query.from_ts >> (8 * i)) & 0xFF;
+	}
+	points.req = req;
+	points.binary = true;
+	points.len = 8;
+	telemetryCodec_init(&points.codec, query.from_ts, 4);
+	
+	httpd_resp_set_type(req, "application/octet-stream");
+	err = telemetryStore_query(&query, router_sendPoint, &points, NULL);
+	if (err != ESP_OK) {
+		return router_sendResult(req, err);
+	}
+	httpd_resp_send_chunk(req, points.buf, points.len);
+	httpd_resp_send_chunk(req, NULL, 0);
+	
+	return ESP_OK;
+}
+
+/**
+ * GET uplink/stats handler answers the MQTT uplink figures.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t APP_URI_FUNCTION_HANDLER_NAME(uplink_stats_json)(httpd_req_t *req)
+{
+	char statsJSON[BUFFER_MAX_SIZE * 6];
+	mqtt_uplink_stats_t stats;
+	
+	ESP_LOGI(TAG, "/uplink/stats requested");
+	
+	mqttUplink_getStats(&stats);
+	snprintf(statsJSON, sizeof(statsJSON),
+				"{\"started\":%s,\"connected\":%s,\"client_id\":\"%s\",\"connects\":%lu,\"published\":%lu,"
+				"\"acked\":%lu,\"resent\":%lu,\"publish_errors\":%lu,\"inflight\":%u,\"samples\":%lu,\"bytes\":%lu,"
+				"\"backlog_bytes\":%lu,\"lost_blocks\":%lu,\"events\":%lu,\"events_pending\":%u,\"events_dropped\":%lu,"
+				"\"drain_samples\":%lu,\"drain_ms\":%lu}",
+				stats.started ? "true" : "false", stats.connected ? "true" : "false", stats.client_id, stats.connects,
+				stats.published, stats.acked, stats.resent, stats.publish_errors, stats.inflight, stats.samples, stats.bytes,
+				stats.backlog_bytes, stats.lost_blocks, stats.events, stats.events_pending, stats.events_dropped,
+				stats.drain_samples, stats.drain_ms);
+	
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, statsJSON, strlen(statsJSON));
+	
+	return ESP_OK;
+}
+
+/**
+ * Reads the telemetry query parameters: ieee, attr, from, to and step.
+ * @param req HTTP request
+ * @param query_p destination
+ * @return ESP_ERR_INVALID_ARG without a valid device and attribute
+ */
+static esp_err_t router_parseTelemetryQuery(httpd_req_t *req, telemetry_query_t * query_p)
+{
+	char query[BUFFER_MAX_SIZE * 2];
+	char value[24];
+	char * end_p = NULL;
+	int attr = DEVICE_ATTR_COUNT;
+	
+	if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (httpd_query_key_value(query, "ieee", value, sizeof(value)) == ESP_OK && strlen(value) == 16) {
+		query_p->ieee = strtoull(value, &end_p, 16);
+	}
+	if (httpd_query_key_value(query, "attr", value, sizeof(value)) == ESP_OK) {
+		for (attr = 0; attr < DEVICE_ATTR_COUNT && strcmp(value, deviceRegistry_attrName(attr)) != 0; attr++);
+	}
+	if (end_p == NULL || *end_p != '\0' || query_p->ieee == 0 || attr >= DEVICE_ATTR_COUNT) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	query_p->attr = attr;
+	
+	query_p->to_ts = timebase_nowUs() / 1000000;
+	if (httpd_query_key_value(query, "to", value, sizeof(value)) == ESP_OK) {
+		query_p->to_ts = strtoul(value, NULL, 10);
+	}
+	query_p->from_ts = (query_p->to_ts > 86400) ? query_p->to_ts - 86400 : 0;
+	if (httpd_query_key_value(query, "from", value, sizeof(value)) == ESP_OK) {
+		query_p->from_ts = strtoul(value, NULL, 10);
+	}
+	if (httpd_query_key_value(query, "step", value, sizeof(value)) == ESP_OK) {
+		query_p->step_s = strtoul(value, NULL, 10);
+	}
+	
+	return (query_p->to_ts >= query_p->from_ts) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/**
+ * Adds a telemetry point to the chunk being filled, sends it when full.
+ * @param point_p
+ * @param ctx router_points_t
+ */
+static void router_sendPoint(const telemetry_point_t * point_p, void * ctx)
+{
+	router_points_t * points_p = ctx;
+	
+	if (points_p->len > sizeof(points_p->buf) - BUFFER_MAX_SIZE) {
+		httpd_resp_send_chunk(points_p->req, points_p->buf, points_p->len);
+		points_p->len = 0;
+	}
+	if (points_p->binary) {
+		int32_t columns[4] = { point_p->min, point_p->max, point_p->avg, point_p->count };
+		points_p->len += telemetryCodec_encode(&points_p->codec, point_p->ts, columns,
+												(uint8_t *)points_p->buf + points_p->len, sizeof(points_p->buf) - points_p->len);
+		return;
+	}
+	points_p->len += snprintf(points_p->buf + points_p->len, sizeof(points_p->buf) - points_p->len,
+								"%s[%lu,%ld,%ld,%ld,%lu]", points_p->first ? "" : ",",
+								point_p->ts, point_p->min, point_p->max, point_p->avg, point_p->count);
+	points_p->first = false;
+}
+
+/**
+ * Reads an IEEE address written as 16 hex digits.
+ * @param json string item, may be NULL
+ * @param ieee_p destination
+ * @return true when valid and not 0
+ */
+static bool router_parseIeee(cJSON * json, uint64_t * ieee_p)
+{
+	char * end_p;
+	
+	if (!cJSON_IsString(json) || strlen(json->valuestring) != 16) {
+		return false;
+	}
+	*ieee_p = strtoull(json->valuestring, &end_p, 16);
+	
+	return *end_p == '\0' && *ieee_p != 0;
+}
+
+/**
+ * Receives the whole request body as a NUL terminated string.
+ * @param req HTTP request
+ * @param buffer destination
+ * @param size destination size, including the terminator
+ * @return body length, or -1 when it doesn't fit or the connection fails
+ */
+static int router_recvBody(httpd_req_t *req, char * buffer, size_t size)
+{
+	size_t received = 0;
+	
+	if (req->content_len >= size) {
+		ESP_LOGE(TAG, "Request body too big (%d bytes)", req->content_len);
+		return -1;
+	}
+	
+	while (received < req->content_len)
+	{
+		int len = httpd_req_recv(req, buffer + received, req->content_len - received);
+		if (len == HTTPD_SOCK_ERR_TIMEOUT) {
+			continue;
+		}
+		if (len <= 0) {
+			return -1;
+		}
+		received += len;
+	}
+	buffer[received] = '\0';
+	
+	return received;
+}
+
+/**
+ * Answers a CRUD request with {"result":"<esp_err_t name>"}
+ * @param req HTTP request
+ * @param err result of the operation
+ * @return ESP_OK
+ */
+static esp_err_t router_sendResult(httpd_req_t *req, esp_err_t err)
+{
+	char resultJSON[BUFFER_MAX_SIZE];
+	
+	snprintf(resultJSON, sizeof(resultJSON), "{\"result\":\"%s\"}", esp_err_to_name(err));
+	
+	if (err == ESP_ERR_TIMEOUT) {
+		// Busy, the same request may be sent again
+		httpd_resp_set_status(req, "503 Service Unavailable");
+	}
+	else if (err != ESP_OK) {
+		httpd_resp_set_status(req, (err == ESP_ERR_NOT_FOUND) ? HTTPD_404 : HTTPD_400);
+	}
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, resultJSON, strlen(resultJSON));
 	
 	return ESP_OK;
 }
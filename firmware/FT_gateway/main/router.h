@@ -33,6 +33,7 @@
 **************************/
 
 #define BUFFER_MAX_SIZE 100
+#define BODY_MAX_SIZE	256
 
 #define APP_URI_FUNCTION_HANDLER_NAME(uri) webRouter_##uri##_handler
 
@@ -46,7 +47,33 @@
 	X(2, get_wifi_connect_info_json,	"/wifiConnectInfo.json",	HTTP_GET,		"application/json") \
 	X(3, wifi_disconnect_json,			"/wifiDisconnect.json",		HTTP_DELETE,	"application/json") \
 	X(4, http_server_OTA_update_handler, "/OTAupdate",				HTTP_POST, 		"application/octet-stream") \
-	X(5, http_server_OTA_status_handler, "/OTAstatus",				HTTP_POST, 		"application/json")
+	X(5, http_server_OTA_status_handler, "/OTAstatus",				HTTP_POST, 		"application/json") \
+	X(6, get_wifi_networks_json,		"/wifiNetworks.json",		HTTP_GET,		"application/json") \
+	X(7, set_wifi_network_json,			"/wifiNetworks.json",		HTTP_POST,		"application/json") \
+	X(8, delete_wifi_network_json,		"/wifiNetworks.json",		HTTP_DELETE,	"application/json") \
+	X(9, wifi_scan_json,				"/wifiScan.json",			HTTP_GET,		"application/json") \
+	X(10, wifi_app_stats_json,			"/wifiAppStats.json",		HTTP_GET,		"application/json") \
+	X(11, get_wifi_power_json,			"/wifiPower.json",			HTTP_GET,		"application/json") \
+	X(12, set_wifi_power_json,			"/wifiPower.json",			HTTP_POST,		"application/json") \
+	X(13, link_quality_json,			"/linkQuality.json",		HTTP_GET,		"application/json") \
+	X(14, ntp_status_json,				"/ntpStatus.json",			HTTP_GET,		"application/json") \
+	X(15, sys_stats_json,				"/sys/stats",				HTTP_GET,		"application/json") \
+	X(16, heap_trace_json,				"/sys/heap",				HTTP_POST,		"application/json") \
+	X(17, boot_profile_json,			"/sys/boot",				HTTP_GET,		"application/json") \
+	X(18, log_tail,						"/sys/log",					HTTP_GET,		"text/plain") \
+	X(19, ncp_stats_json,				"/sys/ncp",					HTTP_GET,		"application/json") \
+	X(20, ncp_bench_json,				"/sys/ncp/bench",			HTTP_POST,		"application/json") \
+	X(21, get_devices_json,				"/devices.json",			HTTP_GET,		"application/json") \
+	X(22, set_device_json,				"/devices.json",			HTTP_POST,		"application/json") \
+	X(23, delete_device_json,			"/devices.json",			HTTP_DELETE,	"application/json") \
+	X(24, get_schedules_json,			"/schedules.json",			HTTP_GET,		"application/json") \
+	X(25, set_schedule_json,			"/schedules.json",			HTTP_POST,		"application/json") \
+	X(26, delete_schedule_json,			"/schedules.json",			HTTP_DELETE,	"application/json") \
+	X(27, schedule_bench_json,			"/schedules/bench",			HTTP_POST,		"application/json") \
+	X(28, telemetry_json,				"/telemetry.json",			HTTP_GET,		"application/json") \
+	X(29, telemetry_stats_json,			"/telemetry/stats",			HTTP_GET,		"application/json") \
+	X(30, telemetry_bin,				"/telemetry.bin",			HTTP_GET,		"application/octet-stream") \
+	X(31, uplink_stats_json,			"/uplink/stats",			HTTP_GET,		"application/json")
 
 /**************************
 **		FUNCTIONS		 **
@@ -0,0 +1,288 @@
+/**
+ * @file sysStats.c
+ * @brief CPU, stack, heap and socket figures for /sys/stats
+ * @details
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <string.h>
+
+// ESP libraries
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+
+// Personal libraries
+#include "sysStats.h"
+#include "tasks_common.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+	/* Definitions */
+
+#if CONFIG_GW_STATIC_ALLOCATION
+_Static_assert(TASKS_GW_STACK_BYTES <= CONFIG_GW_STATIC_STACK_BUDGET,
+				"gateway task stacks exceed CONFIG_GW_STATIC_STACK_BUDGET");
+#endif
+
+
+	/* Structures */
+
+/**
+ * @brief Run time counter of a task on the previous sample
+ */
+typedef struct sys_stats_counter_s
+{
+	TaskHandle_t	handle;
+	uint32_t		run_time;
+} sys_stats_counter_t;
+
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "sys_stats";
+
+// Capabilities of each reported heap
+static const uint32_t g_heap_caps[SYS_STATS_HEAP_COUNT] =
+{
+#define X(ID, NAME, CAPS) [ID] = CAPS,
+	X_MACRO_SYS_STATS_HEAP_LIST
+#undef X
+};
+
+// Snapshot served to the readers
+static sys_stats_t g_stats;
+static portMUX_TYPE sys_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Sampler state, only touched from the timer service task
+static sys_stats_t g_next;
+static int64_t g_last_us;
+#if CONFIG_GW_SYS_STATS_TASKS
+static TaskStatus_t g_status[SYS_STATS_MAX_TASKS];
+static sys_stats_counter_t g_counters[SYS_STATS_MAX_TASKS];
+static uint8_t g_counter_count;
+#endif
+
+
+	/* FreeRTOS Structures */
+
+static TimerHandle_t sys_stats_timer;
+#if CONFIG_GW_STATIC_ALLOCATION
+static StaticTimer_t sys_stats_timer_struct;
+#endif
+
+
+	/* Static Functions */
+
+static void sysStats_sampleTasks(sys_stats_t * stats_p, uint32_t period_us);
+static void sysStats_sampleHeap(sys_stats_t * stats_p);
+static void sysStats_sampleSockets(sys_stats_t * stats_p);
+static void sysStats_sample(TimerHandle_t timer);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Takes a first sample and starts the periodic timer
+void sysStats_start(void)
+{
+	sysStats_sample(NULL);
+
+#if CONFIG_GW_STATIC_ALLOCATION
+	sys_stats_timer = xTimerCreateStatic("sys_stats", pdMS_TO_TICKS(SYS_STATS_PERIOD_S * 1000), pdTRUE, NULL, sysStats_sample, &sys_stats_timer_struct);
+#else
+	sys_stats_timer = xTimerCreate("sys_stats", pdMS_TO_TICKS(SYS_STATS_PERIOD_S * 1000), pdTRUE, NULL, sysStats_sample);
+#endif
+	if (sys_stats_timer == NULL || xTimerStart(sys_stats_timer, 0) != pdPASS)
+	{
+		ESP_LOGE(TAG, "sysStats_start: timer not started");
+	}
+}
+
+// Logs the memory taken by the gateway tasks
+void sysStats_logBudget(void)
+{
+	static const struct { const char * name; uint32_t stack_size; } tasks[] =
+	{
+#define X(NAME, OPTION, STACK) { NAME, STACK },
+		X_MACRO_GW_TASK_LIST
+#undef X
+	};
+
+	ESP_LOGI(TAG, "%-20s %6s %6s", "task", "stack", "used");
+	for (size_t i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++)
+	{
+		TaskHandle_t handle = xTaskGetHandle(tasks[i].name);
+
+		if (handle == NULL)
+		{
+			ESP_LOGI(TAG, "%-20s %6lu %6s", tasks[i].name, tasks[i].stack_size, "-");
+			continue;
+		}
+		ESP_LOGI(TAG, "%-20s %6lu %6lu", tasks[i].name, tasks[i].stack_size,
+						tasks[i].stack_size - uxTaskGetStackHighWaterMark(handle));
+	}
+
+#if CONFIG_GW_STATIC_ALLOCATION
+	ESP_LOGI(TAG, "gateway stacks %d of %d bytes budget, static", TASKS_GW_STACK_BYTES, CONFIG_GW_STATIC_STACK_BUDGET);
+#else
+	ESP_LOGI(TAG, "gateway stacks %d bytes, heap", TASKS_GW_STACK_BYTES);
+#endif
+	ESP_LOGI(TAG, "internal heap %u free, %u minimum",
+					heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+					heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+}
+
+// Copies the last snapshot
+void sysStats_get(sys_stats_t * stats_p)
+{
+	taskENTER_CRITICAL(&sys_stats_mux);
+	*stats_p = g_stats;
+	taskEXIT_CRITICAL(&sys_stats_mux);
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Tasks CPU load over the period and stack high water marks
+ * @param stats_p destination
+ * @param period_us 0 on the first sample, no load yet
+ */
+static void sysStats_sampleTasks(sys_stats_t * stats_p, uint32_t period_us)
+{
+#if CONFIG_GW_SYS_STATS_TASKS
+	sys_stats_counter_t counters[SYS_STATS_MAX_TASKS];
+	UBaseType_t count = uxTaskGetSystemState(g_status, SYS_STATS_MAX_TASKS, NULL);
+
+	if (count == 0)
+	{
+		ESP_LOGW(TAG, "more than %d tasks, raise SYS_STATS_MAX_TASKS", SYS_STATS_MAX_TASKS);
+		return;
+	}
+
+	for (UBaseType_t i = 0; i < count; i++)
+	{
+		const TaskStatus_t * status_p = &g_status[i];
+		sys_stats_task_t * task_p = &stats_p->tasks[i];
+		BaseType_t core = xTaskGetCoreID(status_p->xHandle);
+		uint32_t delta = 0;
+
+		// Tasks created during the period have no load until the next one
+		for (uint8_t j = 0; j < g_counter_count; j++)
+		{
+			if (g_counters[j].handle == status_p->xHandle)
+			{
+				delta = status_p->ulRunTimeCounter - g_counters[j].run_time;
+				break;
+			}
+		}
+		counters[i].handle = status_p->xHandle;
+		counters[i].run_time = status_p->ulRunTimeCounter;
+
+		strncpy(task_p->name, status_p->pcTaskName, sizeof(task_p->name) - 1);
+		task_p->name[sizeof(task_p->name) - 1] = '\0';
+		task_p->core = (core == tskNO_AFFINITY) ? -1 : core;
+		task_p->priority = status_p->uxCurrentPriority;
+		task_p->stack_free = status_p->usStackHighWaterMark;
+		task_p->cpu_permille = (period_us > 0) ? (uint64_t)delta * 1000 / period_us : 0;
+		if (task_p->cpu_permille > 1000)
+		{
+			task_p->cpu_permille = 1000;
+		}
+
+		// A core is busy for whatever its idle task didn't get
+		for (int c = 0; c < portNUM_PROCESSORS; c++)
+		{
+			if (period_us > 0 && status_p->xHandle == xTaskGetIdleTaskHandleForCore(c))
+			{
+				stats_p->core_busy_permille[c] = 1000 - task_p->cpu_permille;
+			}
+		}
+	}
+	stats_p->task_count = count;
+
+	memcpy(g_counters, counters, count * sizeof(sys_stats_counter_t));
+	g_counter_count = count;
+#else
+	stats_p->task_count = 0;
+#endif
+}
+
+/**
+ * @brief Free, minimum ever and largest block of each capability
+ * @param stats_p destination
+ */
+static void sysStats_sampleHeap(sys_stats_t * stats_p)
+{
+	for (int i = 0; i < SYS_STATS_HEAP_COUNT; i++)
+	{
+		stats_p->heap[i].free = heap_caps_get_free_size(g_heap_caps[i]);
+		stats_p->heap[i].min_free = heap_caps_get_minimum_free_size(g_heap_caps[i]);
+		stats_p->heap[i].largest_block = heap_caps_get_largest_free_block(g_heap_caps[i]);
+	}
+}
+
+/**
+ * @brief Counts the lwIP sockets in use
+ * @param stats_p destination
+ */
+static void sysStats_sampleSockets(sys_stats_t * stats_p)
+{
+	int type;
+	socklen_t len;
+
+	stats_p->sockets_open = 0;
+	stats_p->sockets_max = CONFIG_LWIP_MAX_SOCKETS;
+	for (int fd = LWIP_SOCKET_OFFSET; fd < LWIP_SOCKET_OFFSET + CONFIG_LWIP_MAX_SOCKETS; fd++)
+	{
+		len = sizeof(type);
+		if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == 0)
+		{
+			stats_p->sockets_open++;
+		}
+	}
+}
+
+/**
+ * @brief Takes a sample and publishes it, runs on the timer service task
+ * @param timer
+ */
+static void sysStats_sample(TimerHandle_t timer)
+{
+	int64_t now_us = esp_timer_get_time();
+	uint32_t period_us = (g_last_us > 0) ? now_us - g_last_us : 0;
+
+	memset(&g_next, 0x00, sizeof(g_next));
+	g_next.uptime_s = now_us / 1000000;
+	g_next.period_ms = period_us / 1000;
+
+	sysStats_sampleTasks(&g_next, period_us);
+	sysStats_sampleHeap(&g_next);
+	sysStats_sampleSockets(&g_next);
+	g_last_us = now_us;
+
+	taskENTER_CRITICAL(&sys_stats_mux);
+	g_stats = g_next;
+	taskEXIT_CRITICAL(&sys_stats_mux);
+}
@@ -0,0 +1,122 @@
+/**
+ * @file sysStats.h
+ * @brief CPU, stack, heap and socket figures for /sys/stats
+ * @details
+ * A FreeRTOS timer refreshes a snapshot every SYS_STATS_PERIOD_S: the
+ * CPU load of each task and core over the period, stack high water marks
+ * (with CONFIG_GW_SYS_STATS_TASKS), free, minimum ever and largest free
+ * block of each heap capability and the open lwIP sockets. Readers only
+ * copy the snapshot, so the endpoint costs the same however often it is
+ * called.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_SYSSTATS_H_
+#define MAIN_SYSSTATS_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdint.h>
+
+// ESP libraries
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+/**
+ * @brief Heap capabilities reported
+ * @details columns: ID, NAME, CAPS
+ */
+#define X_MACRO_SYS_STATS_HEAP_LIST			\
+	X(0, "default",		MALLOC_CAP_DEFAULT	)	\
+	X(1, "internal",	MALLOC_CAP_INTERNAL	)	\
+	X(2, "dma",			MALLOC_CAP_DMA		)
+
+enum
+{
+#define X(ID, NAME, CAPS) SYS_STATS_HEAP_ID_ ## ID,
+	X_MACRO_SYS_STATS_HEAP_LIST
+#undef X
+	SYS_STATS_HEAP_COUNT
+};
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief One task
+ */
+typedef struct sys_stats_task_s
+{
+	char		name[configMAX_TASK_NAME_LEN];
+	int8_t		core;				///> -1 when not pinned
+	uint8_t		priority;
+	uint16_t	cpu_permille;		///> of one core, over the last period
+	uint32_t	stack_free;			///> bytes never used since the task started
+} sys_stats_task_t;
+
+/**
+ * @brief One heap capability
+ */
+typedef struct sys_stats_heap_s
+{
+	uint32_t	free;
+	uint32_t	min_free;			///> lowest since boot
+	uint32_t	largest_block;		///> biggest single allocation possible
+} sys_stats_heap_t;
+
+/**
+ * @brief Snapshot of the last period
+ */
+typedef struct sys_stats_s
+{
+	uint32_t			uptime_s;
+	uint32_t			period_ms;		///> length of the period the loads cover, 0 before the first one
+	uint16_t			core_busy_permille[portNUM_PROCESSORS];
+	uint8_t				task_count;		///> 0 without CONFIG_GW_SYS_STATS_TASKS
+	sys_stats_task_t	tasks[SYS_STATS_MAX_TASKS];
+	sys_stats_heap_t	heap[SYS_STATS_HEAP_COUNT];
+	uint8_t				sockets_open;
+	uint8_t				sockets_max;
+} sys_stats_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Takes a first sample and starts the periodic timer
+ * @details
+ */
+void sysStats_start(void);
+
+/**
+ * @brief Logs the memory taken by the gateway tasks
+ * @details stack size and use of each task, the stack total against
+ * CONFIG_GW_STATIC_STACK_BUDGET and the internal heap left, meant for the
+ * end of the boot. Tasks not started yet have no use.
+ */
+void sysStats_logBudget(void);
+
+/**
+ * @brief Copies the last snapshot
+ * @param stats_p destination
+ */
+void sysStats_get(sys_stats_t * stats_p);
+
+#endif /* MAIN_SYSSTATS_H_ */
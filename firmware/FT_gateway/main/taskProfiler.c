@@ -0,0 +1,285 @@
+/**
+ * @file taskProfiler.c
+ * @brief CPU load per task and core, with placement recommendations
+ * @details
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdlib.h>
+#include <string.h>
+
+// ESP libraries
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Personal libraries
+#include "taskProfiler.h"
+#include "tasks_common.h"
+
+#if CONFIG_GW_TASK_PROFILER
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+	/* Structures */
+
+/**
+ * @brief One gateway task
+ */
+typedef struct profiled_task_s
+{
+	const char *	name;
+	const char *	option;
+	uint32_t		stack_size;
+} profiled_task_t;
+
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "task_profiler";
+
+static const profiled_task_t g_profiled[] =
+{
+#define X(NAME, OPTION, STACK) { NAME, OPTION, STACK },
+	X_MACRO_GW_TASK_LIST
+#undef X
+};
+
+// Counters of the previous and the current period, too big for the task stack
+static TaskStatus_t g_prev[TASK_PROFILER_MAX_TASKS];
+static TaskStatus_t g_curr[TASK_PROFILER_MAX_TASKS];
+static uint32_t g_load_permille[TASK_PROFILER_MAX_TASKS];
+
+
+	/* FreeRTOS Structures */
+
+TASK_STORAGE(taskProfiler_task, TASK_PROFILER_TASK_STACK_SIZE)
+
+
+	/* Static Functions */
+
+static const profiled_task_t * taskProfiler_findProfiled(const char * name);
+static void taskProfiler_report(UBaseType_t count, UBaseType_t prev_count, uint32_t window_us);
+static void taskProfiler_recommend(UBaseType_t count, const uint32_t * core_busy_permille);
+static void taskProfiler_task(void * pvParameters);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Starts the profiler task
+void taskProfiler_start(void)
+{
+	TASK_CREATE(	taskProfiler_task,
+					&taskProfiler_task,
+					TASK_PROFILER_TASK_STACK_SIZE,
+					TASK_PROFILER_TASK_PRIORITY,
+					NULL,
+					TASK_PROFILER_TASK_CORE_ID);
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Finds a gateway task by name
+ * @param name
+ * @return const profiled_task_t* NULL for the IDF tasks
+ */
+static const profiled_task_t * taskProfiler_findProfiled(const char * name)
+{
+	for (size_t i = 0; i < sizeof(g_profiled) / sizeof(g_profiled[0]); i++)
+	{
+		if (strcmp(g_profiled[i].name, name) == 0)
+		{
+			return &g_profiled[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Logs the load of every task and core over the period
+ * @param count tasks on g_curr
+ * @param prev_count tasks on g_prev
+ * @param window_us length of the period
+ */
+static void taskProfiler_report(UBaseType_t count, UBaseType_t prev_count, uint32_t window_us)
+{
+	uint32_t core_busy_permille[portNUM_PROCESSORS];
+
+	ESP_LOGI(TAG, "%-20s %4s %4s %7s %10s", "task", "core", "prio", "load", "stack free");
+
+	for (UBaseType_t i = 0; i < count; i++)
+	{
+		uint32_t delta = g_curr[i].ulRunTimeCounter;
+
+		// Tasks created during the period count from zero
+		for (UBaseType_t j = 0; j < prev_count; j++)
+		{
+			if (g_prev[j].xHandle == g_curr[i].xHandle)
+			{
+				delta = g_curr[i].ulRunTimeCounter - g_prev[j].ulRunTimeCounter;
+				break;
+			}
+		}
+		g_load_permille[i] = (uint64_t)delta * 1000 / window_us;
+
+		BaseType_t core = xTaskGetCoreID(g_curr[i].xHandle);
+		ESP_LOGI(TAG, "%-20s %4s %4u %5lu.%lu%% %10lu",
+						g_curr[i].pcTaskName,
+						(core == tskNO_AFFINITY) ? "any" : (core == 0) ? "0" : "1",
+						g_curr[i].uxCurrentPriority,
+						g_load_permille[i] / 10, g_load_permille[i] % 10,
+						(uint32_t)g_curr[i].usStackHighWaterMark);
+	}
+
+	// A core is busy for whatever its idle task didn't get
+	for (int core = 0; core < portNUM_PROCESSORS; core++)
+	{
+		TaskHandle_t idle = xTaskGetIdleTaskHandleForCore(core);
+
+		core_busy_permille[core] = 0;
+		for (UBaseType_t i = 0; i < count; i++)
+		{
+			if (g_curr[i].xHandle == idle)
+			{
+				core_busy_permille[core] = (g_load_permille[i] < 1000) ? 1000 - g_load_permille[i] : 0;
+				break;
+			}
+		}
+		ESP_LOGI(TAG, "core %d busy %lu.%lu%%", core, core_busy_permille[core] / 10, core_busy_permille[core] % 10);
+	}
+
+	taskProfiler_recommend(count, core_busy_permille);
+}
+
+/**
+ * @brief Suggests a placement that evens out the cores and the stack sizes
+ * @param count tasks on g_curr
+ * @param core_busy_permille load of each core
+ */
+static void taskProfiler_recommend(UBaseType_t count, const uint32_t * core_busy_permille)
+{
+	int busy = (core_busy_permille[0] >= core_busy_permille[1]) ? 0 : 1;
+	int32_t diff = core_busy_permille[busy] - core_busy_permille[!busy];
+	int best = -1;
+	int32_t best_left = diff;
+
+	for (UBaseType_t i = 0; i < count; i++)
+	{
+		const profiled_task_t * profiled_p = taskProfiler_findProfiled(g_curr[i].pcTaskName);
+
+		if (profiled_p == NULL)
+		{
+			continue;
+		}
+
+		// Stack sizing, the high water mark is in bytes on this port
+		uint32_t free_bytes = g_curr[i].usStackHighWaterMark;
+		if (free_bytes < TASK_PROFILER_STACK_LOW_BYTES)
+		{
+			ESP_LOGW(TAG, "%s: %lu bytes of stack left, raise CONFIG_%s_STACK_SIZE to %lu",
+							profiled_p->name, free_bytes, profiled_p->option,
+							profiled_p->stack_size + TASK_PROFILER_STACK_LOW_BYTES);
+		}
+		else if (free_bytes > profiled_p->stack_size / 2)
+		{
+			uint32_t used = profiled_p->stack_size - free_bytes;
+			ESP_LOGI(TAG, "%s: uses %lu of %lu bytes of stack, CONFIG_%s_STACK_SIZE could be %lu",
+							profiled_p->name, used, profiled_p->stack_size, profiled_p->option,
+							(used + TASK_PROFILER_STACK_LOW_BYTES + 255) & ~255UL);
+		}
+
+		// Moving a task from the busy core shifts twice its load on the difference
+		if (xTaskGetCoreID(g_curr[i].xHandle) == busy)
+		{
+			int32_t left = abs(diff - 2 * (int32_t)g_load_permille[i]);
+			if (left < best_left)
+			{
+				best_left = left;
+				best = i;
+			}
+		}
+	}
+
+	if (diff <= CONFIG_GW_TASK_PROFILER_IMBALANCE_PCT * 10)
+	{
+		ESP_LOGI(TAG, "cores within %d%%, placement is fine", CONFIG_GW_TASK_PROFILER_IMBALANCE_PCT);
+	}
+	else if (best < 0)
+	{
+		ESP_LOGI(TAG, "core %d is %ld.%ld%% busier, but no gateway task moved would help", busy, diff / 10, diff % 10);
+	}
+	else
+	{
+		ESP_LOGW(TAG, "core %d is %ld.%ld%% busier: set CONFIG_%s_CORE=%d (difference down to %ld.%ld%%)",
+						busy, diff / 10, diff % 10,
+						taskProfiler_findProfiled(g_curr[best].pcTaskName)->option, !busy,
+						best_left / 10, best_left % 10);
+	}
+}
+
+/**
+ * @brief Profiler task
+ * @details
+ * @param pvParameters
+ */
+static void taskProfiler_task(void * pvParameters)
+{
+	UBaseType_t prev_count;
+	UBaseType_t count;
+	int64_t prev_us;
+	int64_t now_us;
+
+	ESP_LOGI(TAG, "Profiling every %d s", CONFIG_GW_TASK_PROFILER_PERIOD_S);
+
+	prev_count = uxTaskGetSystemState(g_prev, TASK_PROFILER_MAX_TASKS, NULL);
+	prev_us = esp_timer_get_time();
+
+	for (;;)
+	{
+		vTaskDelay(pdMS_TO_TICKS(CONFIG_GW_TASK_PROFILER_PERIOD_S * 1000));
+
+		// The run time counters tick in microseconds, on esp_timer
+		count = uxTaskGetSystemState(g_curr, TASK_PROFILER_MAX_TASKS, NULL);
+		now_us = esp_timer_get_time();
+		if (count == 0)
+		{
+			ESP_LOGE(TAG, "more than %d tasks, raise TASK_PROFILER_MAX_TASKS", TASK_PROFILER_MAX_TASKS);
+			continue;
+		}
+
+		taskProfiler_report(count, prev_count, now_us - prev_us);
+
+		memcpy(g_prev, g_curr, count * sizeof(TaskStatus_t));
+		prev_count = count;
+		prev_us = now_us;
+	}
+}
+
+#else
+
+// Starts the profiler task
+void taskProfiler_start(void)
+{
+}
+
+#endif /* CONFIG_GW_TASK_PROFILER */
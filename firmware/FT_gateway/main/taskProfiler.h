@@ -0,0 +1,49 @@
+/**
+ * @file taskProfiler.h
+ * @brief CPU load per task and core, with placement recommendations
+ * @details
+ * Built with CONFIG_GW_TASK_PROFILER only. Every
+ * CONFIG_GW_TASK_PROFILER_PERIOD_S the FreeRTOS run time counters are
+ * sampled and the load of each task and core over the period is logged.
+ * When the cores differ by more than CONFIG_GW_TASK_PROFILER_IMBALANCE_PCT
+ * the gateway task that best evens them out is suggested for the other
+ * core, and stacks too tight or too loose are pointed out, both as the
+ * menuconfig option to change.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_TASKPROFILER_H_
+#define MAIN_TASKPROFILER_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// ESP libraries
+#include "sdkconfig.h"
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+// Most tasks sampled, IDF and application ones
+#define TASK_PROFILER_MAX_TASKS			32
+
+// Stack left unused below this is worth raising
+#define TASK_PROFILER_STACK_LOW_BYTES	512
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Starts the profiler task
+ * @details
+ */
+void taskProfiler_start(void);
+
+#endif /* MAIN_TASKPROFILER_H_ */
@@ -9,20 +9,20 @@
 #ifndef MAIN_TASKS_COMMON_H_
 #define MAIN_TASKS_COMMON_H_
 
+// Placement of the gateway tasks is set on menuconfig, "Gateway Tasks"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
 // Wifi application task
-#define WIFI_APP_TASK_STACK_SIZE		4096
-#define WIFI_APP_TASK_PRIORITY			5
-#define WIFI_APP_TASK_CORE_ID			0
+#define WIFI_APP_TASK_STACK_SIZE		CONFIG_GW_WIFI_APP_TASK_STACK_SIZE
+#define WIFI_APP_TASK_PRIORITY			CONFIG_GW_WIFI_APP_TASK_PRIORITY
+#define WIFI_APP_TASK_CORE_ID			CONFIG_GW_WIFI_APP_TASK_CORE
 
 // HTTP Server task
-#define HTTP_SERVER_STACK_SIZE			8192
-#define HTTP_SERVER_TASK_PRIORITY		4
-#define HTTP_SERVER_TASK_CORE_ID		0
-
-// HTTP Server Monitor task
-#define HTTP_SERVER_MONITOR_STACK_SIZE	4096
-#define HTTP_SERVER_MONITOR_PRIORITY	3
-#define HTTP_SERVER_MONITOR_CORE_ID		0
+#define HTTP_SERVER_STACK_SIZE			CONFIG_GW_HTTP_SERVER_TASK_STACK_SIZE
+#define HTTP_SERVER_TASK_PRIORITY		CONFIG_GW_HTTP_SERVER_TASK_PRIORITY
+#define HTTP_SERVER_TASK_CORE_ID		CONFIG_GW_HTTP_SERVER_TASK_CORE
 
 // Menu Task
 #define MENU_TASK_STACK_SIZE			4096
@@ -36,8 +36,126 @@
 
 
 // NTP DateTime Task
-#define NTP_DATE_TIME_TASK_STACK_SIZE	4096
-#define NTP_DATE_TIME_TASK_PRIORITY     4
-#define NTP_DATE_TIME_TASK_CORE_ID		1
+#define NTP_DATE_TIME_TASK_STACK_SIZE	CONFIG_GW_NTP_TASK_STACK_SIZE
+#define NTP_DATE_TIME_TASK_PRIORITY     CONFIG_GW_NTP_TASK_PRIORITY
+#define NTP_DATE_TIME_TASK_CORE_ID		CONFIG_GW_NTP_TASK_CORE
+
+// Link Quality sampler task
+#define LINK_QUALITY_TASK_STACK_SIZE	CONFIG_GW_LINK_QUALITY_TASK_STACK_SIZE
+#define LINK_QUALITY_TASK_PRIORITY		CONFIG_GW_LINK_QUALITY_TASK_PRIORITY
+#define LINK_QUALITY_TASK_CORE_ID		CONFIG_GW_LINK_QUALITY_TASK_CORE
+
+// Zigbee NCP receive task
+#define ZIGBEE_NCP_TASK_STACK_SIZE		CONFIG_GW_ZIGBEE_NCP_TASK_STACK_SIZE
+#define ZIGBEE_NCP_TASK_PRIORITY		CONFIG_GW_ZIGBEE_NCP_TASK_PRIORITY
+#define ZIGBEE_NCP_TASK_CORE_ID			CONFIG_GW_ZIGBEE_NCP_TASK_CORE
+
+// Task profiler, only with CONFIG_GW_TASK_PROFILER
+#define TASK_PROFILER_TASK_STACK_SIZE	3072
+#define TASK_PROFILER_TASK_PRIORITY		1
+#define TASK_PROFILER_TASK_CORE_ID		1
+
+// A disabled bool option is left out of sdkconfig.h, the stack sum needs a 0/1 value
+#ifdef CONFIG_GW_TASK_PROFILER
+#define TASK_PROFILER_ENABLED			1
+#else
+#define TASK_PROFILER_ENABLED			0
+#endif
+
+// Async log drain task
+#define ASYNC_LOG_TASK_STACK_SIZE		CONFIG_GW_ASYNC_LOG_TASK_STACK_SIZE
+#define ASYNC_LOG_TASK_PRIORITY			CONFIG_GW_ASYNC_LOG_TASK_PRIORITY
+#define ASYNC_LOG_TASK_CORE_ID			CONFIG_GW_ASYNC_LOG_TASK_CORE
+
+// Valve schedule task
+#define VALVE_SCHEDULE_TASK_STACK_SIZE	CONFIG_GW_VALVE_SCHEDULE_TASK_STACK_SIZE
+#define VALVE_SCHEDULE_TASK_PRIORITY	CONFIG_GW_VALVE_SCHEDULE_TASK_PRIORITY
+#define VALVE_SCHEDULE_TASK_CORE_ID		CONFIG_GW_VALVE_SCHEDULE_TASK_CORE
+
+// Device registry NVS writer task
+#define DEVICE_REGISTRY_TASK_STACK_SIZE	CONFIG_GW_DEVICE_REGISTRY_TASK_STACK_SIZE
+#define DEVICE_REGISTRY_TASK_PRIORITY	CONFIG_GW_DEVICE_REGISTRY_TASK_PRIORITY
+#define DEVICE_REGISTRY_TASK_CORE_ID	CONFIG_GW_DEVICE_REGISTRY_TASK_CORE
+
+// Telemetry store task
+#define TELEMETRY_TASK_STACK_SIZE		CONFIG_GW_TELEMETRY_TASK_STACK_SIZE
+#define TELEMETRY_TASK_PRIORITY			CONFIG_GW_TELEMETRY_TASK_PRIORITY
+#define TELEMETRY_TASK_CORE_ID			CONFIG_GW_TELEMETRY_TASK_CORE
+
+// MQTT uplink task, the client task is allocated by esp-mqtt
+#define MQTT_UPLINK_TASK_STACK_SIZE		CONFIG_GW_MQTT_UPLINK_TASK_STACK_SIZE
+#define MQTT_UPLINK_TASK_PRIORITY		CONFIG_GW_MQTT_UPLINK_TASK_PRIORITY
+#define MQTT_UPLINK_TASK_CORE_ID		CONFIG_GW_MQTT_UPLINK_TASK_CORE
+#define MQTT_CLIENT_TASK_STACK_SIZE		CONFIG_GW_MQTT_CLIENT_TASK_STACK_SIZE
+#define MQTT_CLIENT_TASK_PRIORITY		CONFIG_GW_MQTT_CLIENT_TASK_PRIORITY
+
+// esp-mqtt pins its task from its own core selection, they must agree
+#if !(defined(CONFIG_MQTT_USE_CORE_0) && CONFIG_GW_MQTT_CLIENT_TASK_CORE == 0) \
+	&& !(defined(CONFIG_MQTT_USE_CORE_1) && CONFIG_GW_MQTT_CLIENT_TASK_CORE == 1)
+#error "CONFIG_GW_MQTT_CLIENT_TASK_CORE: enable the ESP-MQTT core selection on the same core"
+#endif
+
+/**
+ * @brief Gateway tasks with menuconfig options
+ * @details columns: TASK NAME, MENUCONFIG PREFIX, STACK SIZE
+ */
+#define X_MACRO_GW_TASK_LIST																		\
+	X("wifiApp_task",			"GW_WIFI_APP_TASK",				WIFI_APP_TASK_STACK_SIZE		)	\
+	X("httpd",					"GW_HTTP_SERVER_TASK",			HTTP_SERVER_STACK_SIZE			)	\
+	X("router_fetchDateTime",	"GW_NTP_TASK",					NTP_DATE_TIME_TASK_STACK_SIZE	)	\
+	X("linkQuality_task",		"GW_LINK_QUALITY_TASK",			LINK_QUALITY_TASK_STACK_SIZE	)	\
+	X("zigbeeNcp_task",			"GW_ZIGBEE_NCP_TASK",			ZIGBEE_NCP_TASK_STACK_SIZE		)	\
+	X("asyncLog_task",			"GW_ASYNC_LOG_TASK",			ASYNC_LOG_TASK_STACK_SIZE		)	\
+	X("deviceRegistry_task",	"GW_DEVICE_REGISTRY_TASK",		DEVICE_REGISTRY_TASK_STACK_SIZE	)	\
+	X("valveSchedule_task",		"GW_VALVE_SCHEDULE_TASK",		VALVE_SCHEDULE_TASK_STACK_SIZE	)	\
+	X("telemetryStore_task",	"GW_TELEMETRY_TASK",			TELEMETRY_TASK_STACK_SIZE		)	\
+	X("mqttUplink_task",		"GW_MQTT_UPLINK_TASK",			MQTT_UPLINK_TASK_STACK_SIZE		)	\
+	X("mqtt_task",				"GW_MQTT_CLIENT_TASK",			MQTT_CLIENT_TASK_STACK_SIZE		)
+
+// The lists above look the tasks up by name, FreeRTOS cuts longer ones
+#define X(NAME, OPTION, STACK) _Static_assert(sizeof(NAME) <= configMAX_TASK_NAME_LEN, NAME ": raise CONFIG_FREERTOS_MAX_TASK_NAME_LEN");
+X_MACRO_GW_TASK_LIST
+#undef X
+
+/**
+ * @brief Stacks the gateway creates itself, httpd and the MQTT client are allocated by their components
+ */
+#define TASKS_GW_STACK_BYTES	(WIFI_APP_TASK_STACK_SIZE + NTP_DATE_TIME_TASK_STACK_SIZE + LINK_QUALITY_TASK_STACK_SIZE \
+								+ ASYNC_LOG_TASK_STACK_SIZE + ZIGBEE_NCP_TASK_STACK_SIZE + VALVE_SCHEDULE_TASK_STACK_SIZE \
+								+ TELEMETRY_TASK_STACK_SIZE + MQTT_UPLINK_TASK_STACK_SIZE + DEVICE_REGISTRY_TASK_STACK_SIZE \
+								+ (TASK_PROFILER_ENABLED ? TASK_PROFILER_TASK_STACK_SIZE : 0))
+
+/**
+ * @brief Task storage and creation, static with CONFIG_GW_STATIC_ALLOCATION
+ * @details TASK_STORAGE goes at file scope, NAME is also the task name.
+ * TASK_CREATE returns pdPASS like xTaskCreatePinnedToCore.
+ */
+#if CONFIG_GW_STATIC_ALLOCATION
+#define TASK_STORAGE(NAME, STACK_SIZE)												\
+	static StackType_t NAME ## _stack[STACK_SIZE];									\
+	static StaticTask_t NAME ## _tcb;
+#define TASK_CREATE(NAME, FUNC, STACK_SIZE, PRIORITY, HANDLE_P, CORE_ID)			\
+	tasks_created(xTaskCreateStaticPinnedToCore(FUNC, #NAME, STACK_SIZE, NULL, PRIORITY,	\
+												NAME ## _stack, &NAME ## _tcb, CORE_ID), HANDLE_P)
+
+/**
+ * @brief Gives xTaskCreateStaticPinnedToCore the xTaskCreatePinnedToCore interface
+ * @param handle NULL when the parameters were invalid
+ * @param handle_p where to store it, may be NULL
+ * @return BaseType_t pdPASS or pdFAIL
+ */
+static inline BaseType_t tasks_created(TaskHandle_t handle, TaskHandle_t * handle_p)
+{
+	if (handle_p != NULL)
+	{
+		*handle_p = handle;
+	}
+	return (handle != NULL) ? pdPASS : pdFAIL;
+}
+#else
+#define TASK_STORAGE(NAME, STACK_SIZE)
+#define TASK_CREATE(NAME, FUNC, STACK_SIZE, PRIORITY, HANDLE_P, CORE_ID)			\
+	xTaskCreatePinnedToCore(FUNC, #NAME, STACK_SIZE, NULL, PRIORITY, HANDLE_P, CORE_ID)
+#endif
 
 #endif /* MAIN_TASKS_COMMON_H_ */
@@ -0,0 +1,186 @@
+/**
+ * @file telemetryCodec.c
+ * @brief Streaming compression of the telemetry samples
+ * @details
+ * The differences are taken modulo 2^32, so any sequence of times and
+ * values comes back exactly, wrap and clock steps included. Zigzag maps
+ * the small negative numbers to small varints: 0 1 -1 2 -2 -> 0 1 2 3 4.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <string.h>
+
+// Personal libraries
+#include "telemetryCodec.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+	/* Static Functions */
+
+static inline uint32_t telemetryCodec_zigzag(uint32_t value);
+static inline uint32_t telemetryCodec_unzigzag(uint32_t value);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Starts a stream
+void telemetryCodec_init(telemetry_codec_t * codec_p, uint32_t base_ts, uint8_t columns)
+{
+	memset(codec_p, 0x00, sizeof(telemetry_codec_t));
+	codec_p->ts = base_ts;
+	codec_p->columns = (columns <= TELEMETRY_CODEC_MAX_COLUMNS) ? columns : TELEMETRY_CODEC_MAX_COLUMNS;
+}
+
+// Encodes a sample
+size_t telemetryCodec_encode(telemetry_codec_t * codec_p, uint32_t ts, const int32_t * values, uint8_t * out_p, size_t size)
+{
+	uint32_t delta = ts - codec_p->ts;
+	size_t len;
+	size_t n;
+
+	len = telemetryCodec_putVarint(telemetryCodec_zigzag(delta - codec_p->delta), out_p, size);
+	for (uint8_t c = 0; c < codec_p->columns && len > 0; c++)
+	{
+		n = telemetryCodec_putVarint(telemetryCodec_zigzag((uint32_t)values[c] - (uint32_t)codec_p->values[c]),
+										out_p + len, size - len);
+		len = (n > 0) ? len + n : 0;
+	}
+	if (len == 0)
+	{
+		return 0;
+	}
+
+	codec_p->ts = ts;
+	codec_p->delta = delta;
+	memcpy(codec_p->values, values, codec_p->columns * sizeof(int32_t));
+	return len;
+}
+
+// Decodes a sample
+size_t telemetryCodec_decode(telemetry_codec_t * codec_p, const uint8_t * in_p, size_t len, uint32_t * ts_p, int32_t * values)
+{
+	int32_t next[TELEMETRY_CODEC_MAX_COLUMNS];
+	uint32_t delta;
+	uint32_t word;
+	size_t used;
+	size_t n;
+
+	// Decoded aside, a truncated sample leaves the stream where it was
+	used = telemetryCodec_getVarint(in_p, len, &word);
+	if (used == 0)
+	{
+		return 0;
+	}
+	delta = codec_p->delta + telemetryCodec_unzigzag(word);
+
+	for (uint8_t c = 0; c < codec_p->columns; c++)
+	{
+		n = telemetryCodec_getVarint(in_p + used, len - used, &word);
+		if (n == 0)
+		{
+			return 0;
+		}
+		used += n;
+		next[c] = (int32_t)((uint32_t)codec_p->values[c] + telemetryCodec_unzigzag(word));
+	}
+
+	codec_p->delta = delta;
+	codec_p->ts += delta;
+	memcpy(codec_p->values, next, codec_p->columns * sizeof(int32_t));
+	*ts_p = codec_p->ts;
+	memcpy(values, next, codec_p->columns * sizeof(int32_t));
+	return used;
+}
+
+// Length of an encoded sample
+size_t telemetryCodec_skip(const uint8_t * in_p, size_t len, uint8_t columns)
+{
+	uint32_t word;
+	size_t used = 0;
+	size_t n;
+
+	for (uint8_t c = 0; c <= columns; c++)
+	{
+		n = telemetryCodec_getVarint(in_p + used, len - used, &word);
+		if (n == 0)
+		{
+			return 0;
+		}
+		used += n;
+	}
+	return used;
+}
+
+// Writes a varint
+size_t telemetryCodec_putVarint(uint32_t value, uint8_t * out_p, size_t size)
+{
+	size_t len = 0;
+
+	do
+	{
+		if (len >= size)
+		{
+			return 0;
+		}
+		out_p[len++] = (value & 0x7F) | ((value > 0x7F) ? 0x80 : 0x00);
+		value >>= 7;
+	} while (value != 0);
+
+	return len;
+}
+
+// Reads a varint
+size_t telemetryCodec_getVarint(const uint8_t * in_p, size_t len, uint32_t * value_p)
+{
+	uint32_t value = 0;
+
+	for (size_t i = 0; i < len && i < TELEMETRY_CODEC_VARINT_MAX; i++)
+	{
+		value |= (uint32_t)(in_p[i] & 0x7F) << (7 * i);
+		if ((in_p[i] & 0x80) == 0)
+		{
+			*value_p = value;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Signed difference to unsigned, small magnitudes first
+ * @param value two's complement
+ * @return uint32_t
+ */
+static inline uint32_t telemetryCodec_zigzag(uint32_t value)
+{
+	return (value << 1) ^ (uint32_t)((int32_t)value >> 31);
+}
+
+/**
+ * @brief Reverses telemetryCodec_zigzag
+ * @param value
+ * @return uint32_t two's complement
+ */
+static inline uint32_t telemetryCodec_unzigzag(uint32_t value)
+{
+	return (value >> 1) ^ (0U - (value & 1));
+}
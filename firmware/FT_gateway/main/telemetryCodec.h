@@ -0,0 +1,124 @@
+/**
+ * @file telemetryCodec.h
+ * @brief Streaming compression of the telemetry samples
+ * @details
+ * Gorilla style, byte aligned. A sample is a time and one or more integer
+ * columns; each is written as a zigzag varint of what the stream state
+ * didn't predict:
+ *
+ *     time		delta of delta, 0 when the interval is the same as before
+ *     column	delta from the column's previous value
+ *
+ * A series reported at a steady rate with slow values takes 2 bytes per
+ * sample, a valve that keeps its state 1 byte plus its time. The decoder
+ * must see every sample of a stream from its start, with the same base
+ * time and columns; any stream can be skipped through without its state.
+ * The store (telemetryStore.h), /telemetry.bin and the MQTT batches
+ * (mqttUplink.h) write this format, tools/telemetry_decode.py reads it.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_TELEMETRYCODEC_H_
+#define MAIN_TELEMETRYCODEC_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+#define TELEMETRY_CODEC_MAX_COLUMNS		4
+#define TELEMETRY_CODEC_VARINT_MAX		5
+// Longest encoded sample
+#define TELEMETRY_CODEC_MAX_BYTES(COLUMNS)	(TELEMETRY_CODEC_VARINT_MAX * (1 + (COLUMNS)))
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief State of a stream, one per encoder and per decoder
+ */
+typedef struct telemetry_codec_s
+{
+	uint32_t	ts;			///> time of the previous sample
+	uint32_t	delta;		///> interval before it
+	int32_t		values[TELEMETRY_CODEC_MAX_COLUMNS];
+	uint8_t		columns;
+} telemetry_codec_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Starts a stream
+ * @param codec_p
+ * @param base_ts time the first sample counts from
+ * @param columns values per sample, 1 to TELEMETRY_CODEC_MAX_COLUMNS
+ */
+void telemetryCodec_init(telemetry_codec_t * codec_p, uint32_t base_ts, uint8_t columns);
+
+/**
+ * @brief Encodes a sample
+ * @details the state only moves when it fits
+ * @param codec_p
+ * @param ts
+ * @param values codec_p->columns of them
+ * @param out_p destination
+ * @param size room at out_p
+ * @return size_t bytes written, 0 when it doesn't fit
+ */
+size_t telemetryCodec_encode(telemetry_codec_t * codec_p, uint32_t ts, const int32_t * values, uint8_t * out_p, size_t size);
+
+/**
+ * @brief Decodes a sample
+ * @param codec_p
+ * @param in_p
+ * @param len bytes available
+ * @param ts_p destination
+ * @param values destination, codec_p->columns of them
+ * @return size_t bytes read, 0 when truncated or invalid, the stream and
+ * the destinations are then left as they were
+ */
+size_t telemetryCodec_decode(telemetry_codec_t * codec_p, const uint8_t * in_p, size_t len, uint32_t * ts_p, int32_t * values);
+
+/**
+ * @brief Length of an encoded sample, without decoding it
+ * @param in_p
+ * @param len bytes available
+ * @param columns of the stream
+ * @return size_t 0 when truncated or invalid
+ */
+size_t telemetryCodec_skip(const uint8_t * in_p, size_t len, uint8_t columns);
+
+/**
+ * @brief Writes a varint, 7 bits per byte, low bits first
+ * @param value
+ * @param out_p
+ * @param size room at out_p
+ * @return size_t bytes written, 0 when it doesn't fit
+ */
+size_t telemetryCodec_putVarint(uint32_t value, uint8_t * out_p, size_t size);
+
+/**
+ * @brief Reads a varint
+ * @param in_p
+ * @param len bytes available
+ * @param value_p destination
+ * @return size_t bytes read, 0 when truncated or longer than TELEMETRY_CODEC_VARINT_MAX
+ */
+size_t telemetryCodec_getVarint(const uint8_t * in_p, size_t len, uint32_t * value_p);
+
+#endif /* MAIN_TELEMETRYCODEC_H_ */
@@ -0,0 +1,1173 @@
+/**
+ * @file telemetryStore.c
+ * @brief History of the device attributes on the telemetry partition
+ * @details
+ * Block layout, TELEMETRY_BLOCK_SIZE bytes:
+ *
+ *     header(20) records -> free <- devices(8 each, first one last)
+ *     record: device(1) attr(1) sample(telemetryCodec.h, 1 column)
+ *
+ * Records grow up and the device list grows down from the end, a block
+ * takes as many devices as it needs and is full when the two meet. Each
+ * device and attribute pair is a codec stream of its own, from the block
+ * base time and value 0, so a block is read without the ones before it.
+ * Erased flash reads 0xFF and writing only clears bits, so the header is
+ * written when the block opens and its counts and latest time are filled
+ * in place when it is sealed. Device entries and records are appended the
+ * same way; a device position is never 0xFF, free space starts there.
+ * After a reset the blocks left unsealed are decoded up to their free
+ * space, a record cut by the reset seals the block before it.
+ * The RAM index mirrors the block headers; the store mutex covers it, the
+ * newest block state and the flash, the RAM buffer has a spinlock so the
+ * appends never wait on a flash write.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ESP libraries
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+// Personal libraries
+#include "tasks_common.h"
+#include "telemetryCodec.h"
+#include "telemetryStore.h"
+#include "timebase.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+#define TELEMETRY_MAGIC				0x324D4C54	// "TLM2"
+#define TELEMETRY_FREE				0xFF
+#define TELEMETRY_MAX_DT			0xFFFF
+#define TELEMETRY_RECORDS_OFFSET	sizeof(telemetry_block_header_t)
+#define TELEMETRY_RECORD_MAX		(2 + TELEMETRY_CODEC_MAX_BYTES(1))
+// Bytes left for records once a block holds some devices
+#define TELEMETRY_ROOM(DEVICES)		(TELEMETRY_BLOCK_SIZE - TELEMETRY_RECORDS_OFFSET - (DEVICES) * sizeof(uint64_t))
+// Device list entry, the first one is at the end of the block
+#define TELEMETRY_DEVICE_OFFSET(BLOCK, POS)	(((BLOCK) + 1) * TELEMETRY_BLOCK_SIZE - ((POS) + 1) * sizeof(uint64_t))
+
+	/* Structures */
+
+/**
+ * @brief Start of a block
+ */
+typedef struct __attribute__((packed)) telemetry_block_header_s
+{
+	uint32_t	magic;
+	uint32_t	seq;		// the highest is the newest block
+	uint32_t	base_ts;	// epoch second the records count from
+	uint16_t	count;		// records, 0xFFFF until sealed
+	uint16_t	max_dt;		// latest record, 0xFFFF until sealed
+	uint16_t	devices;	// device list entries, 0xFFFF until sealed
+	uint16_t	bytes;		// of the records, 0xFFFF until sealed
+} telemetry_block_header_t;
+
+/**
+ * @brief RAM index of a block, seq 0 for a free one
+ */
+typedef struct telemetry_block_s
+{
+	uint32_t	seq;
+	uint32_t	base_ts;
+	uint16_t	count;
+	uint16_t	max_dt;
+	uint16_t	devices;
+	uint16_t	bytes;
+} telemetry_block_t;
+
+/**
+ * @brief Codec state of a device attribute on a block
+ */
+typedef struct telemetry_series_s
+{
+	uint32_t	delta;
+	int32_t		value;
+	uint16_t	dt;			// of the previous sample, from the block base time
+	uint8_t		device;
+	uint8_t		attr;
+} telemetry_series_t;
+
+/**
+ * @brief Step being summed by a query
+ */
+typedef struct telemetry_agg_s
+{
+	const telemetry_query_t *	query_p;
+	telemetry_query_result_t *	result_p;
+	telemetry_point_cb_t		cb;
+	void *						ctx;
+	bool						open;
+	telemetry_point_t			point;
+	int64_t						sum;
+} telemetry_agg_t;
+
+_Static_assert(sizeof(telemetry_block_header_t) == 20, "header layout");
+_Static_assert(TELEMETRY_BLOCK_DEVICES < TELEMETRY_FREE, "device positions are 8 bit, 0xFF is free space");
+
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "telemetry";
+
+static const esp_partition_t * g_partition;
+static uint16_t g_block_count;
+
+// Index of every block, and the newest one
+static telemetry_block_t g_blocks[TELEMETRY_MAX_BLOCKS];
+static int g_head = -1;
+static bool g_head_open;
+static uint64_t g_devices[TELEMETRY_BLOCK_DEVICES];
+static uint8_t g_device_count;
+static telemetry_series_t g_series[TELEMETRY_BLOCK_SERIES];
+static uint16_t g_series_count;
+
+// Records of the newest block not written yet, from byte g_staged_from
+static uint8_t g_staging[TELEMETRY_BUFFER_RECORDS * TELEMETRY_RECORD_MAX];
+static uint16_t g_staged;
+static uint16_t g_staged_from;
+
+// Samples waiting for the task, and the batch it is writing
+static telemetry_sample_t g_buffer[TELEMETRY_BUFFER_RECORDS];
+static uint16_t g_buffered;
+static telemetry_sample_t g_batch[TELEMETRY_BUFFER_RECORDS];
+
+static telemetry_stats_t g_stats;
+static portMUX_TYPE telemetry_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+	/* FreeRTOS Structures */
+
+TASK_STORAGE(telemetryStore_task, TELEMETRY_TASK_STACK_SIZE)
+static TaskHandle_t telemetry_task_handle;
+
+// Protects the index, the newest block and the flash
+static SemaphoreHandle_t telemetry_mutex;
+#if CONFIG_GW_STATIC_ALLOCATION
+static StaticSemaphore_t telemetry_mutex_struct;
+#endif
+
+
+	/* Static Functions */
+
+static void telemetryStore_task(void * pvParameters);
+static esp_err_t telemetryStore_mount(void);
+static bool telemetryStore_scan(uint16_t block, uint8_t * buf_p);
+static void telemetryStore_flush(void);
+static void telemetryStore_put(const telemetry_sample_t * sample_p);
+static bool telemetryStore_open(uint32_t base_ts);
+static void telemetryStore_seal(void);
+static void telemetryStore_writeStaged(void);
+static int telemetryStore_findDevice(const uint64_t * devices, uint8_t count, uint64_t ieee);
+static telemetry_series_t * telemetryStore_findSeries(telemetry_series_t * series, uint16_t count, uint8_t device, uint8_t attr);
+static telemetry_series_t * telemetryStore_addSeries(telemetry_series_t * series, uint16_t * count_p, uint8_t device, uint8_t attr);
+static size_t telemetryStore_code(telemetry_series_t * series_p, uint32_t base_ts, uint8_t * data_p, size_t size,
+									uint32_t * ts_p, int32_t * value_p, bool encode);
+static int telemetryStore_nextBlock(uint32_t min_seq);
+static int telemetryStore_cursorBlock(telemetry_cursor_t * cursor_p, uint32_t * lost_p);
+static void telemetryStore_aggregate(telemetry_agg_t * agg_p, uint32_t ts, int32_t value);
+static void telemetryStore_emit(telemetry_agg_t * agg_p);
+static esp_err_t telemetryStore_write(size_t offset, const void * data, size_t size);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Finds the newest block and starts the telemetry task
+esp_err_t telemetryStore_init(void)
+{
+	if (telemetry_mutex != NULL)
+	{
+		return ESP_OK;
+	}
+
+#if CONFIG_GW_STATIC_ALLOCATION
+	telemetry_mutex = xSemaphoreCreateMutexStatic(&telemetry_mutex_struct);
+#else
+	telemetry_mutex = xSemaphoreCreateMutex();
+#endif
+
+	g_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_UNDEFINED,
+											TELEMETRY_PARTITION_LABEL);
+	if (g_partition == NULL)
+	{
+		ESP_LOGE(TAG, "no \"%s\" partition, telemetry not kept", TELEMETRY_PARTITION_LABEL);
+		return ESP_ERR_NOT_FOUND;
+	}
+	g_block_count = g_partition->size / TELEMETRY_BLOCK_SIZE;
+	if (g_block_count > TELEMETRY_MAX_BLOCKS)
+	{
+		g_block_count = TELEMETRY_MAX_BLOCKS;
+	}
+	if (g_block_count < 2)
+	{
+		ESP_LOGE(TAG, "\"%s\" partition too small", TELEMETRY_PARTITION_LABEL);
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	if (telemetryStore_mount() != ESP_OK)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+
+	TASK_CREATE(	telemetryStore_task,
+					&telemetryStore_task,
+					TELEMETRY_TASK_STACK_SIZE,
+					TELEMETRY_TASK_PRIORITY,
+					&telemetry_task_handle,
+					TELEMETRY_TASK_CORE_ID);
+	return ESP_OK;
+}
+
+// Adds a sample taken now
+bool telemetryStore_append(uint64_t ieee, uint8_t attr, int32_t value)
+{
+	bool kept = false;
+	bool wake = false;
+
+	if (!timebase_isSynced())
+	{
+		taskENTER_CRITICAL(&telemetry_mux);
+		g_stats.unsynced++;
+		taskEXIT_CRITICAL(&telemetry_mux);
+		return false;
+	}
+
+	telemetry_sample_t sample =
+	{
+		.ieee = ieee,
+		.ts = timebase_nowUs() / 1000000,
+		.value = value,
+		.attr = attr,
+	};
+
+	taskENTER_CRITICAL(&telemetry_mux);
+	if (g_stats.mounted && g_buffered < TELEMETRY_BUFFER_RECORDS)
+	{
+		g_buffer[g_buffered++] = sample;
+		g_stats.appended++;
+		wake = (g_buffered == TELEMETRY_BUFFER_RECORDS / 2);
+		kept = true;
+	}
+	else
+	{
+		g_stats.dropped++;
+	}
+	taskEXIT_CRITICAL(&telemetry_mux);
+
+	// Half full, written before it fills up
+	if (wake && telemetry_task_handle != NULL)
+	{
+		xTaskNotifyGive(telemetry_task_handle);
+	}
+	return kept;
+}
+
+// Reads a range, one point per step
+esp_err_t telemetryStore_query(const telemetry_query_t * query_p, telemetry_point_cb_t cb, void * ctx,
+								telemetry_query_result_t * result_p)
+{
+	telemetry_query_result_t result = { 0 };
+	telemetry_agg_t agg =
+	{
+		.query_p = query_p,
+		.result_p = &result,
+		.cb = cb,
+		.ctx = ctx,
+	};
+	telemetry_codec_t codec;
+	telemetry_sample_t * pending_p;
+	uint64_t * devices_p;
+	uint8_t * buf_p;
+	uint32_t ts;
+	int32_t value;
+	int64_t start_us = esp_timer_get_time();
+	uint32_t span_s;
+	uint32_t min_seq = 1;
+	uint16_t pending = 0;
+	bool last = false;
+
+	if (!g_stats.mounted)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+	if (query_p->to_ts < query_p->from_ts)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// The step grows until the range fits in the points allowed
+	span_s = query_p->to_ts - query_p->from_ts + 1;
+	result.step_s = (query_p->step_s > 0) ? query_p->step_s : 1;
+	if (span_s / result.step_s >= TELEMETRY_QUERY_MAX_POINTS)
+	{
+		result.step_s = span_s / TELEMETRY_QUERY_MAX_POINTS + 1;
+	}
+
+	// One block and the RAM buffer
+	buf_p = malloc(TELEMETRY_BLOCK_SIZE + sizeof(g_buffer));
+	if (buf_p == NULL)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+	pending_p = (telemetry_sample_t *)(buf_p + TELEMETRY_BLOCK_SIZE);
+
+	// Oldest block first, the lock is taken per block so the writes go on between them
+	while (!last)
+	{
+		telemetry_block_t block = { 0 };
+		int device = -1;
+		int index;
+
+		xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+		index = telemetryStore_nextBlock(min_seq);
+		if (index >= 0)
+		{
+			block = g_blocks[index];
+			min_seq = block.seq + 1;
+		}
+
+		// The newest block goes with the buffer, no sample is seen twice or missed in between
+		last = (index < 0 || index == g_head);
+		if (last)
+		{
+			taskENTER_CRITICAL(&telemetry_mux);
+			pending = g_buffered;
+			memcpy(pending_p, g_buffer, pending * sizeof(telemetry_sample_t));
+			taskEXIT_CRITICAL(&telemetry_mux);
+		}
+
+		if (index >= 0)
+		{
+			if (block.count == 0 || block.base_ts > query_p->to_ts || block.base_ts + block.max_dt < query_p->from_ts)
+			{
+				block.count = 0;
+			}
+			else if (index == g_head)
+			{
+				device = telemetryStore_findDevice(g_devices, g_device_count, query_p->ieee);
+			}
+			else
+			{
+				// Read in flash order, the last device first
+				devices_p = (uint64_t *)(buf_p + TELEMETRY_BLOCK_SIZE - block.devices * sizeof(uint64_t));
+				esp_partition_read(g_partition, TELEMETRY_DEVICE_OFFSET(index, block.devices - 1),
+									devices_p, block.devices * sizeof(uint64_t));
+				device = telemetryStore_findDevice(devices_p, block.devices, query_p->ieee);
+				device = (device >= 0) ? block.devices - 1 - device : -1;
+			}
+
+			if (device >= 0)
+			{
+				esp_partition_read(g_partition, index * TELEMETRY_BLOCK_SIZE + TELEMETRY_RECORDS_OFFSET,
+									buf_p, block.bytes);
+				result.blocks_read++;
+			}
+			else
+			{
+				result.blocks_skipped++;
+			}
+		}
+		xSemaphoreGive(telemetry_mutex);
+
+		// Only the stream asked for is decoded, the others are skipped
+		telemetryCodec_init(&codec, block.base_ts, 1);
+		for (size_t offset = 0, n = 1; device >= 0 && n > 0 && offset + 2 < block.bytes; offset += 2 + n)
+		{
+			if (buf_p[offset] == device && buf_p[offset + 1] == query_p->attr)
+			{
+				n = telemetryCodec_decode(&codec, buf_p + offset + 2, block.bytes - offset - 2, &ts, &value);
+				if (n > 0)
+				{
+					telemetryStore_aggregate(&agg, ts, value);
+				}
+			}
+			else
+			{
+				n = telemetryCodec_skip(buf_p + offset + 2, block.bytes - offset - 2, 1);
+			}
+		}
+	}
+
+	for (uint16_t i = 0; i < pending; i++)
+	{
+		if (pending_p[i].ieee == query_p->ieee && pending_p[i].attr == query_p->attr)
+		{
+			telemetryStore_aggregate(&agg, pending_p[i].ts, pending_p[i].value);
+		}
+	}
+	telemetryStore_emit(&agg);
+	free(buf_p);
+
+	result.elapsed_us = esp_timer_get_time() - start_us;
+	if (result_p != NULL)
+	{
+		*result_p = result;
+	}
+	return ESP_OK;
+}
+
+// Reads the samples written after a position
+esp_err_t telemetryStore_read(telemetry_cursor_t * cursor_p, telemetry_sample_cb_t cb, void * ctx, uint32_t * lost_p)
+{
+	telemetry_series_t * series;
+	telemetry_series_t * series_p;
+	telemetry_sample_t sample;
+	uint8_t * buf_p;
+	uint8_t * record_p;
+	uint16_t series_count;
+	size_t n;
+	bool more = true;
+
+	if (!g_stats.mounted)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	// One block and the codec states of its streams
+	buf_p = malloc(TELEMETRY_BLOCK_SIZE + TELEMETRY_BLOCK_SERIES * sizeof(telemetry_series_t));
+	if (buf_p == NULL)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+	series = (telemetry_series_t *)(buf_p + TELEMETRY_BLOCK_SIZE);
+
+	while (more)
+	{
+		telemetry_block_t block = { 0 };
+		int index;
+
+		// The whole block in one read, records at the start and devices at the end
+		xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+		index = telemetryStore_cursorBlock(cursor_p, lost_p);
+		if (index >= 0)
+		{
+			block = g_blocks[index];
+			more = (index != g_head);
+			if (block.bytes > cursor_p->offset)
+			{
+				esp_partition_read(g_partition, index * TELEMETRY_BLOCK_SIZE, buf_p, TELEMETRY_BLOCK_SIZE);
+			}
+		}
+		xSemaphoreGive(telemetry_mutex);
+		if (index < 0)
+		{
+			break;
+		}
+
+		// The streams are decoded from the block start, the samples before the cursor are not handed over
+		series_count = 0;
+		for (size_t offset = 0; block.bytes > cursor_p->offset && offset < block.bytes; offset += n)
+		{
+			record_p = buf_p + TELEMETRY_RECORDS_OFFSET + offset;
+			series_p = telemetryStore_findSeries(series, series_count, record_p[0], record_p[1]);
+			if (series_p == NULL && record_p[0] < block.devices)
+			{
+				series_p = telemetryStore_addSeries(series, &series_count, record_p[0], record_p[1]);
+			}
+			n = (series_p != NULL) ? telemetryStore_code(series_p, block.base_ts, record_p, block.bytes - offset,
+															&sample.ts, &sample.value, false) : 0;
+			if (n == 0)
+			{
+				// Not readable, the rest of the block is skipped
+				cursor_p->offset = block.bytes;
+				break;
+			}
+			if (offset < cursor_p->offset)
+			{
+				continue;
+			}
+
+			memcpy(&sample.ieee, buf_p + TELEMETRY_DEVICE_OFFSET(0, record_p[0]), sizeof(uint64_t));
+			sample.attr = record_p[1];
+			if (!cb(&sample, ctx))
+			{
+				more = false;
+				break;
+			}
+			cursor_p->offset = offset + n;
+		}
+
+		// The newest block is only left once it is sealed and another one follows
+		if (more)
+		{
+			cursor_p->seq = block.seq + 1;
+			cursor_p->offset = 0;
+		}
+	}
+	free(buf_p);
+	return ESP_OK;
+}
+
+// Record bytes on flash after a position
+uint32_t telemetryStore_pending(const telemetry_cursor_t * cursor_p)
+{
+	uint32_t bytes = 0;
+	uint32_t seq;
+
+	if (telemetry_mutex == NULL)
+	{
+		return 0;
+	}
+
+	xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+	// Past the newest block the partition was replaced, a read starts over
+	seq = (g_head >= 0 && cursor_p->seq > g_blocks[g_head].seq) ? 0 : cursor_p->seq;
+	for (uint16_t b = 0; b < g_block_count; b++)
+	{
+		if (g_blocks[b].seq > seq)
+		{
+			bytes += g_blocks[b].bytes;
+		}
+		else if (g_blocks[b].seq == seq && g_blocks[b].bytes > cursor_p->offset)
+		{
+			bytes += g_blocks[b].bytes - cursor_p->offset;
+		}
+	}
+	xSemaphoreGive(telemetry_mutex);
+	return bytes;
+}
+
+// Copies the store figures
+void telemetryStore_getStats(telemetry_stats_t * stats_p)
+{
+	uint32_t oldest_seq = UINT32_MAX;
+	uint32_t records = 0;
+	uint32_t bytes = 0;
+	uint16_t used = 0;
+
+	if (telemetry_mutex == NULL)
+	{
+		memset(stats_p, 0x00, sizeof(telemetry_stats_t));
+		return;
+	}
+
+	xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+	taskENTER_CRITICAL(&telemetry_mux);
+	*stats_p = g_stats;
+	stats_p->buffered = g_buffered;
+	taskEXIT_CRITICAL(&telemetry_mux);
+
+	for (uint16_t b = 0; b < g_block_count; b++)
+	{
+		if (g_blocks[b].seq == 0)
+		{
+			continue;
+		}
+		used++;
+		records += g_blocks[b].count;
+		bytes += g_blocks[b].bytes;
+		if (g_blocks[b].seq < oldest_seq && g_blocks[b].count > 0)
+		{
+			oldest_seq = g_blocks[b].seq;
+			stats_p->oldest_ts = g_blocks[b].base_ts;
+		}
+	}
+	stats_p->blocks = g_block_count;
+	stats_p->blocks_used = used;
+	stats_p->records = records;
+	stats_p->bytes = bytes;
+	stats_p->head_seq = (g_head >= 0) ? g_blocks[g_head].seq : 0;
+	xSemaphoreGive(telemetry_mutex);
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Telemetry task, writes the buffered samples
+ * @details every TELEMETRY_FLUSH_S, or sooner when the buffer is half full
+ * @param pvParameters
+ */
+static void telemetryStore_task(void * pvParameters)
+{
+	for (;;)
+	{
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TELEMETRY_FLUSH_S * 1000));
+		telemetryStore_flush();
+	}
+}
+
+/**
+ * @brief Builds the RAM index from the block headers
+ * @details the blocks left unsealed by a reset are decoded, the newest
+ * one goes on taking records
+ * @return esp_err_t ESP_ERR_NO_MEM
+ */
+static esp_err_t telemetryStore_mount(void)
+{
+	telemetry_block_header_t header;
+	uint32_t records = 0;
+	uint8_t * buf_p;
+
+	for (uint16_t b = 0; b < g_block_count; b++)
+	{
+		memset(&g_blocks[b], 0x00, sizeof(telemetry_block_t));
+		if (esp_partition_read(g_partition, b * TELEMETRY_BLOCK_SIZE, &header, sizeof(header)) != ESP_OK
+			|| header.magic != TELEMETRY_MAGIC || header.seq == 0 || header.seq == UINT32_MAX
+			|| (header.count != 0xFFFF && (header.devices > TELEMETRY_BLOCK_DEVICES
+											|| header.bytes > TELEMETRY_ROOM(header.devices))))
+		{
+			continue;
+		}
+		g_blocks[b].seq = header.seq;
+		g_blocks[b].base_ts = header.base_ts;
+		g_blocks[b].count = header.count;
+		g_blocks[b].max_dt = header.max_dt;
+		g_blocks[b].devices = header.devices;
+		g_blocks[b].bytes = header.bytes;
+		if (g_head < 0 || header.seq > g_blocks[g_head].seq)
+		{
+			g_head = b;
+		}
+	}
+
+	buf_p = malloc(TELEMETRY_BLOCK_SIZE);
+	if (buf_p == NULL)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+
+	// The newest block last, its codec state stays
+	for (uint16_t i = 1; i <= g_block_count; i++)
+	{
+		uint16_t b = (g_head + i) % g_block_count;
+		bool complete;
+
+		if (g_blocks[b].seq == 0 || g_blocks[b].count != 0xFFFF)
+		{
+			continue;
+		}
+		complete = telemetryStore_scan(b, buf_p);
+		if (b == g_head)
+		{
+			g_head_open = true;
+			g_staged_from = g_blocks[b].bytes;
+			if (!complete)
+			{
+				telemetryStore_seal();
+			}
+		}
+	}
+	free(buf_p);
+
+	for (uint16_t b = 0; b < g_block_count; b++)
+	{
+		records += g_blocks[b].count;
+	}
+	g_stats.mounted = true;
+	ESP_LOGI(TAG, "%u blocks, %lu records kept, newest block %lu",
+				g_block_count, records, (g_head >= 0) ? g_blocks[g_head].seq : 0);
+	return ESP_OK;
+}
+
+/**
+ * @brief Decodes an unsealed block, for its counts, latest time and codec state
+ * @param block
+ * @param buf_p TELEMETRY_BLOCK_SIZE bytes
+ * @return false when the last record was cut, nothing may follow it
+ */
+static bool telemetryStore_scan(uint16_t block, uint8_t * buf_p)
+{
+	telemetry_block_t * block_p = &g_blocks[block];
+	telemetry_series_t * series_p;
+	size_t room;
+	size_t offset = 0;
+	size_t n;
+	uint32_t ts;
+	int32_t value;
+
+	block_p->count = 0;
+	block_p->max_dt = 0;
+	block_p->devices = 0;
+	while (block_p->devices < TELEMETRY_BLOCK_DEVICES)
+	{
+		esp_partition_read(g_partition, TELEMETRY_DEVICE_OFFSET(block, block_p->devices),
+							&g_devices[block_p->devices], sizeof(uint64_t));
+		if (g_devices[block_p->devices] == UINT64_MAX)
+		{
+			break;
+		}
+		block_p->devices++;
+	}
+	g_device_count = block_p->devices;
+
+	room = TELEMETRY_ROOM(block_p->devices);
+	esp_partition_read(g_partition, block * TELEMETRY_BLOCK_SIZE + TELEMETRY_RECORDS_OFFSET, buf_p, room);
+	g_series_count = 0;
+	while (offset + 2 < room && buf_p[offset] != TELEMETRY_FREE)
+	{
+		series_p = telemetryStore_findSeries(g_series, g_series_count, buf_p[offset], buf_p[offset + 1]);
+		if (series_p == NULL && buf_p[offset] < block_p->devices)
+		{
+			series_p = telemetryStore_addSeries(g_series, &g_series_count, buf_p[offset], buf_p[offset + 1]);
+		}
+		n = (series_p != NULL) ? telemetryStore_code(series_p, block_p->base_ts, buf_p + offset, room - offset, &ts, &value, false) : 0;
+		if (n == 0)
+		{
+			break;
+		}
+		offset += n;
+		block_p->count++;
+		if (ts - block_p->base_ts > block_p->max_dt)
+		{
+			block_p->max_dt = ts - block_p->base_ts;
+		}
+	}
+	block_p->bytes = offset;
+
+	ESP_LOGI(TAG, "block %lu unsealed, %u devices and %u records found", block_p->seq, block_p->devices, block_p->count);
+	return offset >= room || buf_p[offset] == TELEMETRY_FREE;
+}
+
+/**
+ * @brief Writes the buffered samples
+ */
+static void telemetryStore_flush(void)
+{
+	int64_t start_us;
+	uint16_t count;
+	uint32_t flush_us;
+
+	xSemaphoreTake(telemetry_mutex, portMAX_DELAY);
+
+	// Taken with the lock, a query sees the samples either in RAM or on flash
+	taskENTER_CRITICAL(&telemetry_mux);
+	count = g_buffered;
+	memcpy(g_batch, g_buffer, count * sizeof(telemetry_sample_t));
+	g_buffered = 0;
+	taskEXIT_CRITICAL(&telemetry_mux);
+
+	if (count > 0)
+	{
+		start_us = esp_timer_get_time();
+		for (uint16_t i = 0; i < count; i++)
+		{
+			telemetryStore_put(&g_batch[i]);
+		}
+		telemetryStore_writeStaged();
+
+		flush_us = esp_timer_get_time() - start_us;
+		if (flush_us > g_stats.flush_us_max)
+		{
+			g_stats.flush_us_max = flush_us;
+		}
+	}
+	xSemaphoreGive(telemetry_mutex);
+}
+
+/**
+ * @brief Adds a sample to the newest block
+ * @details a new block is opened when the sample doesn't fit: no room for
+ * the longest record and a new device entry, device or series list full,
+ * or a time before the base or too far after it
+ * @param sample_p
+ */
+static void telemetryStore_put(const telemetry_sample_t * sample_p)
+{
+	telemetry_block_t * block_p;
+	telemetry_series_t * series_p = NULL;
+	int device = -1;
+	uint32_t ts = sample_p->ts;
+	int32_t value = sample_p->value;
+	size_t n;
+
+	if (g_head_open)
+	{
+		block_p = &g_blocks[g_head];
+		device = telemetryStore_findDevice(g_devices, g_device_count, sample_p->ieee);
+		if (device >= 0)
+		{
+			series_p = telemetryStore_findSeries(g_series, g_series_count, device, sample_p->attr);
+		}
+		if (ts < block_p->base_ts || ts - block_p->base_ts >= TELEMETRY_MAX_DT
+			|| block_p->bytes + TELEMETRY_RECORD_MAX > TELEMETRY_ROOM(g_device_count + ((device < 0) ? 1 : 0))
+			|| (device < 0 && g_device_count >= TELEMETRY_BLOCK_DEVICES)
+			|| (series_p == NULL && g_series_count >= TELEMETRY_BLOCK_SERIES))
+		{
+			telemetryStore_seal();
+		}
+	}
+	if (!g_head_open)
+	{
+		if (!telemetryStore_open(ts))
+		{
+			return;
+		}
+		device = -1;
+		series_p = NULL;
+	}
+
+	block_p = &g_blocks[g_head];
+	if (device < 0)
+	{
+		device = g_device_count;
+		g_devices[g_device_count++] = sample_p->ieee;
+		block_p->devices = g_device_count;
+		telemetryStore_write(TELEMETRY_DEVICE_OFFSET(g_head, device), &sample_p->ieee, sizeof(uint64_t));
+	}
+	if (series_p == NULL)
+	{
+		series_p = telemetryStore_addSeries(g_series, &g_series_count, device, sample_p->attr);
+	}
+
+	n = telemetryStore_code(series_p, block_p->base_ts, g_staging + g_staged, sizeof(g_staging) - g_staged, &ts, &value, true);
+	g_staged += n;
+	block_p->bytes += n;
+	block_p->count++;
+	if (ts - block_p->base_ts > block_p->max_dt)
+	{
+		block_p->max_dt = ts - block_p->base_ts;
+	}
+}
+
+/**
+ * @brief Erases the block after the newest one and starts it
+ * @details the oldest block when the log went round
+ * @param base_ts time its records count from
+ * @return false when the flash failed, the sample is lost
+ */
+static bool telemetryStore_open(uint32_t base_ts)
+{
+	uint16_t block = (g_head >= 0) ? (g_head + 1) % g_block_count : 0;
+	telemetry_block_header_t header =
+	{
+		.magic = TELEMETRY_MAGIC,
+		.seq = (g_head >= 0) ? g_blocks[g_head].seq + 1 : 1,
+		.base_ts = base_ts,
+		.count = 0xFFFF,
+		.max_dt = 0xFFFF,
+		.devices = 0xFFFF,
+		.bytes = 0xFFFF,
+	};
+	int64_t start_us = esp_timer_get_time();
+	uint32_t erase_us;
+	esp_err_t err;
+
+	memset(&g_blocks[block], 0x00, sizeof(telemetry_block_t));
+	err = esp_partition_erase_range(g_partition, block * TELEMETRY_BLOCK_SIZE, TELEMETRY_BLOCK_SIZE);
+	erase_us = esp_timer_get_time() - start_us;
+	if (erase_us > g_stats.erase_us_max)
+	{
+		g_stats.erase_us_max = erase_us;
+	}
+	if (err == ESP_OK)
+	{
+		err = telemetryStore_write(block * TELEMETRY_BLOCK_SIZE, &header, sizeof(header));
+	}
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "block %u not opened (%s)", block, esp_err_to_name(err));
+		return false;
+	}
+
+	g_blocks[block].seq = header.seq;
+	g_blocks[block].base_ts = base_ts;
+	g_head = block;
+	g_head_open = true;
+	memset(g_devices, 0xFF, sizeof(g_devices));
+	g_device_count = 0;
+	g_series_count = 0;
+	g_staged = 0;
+	g_staged_from = 0;
+	return true;
+}
+
+/**
+ * @brief Writes the counts and latest time of the newest block
+ */
+static void telemetryStore_seal(void)
+{
+	telemetry_block_t * block_p = &g_blocks[g_head];
+	uint16_t seal[4] = { block_p->count, block_p->max_dt, block_p->devices, block_p->bytes };
+
+	telemetryStore_writeStaged();
+	telemetryStore_write(g_head * TELEMETRY_BLOCK_SIZE + offsetof(telemetry_block_header_t, count), seal, sizeof(seal));
+	g_head_open = false;
+}
+
+/**
+ * @brief Writes the records staged for the newest block, in one go
+ */
+static void telemetryStore_writeStaged(void)
+{
+	if (g_staged == 0)
+	{
+		return;
+	}
+	telemetryStore_write(g_head * TELEMETRY_BLOCK_SIZE + TELEMETRY_RECORDS_OFFSET + g_staged_from, g_staging, g_staged);
+	g_staged_from += g_staged;
+	g_staged = 0;
+}
+
+/**
+ * @brief Position of a device on a block list
+ * @param devices
+ * @param count entries to look at
+ * @param ieee
+ * @return int -1 when not there
+ */
+static int telemetryStore_findDevice(const uint64_t * devices, uint8_t count, uint64_t ieee)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (devices[i] == ieee)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Codec state of a device attribute on a block
+ * @param series states of the block, g_series for the newest one
+ * @param count entries to look at
+ * @param device position on the device list
+ * @param attr
+ * @return telemetry_series_t* NULL when not there
+ */
+static telemetry_series_t * telemetryStore_findSeries(telemetry_series_t * series, uint16_t count, uint8_t device, uint8_t attr)
+{
+	for (uint16_t i = 0; i < count; i++)
+	{
+		if (series[i].device == device && series[i].attr == attr)
+		{
+			return &series[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Starts the codec state of a device attribute, from the block base time
+ * @param series states of the block, TELEMETRY_BLOCK_SERIES entries
+ * @param count_p entries used, incremented
+ * @param device position on the device list
+ * @param attr
+ * @return telemetry_series_t* NULL when TELEMETRY_BLOCK_SERIES are there
+ */
+static telemetry_series_t * telemetryStore_addSeries(telemetry_series_t * series, uint16_t * count_p, uint8_t device, uint8_t attr)
+{
+	telemetry_series_t * series_p;
+
+	if (*count_p >= TELEMETRY_BLOCK_SERIES)
+	{
+		return NULL;
+	}
+	series_p = &series[(*count_p)++];
+	series_p->dt = 0;
+	series_p->delta = 0;
+	series_p->value = 0;
+	series_p->device = device;
+	series_p->attr = attr;
+	return series_p;
+}
+
+/**
+ * @brief Encodes or decodes a record of a device attribute
+ * @details the state is kept compact, a full codec only lives for the call
+ * @param series_p
+ * @param base_ts of the block
+ * @param data_p record
+ * @param size room or bytes available
+ * @param ts_p sample time, in when encoding
+ * @param value_p sample value, in when encoding
+ * @param encode
+ * @return size_t of the record, 0 when it doesn't fit or is cut
+ */
+static size_t telemetryStore_code(telemetry_series_t * series_p, uint32_t base_ts, uint8_t * data_p, size_t size,
+									uint32_t * ts_p, int32_t * value_p, bool encode)
+{
+	telemetry_codec_t codec =
+	{
+		.ts = base_ts + series_p->dt,
+		.delta = series_p->delta,
+		.values = { series_p->value },
+		.columns = 1,
+	};
+	size_t n;
+
+	if (size <= 2)
+	{
+		return 0;
+	}
+	if (encode)
+	{
+		data_p[0] = series_p->device;
+		data_p[1] = series_p->attr;
+		n = telemetryCodec_encode(&codec, *ts_p, value_p, data_p + 2, size - 2);
+	}
+	else
+	{
+		n = telemetryCodec_decode(&codec, data_p + 2, size - 2, ts_p, value_p);
+	}
+	if (n == 0)
+	{
+		return 0;
+	}
+
+	series_p->dt = codec.ts - base_ts;
+	series_p->delta = codec.delta;
+	series_p->value = codec.values[0];
+	return 2 + n;
+}
+
+/**
+ * @brief Block with the lowest sequence from a number on
+ * @param min_seq
+ * @return int -1 when there is none
+ */
+static int telemetryStore_nextBlock(uint32_t min_seq)
+{
+	int found = -1;
+
+	for (int b = 0; b < g_block_count; b++)
+	{
+		if (g_blocks[b].seq >= min_seq && (found < 0 || g_blocks[b].seq < g_blocks[found].seq))
+		{
+			found = b;
+		}
+	}
+	return found;
+}
+
+/**
+ * @brief Block a cursor is on
+ * @details a cursor on an erased block moves to the oldest one, the
+ * blocks in between are counted as lost; one past the newest block, the
+ * partition was replaced and it starts over
+ * @param cursor_p moved when its block is gone
+ * @param lost_p may be NULL
+ * @return int -1 when the store is empty
+ */
+static int telemetryStore_cursorBlock(telemetry_cursor_t * cursor_p, uint32_t * lost_p)
+{
+	int oldest;
+
+	for (int b = 0; b < g_block_count; b++)
+	{
+		if (g_blocks[b].seq != 0 && g_blocks[b].seq == cursor_p->seq)
+		{
+			return b;
+		}
+	}
+
+	oldest = telemetryStore_nextBlock(1);
+	if (oldest < 0)
+	{
+		return -1;
+	}
+	if (cursor_p->seq != 0 && cursor_p->seq < g_blocks[oldest].seq)
+	{
+		ESP_LOGW(TAG, "blocks %lu to %lu erased before they were read", cursor_p->seq, g_blocks[oldest].seq - 1);
+		if (lost_p != NULL)
+		{
+			*lost_p += g_blocks[oldest].seq - cursor_p->seq;
+		}
+	}
+	cursor_p->seq = g_blocks[oldest].seq;
+	cursor_p->offset = 0;
+	return oldest;
+}
+
+/**
+ * @brief Adds a sample to the step it falls in
+ * @details a sample of another step ends the current one
+ * @param agg_p
+ * @param ts
+ * @param value
+ */
+static void telemetryStore_aggregate(telemetry_agg_t * agg_p, uint32_t ts, int32_t value)
+{
+	const telemetry_query_t * query_p = agg_p->query_p;
+	uint32_t step_ts;
+
+	if (ts < query_p->from_ts || ts > query_p->to_ts)
+	{
+		return;
+	}
+	step_ts = query_p->from_ts + (ts - query_p->from_ts) / agg_p->result_p->step_s * agg_p->result_p->step_s;
+
+	if (agg_p->open && agg_p->point.ts != step_ts)
+	{
+		telemetryStore_emit(agg_p);
+	}
+	if (!agg_p->open)
+	{
+		agg_p->open = true;
+		agg_p->point.ts = step_ts;
+		agg_p->point.min = value;
+		agg_p->point.max = value;
+		agg_p->point.count = 0;
+		agg_p->sum = 0;
+	}
+	if (value < agg_p->point.min)
+	{
+		agg_p->point.min = value;
+	}
+	if (value > agg_p->point.max)
+	{
+		agg_p->point.max = value;
+	}
+	agg_p->sum += value;
+	agg_p->point.count++;
+	agg_p->result_p->samples++;
+}
+
+/**
+ * @brief Hands the current step to the callback
+ * @param agg_p
+ */
+static void telemetryStore_emit(telemetry_agg_t * agg_p)
+{
+	if (!agg_p->open)
+	{
+		return;
+	}
+	agg_p->point.avg = agg_p->sum / (int64_t)agg_p->point.count;
+	agg_p->open = false;
+	agg_p->result_p->points++;
+	agg_p->cb(&agg_p->point, agg_p->ctx);
+}
+
+/**
+ * @brief Writes to the partition, counts the errors
+ * @param offset
+ * @param data
+ * @param size
+ * @return esp_err_t
+ */
+static esp_err_t telemetryStore_write(size_t offset, const void * data, size_t size)
+{
+	esp_err_t err = esp_partition_write(g_partition, offset, data, size);
+
+	if (err != ESP_OK)
+	{
+		g_stats.write_errors++;
+		ESP_LOGE(TAG, "write of %u bytes at 0x%x failed (%s)", size, offset, esp_err_to_name(err));
+	}
+	return err;
+}
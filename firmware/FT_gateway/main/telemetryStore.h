@@ -0,0 +1,199 @@
+/**
+ * @file telemetryStore.h
+ * @brief History of the device attributes on the telemetry partition
+ * @details
+ * The partition is a circular log of flash sectors (blocks). Samples are
+ * only appended, to the newest block; when it is full the next sector is
+ * erased and takes over, discarding the oldest block. Every sector is
+ * erased once per turn of the log, the wear is spread evenly.
+ * A block starts with its index: sequence number, base time and, once
+ * sealed, record and device counts and latest time; it ends with the IEEE
+ * addresses of the devices it holds. A query skips the blocks out of its time range or
+ * without its device before reading any record.
+ * The records are compressed (telemetryCodec.h), about 4 bytes a sample.
+ * Samples wait in RAM and are written in batches by the telemetry task,
+ * at least every TELEMETRY_FLUSH_S; queries see them too. Only samples
+ * taken after the first NTP sync are kept.
+ * A reader that forwards the samples (mqttUplink.h) keeps a cursor on the
+ * log and reads what was written after it, the store doesn't track it.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_TELEMETRYSTORE_H_
+#define MAIN_TELEMETRYSTORE_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+// ESP libraries
+#include "esp_err.h"
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief Sample of a device attribute
+ */
+typedef struct telemetry_sample_s
+{
+	uint64_t	ieee;
+	uint32_t	ts;			///> epoch seconds
+	int32_t		value;
+	uint8_t		attr;		///> device_attr_t
+} telemetry_sample_t;
+
+/**
+ * @brief Position on the log, after the samples read
+ */
+typedef struct telemetry_cursor_s
+{
+	uint32_t	seq;		///> block, 0 before the oldest one
+	uint16_t	offset;		///> record bytes of the block read
+} telemetry_cursor_t;
+
+/**
+ * @brief Called for every sample of telemetryStore_read, in the order
+ * they were written; without the store lock held, it may block
+ * @param sample_p
+ * @param ctx given to telemetryStore_read
+ * @return false to stop, the cursor stays before this sample
+ */
+typedef bool (*telemetry_sample_cb_t)(const telemetry_sample_t * sample_p, void * ctx);
+
+/**
+ * @brief Range query, one attribute of one device
+ */
+typedef struct telemetry_query_s
+{
+	uint64_t	ieee;
+	uint8_t		attr;		///> device_attr_t
+	uint32_t	from_ts;	///> epoch seconds, inclusive
+	uint32_t	to_ts;		///> epoch seconds, inclusive
+	uint32_t	step_s;		///> one point per step, raised to fit TELEMETRY_QUERY_MAX_POINTS
+} telemetry_query_t;
+
+/**
+ * @brief Samples of one step
+ */
+typedef struct telemetry_point_s
+{
+	uint32_t	ts;			///> start of the step
+	int32_t		min;
+	int32_t		max;
+	int32_t		avg;
+	uint32_t	count;
+} telemetry_point_t;
+
+/**
+ * @brief Called for every point of a query, in time order unless the
+ * clock went back; without the store lock held, it may block
+ * @param point_p
+ * @param ctx given to telemetryStore_query
+ */
+typedef void (*telemetry_point_cb_t)(const telemetry_point_t * point_p, void * ctx);
+
+/**
+ * @brief What a query did
+ */
+typedef struct telemetry_query_result_s
+{
+	uint32_t	step_s;			///> used
+	uint32_t	points;
+	uint32_t	samples;
+	uint16_t	blocks_read;
+	uint16_t	blocks_skipped;	///> by their index
+	uint32_t	elapsed_us;		///> callbacks included
+} telemetry_query_result_t;
+
+/**
+ * @brief Store figures
+ */
+typedef struct telemetry_stats_s
+{
+	bool		mounted;
+	uint16_t	blocks;
+	uint16_t	blocks_used;
+	uint32_t	records;		///> on flash
+	uint32_t	bytes;			///> of those records, compressed
+	uint32_t	buffered;		///> in RAM, not written yet
+	uint32_t	oldest_ts;		///> 0 when empty
+	uint32_t	head_seq;		///> blocks opened since the partition was blank, over blocks is the erases per sector
+	uint32_t	appended;		///> since the boot
+	uint32_t	dropped;		///> RAM buffer full
+	uint32_t	unsynced;		///> before the first NTP sync, not kept
+	uint32_t	write_errors;
+	uint32_t	flush_us_max;	///> batch write, erase included
+	uint32_t	erase_us_max;
+} telemetry_stats_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Finds the newest block of the partition and starts the telemetry task
+ * @return esp_err_t ESP_ERR_NOT_FOUND without the telemetry partition,
+ * ESP_ERR_INVALID_SIZE, ESP_ERR_NO_MEM; the samples are then counted as dropped
+ */
+esp_err_t telemetryStore_init(void);
+
+/**
+ * @brief Adds a sample taken now
+ * @details never blocks, any task can call it
+ * @param ieee device
+ * @param attr device_attr_t
+ * @param value
+ * @return true when kept
+ */
+bool telemetryStore_append(uint64_t ieee, uint8_t attr, int32_t value);
+
+/**
+ * @brief Reads a range, one point per step
+ * @param query_p
+ * @param cb called for each point
+ * @param ctx passed to cb
+ * @param result_p destination, may be NULL
+ * @return esp_err_t ESP_ERR_INVALID_STATE when not mounted, ESP_ERR_NO_MEM
+ */
+esp_err_t telemetryStore_query(const telemetry_query_t * query_p, telemetry_point_cb_t cb, void * ctx,
+								telemetry_query_result_t * result_p);
+
+/**
+ * @brief Reads the samples written after a position, oldest first
+ * @details only the ones on flash, those still in RAM come with the next
+ * write. A position on a block erased since goes on from the oldest one.
+ * @param cursor_p position, moved past the samples taken
+ * @param cb called for each sample until it returns false
+ * @param ctx passed to cb
+ * @param lost_p blocks erased before they were read are added to it, may be NULL
+ * @return esp_err_t ESP_ERR_INVALID_STATE when not mounted, ESP_ERR_NO_MEM
+ */
+esp_err_t telemetryStore_read(telemetry_cursor_t * cursor_p, telemetry_sample_cb_t cb, void * ctx, uint32_t * lost_p);
+
+/**
+ * @brief Record bytes on flash after a position
+ * @param cursor_p
+ * @return uint32_t compressed, 0 when caught up
+ */
+uint32_t telemetryStore_pending(const telemetry_cursor_t * cursor_p);
+
+/**
+ * @brief Copies the store figures
+ * @param stats_p destination
+ */
+void telemetryStore_getStats(telemetry_stats_t * stats_p);
+
+#endif /* MAIN_TELEMETRYSTORE_H_ */
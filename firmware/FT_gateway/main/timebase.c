@@ -0,0 +1,242 @@
+/**
+ * @file timebase.c
+ * @brief Wall clock built on esp_timer and the NTP corrections
+ * @details
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <string.h>
+#include <time.h>
+
+// ESP libraries
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+// Personal libraries
+#include "timebase.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+	/* Structures */
+
+/**
+ * @brief Clock line, wall = wall_ref + elapsed + slew_us * min(elapsed, slew_period_us) / slew_period_us
+ */
+typedef struct timebase_state_s
+{
+	int64_t		mono_ref_us;		///> esp_timer reading at the reference point
+	int64_t		wall_ref_us;		///> epoch time at the reference point
+	int64_t		slew_us;			///> correction being spread
+	int64_t		slew_period_us;		///> 0 when no correction is pending
+	bool		synced;
+} timebase_state_t;
+
+
+	/* Variables */
+
+// Odd while the writer is updating the state
+static uint32_t g_seq;
+static timebase_state_t g_state;
+
+// Serializes the writers, also keeps them from being preempted mid-update
+static portMUX_TYPE timebase_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// strftime patterns and milliseconds flag of every format
+static const char * const g_format_pattern[TIMEBASE_FMT_COUNT] =
+{
+#define X(ID, ENUM, STRFTIME, MS) [ID] = STRFTIME,
+	X_MACRO_TIMEBASE_FORMAT_LIST
+#undef X
+};
+static const bool g_format_ms[TIMEBASE_FMT_COUNT] =
+{
+#define X(ID, ENUM, STRFTIME, MS) [ID] = MS,
+	X_MACRO_TIMEBASE_FORMAT_LIST
+#undef X
+};
+
+
+	/* Static Functions */
+
+static void timebase_read(timebase_state_t * state_p);
+static int64_t timebase_wallAt(const timebase_state_t * state_p, int64_t mono_us);
+static void timebase_write(const timebase_state_t * state_p);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Current epoch time
+int64_t timebase_nowUs(void)
+{
+	timebase_state_t state;
+
+	timebase_read(&state);
+	return timebase_wallAt(&state, esp_timer_get_time());
+}
+
+// Whether the clock was set by NTP at least once
+bool timebase_isSynced(void)
+{
+	return __atomic_load_n(&g_state.synced, __ATOMIC_RELAXED);
+}
+
+// Formats the current time
+size_t timebase_format(timebase_cache_t * cache_p, timebase_fmt_t format, char * buf_p, size_t size)
+{
+	timebase_state_t state;
+	struct tm local_time;
+	size_t len;
+
+	if (size == 0)
+	{
+		return 0;
+	}
+	buf_p[0] = '\0';
+
+	timebase_read(&state);
+	if (!state.synced || format >= TIMEBASE_FMT_COUNT)
+	{
+		return 0;
+	}
+
+	int64_t now_us = timebase_wallAt(&state, esp_timer_get_time());
+	int64_t sec = now_us / 1000000;
+
+	// Calendar part, localtime_r takes the environment lock so only once per second
+	if (cache_p->sec != sec || cache_p->format != format)
+	{
+		time_t now = sec;
+		localtime_r(&now, &local_time);
+		cache_p->len = strftime(cache_p->text, sizeof(cache_p->text), g_format_pattern[format], &local_time);
+		cache_p->sec = sec;
+		cache_p->format = format;
+	}
+
+	len = (cache_p->len < size - 1) ? cache_p->len : size - 1;
+	memcpy(buf_p, cache_p->text, len);
+
+	if (g_format_ms[format] && len + 4 < size)
+	{
+		uint32_t ms = (now_us % 1000000) / 1000;
+		buf_p[len++] = '.';
+		buf_p[len++] = '0' + ms / 100;
+		buf_p[len++] = '0' + (ms / 10) % 10;
+		buf_p[len++] = '0' + ms % 10;
+	}
+	buf_p[len] = '\0';
+
+	return len;
+}
+
+// Sets the clock on an NTP step
+void timebase_step(int64_t wall_us)
+{
+	timebase_state_t state =
+	{
+		.mono_ref_us = esp_timer_get_time(),
+		.wall_ref_us = wall_us,
+		.synced = true,
+	};
+
+	timebase_write(&state);
+}
+
+// Steers the clock on an NTP slew
+void timebase_slew(int64_t wall_us, uint32_t period_s)
+{
+	timebase_state_t state;
+	int64_t mono_us = esp_timer_get_time();
+
+	// Only the NTP task writes, no need for the sequence to read
+	state = g_state;
+	state.wall_ref_us = timebase_wallAt(&state, mono_us);
+	state.mono_ref_us = mono_us;
+	state.slew_us = wall_us - state.wall_ref_us;
+	state.slew_period_us = (int64_t)period_s * 1000000;
+	state.synced = true;
+
+	timebase_write(&state);
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Reads a consistent copy of the state
+ * @details retries while the writer is in the middle of an update
+ * @param state_p destination
+ */
+static void timebase_read(timebase_state_t * state_p)
+{
+	uint32_t seq;
+
+	for (;;)
+	{
+		seq = __atomic_load_n(&g_seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+		{
+			continue;
+		}
+		*state_p = g_state;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&g_seq, __ATOMIC_RELAXED) == seq)
+		{
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Evaluates the clock line
+ * @param state_p
+ * @param mono_us esp_timer reading
+ * @return int64_t microseconds since 1970
+ */
+static int64_t timebase_wallAt(const timebase_state_t * state_p, int64_t mono_us)
+{
+	int64_t elapsed_us = mono_us - state_p->mono_ref_us;
+	int64_t wall_us = state_p->wall_ref_us + elapsed_us;
+
+	if (state_p->slew_period_us > 0)
+	{
+		if (elapsed_us >= state_p->slew_period_us)
+		{
+			wall_us += state_p->slew_us;
+		}
+		else if (elapsed_us > 0)
+		{
+			wall_us += (state_p->slew_us * elapsed_us) / state_p->slew_period_us;
+		}
+	}
+	return wall_us;
+}
+
+/**
+ * @brief Publishes a new state
+ * @param state_p
+ */
+static void timebase_write(const timebase_state_t * state_p)
+{
+	taskENTER_CRITICAL(&timebase_mux);
+	__atomic_store_n(&g_seq, g_seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	g_state = *state_p;
+	__atomic_store_n(&g_seq, g_seq + 1, __ATOMIC_RELEASE);
+	taskEXIT_CRITICAL(&timebase_mux);
+}
@@ -0,0 +1,117 @@
+/**
+ * @file timebase.h
+ * @brief Wall clock built on esp_timer and the NTP corrections
+ * @details
+ * The wall clock is a line over esp_timer_get_time(): a reference point
+ * plus, after a slewed correction, the offset spread over the poll
+ * interval, so the clock never goes backwards between steps.
+ * The NTP task is the only writer; readers go through a sequence lock and
+ * never take a mutex, so any task can timestamp at high rate.
+ * Formatting goes through a cache owned by the caller: the calendar part
+ * is rebuilt once per second, the rest is a copy plus the milliseconds.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_TIMEBASE_H_
+#define MAIN_TIMEBASE_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+// Longest formatted text, with the terminator
+#define TIMEBASE_TEXT_LEN	24
+
+/**
+ * @brief Text formats, local time
+ * @details columns: ID, ENUM, STRFTIME, MILLISECONDS appended
+ */
+#define X_MACRO_TIMEBASE_FORMAT_LIST														\
+	X(0,	TIMEBASE_FMT_DATE,		"%d/%m/%Y",				false	)	/* 18/10/2026 */				\
+	X(1,	TIMEBASE_FMT_TIME,		"%H:%M",				false	)	/* 14:05 */						\
+	X(2,	TIMEBASE_FMT_STAMP,		"%Y-%m-%d %H:%M:%S",	true	)	/* 2026-10-18 14:05:09.123 */
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief Text formats
+ */
+typedef enum timebase_fmt_e
+{
+#define X(ID, ENUM, STRFTIME, MS) ENUM = ID,
+	X_MACRO_TIMEBASE_FORMAT_LIST
+#undef X
+	TIMEBASE_FMT_COUNT
+} timebase_fmt_t;
+
+/**
+ * @brief Formatting cache, one per caller, zero initialized
+ */
+typedef struct timebase_cache_s
+{
+	int64_t		sec;						///> epoch second of text, 0 when empty
+	uint8_t		format;
+	uint8_t		len;
+	char		text[TIMEBASE_TEXT_LEN];	///> calendar part, without the milliseconds
+} timebase_cache_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Current epoch time
+ * @details lock free, callable from any task; uptime until the first sync
+ * @return int64_t microseconds since 1970
+ */
+int64_t timebase_nowUs(void);
+
+/**
+ * @brief Whether the clock was set by NTP at least once
+ * @return true when synced
+ */
+bool timebase_isSynced(void);
+
+/**
+ * @brief Formats the current time
+ * @details empty text until the first sync
+ * @param cache_p cache owned by the caller, not shared between tasks
+ * @param format
+ * @param buf_p destination
+ * @param size of the destination, TIMEBASE_TEXT_LEN fits every format
+ * @return size_t length written
+ */
+size_t timebase_format(timebase_cache_t * cache_p, timebase_fmt_t format, char * buf_p, size_t size);
+
+/**
+ * @brief Sets the clock, called by the NTP task on a step
+ * @param wall_us microseconds since 1970
+ */
+void timebase_step(int64_t wall_us);
+
+/**
+ * @brief Steers the clock towards a time, called by the NTP task on a slew
+ * @details the difference to the current reading is spread over period_s,
+ * which also folds in whatever the previous slew had left
+ * @param wall_us corrected time now, microseconds since 1970
+ * @param period_s time to apply it, the current poll interval
+ */
+void timebase_slew(int64_t wall_us, uint32_t period_s);
+
+#endif /* MAIN_TIMEBASE_H_ */
@@ -0,0 +1,250 @@
+/**
+ * @file timerWheel.c
+ * @brief Hierarchical timer wheel with one second ticks
+ * @details
+ * A slot is a list linked through pprev, the address of the pointer to
+ * the node, so a node is unlinked without knowing its slot. The timers of
+ * a second are fired from a local list head the nodes point into, a
+ * callback removing another timer of the same second keeps it consistent.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stddef.h>
+#include <string.h>
+
+// Personal libraries
+#include "timerWheel.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+#define TIMER_WHEEL_MASK		(TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_SPAN		(1UL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+
+_Static_assert(TIMER_WHEEL_SLOTS == 64, "level 0 bitmap is 64 bit");
+
+	/* Static Functions */
+
+static void timerWheel_place(timer_wheel_t * wheel_p, timer_wheel_node_t * node_p);
+static void timerWheel_cascade(timer_wheel_t * wheel_p, int level, uint32_t index);
+static void timerWheel_unlink(timer_wheel_t * wheel_p, timer_wheel_node_t * node_p);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Empties the wheel and sets its time
+void timerWheel_init(timer_wheel_t * wheel_p, uint32_t now)
+{
+	memset(wheel_p, 0x00, sizeof(timer_wheel_t));
+	wheel_p->now = now;
+}
+
+// Marks a node as not pending
+void timerWheel_nodeInit(timer_wheel_node_t * node_p)
+{
+	node_p->next = NULL;
+	node_p->pprev = NULL;
+	node_p->expires = 0;
+}
+
+// Adds a timer, or moves it when pending
+void timerWheel_add(timer_wheel_t * wheel_p, timer_wheel_node_t * node_p, uint32_t expires)
+{
+	if (node_p->pprev != NULL)
+	{
+		timerWheel_unlink(wheel_p, node_p);
+		wheel_p->pending--;
+	}
+
+	// The current second was already processed
+	if ((int32_t)(expires - wheel_p->now) <= 0)
+	{
+		expires = wheel_p->now + 1;
+	}
+	node_p->expires = expires;
+	timerWheel_place(wheel_p, node_p);
+	wheel_p->pending++;
+}
+
+// Removes a timer
+void timerWheel_remove(timer_wheel_t * wheel_p, timer_wheel_node_t * node_p)
+{
+	if (node_p->pprev == NULL)
+	{
+		return;
+	}
+	timerWheel_unlink(wheel_p, node_p);
+	wheel_p->pending--;
+}
+
+// Whether a timer is pending
+bool timerWheel_isPending(const timer_wheel_node_t * node_p)
+{
+	return node_p->pprev != NULL;
+}
+
+// Fires the timers up to a second
+uint32_t timerWheel_advance(timer_wheel_t * wheel_p, uint32_t now, timer_wheel_cb_t cb, void * ctx)
+{
+	timer_wheel_node_t * expired;
+	timer_wheel_node_t * node_p;
+	uint32_t fired = 0;
+
+	while ((int32_t)(now - wheel_p->now) > 0)
+	{
+		uint32_t t = wheel_p->now + 1;
+		uint32_t index = t & TIMER_WHEEL_MASK;
+
+		// Jumps to the next busy second, or to the end of the round where the next cascade is
+		if (index != 0)
+		{
+			uint64_t ahead = wheel_p->occupied >> index;
+			uint32_t next = (ahead != 0) ? t + __builtin_ctzll(ahead) : (t | TIMER_WHEEL_MASK) + 1;
+
+			if (next - wheel_p->now > now - wheel_p->now)
+			{
+				wheel_p->now = now;
+				break;
+			}
+			t = next;
+			index = t & TIMER_WHEEL_MASK;
+		}
+		wheel_p->now = t;
+
+		// End of a round: the current slot of each completed level moves down, top first
+		if (index == 0)
+		{
+			int level = 1;
+
+			while (level < TIMER_WHEEL_LEVELS - 1 && ((t >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_MASK) == 0)
+			{
+				level++;
+			}
+			for (; level > 0; level--)
+			{
+				timerWheel_cascade(wheel_p, level, (t >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_MASK);
+			}
+		}
+
+		expired = wheel_p->slots[0][index];
+		if (expired == NULL)
+		{
+			continue;
+		}
+		wheel_p->slots[0][index] = NULL;
+		wheel_p->occupied &= ~(1ULL << index);
+		expired->pprev = &expired;
+
+		while ((node_p = expired) != NULL)
+		{
+			timerWheel_unlink(wheel_p, node_p);
+			wheel_p->pending--;
+			fired++;
+			cb(node_p, ctx);
+		}
+	}
+
+	return fired;
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Links a node on the slot of its expiry
+ * @details the lowest level whose span holds the delay, past the last
+ * level the node waits on the farthest slot and is placed again there
+ * @param wheel_p
+ * @param node_p expires not before the wheel time
+ */
+static void timerWheel_place(timer_wheel_t * wheel_p, timer_wheel_node_t * node_p)
+{
+	uint32_t expires = node_p->expires;
+	uint32_t delta = expires - wheel_p->now;
+	timer_wheel_node_t ** head_pp;
+	uint32_t index;
+	int level = 0;
+
+	while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1UL << (TIMER_WHEEL_SLOT_BITS * (level + 1))))
+	{
+		level++;
+	}
+	if (delta >= TIMER_WHEEL_SPAN)
+	{
+		expires = wheel_p->now + TIMER_WHEEL_SPAN - 1;
+	}
+
+	index = (expires >> (TIMER_WHEEL_SLOT_BITS * level)) & TIMER_WHEEL_MASK;
+	head_pp = &wheel_p->slots[level][index];
+	node_p->next = *head_pp;
+	if (node_p->next != NULL)
+	{
+		node_p->next->pprev = &node_p->next;
+	}
+	node_p->pprev = head_pp;
+	*head_pp = node_p;
+
+	if (level == 0)
+	{
+		wheel_p->occupied |= 1ULL << index;
+	}
+}
+
+/**
+ * @brief Places again the nodes of a slot, they land on lower levels
+ * @param wheel_p
+ * @param level 1 or above
+ * @param index slot
+ */
+static void timerWheel_cascade(timer_wheel_t * wheel_p, int level, uint32_t index)
+{
+	timer_wheel_node_t * node_p = wheel_p->slots[level][index];
+	timer_wheel_node_t * next_p;
+
+	wheel_p->slots[level][index] = NULL;
+	while (node_p != NULL)
+	{
+		next_p = node_p->next;
+		timerWheel_place(wheel_p, node_p);
+		node_p = next_p;
+	}
+}
+
+/**
+ * @brief Unlinks a pending node
+ * @details clears the bitmap bit when it empties a level 0 slot
+ * @param wheel_p
+ * @param node_p
+ */
+static void timerWheel_unlink(timer_wheel_t * wheel_p, timer_wheel_node_t * node_p)
+{
+	timer_wheel_node_t ** pprev = node_p->pprev;
+
+	*pprev = node_p->next;
+	if (node_p->next != NULL)
+	{
+		node_p->next->pprev = pprev;
+	}
+	node_p->next = NULL;
+	node_p->pprev = NULL;
+
+	if (*pprev == NULL && pprev >= &wheel_p->slots[0][0] && pprev < &wheel_p->slots[0][TIMER_WHEEL_SLOTS])
+	{
+		wheel_p->occupied &= ~(1ULL << (pprev - &wheel_p->slots[0][0]));
+	}
+}
@@ -0,0 +1,123 @@
+/**
+ * @file timerWheel.h
+ * @brief Hierarchical timer wheel with one second ticks
+ * @details
+ * TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots, level L counts in
+ * steps of TIMER_WHEEL_SLOTS^L seconds. A timer goes to the lowest level
+ * its delay fits in; when the level below completes a round, the slot of
+ * the current step is moved (cascaded) one level down. Adding, removing
+ * and firing a timer are O(1), each timer is cascaded at most once per
+ * level. Empty seconds are skipped through a bitmap of the level 0 slots.
+ * The nodes belong to the caller, the wheel only links them. Not thread
+ * safe, the owner serializes the calls.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_TIMERWHEEL_H_
+#define MAIN_TIMERWHEEL_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+#define TIMER_WHEEL_SLOT_BITS	6
+#define TIMER_WHEEL_SLOTS		(1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_LEVELS		4		// 2^24 s, 194 days ahead, later timers wait on the last slot
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief Timer, embedded in the caller's structure
+ */
+typedef struct timer_wheel_node_s
+{
+	struct timer_wheel_node_s *		next;
+	struct timer_wheel_node_s **	pprev;		///> NULL when not pending
+	uint32_t						expires;	///> second it fires at
+} timer_wheel_node_t;
+
+/**
+ * @brief Called for every expired timer, the node may be added again
+ * @param node_p
+ * @param ctx given to timerWheel_advance
+ */
+typedef void (*timer_wheel_cb_t)(timer_wheel_node_t * node_p, void * ctx);
+
+/**
+ * @brief Wheel, zero initialized then timerWheel_init
+ */
+typedef struct timer_wheel_s
+{
+	uint32_t				now;		///> last second processed
+	uint32_t				pending;
+	uint64_t				occupied;	///> level 0 slots with timers
+	timer_wheel_node_t *	slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+} timer_wheel_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Empties the wheel and sets its time
+ * @details the nodes that were pending are left as they were, the
+ * caller resets them with timerWheel_nodeInit
+ * @param wheel_p
+ * @param now second the wheel starts at
+ */
+void timerWheel_init(timer_wheel_t * wheel_p, uint32_t now);
+
+/**
+ * @brief Marks a node as not pending, before its first use
+ * @param node_p
+ */
+void timerWheel_nodeInit(timer_wheel_node_t * node_p);
+
+/**
+ * @brief Adds a timer, or moves it when pending
+ * @param wheel_p
+ * @param node_p
+ * @param expires second, a past one fires on the next second
+ */
+void timerWheel_add(timer_wheel_t * wheel_p, timer_wheel_node_t * node_p, uint32_t expires);
+
+/**
+ * @brief Removes a timer, nothing when not pending
+ * @param wheel_p
+ * @param node_p
+ */
+void timerWheel_remove(timer_wheel_t * wheel_p, timer_wheel_node_t * node_p);
+
+/**
+ * @brief Whether a timer is pending
+ * @param node_p
+ * @return true when on the wheel
+ */
+bool timerWheel_isPending(const timer_wheel_node_t * node_p);
+
+/**
+ * @brief Fires the timers up to a second, in order of second
+ * @param wheel_p
+ * @param now second to advance to, nothing when not after the wheel time
+ * @param cb called for each expired timer, already removed
+ * @param ctx passed to cb
+ * @return uint32_t timers fired
+ */
+uint32_t timerWheel_advance(timer_wheel_t * wheel_p, uint32_t now, timer_wheel_cb_t cb, void * ctx);
+
+#endif /* MAIN_TIMERWHEEL_H_ */
@@ -0,0 +1,970 @@
+/**
+ * @file valveSchedule.c
+ * @brief Weekly irrigation schedules of the valves
+ * @details
+ * The wheel counts epoch seconds and the rules local time, the edges are
+ * turned into seconds with mktime one at a time, so a DST change moves
+ * the next edge and nothing else. The rules and the wheel belong to the
+ * mutex. The valve commands are only queued with it taken, one slot per
+ * valve holding the last state wanted; the schedule task sends them after
+ * giving the mutex back, without waiting on the NCP window, and the NCP
+ * task frees or retries them from the responses. The slots and the
+ * counters have a spinlock of their own for that.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// ESP libraries
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "nvs.h"
+
+// Personal libraries
+#include "appEvents.h"
+#include "asyncLog.h"
+#include "deviceRegistry.h"
+#include "tasks_common.h"
+#include "timebase.h"
+#include "timerWheel.h"
+#include "valveSchedule.h"
+#include "zigbeeNcp.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+#define VALVE_SCHEDULE_DAY_S	(24 * 60 * 60)
+#define VALVE_SCHEDULE_WEEK_S	(7 * VALVE_SCHEDULE_DAY_S)
+
+// Response context: generation << 8 | slot
+_Static_assert(VALVE_SCHEDULE_MAX <= 256, "command slots are 8 bit in the response context");
+
+	/* Structures */
+
+/**
+ * @brief Rule saved on NVS, days 0 for an empty place
+ */
+typedef struct __attribute__((packed)) valve_rule_record_s
+{
+	uint64_t	ieee;
+	uint16_t	start_min;
+	uint16_t	duration_min;
+	uint8_t		days;
+	uint8_t		reserved;
+} valve_rule_record_t;
+
+/**
+ * @brief Timer of a rule
+ */
+typedef struct valve_timer_s
+{
+	timer_wheel_node_t	node;		// first, the wheel gives the node back
+	bool				open;		// the next edge is the closing
+} valve_timer_t;
+
+/**
+ * @brief Command of a valve waiting to be sent or answered
+ * @details a valve has one slot at most, a new state replaces the one
+ * queued and bumps the generation so a late response of the old is ignored
+ */
+typedef struct valve_command_s
+{
+	uint64_t	ieee;			// 0 for a free slot
+	uint16_t	generation;
+	uint16_t	short_addr;		// as sent
+	uint8_t		tries;
+	bool		open;
+	bool		sent;			// waiting for the response
+} valve_command_t;
+
+/**
+ * @brief Benchmark state, given to the callback
+ */
+typedef struct valve_bench_run_s
+{
+	timer_wheel_t *		wheel_p;
+	uint32_t			seed;
+} valve_bench_run_t;
+
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "valve_schedule";
+
+// Rules, days 0 for a free ID, and their timers
+static valve_rule_t g_rules[VALVE_SCHEDULE_MAX];
+static valve_timer_t g_timers[VALVE_SCHEDULE_MAX];
+static timer_wheel_t g_wheel;
+static bool g_running;
+
+// Rules as saved, used by the mutex owner
+static valve_rule_record_t g_records[VALVE_SCHEDULE_MAX];
+
+// Commands, at most one per valve and a valve has a rule at least
+static valve_command_t g_commands[VALVE_SCHEDULE_MAX];
+
+static valve_schedule_stats_t g_stats;
+// Protects the counters and the commands
+static portMUX_TYPE valve_schedule_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+	/* FreeRTOS Structures */
+
+TASK_STORAGE(valveSchedule_task, VALVE_SCHEDULE_TASK_STACK_SIZE)
+static TaskHandle_t valve_schedule_task_handle;
+
+// Protects the rules and the wheel
+static SemaphoreHandle_t valve_schedule_mutex;
+#if CONFIG_GW_STATIC_ALLOCATION
+static StaticSemaphore_t valve_schedule_mutex_struct;
+#endif
+
+
+	/* Static Functions */
+
+static void valveSchedule_task(void * pvParameters);
+static void valveSchedule_timeStepped(void * arg, esp_event_base_t event_base, int32_t event_id, void * event_data);
+static void valveSchedule_rebuild(uint32_t now_s);
+static void valveSchedule_arm(uint16_t id, uint32_t now_s);
+static void valveSchedule_fire(timer_wheel_node_t * node_p, void * ctx);
+static uint32_t valveSchedule_startOn(const valve_rule_t * rule_p, uint32_t ref_s, int day);
+static uint32_t valveSchedule_nextStart(const valve_rule_t * rule_p, uint32_t after_s);
+static uint32_t valveSchedule_lastStart(const valve_rule_t * rule_p, uint32_t now_s);
+static bool valveSchedule_valveOpen(uint64_t ieee);
+static void valveSchedule_apply(uint64_t ieee, bool was_open);
+static void valveSchedule_command(uint64_t ieee, bool open);
+static void valveSchedule_sendCommands(void);
+static void valveSchedule_commandFailed(uint16_t slot, uint16_t generation);
+static void valveSchedule_commandDone(void * ctx, esp_err_t err, const uint8_t * payload, uint16_t len);
+static void valveSchedule_wake(void);
+static esp_err_t valveSchedule_save(void);
+static void valveSchedule_snapshot(void);
+static uint32_t valveSchedule_benchRand(uint32_t * seed_p);
+static void valveSchedule_benchFire(timer_wheel_node_t * node_p, void * ctx);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Loads the rules saved on NVS and starts the schedule task
+esp_err_t valveSchedule_init(void)
+{
+	size_t length = sizeof(g_records);
+	nvs_handle_t handle;
+	esp_err_t err;
+
+	if (valve_schedule_task_handle != NULL)
+	{
+		return ESP_OK;
+	}
+
+#if CONFIG_GW_STATIC_ALLOCATION
+	valve_schedule_mutex = xSemaphoreCreateMutexStatic(&valve_schedule_mutex_struct);
+#else
+	valve_schedule_mutex = xSemaphoreCreateMutex();
+#endif
+
+	for (uint16_t id = 0; id < VALVE_SCHEDULE_MAX; id++)
+	{
+		timerWheel_nodeInit(&g_timers[id].node);
+	}
+
+	err = nvs_open(VALVE_SCHEDULE_NVS_NAMESPACE, NVS_READONLY, &handle);
+	if (err == ESP_OK)
+	{
+		if (nvs_get_blob(handle, VALVE_SCHEDULE_NVS_KEY, g_records, &length) == ESP_OK)
+		{
+			for (uint16_t id = 0; id < length / sizeof(valve_rule_record_t); id++)
+			{
+				g_rules[id].ieee = g_records[id].ieee;
+				g_rules[id].start_min = g_records[id].start_min;
+				g_rules[id].duration_min = g_records[id].duration_min;
+				g_rules[id].days = g_records[id].days & VALVE_SCHEDULE_DAYS_ALL;
+			}
+		}
+		nvs_close(handle);
+	}
+	else if (err != ESP_ERR_NVS_NOT_FOUND)
+	{
+		ESP_LOGE(TAG, "valveSchedule_init: nvs_open failed (%s)", esp_err_to_name(err));
+	}
+	valveSchedule_snapshot();
+	ESP_LOGI(TAG, "%u rules loaded", g_stats.rules);
+
+	// A step wakes the task up, it checks the jump itself
+	appEvents_subscribe(APP_EVENT_TIME_STEPPED, valveSchedule_timeStepped, NULL);
+
+	if (TASK_CREATE(	valveSchedule_task,
+						&valveSchedule_task,
+						VALVE_SCHEDULE_TASK_STACK_SIZE,
+						VALVE_SCHEDULE_TASK_PRIORITY,
+						&valve_schedule_task_handle,
+						VALVE_SCHEDULE_TASK_CORE_ID) != pdPASS)
+	{
+		ESP_LOGE(TAG, "valveSchedule_init: task not created");
+		return ESP_ERR_NO_MEM;
+	}
+	return ESP_OK;
+}
+
+// Adds a rule and saves the rules
+esp_err_t valveSchedule_add(const valve_rule_t * rule_p, uint16_t * id_p)
+{
+	esp_err_t err = ESP_ERR_NO_MEM;
+
+	if (rule_p->ieee == 0 || (rule_p->days & VALVE_SCHEDULE_DAYS_ALL) == 0 || rule_p->start_min >= 24 * 60
+		|| rule_p->duration_min == 0 || rule_p->duration_min > VALVE_SCHEDULE_MAX_DURATION_MIN)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	xSemaphoreTake(valve_schedule_mutex, portMAX_DELAY);
+	for (uint16_t id = 0; id < VALVE_SCHEDULE_MAX; id++)
+	{
+		if (g_rules[id].days != 0)
+		{
+			continue;
+		}
+		g_rules[id] = *rule_p;
+		g_rules[id].days &= VALVE_SCHEDULE_DAYS_ALL;
+		err = valveSchedule_save();
+		if (err != ESP_OK)
+		{
+			memset(&g_rules[id], 0x00, sizeof(valve_rule_t));
+			break;
+		}
+		if (g_running)
+		{
+			bool was_open = valveSchedule_valveOpen(rule_p->ieee);
+
+			valveSchedule_arm(id, g_wheel.now);
+			valveSchedule_apply(rule_p->ieee, was_open);
+		}
+		if (id_p != NULL)
+		{
+			*id_p = id;
+		}
+		break;
+	}
+	valveSchedule_snapshot();
+	xSemaphoreGive(valve_schedule_mutex);
+
+	// The task sends the command queued, if any
+	valveSchedule_wake();
+	return err;
+}
+
+// Removes a rule and saves the rules
+esp_err_t valveSchedule_remove(uint16_t id)
+{
+	valve_rule_t rule;
+	bool was_open;
+	esp_err_t err;
+
+	if (id >= VALVE_SCHEDULE_MAX)
+	{
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	xSemaphoreTake(valve_schedule_mutex, portMAX_DELAY);
+	if (g_rules[id].days == 0)
+	{
+		xSemaphoreGive(valve_schedule_mutex);
+		return ESP_ERR_NOT_FOUND;
+	}
+	rule = g_rules[id];
+	was_open = valveSchedule_valveOpen(rule.ieee);
+
+	memset(&g_rules[id], 0x00, sizeof(valve_rule_t));
+	err = valveSchedule_save();
+	if (err != ESP_OK)
+	{
+		g_rules[id] = rule;
+	}
+	else
+	{
+		timerWheel_remove(&g_wheel, &g_timers[id].node);
+		g_timers[id].open = false;
+		if (g_running)
+		{
+			valveSchedule_apply(rule.ieee, was_open);
+		}
+	}
+	valveSchedule_snapshot();
+	xSemaphoreGive(valve_schedule_mutex);
+
+	valveSchedule_wake();
+	return err;
+}
+
+// Reads a rule
+bool valveSchedule_getRule(uint16_t id, valve_rule_info_t * info_p)
+{
+	bool found = false;
+
+	if (id >= VALVE_SCHEDULE_MAX)
+	{
+		return false;
+	}
+
+	xSemaphoreTake(valve_schedule_mutex, portMAX_DELAY);
+	if (g_rules[id].days != 0)
+	{
+		info_p->rule = g_rules[id];
+		info_p->open = g_timers[id].open;
+		info_p->next_s = timerWheel_isPending(&g_timers[id].node) ? g_timers[id].node.expires : 0;
+		found = true;
+	}
+	xSemaphoreGive(valve_schedule_mutex);
+
+	return found;
+}
+
+// Copies the engine figures
+void valveSchedule_getStats(valve_schedule_stats_t * stats_p)
+{
+	taskENTER_CRITICAL(&valve_schedule_mux);
+	*stats_p = g_stats;
+	taskEXIT_CRITICAL(&valve_schedule_mux);
+}
+
+// Times a wheel of random weekly timers
+esp_err_t valveSchedule_benchmark(uint32_t timers, uint32_t days, valve_schedule_bench_t * result_p)
+{
+	valve_bench_run_t run = { .seed = 0x2545F491 };
+	timer_wheel_node_t * nodes_p;
+	uint32_t start_s = timebase_nowUs() / 1000000;
+	int64_t start_us;
+	int64_t insert_us;
+	int64_t advance_us;
+
+	if (timers == 0 || timers > VALVE_SCHEDULE_BENCH_MAX || days == 0 || days > VALVE_SCHEDULE_BENCH_MAX_DAYS)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	run.wheel_p = malloc(sizeof(timer_wheel_t));
+	nodes_p = malloc(timers * sizeof(timer_wheel_node_t));
+	if (run.wheel_p == NULL || nodes_p == NULL)
+	{
+		free(run.wheel_p);
+		free(nodes_p);
+		return ESP_ERR_NO_MEM;
+	}
+	timerWheel_init(run.wheel_p, start_s);
+
+	start_us = esp_timer_get_time();
+	for (uint32_t i = 0; i < timers; i++)
+	{
+		timerWheel_nodeInit(&nodes_p[i]);
+		timerWheel_add(run.wheel_p, &nodes_p[i], start_s + valveSchedule_benchRand(&run.seed) % VALVE_SCHEDULE_WEEK_S);
+	}
+	insert_us = esp_timer_get_time() - start_us;
+
+	start_us = esp_timer_get_time();
+	result_p->fired = timerWheel_advance(run.wheel_p, start_s + days * VALVE_SCHEDULE_DAY_S, valveSchedule_benchFire, &run);
+	advance_us = esp_timer_get_time() - start_us;
+
+	result_p->timers = timers;
+	result_p->days = days;
+	result_p->insert_ns = insert_us * 1000 / timers;
+	result_p->fire_ns = (result_p->fired > 0) ? advance_us * 1000 / result_p->fired : 0;
+	result_p->elapsed_ms = advance_us / 1000;
+
+	free(nodes_p);
+	free(run.wheel_p);
+
+	ESP_LOGI(TAG, "bench: %lu timers, %lu days, %lu fired, insert %lu ns, fire %lu ns",
+				timers, days, result_p->fired, result_p->insert_ns, result_p->fire_ns);
+	return ESP_OK;
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Schedule task, one pass per second of the wall clock
+ * @details rebuilds the wheel on the first pass after the sync and after
+ * a jump larger than VALVE_SCHEDULE_RESYNC_S, advances it otherwise, then
+ * sends the commands queued
+ * @param pvParameters
+ */
+static void valveSchedule_task(void * pvParameters)
+{
+	int64_t now_us;
+	uint32_t now_s;
+	int32_t jump_s;
+
+	for (;;)
+	{
+		now_us = timebase_nowUs();
+		now_s = now_us / 1000000;
+
+		if (timebase_isSynced())
+		{
+			xSemaphoreTake(valve_schedule_mutex, portMAX_DELAY);
+			jump_s = (int32_t)(now_s - g_wheel.now);
+			if (!g_running || jump_s > VALVE_SCHEDULE_RESYNC_S || jump_s < -VALVE_SCHEDULE_RESYNC_S)
+			{
+				if (g_running)
+				{
+					ESP_LOGW(TAG, "clock jumped %ld s, rebuilding the schedules", jump_s);
+				}
+				valveSchedule_rebuild(now_s);
+				// The next jump is measured from the clock after the rebuild, the seconds it took fire now
+				now_us = timebase_nowUs();
+				now_s = now_us / 1000000;
+			}
+			timerWheel_advance(&g_wheel, now_s, valveSchedule_fire, NULL);
+			valveSchedule_snapshot();
+			xSemaphoreGive(valve_schedule_mutex);
+
+			valveSchedule_sendCommands();
+		}
+
+		// Next second, or sooner on a clock step
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000 - (now_us / 1000) % 1000 + 1));
+	}
+}
+
+/**
+ * @brief APP_EVENT_TIME_STEPPED handler
+ * @param arg
+ * @param event_base
+ * @param event_id
+ * @param event_data app_event_time_stepped_t
+ */
+static void valveSchedule_timeStepped(void * arg, esp_event_base_t event_base, int32_t event_id, void * event_data)
+{
+	valveSchedule_wake();
+}
+
+/**
+ * @brief Builds the wheel again from the rules
+ * @details every scheduled valve is sent the state it should be in now,
+ * the jump or a reboot may have skipped its last edge
+ * @param now_s
+ */
+static void valveSchedule_rebuild(uint32_t now_s)
+{
+	timerWheel_init(&g_wheel, now_s);
+	for (uint16_t id = 0; id < VALVE_SCHEDULE_MAX; id++)
+	{
+		timerWheel_nodeInit(&g_timers[id].node);
+		g_timers[id].open = false;
+		if (g_rules[id].days != 0)
+		{
+			valveSchedule_arm(id, now_s);
+		}
+	}
+	g_running = true;
+
+	for (uint16_t id = 0; id < VALVE_SCHEDULE_MAX; id++)
+	{
+		uint16_t first = 0;
+
+		if (g_rules[id].days == 0)
+		{
+			continue;
+		}
+		// Once per valve, on its first rule
+		while (g_rules[first].days == 0 || g_rules[first].ieee != g_rules[id].ieee)
+		{
+			first++;
+		}
+		if (first == id)
+		{
+			valveSchedule_command(g_rules[id].ieee, valveSchedule_valveOpen(g_rules[id].ieee));
+		}
+	}
+
+	taskENTER_CRITICAL(&valve_schedule_mux);
+	g_stats.resyncs++;
+	taskEXIT_CRITICAL(&valve_schedule_mux);
+	ESP_LOGI(TAG, "%lu timers armed", g_wheel.pending);
+}
+
+/**
+ * @brief Sets the timer of a rule for the time given
+ * @details inside a window the next edge is its end, its next start
+ * otherwise
+ * @param id
+ * @param now_s
+ */
+static void valveSchedule_arm(uint16_t id, uint32_t now_s)
+{
+	const valve_rule_t * rule_p = &g_rules[id];
+	uint32_t last_s = valveSchedule_lastStart(rule_p, now_s);
+	uint32_t end_s = last_s + rule_p->duration_min * 60;
+
+	g_timers[id].open = (last_s != 0 && now_s < end_s);
+	timerWheel_add(&g_wheel, &g_timers[id].node, g_timers[id].open ? end_s : valveSchedule_nextStart(rule_p, now_s));
+}
+
+/**
+ * @brief Edge of a rule, the timer goes on to the next one
+ * @details the wheel time is the edge second, also when catching up
+ * @param node_p timer of the rule
+ * @param ctx
+ */
+static void valveSchedule_fire(timer_wheel_node_t * node_p, void * ctx)
+{
+	valve_timer_t * timer_p = (valve_timer_t *)node_p;
+	const valve_rule_t * rule_p = &g_rules[timer_p - g_timers];
+	bool was_open = valveSchedule_valveOpen(rule_p->ieee);
+
+	if (timer_p->open)
+	{
+		timer_p->open = false;
+		timerWheel_add(&g_wheel, node_p, valveSchedule_nextStart(rule_p, g_wheel.now));
+	}
+	else
+	{
+		timer_p->open = true;
+		timerWheel_add(&g_wheel, node_p, g_wheel.now + rule_p->duration_min * 60);
+	}
+
+	taskENTER_CRITICAL(&valve_schedule_mux);
+	g_stats.fired++;
+	taskEXIT_CRITICAL(&valve_schedule_mux);
+
+	valveSchedule_apply(rule_p->ieee, was_open);
+}
+
+/**
+ * @brief Start of a rule on a local day
+ * @param rule_p
+ * @param ref_s epoch second on the reference day
+ * @param day from the reference day, may be negative
+ * @return uint32_t epoch second, 0 when not one of the rule days
+ */
+static uint32_t valveSchedule_startOn(const valve_rule_t * rule_p, uint32_t ref_s, int day)
+{
+	time_t time_s = ref_s;
+	struct tm tm;
+
+	localtime_r(&time_s, &tm);
+	tm.tm_mday += day;
+	tm.tm_hour = rule_p->start_min / 60;
+	tm.tm_min = rule_p->start_min % 60;
+	tm.tm_sec = 0;
+	tm.tm_isdst = -1;
+	time_s = mktime(&tm);
+
+	return (rule_p->days & (1 << tm.tm_wday)) ? (uint32_t)time_s : 0;
+}
+
+/**
+ * @brief First start of a rule after a second
+ * @param rule_p
+ * @param after_s
+ * @return uint32_t epoch second
+ */
+static uint32_t valveSchedule_nextStart(const valve_rule_t * rule_p, uint32_t after_s)
+{
+	uint32_t start_s;
+
+	for (int day = 0; day <= 7; day++)
+	{
+		start_s = valveSchedule_startOn(rule_p, after_s, day);
+		if (start_s > after_s)
+		{
+			return start_s;
+		}
+	}
+	// No day set, checked when the rule was added
+	return after_s + VALVE_SCHEDULE_WEEK_S;
+}
+
+/**
+ * @brief Last start of a rule up to a second
+ * @param rule_p
+ * @param now_s
+ * @return uint32_t epoch second, 0 when none in the last week
+ */
+static uint32_t valveSchedule_lastStart(const valve_rule_t * rule_p, uint32_t now_s)
+{
+	uint32_t start_s;
+
+	for (int day = 0; day >= -7; day--)
+	{
+		start_s = valveSchedule_startOn(rule_p, now_s, day);
+		if (start_s != 0 && start_s <= now_s)
+		{
+			return start_s;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief Whether any rule of a valve is inside its window
+ * @param ieee
+ * @return true when the valve should be open
+ */
+static bool valveSchedule_valveOpen(uint64_t ieee)
+{
+	for (uint16_t id = 0; id < VALVE_SCHEDULE_MAX; id++)
+	{
+		if (g_timers[id].open && g_rules[id].days != 0 && g_rules[id].ieee == ieee)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Sends the valve state when a change of its rules changed it
+ * @param ieee
+ * @param was_open state before the change
+ */
+static void valveSchedule_apply(uint64_t ieee, bool was_open)
+{
+	bool open = valveSchedule_valveOpen(ieee);
+
+	if (open != was_open)
+	{
+		valveSchedule_command(ieee, open);
+	}
+}
+
+/**
+ * @brief Queues an On/Off command to a valve
+ * @details never blocks, the schedule task sends it; replaces the command
+ * of the valve not answered yet
+ * @param ieee
+ * @param open
+ */
+static void valveSchedule_command(uint64_t ieee, bool open)
+{
+	int slot = -1;
+
+	taskENTER_CRITICAL(&valve_schedule_mux);
+	for (int i = 0; i < VALVE_SCHEDULE_MAX; i++)
+	{
+		if (g_commands[i].ieee == ieee)
+		{
+			slot = i;
+			break;
+		}
+		if (slot < 0 && g_commands[i].ieee == 0)
+		{
+			slot = i;
+		}
+	}
+	if (slot >= 0)
+	{
+		g_commands[slot].ieee = ieee;
+		g_commands[slot].generation++;
+		g_commands[slot].tries = 0;
+		g_commands[slot].open = open;
+		g_commands[slot].sent = false;
+	}
+	else
+	{
+		g_stats.failed++;
+	}
+	taskEXIT_CRITICAL(&valve_schedule_mux);
+
+	if (slot < 0)
+	{
+		ESP_LOGE(TAG, "valve %016llx not %s, no command slot", ieee, open ? "opened" : "closed");
+	}
+}
+
+/**
+ * @brief Sends the queued On/Off commands through the NCP, schedule task
+ * @details without the mutex and without waiting: a full window leaves the
+ * rest for the next pass, the responses are handled on the NCP task
+ */
+static void valveSchedule_sendCommands(void)
+{
+	for (uint16_t slot = 0; slot < VALVE_SCHEDULE_MAX; slot++)
+	{
+		device_info_t device;
+		uint16_t generation;
+		uint8_t payload[4];
+		uint64_t ieee;
+		esp_err_t err;
+		bool open;
+
+		taskENTER_CRITICAL(&valve_schedule_mux);
+		ieee = g_commands[slot].ieee;
+		generation = g_commands[slot].generation;
+		open = g_commands[slot].open;
+		if (ieee == 0 || g_commands[slot].sent)
+		{
+			taskEXIT_CRITICAL(&valve_schedule_mux);
+			continue;
+		}
+		taskEXIT_CRITICAL(&valve_schedule_mux);
+
+		if (!deviceRegistry_findByIeee(ieee, &device) || device.short_addr == DEVICE_SHORT_NONE)
+		{
+			ESP_LOGW(TAG, "valve %016llx unreachable, not %s", ieee, open ? "opened" : "closed");
+			taskENTER_CRITICAL(&valve_schedule_mux);
+			if (g_commands[slot].generation == generation)
+			{
+				g_commands[slot].ieee = 0;
+			}
+			g_stats.unreachable++;
+			taskEXIT_CRITICAL(&valve_schedule_mux);
+			continue;
+		}
+
+		// Marked before the request, the response may come first
+		taskENTER_CRITICAL(&valve_schedule_mux);
+		if (g_commands[slot].generation != generation)
+		{
+			// Replaced meanwhile, sent on the next pass
+			taskEXIT_CRITICAL(&valve_schedule_mux);
+			continue;
+		}
+		g_commands[slot].sent = true;
+		g_commands[slot].short_addr = device.short_addr;
+		taskEXIT_CRITICAL(&valve_schedule_mux);
+
+		// short(2) endpoint(1) on(1)
+		payload[0] = device.short_addr & 0xFF;
+		payload[1] = device.short_addr >> 8;
+		payload[2] = VALVE_SCHEDULE_ENDPOINT;
+		payload[3] = open;
+
+		err = zigbeeNcp_tryRequestAsync(ZIGBEE_NCP_CMD_ON_OFF, payload, sizeof(payload), valveSchedule_commandDone,
+										(void *)(uintptr_t)((generation << 8) | slot), VALVE_SCHEDULE_CMD_TIMEOUT_MS);
+		if (err == ESP_ERR_TIMEOUT)
+		{
+			// Window full, this one and the rest go on the next pass
+			taskENTER_CRITICAL(&valve_schedule_mux);
+			if (g_commands[slot].generation == generation)
+			{
+				g_commands[slot].sent = false;
+			}
+			taskEXIT_CRITICAL(&valve_schedule_mux);
+			break;
+		}
+		if (err != ESP_OK)
+		{
+			ESP_LOGW(TAG, "valve 0x%04x command not sent (%s)", device.short_addr, esp_err_to_name(err));
+			valveSchedule_commandFailed(slot, generation);
+			continue;
+		}
+
+		ESP_LOGI(TAG, "%s valve %016llx (0x%04x)", open ? "opening" : "closing", ieee, device.short_addr);
+		taskENTER_CRITICAL(&valve_schedule_mux);
+		g_stats.commands++;
+		taskEXIT_CRITICAL(&valve_schedule_mux);
+	}
+}
+
+/**
+ * @brief Counts a command refused or not answered, queues it again up to
+ * VALVE_SCHEDULE_CMD_RETRIES times
+ * @details any task, a command replaced meanwhile is left alone
+ * @param slot
+ * @param generation of the command sent
+ */
+static void valveSchedule_commandFailed(uint16_t slot, uint16_t generation)
+{
+	bool retry = false;
+	uint16_t short_addr;
+
+	taskENTER_CRITICAL(&valve_schedule_mux);
+	g_stats.failed++;
+	short_addr = g_commands[slot].short_addr;
+	if (g_commands[slot].ieee != 0 && g_commands[slot].generation == generation && g_commands[slot].sent)
+	{
+		g_commands[slot].sent = false;
+		if (++g_commands[slot].tries < VALVE_SCHEDULE_CMD_RETRIES)
+		{
+			retry = true;
+		}
+		else
+		{
+			g_commands[slot].ieee = 0;
+		}
+	}
+	taskEXIT_CRITICAL(&valve_schedule_mux);
+
+	if (!retry)
+	{
+		ASYNC_LOGW(TAG, "valve 0x%04x command dropped", short_addr);
+	}
+}
+
+/**
+ * @brief On/Off response, on the NCP task
+ * @details the valve state is recorded on the registry once confirmed, a
+ * failure is retried on the next pass of the schedule task
+ * @param ctx generation << 8 | slot
+ * @param err
+ * @param payload
+ * @param len
+ */
+static void valveSchedule_commandDone(void * ctx, esp_err_t err, const uint8_t * payload, uint16_t len)
+{
+	uint16_t slot = (uintptr_t)ctx & 0xFF;
+	uint16_t generation = (uintptr_t)ctx >> 8;
+	uint16_t short_addr = 0;
+	bool confirmed = false;
+	bool open = false;
+
+	if (err != ESP_OK)
+	{
+		ASYNC_LOGW(TAG, "valve command %d not answered (%d)", slot, err);
+		valveSchedule_commandFailed(slot, generation);
+		return;
+	}
+
+	taskENTER_CRITICAL(&valve_schedule_mux);
+	if (g_commands[slot].ieee != 0 && g_commands[slot].generation == generation && g_commands[slot].sent)
+	{
+		short_addr = g_commands[slot].short_addr;
+		open = g_commands[slot].open;
+		g_commands[slot].ieee = 0;
+		confirmed = true;
+	}
+	taskEXIT_CRITICAL(&valve_schedule_mux);
+
+	// A replaced command gives the state of the next response
+	if (confirmed)
+	{
+		deviceRegistry_setAttr(short_addr, DEVICE_ATTR_VALVE_OPEN, open);
+	}
+}
+
+/**
+ * @brief Wakes the schedule task up for a pass, it sends the queued commands
+ */
+static void valveSchedule_wake(void)
+{
+	if (valve_schedule_task_handle != NULL)
+	{
+		xTaskNotifyGive(valve_schedule_task_handle);
+	}
+}
+
+/**
+ * @brief Writes the rules up to the last one used
+ * @return esp_err_t
+ */
+static esp_err_t valveSchedule_save(void)
+{
+	nvs_handle_t handle;
+	uint16_t count = 0;
+	esp_err_t err;
+
+	memset(g_records, 0x00, sizeof(g_records));
+	for (uint16_t id = 0; id < VALVE_SCHEDULE_MAX; id++)
+	{
+		if (g_rules[id].days == 0)
+		{
+			continue;
+		}
+		g_records[id].ieee = g_rules[id].ieee;
+		g_records[id].start_min = g_rules[id].start_min;
+		g_records[id].duration_min = g_rules[id].duration_min;
+		g_records[id].days = g_rules[id].days;
+		count = id + 1;
+	}
+
+	err = nvs_open(VALVE_SCHEDULE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "valveSchedule_save: nvs_open failed (%s)", esp_err_to_name(err));
+		return err;
+	}
+	if (count > 0)
+	{
+		err = nvs_set_blob(handle, VALVE_SCHEDULE_NVS_KEY, g_records, count * sizeof(valve_rule_record_t));
+	}
+	else
+	{
+		err = nvs_erase_key(handle, VALVE_SCHEDULE_NVS_KEY);
+		if (err == ESP_ERR_NVS_NOT_FOUND)
+		{
+			err = ESP_OK;
+		}
+	}
+	if (err == ESP_OK)
+	{
+		err = nvs_commit(handle);
+	}
+	nvs_close(handle);
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "valveSchedule_save: %s", esp_err_to_name(err));
+	}
+	return err;
+}
+
+/**
+ * @brief Copies the rule count and the wheel state to the figures
+ * @details with the mutex taken
+ */
+static void valveSchedule_snapshot(void)
+{
+	uint16_t rules = 0;
+
+	for (uint16_t id = 0; id < VALVE_SCHEDULE_MAX; id++)
+	{
+		rules += (g_rules[id].days != 0);
+	}
+
+	taskENTER_CRITICAL(&valve_schedule_mux);
+	g_stats.running = g_running;
+	g_stats.rules = rules;
+	g_stats.pending = g_wheel.pending;
+	taskEXIT_CRITICAL(&valve_schedule_mux);
+}
+
+/**
+ * @brief xorshift32, the benchmark expiries
+ * @param seed_p not 0
+ * @return uint32_t
+ */
+static uint32_t valveSchedule_benchRand(uint32_t * seed_p)
+{
+	uint32_t x = *seed_p;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*seed_p = x;
+	return x;
+}
+
+/**
+ * @brief Benchmark timer, added again one hour to a week later
+ * @param node_p
+ * @param ctx valve_bench_run_t
+ */
+static void valveSchedule_benchFire(timer_wheel_node_t * node_p, void * ctx)
+{
+	valve_bench_run_t * run_p = ctx;
+
+	timerWheel_add(run_p->wheel_p, node_p,
+					run_p->wheel_p->now + 3600 + valveSchedule_benchRand(&run_p->seed) % VALVE_SCHEDULE_WEEK_S);
+}
@@ -0,0 +1,161 @@
+/**
+ * @file valveSchedule.h
+ * @brief Weekly irrigation schedules of the valves
+ * @details
+ * A rule opens a valve on some days of the week at a local time and
+ * closes it a number of minutes later. The rules are saved on NVS; each
+ * one has a timer on a timer wheel (timerWheel.h) for its next opening or
+ * closing, so a pass of the schedule task costs the same with one rule or
+ * with all of them. A valve is open while any of its rules is, the
+ * command goes to the NCP only when that changes. Commands are queued
+ * and sent by the schedule task, never while the rules are locked; one
+ * refused or not answered is sent again up to VALVE_SCHEDULE_CMD_RETRIES
+ * times.
+ * Nothing runs before the first NTP sync. A clock jump of up to
+ * VALVE_SCHEDULE_RESYNC_S forward fires the skipped edges, the same jump
+ * backwards waits for the clock to catch up. Larger jumps, the first sync
+ * included, rebuild the wheel from the rules and send every scheduled
+ * valve the state it should be in now.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_VALVESCHEDULE_H_
+#define MAIN_VALVESCHEDULE_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+// ESP libraries
+#include "esp_err.h"
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+#define VALVE_SCHEDULE_NVS_NAMESPACE		"schedules"
+#define VALVE_SCHEDULE_NVS_KEY				"rules"
+
+// Every day, bit 0 is Sunday
+#define VALVE_SCHEDULE_DAYS_ALL				0x7F
+// Shorter than a day, a window closes before the next one opens
+#define VALVE_SCHEDULE_MAX_DURATION_MIN		(24 * 60 - 1)
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief Rule of a valve
+ */
+typedef struct valve_rule_s
+{
+	uint64_t	ieee;			///> valve on the device registry
+	uint16_t	start_min;		///> minute of the day, local time
+	uint16_t	duration_min;	///> 1 to VALVE_SCHEDULE_MAX_DURATION_MIN
+	uint8_t		days;			///> bit 0 Sunday to bit 6 Saturday
+} valve_rule_t;
+
+/**
+ * @brief Copy of a rule and its timer
+ */
+typedef struct valve_rule_info_s
+{
+	valve_rule_t	rule;
+	bool			open;		///> inside its window
+	uint32_t		next_s;		///> epoch second of the next edge, 0 before the first sync
+} valve_rule_info_t;
+
+/**
+ * @brief Engine figures
+ */
+typedef struct valve_schedule_stats_s
+{
+	bool		running;		///> the clock is synced and the wheel built
+	uint16_t	rules;
+	uint32_t	pending;		///> timers on the wheel
+	uint32_t	fired;			///> edges, openings and closings
+	uint32_t	resyncs;		///> wheel rebuilds, the first sync included
+	uint32_t	commands;
+	uint32_t	failed;			///> commands refused or not answered
+	uint32_t	unreachable;	///> valve unknown or without a short address
+} valve_schedule_stats_t;
+
+/**
+ * @brief Benchmark result
+ */
+typedef struct valve_schedule_bench_s
+{
+	uint32_t	timers;
+	uint32_t	days;			///> simulated
+	uint32_t	fired;
+	uint32_t	insert_ns;		///> average
+	uint32_t	fire_ns;		///> average, the next add included
+	uint32_t	elapsed_ms;		///> to advance over the simulated days
+} valve_schedule_bench_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Loads the rules saved on NVS and starts the schedule task
+ * @details after nvs_flash_init, appEvents_init and deviceRegistry_init
+ * @return esp_err_t
+ */
+esp_err_t valveSchedule_init(void);
+
+/**
+ * @brief Adds a rule and saves the rules
+ * @details the valve opens right away when inside the new window
+ * @param rule_p
+ * @param id_p destination of the rule ID, may be NULL
+ * @return esp_err_t ESP_ERR_INVALID_ARG, ESP_ERR_NO_MEM past VALVE_SCHEDULE_MAX
+ */
+esp_err_t valveSchedule_add(const valve_rule_t * rule_p, uint16_t * id_p);
+
+/**
+ * @brief Removes a rule and saves the rules
+ * @details the valve closes when no other rule holds it open
+ * @param id
+ * @return esp_err_t ESP_ERR_NOT_FOUND
+ */
+esp_err_t valveSchedule_remove(uint16_t id);
+
+/**
+ * @brief Reads a rule, for listing them
+ * @param id 0 to VALVE_SCHEDULE_MAX - 1
+ * @param info_p destination
+ * @return false when there is no rule with this ID
+ */
+bool valveSchedule_getRule(uint16_t id, valve_rule_info_t * info_p);
+
+/**
+ * @brief Copies the engine figures
+ * @param stats_p destination
+ */
+void valveSchedule_getStats(valve_schedule_stats_t * stats_p);
+
+/**
+ * @brief Times a wheel of random weekly timers
+ * @details on a wheel of its own, the schedules keep running
+ * @param timers up to VALVE_SCHEDULE_BENCH_MAX
+ * @param days simulated, up to VALVE_SCHEDULE_BENCH_MAX_DAYS
+ * @param result_p destination
+ * @return esp_err_t ESP_ERR_INVALID_ARG, ESP_ERR_NO_MEM
+ */
+esp_err_t valveSchedule_benchmark(uint32_t timers, uint32_t days, valve_schedule_bench_t * result_p);
+
+#endif /* MAIN_VALVESCHEDULE_H_ */
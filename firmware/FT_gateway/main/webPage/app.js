@@ -4,6 +4,9 @@
 var seconds 	= null;
 var otaTimerVar =  null;
 var wifiConnectInterval = null;
+var wifiScanTimer = null;
+var logInterval = null;
+var logSeq = 0;
 
 /**
  * Initialize functions here.
@@ -18,6 +21,13 @@ $(document).ready(function(){
 	$("#disconnect_wifi").on("click", function(){
 		disconnectWifi();
 	}); 
+	$("#scan_wifi").on("click", function(){
+		getWifiScan(true);
+	}); 
+	getWifiScan(false);
+	$("#stream_logs").on("click", function(){
+		toggleLogs();
+	}); 
 });
 
 // OTA FIRMWARE UPDATES //
@@ -197,9 +207,11 @@ function connectWifi()
 		method: 'POST',
 		cache: false,
 		data: JSON.stringify({ c_ssid: selectedSSID, c_pwd: pwd}),
+	}).done(function() {
+		startWifiConnectStatusInterval();
+	}).fail(function() {
+		document.getElementById("wifi_connect_status").innerHTML = "<h4 class='rd'>The gateway is busy, please try again</h4>";
 	});
-	
-	startWifiConnectStatusInterval();
 }
 
 /**
@@ -235,6 +247,34 @@ function checkCredentials()
 	}
 }
 
+/**
+ * Fills the SSID suggestions with the cached scan of the ESP32.
+ * The server never waits for the radio: while a scan is running the
+ * cached result is shown and the request is repeated shortly after.
+ */
+function getWifiScan(refresh)
+{
+	clearTimeout(wifiScanTimer);
+	$.getJSON('/wifiScan.json' + (refresh ? '?refresh=1' : ''), function(data)
+	{
+		$("#ssid_list").empty();
+		$.each(data["aps"], function(index, ap)
+		{
+			$("#ssid_list").append($("<option>").attr("value", ap["ssid"]).text(ap["rssi"] + " dBm, ch " + ap["ch"]));
+		});
+		
+		if (data["scanning"])
+		{
+			$("#wifi_scan_info").text("Scanning...");
+			wifiScanTimer = setTimeout(function(){ getWifiScan(false); }, 1500);
+		}
+		else if (data["age_ms"] >= 0)
+		{
+			$("#wifi_scan_info").text(data["aps"].length + " networks found " + Math.round(data["age_ms"] / 1000) + " s ago");
+		}
+	});
+}
+
 /**
  * Shows the WiFi password if the box is checked.
  */
@@ -309,4 +349,51 @@ function getLocalTime()
 	{
 		$("#local_time").text(data["time"]);
 	});
-}
\ No newline at end of file
+}
+
+/**************************
+**			LOGS	  	 **
+**************************/
+
+/**
+ * Starts or stops following the ESP32 log.
+ * The gateway only keeps the lines while they are being read.
+ */
+function toggleLogs()
+{
+	if (logInterval != null)
+	{
+		clearInterval(logInterval);
+		logInterval = null;
+		$("#stream_logs").val("Show Logs");
+		return;
+	}
+	$("#stream_logs").val("Hide Logs");
+	getLogs();
+	logInterval = setInterval(getLogs, 1000);
+}
+
+/**
+ * Appends the lines logged since the last request, keeps the last 200.
+ */
+function getLogs()
+{
+	$.ajax({
+		url: '/sys/log',
+		dataType: 'text',
+		cache: false,
+		data: { 'since': logSeq },
+		success: function(data, status, xhr)
+		{
+			logSeq = xhr.getResponseHeader("X-Log-Seq");
+			if (data.length == 0)
+			{
+				return;
+			}
+			var output = $("#log_output");
+			var lines = (output.text() + data).split("\n");
+			output.text(lines.slice(-201).join("\n"));
+			output.scrollTop(output[0].scrollHeight);
+		}
+	});
+}
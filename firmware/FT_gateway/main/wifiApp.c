@@ -13,6 +13,7 @@
 
 // C libraries
 #include <stdint.h>
+#include <string.h>
 
 // ESP libraries
 #include "esp_event.h"
@@ -31,14 +32,24 @@
 
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
+#include "driver/gpio.h"
+#include "freertos/timers.h"
 #include "lwip/netdb.h"
 #include "lwip/sockets.h"
 
 // Personal libraries
+#include "appEvents.h"
+#include "bootProfile.h"
 #include "wifiApp.h"
+#include "wifiChannel.h"
+#include "wifiNetworks.h"
+#include "wifiPower.h"
+#include "wifiScan.h"
 #include "httpServer.h"
 #include "ledRGB.h"
+#include "linkQuality.h"
 #include "tasks_common.h"
 
 
@@ -51,9 +62,6 @@
 // Tag used for ESP serial console messages
 static const char TAG[] = "wifi_app";
 
-// Wifi connected event callback
-static wifi_connected_event_callback_t wifi_connected_event_cb = NULL;
-
 // Alocating Station WiFi credencials
 char ssid[WIFI_SSID_LENGTH];
 char passwd[WIFI_PASSWORD_LENGTH];
@@ -61,6 +69,15 @@ char passwd[WIFI_PASSWORD_LENGTH];
 // Used for returning the WiFi configuration
 wifi_config_t wifi_config_v;
 
+// SoftAP configuration, kept to bring the AP back after it was shut down
+static wifi_config_t ap_config_v;
+
+// The SoftAP is up (WIFI_MODE_APSTA) or shut down (WIFI_MODE_STA)
+static volatile bool g_ap_enabled = true;
+
+// Last AP enable button press, used for debouncing
+static int64_t g_ap_button_last_us;
+
 // Used to track the number for retries when a connectiona attempt fails
 static uint8_t g_retry_number;
 
@@ -68,14 +85,51 @@ static uint8_t g_retry_number;
 esp_netif_t * esp_netif_sta = NULL;
 esp_netif_t * esp_netif_ap  = NULL;
 
-// Variable to check if the state Id is valid
-static uint8_t g_qtd_states;
+// Current connection state, changed only by the state machine handler
+static sm_wifi_conn_state_e g_conn_state = WIFI_CONN_IDLE;
+
+// One bit per event ID waiting on the queue, used to coalesce duplicates
+static uint32_t g_pending_mask;
+
+// Coalesced event IDs that found the queue full, the WiFi task queues them after a dispatch
+static uint32_t g_repost_mask;
+
+// Latest payload of each coalesced event, the dispatch takes it instead of the queued one
+static wifi_app_event_payload_t g_pending_payload[WIFI_APP_STATE_MAX];
+static portMUX_TYPE wifi_app_pending_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Queue counters and the sum used for the average dispatch latency
+static wifi_app_stats_t g_stats;
+static uint64_t g_latency_total_us;
+static portMUX_TYPE wifi_app_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// True while the station is allowed to fail over between saved networks
+static bool g_failover_enabled;
+
+// Rank and connect to the saved networks once the running scan is done
+static bool g_rank_after_scan;
+
+// Scan records and the cache copy used for ranking (too big for the task stack)
+static wifi_ap_record_t g_scan_records[WIFI_SCAN_MAX_RECORDS];
+static wifi_scan_entry_t g_scan_entries[WIFI_SCAN_MAX_RECORDS];
+
+// Timer that retries the saved networks after all of them failed
+static esp_timer_handle_t wifi_app_rescan_timer;
+
+// Timer that shuts the SoftAP down once the station is connected
+static esp_timer_handle_t wifi_app_ap_shutdown_timer;
 
 
 	/* FreeRTOS Structure */
 
 // Queue handle used to manipulate the main queue of events
 static QueueHandle_t wifi_app_queue_handle_t;
+#if CONFIG_GW_STATIC_ALLOCATION
+static StaticQueue_t wifi_app_queue_struct;
+static uint8_t wifi_app_queue_storage[WIFI_APP_QUEUE_LENGTH * sizeof(wifi_app_queue_message_t)];
+#endif
+
+TASK_STORAGE(wifiApp_task, WIFI_APP_TASK_STACK_SIZE)
 
 
 	/* Static Functions */
@@ -84,6 +138,23 @@ static QueueHandle_t wifi_app_queue_handle_t;
 static void WIFI_STATE_FUNC_NAME(WIFI_APP_START_HTTP_SERVER)(wifi_app_queue_message_t * st);
 static void WIFI_STATE_FUNC_NAME(WIFI_APP_CONNECTING_FROM_HTTP_SERVER)(wifi_app_queue_message_t * st);
 static void WIFI_STATE_FUNC_NAME(WIFI_APP_STA_CONNECTED_GOT_IP)(wifi_app_queue_message_t * st);
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_USER_REQUESTED_STA_DISCONNECT)(wifi_app_queue_message_t * st);
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_STA_DISCONNECTED)(wifi_app_queue_message_t * st);
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_CONNECT_SAVED_NETWORKS)(wifi_app_queue_message_t * st);
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_CONNECT_NEXT_NETWORK)(wifi_app_queue_message_t * st);
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_SCAN_START)(wifi_app_queue_message_t * st);
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_SCAN_DONE)(wifi_app_queue_message_t * st);
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_AP_SHUTDOWN_TIMEOUT)(wifi_app_queue_message_t * st);
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_AP_ENABLE)(wifi_app_queue_message_t * st);
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_STA_ASSOCIATED)(wifi_app_queue_message_t * st);
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_POWER_PROFILE)(wifi_app_queue_message_t * st);
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_POWER_MEASURE)(wifi_app_queue_message_t * st);
+static void wifiApp_powerProfile_apply(wifi_power_profile_e profile);
+static void wifiApp_rankAndConnect(void);
+static void wifiApp_apChannel_set(uint8_t channel);
+static void wifiApp_apChannel_pickFromScan(void);
+static void wifiApp_stateMachine_dispatch(wifi_app_queue_message_t * msg);
+static void wifiApp_repost(void);
 static void wifiApp_stateMachine_handler(wifi_app_queue_message_t * msg);
 
 // STA & AP FUNCTIONS
@@ -93,6 +164,12 @@ static void wifiApp_defaultWifi_init(void);
 static void wifiApp_softAP_config(void);
 static void wifiApp_sta_connect(void);
 static void wifiApp_sta_disconnectedLogInfo(void * eventData_p);
+static void wifiApp_rescan_timer_callback(void * arg);
+static void wifiApp_apShutdown_timer_callback(void * arg);
+static void wifiApp_apShutdown_arm(void);
+static void wifiApp_apButton_init(void);
+static void wifiApp_apButton_isr(void * arg);
+static void wifiApp_apButton_deferred(void * arg1, uint32_t arg2);
 
 // APP FUNCTIONS
 static void wifiApp_setup(void);
@@ -123,6 +200,26 @@ wifi_config_t * wifiApp_getWifiConfig(void)
 	return &wifi_config_v;
 }
 
+// Copies the WiFi application queue counters
+void wifiApp_getStats(wifi_app_stats_t * stats_p)
+{
+	taskENTER_CRITICAL(&wifi_app_stats_mux);
+	*stats_p = g_stats;
+	taskEXIT_CRITICAL(&wifi_app_stats_mux);
+}
+
+// Returns the current connection state
+sm_wifi_conn_state_e wifiApp_getConnState(void)
+{
+	return g_conn_state;
+}
+
+// Returns true while the SoftAP is up
+bool wifiApp_isSoftAPEnabled(void)
+{
+	return g_ap_enabled;
+}
+
 
 
 /**************************
@@ -144,12 +241,9 @@ static void wifiApp_setup(void)
 	
 	// SoftAP config
 	wifiApp_softAP_config();
-}
-
-// Sets the callback function
-void wifiApp_setCallback(wifi_connected_event_callback_t callbackFunction)
-{
-	 wifi_connected_event_cb = callbackFunction;
+	
+	// Button that brings the SoftAP back once it was shut down
+	wifiApp_apButton_init();
 }
 
 
@@ -168,8 +262,20 @@ static void WIFI_STATE_FUNC_NAME(WIFI_APP_START_HTTP_SERVER)(wifi_app_queue_mess
 {
 	ESP_LOGI(TAG, "%s", sm_wifi_app_state_names[WIFI_APP_START_HTTP_SERVER]);
 	
+	// Already listening since router_setup, unless it failed there
 	httpServer_start();
 	ledRGB_wifi_disconnected();
+	
+	// Try the saved networks right away
+	if (wifiNetworks_getCount() > 0)
+	{
+		wifiApp_sendMessage(WIFI_APP_CONNECT_SAVED_NETWORKS);
+	}
+	else
+	{
+		// No uplink to follow, the scan lets the SoftAP pick a quiet channel
+		wifiScan_request();
+	}
 }
 
 /**
@@ -182,14 +288,23 @@ static void WIFI_STATE_FUNC_NAME(WIFI_APP_CONNECTING_FROM_HTTP_SERVER)(wifi_app_
 {
 	ESP_LOGI(TAG, "%s", sm_wifi_app_state_names[WIFI_APP_CONNECTING_FROM_HTTP_SERVER]);
 	
+	// The user picked this network, don't jump to a saved one behind the user's back
+	g_failover_enabled = false;
+	esp_timer_stop(wifi_app_rescan_timer);
+	
+	// Credentials typed on the web page
+	memset(&wifi_config_v, 0x00, sizeof(wifi_config_t));
+	memcpy(wifi_config_v.sta.ssid, st->payload.credentials.ssid, strlen(st->payload.credentials.ssid));
+	memcpy(wifi_config_v.sta.password, st->payload.credentials.password, strlen(st->payload.credentials.password));
+	
 	// Attempt a connection
 	wifiApp_sta_connect();
 	
 	// Set current number of retries to zero
 	g_retry_number = 0;
 	
-	// Let the HTTP server know about the connection attempt
-	httpServer_monitor_sendMessage(HTTP_WIFI_CONNECT_INIT);
+	// Let the subscribers know about the connection attempt
+	appEvents_post(APP_EVENT_WIFI_CONNECTING, NULL, 0);
 }
 
 /**
@@ -200,16 +315,18 @@ static void WIFI_STATE_FUNC_NAME(WIFI_APP_CONNECTING_FROM_HTTP_SERVER)(wifi_app_
  */
 static void WIFI_STATE_FUNC_NAME(WIFI_APP_STA_CONNECTED_GOT_IP)(wifi_app_queue_message_t * st)
 {
-	ESP_LOGI(TAG, "%s", sm_wifi_app_state_names[WIFI_APP_STA_CONNECTED_GOT_IP]);
+	ESP_LOGI(TAG, "%s: " IPSTR, sm_wifi_app_state_names[WIFI_APP_STA_CONNECTED_GOT_IP], IP2STR(&st->payload.got_ip.ip));
 	
  	ledRGB_wifi_connected();
 	// displayOled_printHeaderNBody("CONNECTED!", "");
- 	httpServer_monitor_sendMessage(HTTP_WIFI_CONNECT_SUCCESS);
+	app_event_wifi_connected_t connected = { .ip = st->payload.got_ip.ip };
+	appEvents_post(APP_EVENT_WIFI_CONNECTED, &connected, sizeof(connected));
 	
-	if(wifi_connected_event_cb != NULL)
-	{
-		wifi_connected_event_cb();
-	}
+	// A later drop gets the full set of retries again
+	g_retry_number = 0;
+	
+	// The uplink is up, the SoftAP is no longer needed once nobody uses it
+	wifiApp_apShutdown_arm();
 }
 
 /**
@@ -225,6 +342,8 @@ static void WIFI_STATE_FUNC_NAME(WIFI_APP_USER_REQUESTED_STA_DISCONNECT)(wifi_ap
  	ledRGB_wifi_disconnect();
 	// so it doesn't try to reconnect when we hit the button disconnect
 	g_retry_number = MAX_CONNECTION_RETRIES;
+	g_failover_enabled = false;
+	esp_timer_stop(wifi_app_rescan_timer);
 	
  	ESP_ERROR_CHECK(esp_wifi_disconnect());
  	ledRGB_wifi_disconnected();
@@ -238,21 +357,409 @@ static void WIFI_STATE_FUNC_NAME(WIFI_APP_USER_REQUESTED_STA_DISCONNECT)(wifi_ap
  */
 static void WIFI_STATE_FUNC_NAME(WIFI_APP_STA_DISCONNECTED)(wifi_app_queue_message_t * st)
 {
-	ESP_LOGI(TAG, "%s", sm_wifi_app_state_names[WIFI_APP_STA_DISCONNECTED]);
+	ESP_LOGI(TAG, "%s: reason %d", sm_wifi_app_state_names[WIFI_APP_STA_DISCONNECTED], st->payload.disconnected.reason);
 	
  	ledRGB_wifi_disconnected();
- 	httpServer_monitor_sendMessage(HTTP_WIFI_CONNECT_FAIL);
+	app_event_wifi_connect_failed_t failed = { .reason = st->payload.disconnected.reason };
+	appEvents_post(APP_EVENT_WIFI_CONNECT_FAILED, &failed, sizeof(failed));
+}
+
+/**
+ * @brief State Machine Function Definition according to sm_wifi_app_function
+ * function that defines the behavior on
+ * [WIFI_APP_CONNECT_SAVED_NETWORKS] state
+ * @details starts a scan, the saved networks found are ranked and
+ * the best one is tried on [WIFI_APP_SCAN_DONE]
+ */
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_CONNECT_SAVED_NETWORKS)(wifi_app_queue_message_t * st)
+{
+	ESP_LOGI(TAG, "%s", sm_wifi_app_state_names[WIFI_APP_CONNECT_SAVED_NETWORKS]);
+	
+	g_failover_enabled = true;
+	g_rank_after_scan = true;
+	WIFI_STATE_FUNC_NAME(WIFI_APP_SCAN_START)(st);
+}
+
+/**
+ * @brief State Machine Function Definition according to sm_wifi_app_function
+ * function that defines the behavior on
+ * [WIFI_APP_CONNECT_NEXT_NETWORK] state
+ * @details tries the next ranked candidate, when all of them failed
+ * the saved networks are scanned again after WIFI_NETWORKS_RESCAN_DELAY_S
+ */
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_CONNECT_NEXT_NETWORK)(wifi_app_queue_message_t * st)
+{
+	ESP_LOGI(TAG, "%s", sm_wifi_app_state_names[WIFI_APP_CONNECT_NEXT_NETWORK]);
+	
+	if (wifiNetworks_nextCandidate(wifiApp_getWifiConfig()))
+	{
+		g_retry_number = 0;
+		ledRGB_wifi_reconnecting();
+		wifiApp_sta_connect();
+		appEvents_post(APP_EVENT_WIFI_CONNECTING, NULL, 0);
+	}
+	else
+	{
+		// Every candidate failed, keep the reason of the last disconnection
+		wifiApp_sendEvent(WIFI_APP_STA_DISCONNECTED, &st->payload);
+		esp_timer_stop(wifi_app_rescan_timer);
+		esp_timer_start_once(wifi_app_rescan_timer, WIFI_NETWORKS_RESCAN_DELAY_S * 1000000ULL);
+	}
+}
+
+/**
+ * @brief State Machine Function Definition according to sm_wifi_app_function
+ * function that defines the behavior on
+ * [WIFI_APP_SCAN_START] state
+ * @details the scan runs in background, WIFI_EVENT_SCAN_DONE brings
+ * the application to [WIFI_APP_SCAN_DONE]
+ */
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_SCAN_START)(wifi_app_queue_message_t * st)
+{
+	ESP_LOGI(TAG, "%s", sm_wifi_app_state_names[WIFI_APP_SCAN_START]);
+	
+	if (wifiScan_isRunning())
+	{
+		return;
+	}
+	
+	if (esp_wifi_scan_start(NULL, false) == ESP_OK)
+	{
+		wifiScan_setRunning(true);
+	}
+	else
+	{
+		// e.g. the station is busy connecting, keep the cached result
+		ESP_LOGW(TAG, "scan could not be started");
+		if (g_rank_after_scan)
+		{
+			wifiApp_rankAndConnect();
+		}
+	}
+}
+
+/**
+ * @brief State Machine Function Definition according to sm_wifi_app_function
+ * function that defines the behavior on
+ * [WIFI_APP_SCAN_DONE] state
+ * @details moves the driver records into the scan cache
+ */
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_SCAN_DONE)(wifi_app_queue_message_t * st)
+{
+	uint16_t count = WIFI_SCAN_MAX_RECORDS;
+	
+	ESP_LOGI(TAG, "%s", sm_wifi_app_state_names[WIFI_APP_SCAN_DONE]);
+	
+	if (esp_wifi_scan_get_ap_records(&count, g_scan_records) == ESP_OK)
+	{
+		wifiScan_store(g_scan_records, count);
+	}
+	else
+	{
+		// Releases the memory the driver allocated for the scan
+		esp_wifi_clear_ap_list();
+	}
+	wifiScan_setRunning(false);
+	
+	if (g_rank_after_scan)
+	{
+		// The SoftAP will follow the uplink channel once associated
+		wifiApp_rankAndConnect();
+	}
+	else if (g_conn_state == WIFI_CONN_IDLE || g_conn_state == WIFI_CONN_DISCONNECTED)
+	{
+		wifiApp_apChannel_pickFromScan();
+	}
+}
+
+/**
+ * @brief State Machine Function Definition according to sm_wifi_app_function
+ * function that defines the behavior on
+ * [WIFI_APP_AP_SHUTDOWN_TIMEOUT] state
+ * @details drops to STA only when the station is connected and the AP has
+ * no clients, otherwise checks again after WIFI_AP_SHUTDOWN_DELAY_S.
+ * Without the AP the radio stops beaconing and no longer shares airtime
+ * between the AP channel and the uplink.
+ */
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_AP_SHUTDOWN_TIMEOUT)(wifi_app_queue_message_t * st)
+{
+	wifi_sta_list_t sta_list;
+	
+	ESP_LOGI(TAG, "%s", sm_wifi_app_state_names[WIFI_APP_AP_SHUTDOWN_TIMEOUT]);
+	
+	if (!g_ap_enabled || g_conn_state != WIFI_CONN_CONNECTED)
+	{
+		return;
+	}
+	
+	if (esp_wifi_ap_get_sta_list(&sta_list) != ESP_OK || sta_list.num > 0)
+	{
+		ESP_LOGI(TAG, "SoftAP still in use, checking again later");
+		wifiApp_apShutdown_arm();
+		return;
+	}
+	
+	if (esp_wifi_set_mode(WIFI_MODE_STA) == ESP_OK)
+	{
+		g_ap_enabled = false;
+		wifiPower_setApEnabled(false);
+		ESP_LOGI(TAG, "SoftAP shut down, ~%d.%d%% of airtime no longer spent on beacons",
+						(WIFI_AP_BEACON_AIRTIME_US * 100) / (ap_config_v.ap.beacon_interval * 1024),
+						((WIFI_AP_BEACON_AIRTIME_US * 1000) / (ap_config_v.ap.beacon_interval * 1024)) % 10);
+	}
+}
+
+/**
+ * @brief State Machine Function Definition according to sm_wifi_app_function
+ * function that defines the behavior on
+ * [WIFI_APP_AP_ENABLE] state
+ * @details brings the SoftAP back (link loss or button), if the station is
+ * still connected the AP is shut down again after WIFI_AP_SHUTDOWN_DELAY_S
+ */
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_AP_ENABLE)(wifi_app_queue_message_t * st)
+{
+	ESP_LOGI(TAG, "%s", sm_wifi_app_state_names[WIFI_APP_AP_ENABLE]);
+	
+	if (!g_ap_enabled)
+	{
+		// A driver error here must not reboot the gateway, it stays in STA mode
+		esp_err_t err = esp_wifi_set_mode(WIFI_MODE_APSTA);
+		if (err == ESP_OK)
+		{
+			err = esp_wifi_set_config(ESP_IF_WIFI_AP, &ap_config_v);
+			if (err != ESP_OK)
+			{
+				esp_wifi_set_mode(WIFI_MODE_STA);
+			}
+		}
+		if (err != ESP_OK)
+		{
+			ESP_LOGE(TAG, "SoftAP not enabled: %s", esp_err_to_name(err));
+			return;
+		}
+		esp_wifi_set_bandwidth(WIFI_IF_AP, WIFI_AP_BANDWIDTH);
+		g_ap_enabled = true;
+		wifiPower_setApEnabled(true);
+	}
+	
+	if (g_conn_state == WIFI_CONN_CONNECTED)
+	{
+		wifiApp_apShutdown_arm();
+	}
+}
+
+/**
+ * @brief State Machine Function Definition according to sm_wifi_app_function
+ * function that defines the behavior on
+ * [WIFI_APP_STA_ASSOCIATED] state
+ * @details the ESP32 has a single radio, in APSTA mode the AP must sit on
+ * the uplink channel or the driver keeps hopping between both of them
+ */
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_STA_ASSOCIATED)(wifi_app_queue_message_t * st)
+{
+	ESP_LOGI(TAG, "%s: channel %d", sm_wifi_app_state_names[WIFI_APP_STA_ASSOCIATED], st->payload.associated.channel);
+	
+	wifiApp_apChannel_set(st->payload.associated.channel);
+}
+
+/**
+ * @brief State Machine Function Definition according to sm_wifi_app_function
+ * function that defines the behavior on
+ * [WIFI_APP_POWER_PROFILE] state
+ * @details the listen interval only changes on the next association
+ */
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_POWER_PROFILE)(wifi_app_queue_message_t * st)
+{
+	ESP_LOGI(TAG, "%s", sm_wifi_app_state_names[WIFI_APP_POWER_PROFILE]);
+	
+	if (!wifiPower_isMeasuring())
+	{
+		wifiApp_powerProfile_apply(wifiPower_getProfile());
+	}
 }
 
+/**
+ * @brief State Machine Function Definition according to sm_wifi_app_function
+ * function that defines the behavior on
+ * [WIFI_APP_POWER_MEASURE] state
+ * @details one step of the measurement sweep, applies the next profile and
+ * pings the gateway under it. The selected profile is restored at the end.
+ */
+static void WIFI_STATE_FUNC_NAME(WIFI_APP_POWER_MEASURE)(wifi_app_queue_message_t * st)
+{
+	wifi_power_profile_e profile;
+	esp_netif_ip_info_t ip_info;
+	
+	ESP_LOGI(TAG, "%s", sm_wifi_app_state_names[WIFI_APP_POWER_MEASURE]);
+	
+	if (g_conn_state != WIFI_CONN_CONNECTED || esp_netif_get_ip_info(esp_netif_sta, &ip_info) != ESP_OK)
+	{
+		ESP_LOGW(TAG, "Power measurement aborted, the station is not connected");
+		wifiPower_measureAbort();
+	}
+	else if (wifiPower_measureNext(&profile))
+	{
+		wifiApp_powerProfile_apply(profile);
+		if (wifiPower_measurePing(&ip_info.gw) == ESP_OK)
+		{
+			return;
+		}
+	}
+	
+	wifiApp_powerProfile_apply(wifiPower_getProfile());
+}
 
-// State Machine Table Functions - to be used in the loop
-sm_wifi_table_fn_t sm_wifi_state_table[] =
+/**
+ * @brief Applies a power profile and pushes the new beacon interval to the SoftAP
+ * @details
+ * @param profile
+ */
+static void wifiApp_powerProfile_apply(wifi_power_profile_e profile)
 {
-#define X(ID, ENUM) { WIFI_STATE_FUNC_NAME(ENUM) }, 
+	wifiPower_apply(profile, &ap_config_v.ap);
+	
+	// A shut down AP picks it up on [WIFI_APP_AP_ENABLE]
+	if (g_ap_enabled && esp_wifi_set_config(ESP_IF_WIFI_AP, &ap_config_v) != ESP_OK)
+	{
+		ESP_LOGW(TAG, "SoftAP beacon interval not updated");
+	}
+}
+
+/**
+ * @brief Moves the SoftAP to a new channel and saves it on NVS
+ * @details the clients are warned by WIFI_AP_CSA_COUNT beacons carrying a
+ * Channel Switch Announcement, so they follow instead of reassociating
+ * @param channel
+ */
+static void wifiApp_apChannel_set(uint8_t channel)
+{
+	esp_err_t err;
+	
+	if (channel < WIFI_CHANNEL_MIN || channel > WIFI_CHANNEL_MAX || channel == ap_config_v.ap.channel)
+	{
+		return;
+	}
+	
+	ESP_LOGI(TAG, "SoftAP channel %d -> %d", ap_config_v.ap.channel, channel);
+	ap_config_v.ap.channel = channel;
+	ap_config_v.ap.csa_count = WIFI_AP_CSA_COUNT;
+	
+	// A shut down AP picks the new channel up on [WIFI_APP_AP_ENABLE]
+	if (g_ap_enabled)
+	{
+		err = esp_wifi_set_config(ESP_IF_WIFI_AP, &ap_config_v);
+		if (err != ESP_OK)
+		{
+			ESP_LOGW(TAG, "SoftAP channel change failed (%s)", esp_err_to_name(err));
+		}
+	}
+	
+	wifiChannel_save(channel);
+}
+
+/**
+ * @brief Moves the SoftAP to the least congested channel of the scan cache
+ * @details only while nobody is connected to the AP, a phone on the config
+ * page would be dropped for nothing
+ */
+static void wifiApp_apChannel_pickFromScan(void)
+{
+	wifi_sta_list_t sta_list;
+	uint16_t count = wifiScan_get(g_scan_entries, NULL);
+	
+	if (!g_ap_enabled || count == 0)
+	{
+		return;
+	}
+	
+	if (esp_wifi_ap_get_sta_list(&sta_list) != ESP_OK || sta_list.num > 0)
+	{
+		return;
+	}
+	
+	wifiApp_apChannel_set(wifiChannel_leastCongested(g_scan_entries, count));
+}
+
+/**
+ * @brief Ranks the saved networks present on the scan cache and tries the best one
+ * @details
+ */
+static void wifiApp_rankAndConnect(void)
+{
+	uint16_t count = wifiScan_get(g_scan_entries, NULL);
+	
+	g_rank_after_scan = false;
+	wifiNetworks_rank(g_scan_entries, count);
+	wifiApp_sendMessage(WIFI_APP_CONNECT_NEXT_NETWORK);
+}
+
+
+// State Machine Table Functions and transitions - to be used in the loop
+static const sm_wifi_table_fn_t sm_wifi_state_table[WIFI_APP_STATE_MAX] =
+{
+#define X(ID, ENUM, ACCEPTED, NEXT, COALESCE) \
+	[ENUM] = { WIFI_STATE_FUNC_NAME(ENUM), ACCEPTED, NEXT, COALESCE },
 	X_MACRO_WIFI_STATE_LIST
 #undef X
 };
 
+/**
+ * @brief Runs one event through the transition table
+ * @details
+ * @param msg 
+ */
+static void wifiApp_stateMachine_dispatch(wifi_app_queue_message_t * msg)
+{
+	const sm_wifi_table_fn_t * entry_p = &sm_wifi_state_table[msg->wifiApp_state];
+	int64_t start_us = esp_timer_get_time();
+	uint32_t latency_us = start_us - msg->timestamp_us;
+	uint32_t depth = uxQueueMessagesWaiting(wifi_app_queue_handle_t) + 1;
+	
+	// A new event of this ID may be queued from now on, the payload is the latest one sent
+	if (entry_p->coalesce)
+	{
+		taskENTER_CRITICAL(&wifi_app_pending_mux);
+		g_pending_mask &= ~(1U << msg->wifiApp_state);
+		msg->payload = g_pending_payload[msg->wifiApp_state];
+		taskEXIT_CRITICAL(&wifi_app_pending_mux);
+	}
+	
+	if ((entry_p->accepted & WIFI_CONN_MASK(g_conn_state)) == 0)
+	{
+		ESP_LOGW(TAG, "%s ignored on state %d", sm_wifi_app_state_names[msg->wifiApp_state], g_conn_state);
+		taskENTER_CRITICAL(&wifi_app_stats_mux);
+		g_stats.rejected++;
+		taskEXIT_CRITICAL(&wifi_app_stats_mux);
+		return;
+	}
+	
+	if (entry_p->next != WIFI_CONN_KEEP)
+	{
+		g_conn_state = entry_p->next;
+	}
+	entry_p->func(msg);
+	
+	uint32_t handler_us = esp_timer_get_time() - start_us;
+	
+	taskENTER_CRITICAL(&wifi_app_stats_mux);
+	g_stats.dispatched++;
+	g_latency_total_us += latency_us;
+	g_stats.latency_avg_us = g_latency_total_us / g_stats.dispatched;
+	if (latency_us > g_stats.latency_max_us)
+	{
+		g_stats.latency_max_us = latency_us;
+	}
+	if (handler_us > g_stats.handler_max_us)
+	{
+		g_stats.handler_max_us = handler_us;
+	}
+	if (depth > g_stats.queue_depth_max)
+	{
+		g_stats.queue_depth_max = depth;
+	}
+	taskEXIT_CRITICAL(&wifi_app_stats_mux);
+}
+
 /**
  * @brief WiFiApp State Machine Handler
  * @details
@@ -260,22 +767,56 @@ sm_wifi_table_fn_t sm_wifi_state_table[] =
  */
 static void wifiApp_stateMachine_handler(wifi_app_queue_message_t * msg)
 {
-	g_qtd_states = 0;
-	#define X(ID, ENUM) g_qtd_states++; 
-		X_MACRO_WIFI_STATE_LIST
-	#undef X
-	
 	for (;;)
 	{
 		if (xQueueReceive(wifi_app_queue_handle_t, msg, portMAX_DELAY))
 		{
-			if(msg->wifiApp_state < g_qtd_states) {
-				sm_wifi_state_table[msg->wifiApp_state].func(msg);
+			if(msg->wifiApp_state < WIFI_APP_STATE_MAX) {
+				wifiApp_stateMachine_dispatch(msg);
 			}
+			wifiApp_repost();
 		}
 	}
 }
 
+/**
+ * @brief Queues the coalesced events that found the queue full
+ * @details their pending bit stayed set, so later senders coalesced on them
+ * and the payload is the latest. What still doesn't fit waits for the next
+ * dispatch.
+ */
+static void wifiApp_repost(void)
+{
+	wifi_app_queue_message_t msg;
+	uint32_t repost;
+
+	taskENTER_CRITICAL(&wifi_app_pending_mux);
+	repost = g_repost_mask;
+	taskEXIT_CRITICAL(&wifi_app_pending_mux);
+
+	while (repost != 0)
+	{
+		sm_wifi_app_state_e msgId = __builtin_ctz(repost);
+
+		repost &= repost - 1;
+		msg.wifiApp_state = msgId;
+		msg.timestamp_us = esp_timer_get_time();
+		// The dispatch takes the pending payload
+		memset(&msg.payload, 0x00, sizeof(msg.payload));
+		if (xQueueSend(wifi_app_queue_handle_t, &msg, 0) != pdTRUE)
+		{
+			return;
+		}
+
+		taskENTER_CRITICAL(&wifi_app_pending_mux);
+		g_repost_mask &= ~(1U << msgId);
+		taskEXIT_CRITICAL(&wifi_app_pending_mux);
+		taskENTER_CRITICAL(&wifi_app_stats_mux);
+		g_stats.sent++;
+		taskEXIT_CRITICAL(&wifi_app_stats_mux);
+	}
+}
+
 
 
 /**************************
@@ -298,6 +839,7 @@ static void wifiApp_task(void * pvParameters)
 	
 	// Start WiFi
 	ESP_ERROR_CHECK(esp_wifi_start());
+	bootProfile_mark(BOOT_MARKER_WIFI_STARTED);
 	
 	// Send first event message
 	wifiApp_sendMessage(WIFI_APP_START_HTTP_SERVER);
@@ -305,17 +847,89 @@ static void wifiApp_task(void * pvParameters)
 	wifiApp_stateMachine_handler(&msg);
 }
 
-// Sends a message to the queue
-// @param msgId message ID from the wifi_app_message_e enum
-// @return pdTRUE if an item was successfully sent to the queue, otherwise pdFALSE
-/**
- * \todo colocar um enum status pra indicar falha ou sucesso
- */
+// Sends a message without payload to the queue
 BaseType_t wifiApp_sendMessage(sm_wifi_app_state_e msgId)
+{
+	return wifiApp_sendEvent(msgId, NULL);
+}
+
+// Sends a message with payload to the queue
+BaseType_t wifiApp_sendEvent(sm_wifi_app_state_e msgId, const wifi_app_event_payload_t * payload_p)
 {
 	wifi_app_queue_message_t msg;
+	uint32_t bit = 1U << msgId;
+	bool coalesce;
+	bool pending = false;
+	BaseType_t sent;
+	
+	if (msgId >= WIFI_APP_STATE_MAX || wifi_app_queue_handle_t == NULL)
+	{
+		return pdFALSE;
+	}
+	coalesce = sm_wifi_state_table[msgId].coalesce;
+	
 	msg.wifiApp_state = msgId;
-	return xQueueGenericSend(wifi_app_queue_handle_t, &msg, portMAX_DELAY, queueSEND_TO_BACK );
+	msg.timestamp_us = esp_timer_get_time();
+	if (payload_p != NULL)
+	{
+		msg.payload = *payload_p;
+	}
+	else
+	{
+		memset(&msg.payload, 0x00, sizeof(msg.payload));
+	}
+	
+	if (coalesce)
+	{
+		taskENTER_CRITICAL(&wifi_app_pending_mux);
+		pending = (g_pending_mask & bit) != 0;
+		g_pending_mask |= bit;
+		g_pending_payload[msgId] = msg.payload;
+		taskEXIT_CRITICAL(&wifi_app_pending_mux);
+	}
+	
+	// The same event is already waiting, it is handled with this payload
+	if (pending)
+	{
+		taskENTER_CRITICAL(&wifi_app_stats_mux);
+		g_stats.coalesced++;
+		taskEXIT_CRITICAL(&wifi_app_stats_mux);
+		return pdTRUE;
+	}
+	
+	// Never block, this runs on the esp_event loop and on timer callbacks
+	sent = xQueueSend(wifi_app_queue_handle_t, &msg, 0);
+	
+	if (sent != pdTRUE && coalesce)
+	{
+		// The bit stays set, senders coalesce meanwhile and the WiFi task queues it
+		// after its next dispatch. The queue is full, so one is coming.
+		taskENTER_CRITICAL(&wifi_app_pending_mux);
+		g_repost_mask |= bit;
+		taskEXIT_CRITICAL(&wifi_app_pending_mux);
+		taskENTER_CRITICAL(&wifi_app_stats_mux);
+		g_stats.deferred++;
+		taskEXIT_CRITICAL(&wifi_app_stats_mux);
+		ESP_LOGW(TAG, "queue full, %s deferred", sm_wifi_app_state_names[msgId]);
+		return pdTRUE;
+	}
+	
+	taskENTER_CRITICAL(&wifi_app_stats_mux);
+	if (sent == pdTRUE)
+	{
+		g_stats.sent++;
+	}
+	else
+	{
+		g_stats.dropped++;
+	}
+	taskEXIT_CRITICAL(&wifi_app_stats_mux);
+	
+	if (sent != pdTRUE)
+	{
+		ESP_LOGE(TAG, "queue full, %s dropped", sm_wifi_app_state_names[msgId]);
+	}
+	return sent;
 }
 
 // Starts the WiFi RTOS task
@@ -332,17 +946,46 @@ void wifiApp_start(void)
 	// Clearing memory for the WiFi configuration
 	memset(&wifi_config_v, 0x00, sizeof(wifi_config_t)); 
 	
+	// Load the saved networks and power profile
+	wifiNetworks_init();
+	wifiPower_init();
+	
+	// Initializes the TCP stack here, the HTTP server can listen before the WiFi task is done
+	ESP_ERROR_CHECK(esp_netif_init());
+	
+	// Timer used to scan the saved networks again after all of them failed
+	const esp_timer_create_args_t rescan_timer_args = {
+		.callback = &wifiApp_rescan_timer_callback,
+		.arg = NULL,
+		.dispatch_method = ESP_TIMER_TASK,
+		.name = "wifi_rescan"
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&rescan_timer_args, &wifi_app_rescan_timer));
+	
+	// Timer used to shut the SoftAP down after the station got an IP
+	const esp_timer_create_args_t ap_shutdown_timer_args = {
+		.callback = &wifiApp_apShutdown_timer_callback,
+		.arg = NULL,
+		.dispatch_method = ESP_TIMER_TASK,
+		.name = "wifi_ap_shutdown"
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&ap_shutdown_timer_args, &wifi_app_ap_shutdown_timer));
+	
 	// Create message queue
-	wifi_app_queue_handle_t = xQueueCreate(3, sizeof(wifi_app_queue_message_t));
+#if CONFIG_GW_STATIC_ALLOCATION
+	wifi_app_queue_handle_t = xQueueCreateStatic(WIFI_APP_QUEUE_LENGTH, sizeof(wifi_app_queue_message_t),
+													wifi_app_queue_storage, &wifi_app_queue_struct);
+#else
+	wifi_app_queue_handle_t = xQueueCreate(WIFI_APP_QUEUE_LENGTH, sizeof(wifi_app_queue_message_t));
+#endif
 	
 	// Start the WiFi application task
-	xTaskCreatePinnedToCore(	&wifiApp_task,
-								"wifiApp_task",
-								WIFI_APP_TASK_STACK_SIZE,
-								NULL,
-								WIFI_APP_TASK_PRIORITY,
-								NULL,
-								WIFI_APP_TASK_CORE_ID);
+	TASK_CREATE(	wifiApp_task,
+					&wifiApp_task,
+					WIFI_APP_TASK_STACK_SIZE,
+					WIFI_APP_TASK_PRIORITY,
+					NULL,
+					WIFI_APP_TASK_CORE_ID);
 							
 }
 
@@ -368,6 +1011,7 @@ void wifiApp_start(void)
 		 {
 			 case WIFI_EVENT_AP_START:
 			 	ESP_LOGI(TAG, "WIFI_EVENT_AP_START");
+			 	bootProfile_mark(BOOT_MARKER_AP_STARTED);
 				// displayOled_printAccessPoint();
 			 	break;
 				
@@ -388,6 +1032,16 @@ void wifiApp_start(void)
 			 	ESP_LOGI(TAG, "WIFI_EVENT_AP_PROBEREQRECVED");
 			 	break;
 				
+			 case WIFI_EVENT_SCAN_DONE:
+			 	ESP_LOGI(TAG, "WIFI_EVENT_SCAN_DONE");
+			 	if (wifiApp_sendMessage(WIFI_APP_SCAN_DONE) != pdTRUE)
+			 	{
+			 		// The records are lost, free them and let the next request scan again
+			 		esp_wifi_clear_ap_list();
+			 		wifiScan_setRunning(false);
+			 	}
+			 	break;
+				
 			 case WIFI_EVENT_STA_START:
 			 	ESP_LOGI(TAG, "WIFI_EVENT_STA_START");
 			 	break;
@@ -397,21 +1051,40 @@ void wifiApp_start(void)
 			 	break;
 				
 			 case WIFI_EVENT_STA_CONNECTED:
+			 {
 			 	ESP_LOGI(TAG, "WIFI_EVENT_STA_CONNECTED");
+			 	wifi_event_sta_connected_t * connected_p = (wifi_event_sta_connected_t *)eventData_p;
+			 	wifi_app_event_payload_t payload = { .associated.channel = connected_p->channel };
+			 	wifiApp_sendEvent(WIFI_APP_STA_ASSOCIATED, &payload);
 			 	break;
+			 }
 				
 			 case WIFI_EVENT_STA_DISCONNECTED:
 			 	ESP_LOGI(TAG, "WIFI_EVENT_STA_DISCONNECTED");
 			 	wifiApp_sta_disconnectedLogInfo(eventData_p);
+			 	
+			 	// The uplink is gone, the SoftAP must be reachable again
+			 	esp_timer_stop(wifi_app_ap_shutdown_timer);
+			 	if (!g_ap_enabled)
+			 	{
+			 		wifiApp_sendMessage(WIFI_APP_AP_ENABLE);
+			 	}
     
 			    if( g_retry_number < MAX_CONNECTION_RETRIES)
 			    {
+					ledRGB_wifi_reconnecting();
 					esp_wifi_connect();
 					g_retry_number++;
 				}
 			    else
 				{
-					wifiApp_sendMessage(WIFI_APP_STA_DISCONNECTED);
+					wifi_app_event_payload_t payload = {
+						.disconnected = {
+							.reason	= ((wifi_event_sta_disconnected_t *)eventData_p)->reason,
+							.rssi	= ((wifi_event_sta_disconnected_t *)eventData_p)->rssi,
+						},
+					};
+					wifiApp_sendEvent(g_failover_enabled ? WIFI_APP_CONNECT_NEXT_NETWORK : WIFI_APP_STA_DISCONNECTED, &payload);
 				}
 			 	break;
 		 }
@@ -422,8 +1095,12 @@ void wifiApp_start(void)
 		 {
 			 case IP_EVENT_STA_GOT_IP:
 			 	ESP_LOGI(TAG, "IP_EVENT_STA_GOT_IP");
+			 	bootProfile_mark(BOOT_MARKER_STA_GOT_IP);
 			 	
-			 	wifiApp_sendMessage(WIFI_APP_STA_CONNECTED_GOT_IP);
+			 	wifi_app_event_payload_t payload = {
+			 		.got_ip = ((ip_event_got_ip_t *)eventData_p)->ip_info,
+			 	};
+			 	wifiApp_sendEvent(WIFI_APP_STA_CONNECTED_GOT_IP, &payload);
 			 	
 			 	break;
 		 }
@@ -436,8 +1113,7 @@ void wifiApp_start(void)
  */
 static void wifiApp_eventHandler_init(void)
 {
-	// Event loop for the WiFi driver
-	ESP_ERROR_CHECK(esp_event_loop_create_default());
+	// The default event loop is created on boot by appEvents_init
 	
 	// Event handler for the connection
 	esp_event_handler_instance_t instance_wifi_event;
@@ -459,10 +1135,7 @@ static void wifiApp_eventHandler_init(void)
  */
 static void wifiApp_defaultWifi_init(void)
 {
-	// Initializes the TCP stack
-	ESP_ERROR_CHECK(esp_netif_init());
-	
-	// Default Wifi config - operations must be in this order!
+	// Default Wifi config, the TCP stack was initialized by wifiApp_start - operations must be in this order!
 	wifi_init_config_t wifi_init_config = WIFI_INIT_CONFIG_DEFAULT();
 	ESP_ERROR_CHECK(esp_wifi_init(&wifi_init_config));
 	ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
@@ -478,13 +1151,13 @@ static void wifiApp_defaultWifi_init(void)
 static void wifiApp_softAP_config(void)
 {
 	// SoftAP - WiFi access point configuration
-	wifi_config_t ap_config =
+	const wifi_config_t ap_config =
 	{
 		.ap = {
 			.ssid 			= 	WIFI_AP_SSID,
 			.ssid_len 		=	strlen(WIFI_AP_SSID),
 			.password 		=	WIFI_AP_PASSWORD,
-			.channel 		=	WIFI_AP_CHANNEL,
+			.channel 		=	wifiChannel_load(),
 			.ssid_hidden	=	WIFI_AP_SSID_HIDDEN,
 			.authmode		=	WIFI_AUTH_WPA2_PSK,
 			.max_connection	=	WIFI_AP_MAX_CONNECTIONS,
@@ -510,11 +1183,16 @@ static void wifiApp_softAP_config(void)
 	// Start the AP DHCP server (for connecting stations e.g. your mobile device)
 	ESP_ERROR_CHECK(esp_netif_dhcps_start(esp_netif_ap));
 	
+	// Kept to restore the AP after it was shut down
+	ap_config_v = ap_config;
+	
+	// Power save, DFS, light sleep and beacon interval of the saved profile
+	wifiPower_apply(wifiPower_getProfile(), &ap_config_v.ap);
+	
 	// Setting the mode as Access Point / Station Mode
 	ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_APSTA));
-	ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_AP, &ap_config));	///> set configuration
+	ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_AP, &ap_config_v));	///> set configuration
 	ESP_ERROR_CHECK(esp_wifi_set_bandwidth(WIFI_IF_AP, WIFI_AP_BANDWIDTH));	///> default bandwidth 20 MHz
-	ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_STA_POWER_SAVE));						///> power save set to "none"
 }
 
 /**
@@ -523,6 +1201,7 @@ static void wifiApp_softAP_config(void)
  */
 static void wifiApp_sta_connect(void)
 {
+	wifiApp_getWifiConfig()->sta.listen_interval = wifiPower_getListenInterval();
 	ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, wifiApp_getWifiConfig()));
 	ESP_ERROR_CHECK(esp_wifi_connect());
 }
@@ -536,4 +1215,99 @@ static void wifiApp_sta_disconnectedLogInfo(void * eventData_p)
 {
 	wifi_event_sta_disconnected_t *wifi_event = (wifi_event_sta_disconnected_t *)eventData_p;
     ESP_LOGI(TAG, "WiFi disconnected, reason: %d", wifi_event->reason);
-}
\ No newline at end of file
+    linkQuality_recordDisconnect(wifi_event->reason);
+}
+
+/**
+ * @brief Timer callback that scans the saved networks again
+ * @details
+ * @param arg 
+ */
+static void wifiApp_rescan_timer_callback(void * arg)
+{
+	if (g_failover_enabled)
+	{
+		wifiApp_sendMessage(WIFI_APP_CONNECT_SAVED_NETWORKS);
+	}
+}
+
+/**
+ * @brief Timer callback that asks the WiFi application to shut the SoftAP down
+ * @details
+ * @param arg 
+ */
+static void wifiApp_apShutdown_timer_callback(void * arg)
+{
+	wifiApp_sendMessage(WIFI_APP_AP_SHUTDOWN_TIMEOUT);
+}
+
+/**
+ * @brief (Re)starts the SoftAP shutdown timer
+ * @details does nothing when WIFI_AP_SHUTDOWN_DELAY_S is 0
+ */
+static void wifiApp_apShutdown_arm(void)
+{
+#if WIFI_AP_SHUTDOWN_DELAY_S > 0
+	esp_timer_stop(wifi_app_ap_shutdown_timer);
+	esp_timer_start_once(wifi_app_ap_shutdown_timer, WIFI_AP_SHUTDOWN_DELAY_S * 1000000ULL);
+#endif
+}
+
+/**
+ * @brief Configures the button that brings the SoftAP back
+ * @details
+ */
+static void wifiApp_apButton_init(void)
+{
+#if WIFI_AP_ENABLE_BUTTON_GPIO >= 0
+	gpio_config_t button_config = {
+		.pin_bit_mask	= 1ULL << WIFI_AP_ENABLE_BUTTON_GPIO,
+		.mode			= GPIO_MODE_INPUT,
+		.pull_up_en		= WIFI_AP_ENABLE_BUTTON_LEVEL ? GPIO_PULLUP_DISABLE : GPIO_PULLUP_ENABLE,
+		.pull_down_en	= WIFI_AP_ENABLE_BUTTON_LEVEL ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE,
+		.intr_type		= WIFI_AP_ENABLE_BUTTON_LEVEL ? GPIO_INTR_POSEDGE : GPIO_INTR_NEGEDGE,
+	};
+	ESP_ERROR_CHECK(gpio_config(&button_config));
+	
+	// The service may already be installed by another module
+	esp_err_t err = gpio_install_isr_service(0);
+	if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+	{
+		ESP_ERROR_CHECK(err);
+	}
+	ESP_ERROR_CHECK(gpio_isr_handler_add(WIFI_AP_ENABLE_BUTTON_GPIO, &wifiApp_apButton_isr, NULL));
+#endif
+}
+
+/**
+ * @brief AP enable button ISR
+ * @details wifiApp_sendMessage lives in flash, logs and uses the task API of the
+ * queue, so the event is sent from the timer service task
+ * @param arg 
+ */
+static void IRAM_ATTR wifiApp_apButton_isr(void * arg)
+{
+	BaseType_t higher_priority_task_woken = pdFALSE;
+	int64_t now_us = esp_timer_get_time();
+	
+	if (now_us - g_ap_button_last_us < WIFI_AP_ENABLE_BUTTON_DEBOUNCE_MS * 1000LL)
+	{
+		return;
+	}
+	g_ap_button_last_us = now_us;
+	
+	xTimerPendFunctionCallFromISR(&wifiApp_apButton_deferred, NULL, 0, &higher_priority_task_woken);
+	portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+/**
+ * @brief Runs on the timer service task after the AP enable button was pressed
+ * @details
+ * @param arg1 
+ * @param arg2 
+ */
+static void wifiApp_apButton_deferred(void * arg1, uint32_t arg2)
+{
+	ESP_LOGI(TAG, "AP enable button pressed");
+	wifiApp_sendMessage(WIFI_APP_AP_ENABLE);
+}
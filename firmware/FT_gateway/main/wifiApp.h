@@ -14,9 +14,14 @@
 **		  INCLUDES	 	 **
 **************************/
 
+// C libraries
+#include <stdbool.h>
+#include <stdint.h>
+
 // ESP libraries
 #include "esp_netif.h"
 #include "esp_wifi_types_generic.h"
+#include "freertos/FreeRTOS.h"
 #include "freertos/portmacro.h"
 
 // Personal libraries
@@ -34,17 +39,56 @@
  */
 #define WIFI_STATE_FUNC_NAME(state) wifiApp_sm_ ## state ## _fn
 
+/**
+ * @brief Depth of the WiFi application queue
+ * @details duplicated events are coalesced, so this only has to hold distinct ones
+ */
+#define WIFI_APP_QUEUE_LENGTH	8
+
+/**
+ * @brief Connection states of the WiFi application
+ * @details
+ */
+#define X_MACRO_WIFI_CONN_STATE_LIST	\
+	X(0, WIFI_CONN_IDLE			) \
+	X(1, WIFI_CONN_CONNECTING	) \
+	X(2, WIFI_CONN_CONNECTED	) \
+	X(3, WIFI_CONN_DISCONNECTED	)
+
+/**
+ * @brief Masks of connection states used on the transition table
+ * @details
+ */
+#define WIFI_CONN_MASK(state)	(1U << (state))
+#define WIFI_CONN_ANY			0xFFU
+#define WIFI_CONN_OFFLINE		(WIFI_CONN_MASK(WIFI_CONN_IDLE) | WIFI_CONN_MASK(WIFI_CONN_DISCONNECTED))
+#define WIFI_CONN_ACTIVE		(WIFI_CONN_MASK(WIFI_CONN_CONNECTING) | WIFI_CONN_MASK(WIFI_CONN_CONNECTED))
+
 /**
  * @brief List used to create all the structures for the WiFi state machine
  * based on X definition
  * @details
+ * Each line is one event of the WiFi application and its transition:
+ * - ACCEPTED: mask of connection states the event is handled in, it's dropped otherwise
+ * - NEXT: connection state after the event is handled (WIFI_CONN_KEEP = unchanged)
+ * - COALESCE: an event already waiting on the queue absorbs new ones of the same ID
  */
-#define X_MACRO_WIFI_STATE_LIST 				\
-	X(0, WIFI_APP_START_HTTP_SERVER				) \
-	X(1, WIFI_APP_CONNECTING_FROM_HTTP_SERVER	) \
-	X(2, WIFI_APP_STA_CONNECTED_GOT_IP			) \
-	X(3, WIFI_APP_USER_REQUESTED_STA_DISCONNECT	) \
-	X(4, WIFI_APP_STA_DISCONNECTED				) 
+#define X_MACRO_WIFI_STATE_LIST 																		\
+	/*ID, EVENT,									ACCEPTED,			NEXT,					COALESCE */	\
+	X(0, WIFI_APP_START_HTTP_SERVER,				WIFI_CONN_ANY,		WIFI_CONN_IDLE,			true	) \
+	X(1, WIFI_APP_CONNECTING_FROM_HTTP_SERVER,		WIFI_CONN_ANY,		WIFI_CONN_CONNECTING,	false	) \
+	X(2, WIFI_APP_STA_CONNECTED_GOT_IP,				WIFI_CONN_ANY,		WIFI_CONN_CONNECTED,	true	) \
+	X(3, WIFI_APP_USER_REQUESTED_STA_DISCONNECT,	WIFI_CONN_ANY,		WIFI_CONN_IDLE,			true	) \
+	X(4, WIFI_APP_STA_DISCONNECTED,					WIFI_CONN_ANY,		WIFI_CONN_DISCONNECTED,	true	) \
+	X(5, WIFI_APP_CONNECT_SAVED_NETWORKS,			WIFI_CONN_OFFLINE,	WIFI_CONN_CONNECTING,	true	) \
+	X(6, WIFI_APP_CONNECT_NEXT_NETWORK,				WIFI_CONN_ACTIVE,	WIFI_CONN_CONNECTING,	true	) \
+	X(7, WIFI_APP_SCAN_START,						WIFI_CONN_ANY,		WIFI_CONN_KEEP,			true	) \
+	X(8, WIFI_APP_SCAN_DONE,						WIFI_CONN_ANY,		WIFI_CONN_KEEP,			true	) \
+	X(9, WIFI_APP_AP_SHUTDOWN_TIMEOUT,				WIFI_CONN_ANY,		WIFI_CONN_KEEP,			true	) \
+	X(10, WIFI_APP_AP_ENABLE,						WIFI_CONN_ANY,		WIFI_CONN_KEEP,			true	) \
+	X(11, WIFI_APP_STA_ASSOCIATED,					WIFI_CONN_ANY,		WIFI_CONN_KEEP,			false	) \
+	X(12, WIFI_APP_POWER_PROFILE,					WIFI_CONN_ANY,		WIFI_CONN_KEEP,			true	) \
+	X(13, WIFI_APP_POWER_MEASURE,					WIFI_CONN_ANY,		WIFI_CONN_KEEP,			true	)
 
 
 
@@ -53,10 +97,16 @@
 **************************/
 
 /**
- * @brief Wifi callback function type
+ * @brief Connection states of the WiFi application
  * @details
  */
-typedef void(*wifi_connected_event_callback_t)(void);
+typedef enum
+{
+	#define X(ID, ENUM) ENUM=ID,
+		X_MACRO_WIFI_CONN_STATE_LIST
+	#undef X
+	WIFI_CONN_KEEP,		///> used on the transition table, the state doesn't change
+} sm_wifi_conn_state_e;
 
 /**
  * @brief Message IDs for the WiFi application task
@@ -64,9 +114,10 @@ typedef void(*wifi_connected_event_callback_t)(void);
  */
 typedef enum
 {
-	#define X(ID, ENUM) ENUM=ID,
+	#define X(ID, ENUM, ACCEPTED, NEXT, COALESCE) ENUM=ID,
 		X_MACRO_WIFI_STATE_LIST
 	#undef X
+	WIFI_APP_STATE_MAX,	///> number of events, must stay the last one
 } sm_wifi_app_state_e;
 
 /**
@@ -75,29 +126,82 @@ typedef enum
  */
 static const char * sm_wifi_app_state_names[] = 
 {
-#define X(ID, ENUM) #ENUM,
+#define X(ID, ENUM, ACCEPTED, NEXT, COALESCE) #ENUM,
 	X_MACRO_WIFI_STATE_LIST
 #undef X
 };
 
+/**
+ * @brief Data carried by an event, the member used depends on the event ID
+ * @details
+ */
+typedef union wifi_app_event_payload_u
+{
+	// WIFI_APP_CONNECTING_FROM_HTTP_SERVER
+	struct
+	{
+		char ssid[WIFI_SSID_LENGTH + 1];
+		char password[WIFI_PASSWORD_LENGTH + 1];
+	} credentials;
+	
+	// WIFI_APP_STA_DISCONNECTED
+	struct
+	{
+		uint8_t reason;		///> wifi_err_reason_t of the last disconnection
+		int8_t	rssi;
+	} disconnected;
+	
+	// WIFI_APP_STA_CONNECTED_GOT_IP
+	esp_netif_ip_info_t got_ip;
+	
+	// WIFI_APP_STA_ASSOCIATED
+	struct
+	{
+		uint8_t channel;	///> channel of the upstream AP
+	} associated;
+} wifi_app_event_payload_t;
+
 /**
  * @brief Structure for the message queue
  * @details
  */
 typedef struct wifi_app_queue_message_s
 {
-    sm_wifi_app_state_e  wifiApp_state;
+    sm_wifi_app_state_e			wifiApp_state;
+    int64_t						timestamp_us;	///> esp_timer time when it was sent
+    wifi_app_event_payload_t	payload;
 } wifi_app_queue_message_t;
 
 // Defining a type for every function of the WiFi state machine
 typedef void (*sm_wifi_app_function)(wifi_app_queue_message_t * st);
 
-// Creating a struct to hold those functions later on an array
+// Creating a struct to hold those functions and their transition later on an array
 typedef struct sm_wifi_table_fn_s
 {
-	sm_wifi_app_function func;
+	sm_wifi_app_function	func;
+	uint8_t					accepted;	///> mask of sm_wifi_conn_state_e
+	sm_wifi_conn_state_e	next;
+	bool					coalesce;
 } sm_wifi_table_fn_t;
 
+/**
+ * @brief Counters of the WiFi application queue
+ * @details
+ */
+typedef struct wifi_app_stats_s
+{
+	uint32_t sent;				///> events put on the queue
+	uint32_t coalesced;			///> events absorbed by an equal one already queued
+	uint32_t deferred;			///> coalesced events queued by the WiFi task, the queue was full
+	uint32_t dropped;			///> events lost because the queue was full
+	uint32_t rejected;			///> events not accepted in the current connection state
+	uint32_t dispatched;		///> events handled
+	uint32_t queue_depth_max;	///> queue high-water mark
+	uint32_t latency_max_us;	///> worst time between send and dispatch
+	uint32_t latency_avg_us;	///> average time between send and dispatch
+	uint32_t handler_max_us;	///> worst time spent inside a handler
+} wifi_app_stats_t;
+
 
 
 /**************************
@@ -132,24 +236,51 @@ wifi_config_t * wifiApp_getWifiConfig(void);
 **************************/
 
 /**
- * @brief Sends a message to the queue
- * @param msgId message ID from the wifi_app_message_e enum
- * @return pdTRUE if an item was successfully sent to the queue, otherwise pdFALSE
+ * @brief Sends a message without payload to the queue
+ * @details never blocks, safe to call from the esp_event and esp_timer tasks
+ * @param msgId message ID from the sm_wifi_app_state_e enum
+ * @return pdTRUE if the event was queued, coalesced or deferred, otherwise pdFALSE
  */
 BaseType_t wifiApp_sendMessage(sm_wifi_app_state_e msgId);
 
 /**
- * @brief Starts the WiFi RTOS task
+ * @brief Sends a message with payload to the queue
+ * @details never blocks, safe to call from the esp_event and esp_timer tasks.
+ * A coalesced event replaces the payload of the one already queued, the
+ * handler sees the latest. One that finds the queue full is queued by the
+ * WiFi task after its next dispatch.
+ * @param msgId message ID from the sm_wifi_app_state_e enum
+ * @param payload_p event data, may be NULL
+ * @return pdTRUE if the event was queued, coalesced or deferred, otherwise pdFALSE
+ */
+BaseType_t wifiApp_sendEvent(sm_wifi_app_state_e msgId, const wifi_app_event_payload_t * payload_p);
+
+/**
+ * @brief Copies the WiFi application queue counters
  * @details
+ * @param stats_p destination
  */
-void wifiApp_start(void);
+void wifiApp_getStats(wifi_app_stats_t * stats_p);
 
 /**
- * @brief Sets the callback function
+ * @brief Returns the current connection state
  * @details
- * @param cbFunction 
+ * @return sm_wifi_conn_state_e
  */
-void wifiApp_setCallback(wifi_connected_event_callback_t cbFunction);
+sm_wifi_conn_state_e wifiApp_getConnState(void);
+
+/**
+ * @brief Returns true while the SoftAP is up
+ * @details
+ * @return bool
+ */
+bool wifiApp_isSoftAPEnabled(void);
+
+/**
+ * @brief Starts the WiFi RTOS task
+ * @details
+ */
+void wifiApp_start(void);
 
 
 #endif /* MAIN_WIFIAPP_H_ */
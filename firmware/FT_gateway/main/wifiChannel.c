@@ -0,0 +1,126 @@
+/**
+ * @file wifiChannel.c
+ * @brief SoftAP channel selection and persistence
+ * @details
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdlib.h>
+
+// ESP libraries
+#include "esp_log.h"
+#include "nvs.h"
+
+// Personal libraries
+#include "wifiChannel.h"
+#include "projectConfig.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "wifi_channel";
+
+// Candidate channels
+static const uint8_t wifi_channel_candidates[] =
+{
+#define X(CHANNEL) CHANNEL,
+	X_MACRO_WIFI_CHANNEL_CANDIDATES
+#undef X
+};
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Returns the SoftAP channel saved on NVS
+uint8_t wifiChannel_load(void)
+{
+	nvs_handle_t handle;
+	uint8_t channel = WIFI_AP_CHANNEL;
+
+	if (nvs_open(WIFI_CHANNEL_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+	{
+		if (nvs_get_u8(handle, WIFI_CHANNEL_NVS_KEY, &channel) != ESP_OK
+			|| channel < WIFI_CHANNEL_MIN || channel > WIFI_CHANNEL_MAX)
+		{
+			channel = WIFI_AP_CHANNEL;
+		}
+		nvs_close(handle);
+	}
+
+	ESP_LOGI(TAG, "wifiChannel_load: SoftAP on channel %d", channel);
+	return channel;
+}
+
+// Saves the SoftAP channel on NVS
+esp_err_t wifiChannel_save(uint8_t channel)
+{
+	nvs_handle_t handle;
+	esp_err_t err;
+
+	err = nvs_open(WIFI_CHANNEL_NVS_NAMESPACE, NVS_READWRITE, &handle);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "wifiChannel_save: nvs_open failed (%s)", esp_err_to_name(err));
+		return err;
+	}
+
+	err = nvs_set_u8(handle, WIFI_CHANNEL_NVS_KEY, channel);
+	if (err == ESP_OK)
+	{
+		err = nvs_commit(handle);
+	}
+	nvs_close(handle);
+
+	return err;
+}
+
+// Picks the least congested channel from a scan result
+uint8_t wifiChannel_leastCongested(const wifi_scan_entry_t * entries, uint16_t count)
+{
+	uint8_t best_channel = wifi_channel_candidates[0];
+	int32_t best_load = INT32_MAX;
+
+	for (uint8_t i = 0; i < sizeof(wifi_channel_candidates); i++)
+	{
+		int32_t load = 0;
+
+		for (uint16_t j = 0; j < count; j++)
+		{
+			int distance = abs((int)entries[j].channel - (int)wifi_channel_candidates[i]);
+			if (distance > WIFI_CHANNEL_OVERLAP)
+			{
+				continue;
+			}
+			// -100 dBm counts as nothing, a co-channel AP weighs the most
+			int32_t strength = entries[j].rssi + 100;
+			if (strength > 0)
+			{
+				load += strength * (WIFI_CHANNEL_OVERLAP + 1 - distance);
+			}
+		}
+
+		ESP_LOGI(TAG, "wifiChannel_leastCongested: channel %d load %ld", wifi_channel_candidates[i], load);
+		if (load < best_load)
+		{
+			best_load = load;
+			best_channel = wifi_channel_candidates[i];
+		}
+	}
+
+	return best_channel;
+}
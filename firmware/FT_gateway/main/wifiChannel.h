@@ -0,0 +1,82 @@
+/**
+ * @file wifiChannel.h
+ * @brief SoftAP channel selection and persistence
+ * @details
+ * The SoftAP follows the channel of the upstream AP once the station is
+ * associated, so the radio never has to hop between two channels. When the
+ * station isn't associated the least congested of the non overlapping
+ * channels is picked from the scan cache. The last choice is kept on NVS.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_WIFICHANNEL_H_
+#define MAIN_WIFICHANNEL_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdint.h>
+
+// ESP libraries
+#include "esp_err.h"
+
+// Personal libraries
+#include "wifiScan.h"
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+#define WIFI_CHANNEL_NVS_NAMESPACE	"wifi_ap"
+#define WIFI_CHANNEL_NVS_KEY		"channel"
+
+#define WIFI_CHANNEL_MIN			1
+#define WIFI_CHANNEL_MAX			13
+
+/**
+ * @brief 2.4 GHz channels 5 MHz apart overlap up to 4 channels away on 20 MHz
+ */
+#define WIFI_CHANNEL_OVERLAP		4
+
+/**
+ * @brief Candidates for the least congested channel (non overlapping set)
+ */
+#define X_MACRO_WIFI_CHANNEL_CANDIDATES	\
+	X(1)	\
+	X(6)	\
+	X(11)
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Returns the SoftAP channel saved on NVS
+ * @return uint8_t saved channel, WIFI_AP_CHANNEL if none is saved
+ */
+uint8_t wifiChannel_load(void);
+
+/**
+ * @brief Saves the SoftAP channel on NVS
+ * @param channel
+ * @return esp_err_t
+ */
+esp_err_t wifiChannel_save(uint8_t channel);
+
+/**
+ * @brief Picks the least congested channel from a scan result
+ * @details every AP found adds a load that grows with its RSSI and fades
+ * with the distance to the candidate channel
+ * @param entries scan cache entries
+ * @param count number of entries
+ * @return uint8_t one of X_MACRO_WIFI_CHANNEL_CANDIDATES
+ */
+uint8_t wifiChannel_leastCongested(const wifi_scan_entry_t * entries, uint16_t count);
+
+#endif /* MAIN_WIFICHANNEL_H_ */
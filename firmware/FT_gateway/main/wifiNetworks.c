@@ -0,0 +1,355 @@
+/**
+ * @file wifiNetworks.c
+ * @brief Saved WiFi networks (credential store) with priority and RSSI ranking
+ * @details
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <string.h>
+
+// ESP libraries
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+// Personal libraries
+#include "wifiNetworks.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+	/* Structures */
+
+/**
+ * @brief Blob layout stored on NVS
+ */
+typedef struct wifi_networks_store_s
+{
+	uint8_t			count;
+	wifi_network_t	list[WIFI_NETWORKS_MAX_SAVED];
+} wifi_networks_store_t;
+
+/**
+ * @brief A ranked candidate
+ */
+typedef struct wifi_networks_candidate_s
+{
+	wifi_network_t	network;
+	int16_t			score;
+} wifi_networks_candidate_t;
+
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "wifi_networks";
+
+// Saved networks (RAM copy of the NVS blob)
+static wifi_networks_store_t g_store;
+
+// Ranked candidates from the last scan and the next one to be tried
+static wifi_networks_candidate_t g_candidates[WIFI_NETWORKS_MAX_SAVED];
+static uint8_t g_candidates_count;
+static uint8_t g_candidates_cursor;
+
+
+	/* FreeRTOS Structures */
+
+// Protects the store, it is changed from the HTTP server and read by the WiFi task
+static SemaphoreHandle_t wifi_networks_mutex;
+#if CONFIG_GW_STATIC_ALLOCATION
+static StaticSemaphore_t wifi_networks_mutex_struct;
+#endif
+
+
+	/* Static Functions */
+
+static esp_err_t wifiNetworks_save(void);
+static int wifiNetworks_find(const char * ssid);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Loads the saved networks from NVS
+esp_err_t wifiNetworks_init(void)
+{
+	nvs_handle_t handle;
+	size_t length = sizeof(g_store);
+	esp_err_t err;
+
+	if (wifi_networks_mutex == NULL)
+	{
+#if CONFIG_GW_STATIC_ALLOCATION
+		wifi_networks_mutex = xSemaphoreCreateMutexStatic(&wifi_networks_mutex_struct);
+#else
+		wifi_networks_mutex = xSemaphoreCreateMutex();
+#endif
+	}
+
+	memset(&g_store, 0x00, sizeof(g_store));
+	g_candidates_count = 0;
+	g_candidates_cursor = 0;
+
+	err = nvs_open(WIFI_NETWORKS_NVS_NAMESPACE, NVS_READONLY, &handle);
+	if (err == ESP_ERR_NVS_NOT_FOUND)
+	{
+		// Nothing saved yet
+		return ESP_OK;
+	}
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "wifiNetworks_init: nvs_open failed (%s)", esp_err_to_name(err));
+		return err;
+	}
+
+	err = nvs_get_blob(handle, WIFI_NETWORKS_NVS_KEY, &g_store, &length);
+	nvs_close(handle);
+
+	if (err == ESP_ERR_NVS_NOT_FOUND)
+	{
+		return ESP_OK;
+	}
+	if (err != ESP_OK || length != sizeof(g_store) || g_store.count > WIFI_NETWORKS_MAX_SAVED)
+	{
+		ESP_LOGW(TAG, "wifiNetworks_init: discarding invalid saved list");
+		memset(&g_store, 0x00, sizeof(g_store));
+		return (err != ESP_OK) ? err : ESP_ERR_INVALID_SIZE;
+	}
+
+	ESP_LOGI(TAG, "wifiNetworks_init: %d saved network(s)", g_store.count);
+	return ESP_OK;
+}
+
+// Returns how many networks are saved
+uint8_t wifiNetworks_getCount(void)
+{
+	return g_store.count;
+}
+
+// Copies the saved network at a given index
+esp_err_t wifiNetworks_get(uint8_t index, wifi_network_t * network_p)
+{
+	esp_err_t err = ESP_ERR_INVALID_ARG;
+
+	xSemaphoreTake(wifi_networks_mutex, portMAX_DELAY);
+	if (network_p != NULL && index < g_store.count)
+	{
+		*network_p = g_store.list[index];
+		err = ESP_OK;
+	}
+	xSemaphoreGive(wifi_networks_mutex);
+
+	return err;
+}
+
+// Adds a network or updates an existing one
+esp_err_t wifiNetworks_set(const char * ssid, const char * password, uint8_t priority)
+{
+	esp_err_t err;
+	int index;
+
+	if (ssid == NULL || password == NULL
+		|| strlen(ssid) == 0 || strlen(ssid) > WIFI_SSID_LENGTH
+		|| strlen(password) > WIFI_PASSWORD_LENGTH)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	xSemaphoreTake(wifi_networks_mutex, portMAX_DELAY);
+
+	index = wifiNetworks_find(ssid);
+	if (index < 0)
+	{
+		if (g_store.count >= WIFI_NETWORKS_MAX_SAVED)
+		{
+			xSemaphoreGive(wifi_networks_mutex);
+			return ESP_ERR_NO_MEM;
+		}
+		index = g_store.count++;
+	}
+
+	memset(&g_store.list[index], 0x00, sizeof(wifi_network_t));
+	strcpy(g_store.list[index].ssid, ssid);
+	strcpy(g_store.list[index].password, password);
+	g_store.list[index].priority = priority;
+
+	err = wifiNetworks_save();
+	xSemaphoreGive(wifi_networks_mutex);
+
+	ESP_LOGI(TAG, "wifiNetworks_set: '%s' priority %d", ssid, priority);
+	return err;
+}
+
+// Removes a saved network
+esp_err_t wifiNetworks_remove(const char * ssid)
+{
+	esp_err_t err;
+	int index;
+
+	if (ssid == NULL)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	xSemaphoreTake(wifi_networks_mutex, portMAX_DELAY);
+
+	index = wifiNetworks_find(ssid);
+	if (index < 0)
+	{
+		xSemaphoreGive(wifi_networks_mutex);
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	// Keep the list packed
+	memmove(&g_store.list[index], &g_store.list[index + 1], (g_store.count - index - 1) * sizeof(wifi_network_t));
+	g_store.count--;
+	memset(&g_store.list[g_store.count], 0x00, sizeof(wifi_network_t));
+
+	err = wifiNetworks_save();
+	xSemaphoreGive(wifi_networks_mutex);
+
+	ESP_LOGI(TAG, "wifiNetworks_remove: '%s'", ssid);
+	return err;
+}
+
+// Ranks the saved networks present in a scan result
+uint8_t wifiNetworks_rank(const wifi_scan_entry_t * entries, uint16_t count)
+{
+	xSemaphoreTake(wifi_networks_mutex, portMAX_DELAY);
+
+	g_candidates_count = 0;
+	g_candidates_cursor = 0;
+
+	for (uint8_t i = 0; i < g_store.count; i++)
+	{
+		int8_t best_rssi = INT8_MIN;
+
+		// The same SSID may be served by several APs, keep the strongest one
+		for (uint16_t j = 0; j < count; j++)
+		{
+			if (strcmp(entries[j].ssid, g_store.list[i].ssid) == 0
+				&& entries[j].rssi > best_rssi)
+			{
+				best_rssi = entries[j].rssi;
+			}
+		}
+
+		if (best_rssi < WIFI_NETWORKS_MIN_RSSI)
+		{
+			continue;
+		}
+
+		// Insertion sort, highest score first
+		int16_t score = best_rssi + g_store.list[i].priority * WIFI_NETWORKS_PRIORITY_WEIGHT_DBM;
+		uint8_t pos = g_candidates_count;
+		while (pos > 0 && g_candidates[pos - 1].score < score)
+		{
+			g_candidates[pos] = g_candidates[pos - 1];
+			pos--;
+		}
+		g_candidates[pos].network = g_store.list[i];
+		g_candidates[pos].score = score;
+		g_candidates_count++;
+	}
+
+	for (uint8_t i = 0; i < g_candidates_count; i++)
+	{
+		ESP_LOGI(TAG, "wifiNetworks_rank: #%d '%s' score %d", i, g_candidates[i].network.ssid, g_candidates[i].score);
+	}
+
+	xSemaphoreGive(wifi_networks_mutex);
+
+	return g_candidates_count;
+}
+
+// Fills the station configuration with the next ranked candidate
+bool wifiNetworks_nextCandidate(wifi_config_t * wifi_config_p)
+{
+	bool found = false;
+
+	xSemaphoreTake(wifi_networks_mutex, portMAX_DELAY);
+	if (g_candidates_cursor < g_candidates_count)
+	{
+		wifi_network_t * network_p = &g_candidates[g_candidates_cursor++].network;
+
+		memset(wifi_config_p, 0x00, sizeof(wifi_config_t));
+		memcpy(wifi_config_p->sta.ssid, network_p->ssid, strlen(network_p->ssid));
+		memcpy(wifi_config_p->sta.password, network_p->password, strlen(network_p->password));
+		// Several APs may share the SSID, let the driver pick the strongest one
+		wifi_config_p->sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+		wifi_config_p->sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+
+		ESP_LOGI(TAG, "wifiNetworks_nextCandidate: trying '%s'", network_p->ssid);
+		found = true;
+	}
+	xSemaphoreGive(wifi_networks_mutex);
+
+	return found;
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Writes the saved list to NVS, the mutex must be held
+ * @return esp_err_t
+ */
+static esp_err_t wifiNetworks_save(void)
+{
+	nvs_handle_t handle;
+	esp_err_t err;
+
+	err = nvs_open(WIFI_NETWORKS_NVS_NAMESPACE, NVS_READWRITE, &handle);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "wifiNetworks_save: nvs_open failed (%s)", esp_err_to_name(err));
+		return err;
+	}
+
+	err = nvs_set_blob(handle, WIFI_NETWORKS_NVS_KEY, &g_store, sizeof(g_store));
+	if (err == ESP_OK)
+	{
+		err = nvs_commit(handle);
+	}
+	nvs_close(handle);
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "wifiNetworks_save: failed (%s)", esp_err_to_name(err));
+	}
+	return err;
+}
+
+/**
+ * @brief Finds a saved network by SSID, the mutex must be held
+ * @param ssid network name
+ * @return int index, or -1 when not found
+ */
+static int wifiNetworks_find(const char * ssid)
+{
+	for (uint8_t i = 0; i < g_store.count; i++)
+	{
+		if (strcmp(g_store.list[i].ssid, ssid) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file wifiNetworks.h
+ * @brief Saved WiFi networks (credential store) with priority and RSSI ranking
+ * @details
+ * The list is kept in RAM and mirrored to NVS as a single blob. A scan result
+ * is ranked against the saved list and the resulting candidates are consumed
+ * one at a time by the WiFi application, so a lost link fails over to the
+ * next best network.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_WIFINETWORKS_H_
+#define MAIN_WIFINETWORKS_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+// ESP libraries
+#include "esp_err.h"
+#include "esp_wifi_types_generic.h"
+
+// Personal libraries
+#include "projectConfig.h"
+#include "wifiScan.h"
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+#define WIFI_NETWORKS_NVS_NAMESPACE	"wifi_nets"
+#define WIFI_NETWORKS_NVS_KEY		"list"
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief One saved network
+ * @details strings are always NUL terminated
+ */
+typedef struct wifi_network_s
+{
+	char	ssid[WIFI_SSID_LENGTH + 1];
+	char	password[WIFI_PASSWORD_LENGTH + 1];
+	uint8_t	priority;	///> higher value is preferred
+} wifi_network_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Loads the saved networks from NVS
+ * @details NVS must already be initialized
+ * @return ESP_OK, or the NVS error when the stored list can't be read
+ */
+esp_err_t wifiNetworks_init(void);
+
+/**
+ * @brief Returns how many networks are saved
+ * @return uint8_t
+ */
+uint8_t wifiNetworks_getCount(void);
+
+/**
+ * @brief Copies the saved network at a given index
+ * @param index position in the saved list
+ * @param network_p destination
+ * @return ESP_OK, ESP_ERR_INVALID_ARG when out of range
+ */
+esp_err_t wifiNetworks_get(uint8_t index, wifi_network_t * network_p);
+
+/**
+ * @brief Adds a network or updates the password and priority of an existing one
+ * @param ssid network name
+ * @param password network password, may be empty for open networks
+ * @param priority higher value is preferred
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, ESP_ERR_NO_MEM when the list is full,
+ * or the NVS error
+ */
+esp_err_t wifiNetworks_set(const char * ssid, const char * password, uint8_t priority);
+
+/**
+ * @brief Removes a saved network
+ * @param ssid network name
+ * @return ESP_OK, ESP_ERR_NOT_FOUND, or the NVS error
+ */
+esp_err_t wifiNetworks_remove(const char * ssid);
+
+/**
+ * @brief Ranks the saved networks present in a scan result
+ * @details score = RSSI + priority * WIFI_NETWORKS_PRIORITY_WEIGHT_DBM,
+ * networks weaker than WIFI_NETWORKS_MIN_RSSI are dropped. The candidate
+ * cursor is rewound to the best candidate.
+ * @param entries scan cache entries
+ * @param count number of entries
+ * @return uint8_t number of candidates
+ */
+uint8_t wifiNetworks_rank(const wifi_scan_entry_t * entries, uint16_t count);
+
+/**
+ * @brief Fills the station configuration with the next ranked candidate
+ * @param wifi_config_p station configuration to fill
+ * @return true if a candidate was available, false when the list is exhausted
+ */
+bool wifiNetworks_nextCandidate(wifi_config_t * wifi_config_p);
+
+#endif /* MAIN_WIFINETWORKS_H_ */
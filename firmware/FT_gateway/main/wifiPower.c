@@ -0,0 +1,414 @@
+/**
+ * @file wifiPower.c
+ * @brief WiFi power and latency profiles
+ * @details
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <string.h>
+
+// ESP libraries
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs.h"
+#include "ping/ping_sock.h"
+#include "sdkconfig.h"
+
+// Personal libraries
+#include "wifiPower.h"
+#include "wifiApp.h"
+#include "projectConfig.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "wifi_power";
+
+// Profile settings
+static const wifi_power_profile_t wifi_power_profiles[WIFI_POWER_PROFILE_MAX] =
+{
+#define X(ID, ENUM, NAME, PS, LISTEN, CPU_MAX, CPU_MIN, LIGHT_SLEEP, BEACON, EST_MA) \
+	[ENUM] = { NAME, PS, LISTEN, CPU_MAX, CPU_MIN, LIGHT_SLEEP, BEACON, EST_MA },
+	X_MACRO_WIFI_POWER_PROFILE_LIST
+#undef X
+};
+
+// Selected profile
+static wifi_power_profile_e g_profile = WIFI_POWER_DEFAULT_PROFILE;
+
+// Profile applied last, the SoftAP state and the power save mode they give
+static wifi_power_profile_e g_applied = WIFI_POWER_DEFAULT_PROFILE;
+static bool g_ap_enabled = true;
+static volatile wifi_ps_type_t g_ps = WIFI_PS_NONE;
+
+// Measurement sweep, the step is the profile being measured
+static volatile bool g_measuring;
+static int8_t g_measure_step;
+static esp_ping_handle_t g_ping_session;
+
+// Round-trip times per profile, written by the ping task
+static wifi_power_rtt_t g_rtt[WIFI_POWER_PROFILE_MAX];
+static uint32_t g_rtt_total_ms[WIFI_POWER_PROFILE_MAX];
+static portMUX_TYPE wifi_power_rtt_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+	/* Static Functions */
+
+static esp_err_t wifiPower_save(void);
+static void wifiPower_setPs(void);
+static void wifiPower_ping_success(esp_ping_handle_t hdl, void * args);
+static void wifiPower_ping_timeout(esp_ping_handle_t hdl, void * args);
+static void wifiPower_ping_end(esp_ping_handle_t hdl, void * args);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Loads the selected profile from NVS
+void wifiPower_init(void)
+{
+	nvs_handle_t handle;
+	uint8_t profile;
+
+	if (nvs_open(WIFI_POWER_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+	{
+		if (nvs_get_u8(handle, WIFI_POWER_NVS_KEY, &profile) == ESP_OK && profile < WIFI_POWER_PROFILE_MAX)
+		{
+			g_profile = profile;
+		}
+		nvs_close(handle);
+	}
+
+	ESP_LOGI(TAG, "wifiPower_init: profile %s", wifi_power_profiles[g_profile].name);
+}
+
+// Returns the selected profile
+wifi_power_profile_e wifiPower_getProfile(void)
+{
+	return g_profile;
+}
+
+// Returns the settings of a profile
+const wifi_power_profile_t * wifiPower_getSettings(wifi_power_profile_e profile)
+{
+	if (profile >= WIFI_POWER_PROFILE_MAX)
+	{
+		return NULL;
+	}
+	return &wifi_power_profiles[profile];
+}
+
+// Finds a profile by its name
+wifi_power_profile_e wifiPower_find(const char * name)
+{
+	for (uint8_t i = 0; i < WIFI_POWER_PROFILE_MAX; i++)
+	{
+		if (strcmp(wifi_power_profiles[i].name, name) == 0)
+		{
+			return i;
+		}
+	}
+	return WIFI_POWER_PROFILE_MAX;
+}
+
+// Selects a profile, saves it on NVS and asks the WiFi task to apply it
+esp_err_t wifiPower_select(wifi_power_profile_e profile)
+{
+	esp_err_t err;
+
+	if (profile >= WIFI_POWER_PROFILE_MAX)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (g_measuring)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	g_profile = profile;
+	err = wifiPower_save();
+	if (wifiApp_sendMessage(WIFI_APP_POWER_PROFILE) != pdTRUE)
+	{
+		// Saved, applied on the next boot
+		ESP_LOGW(TAG, "wifiPower_select: WiFi task queue full");
+		return ESP_ERR_TIMEOUT;
+	}
+
+	ESP_LOGI(TAG, "wifiPower_select: %s", wifi_power_profiles[profile].name);
+	return err;
+}
+
+// Applies the radio and CPU settings of a profile
+void wifiPower_apply(wifi_power_profile_e profile, wifi_ap_config_t * ap_config_p)
+{
+	const wifi_power_profile_t * settings_p = &wifi_power_profiles[profile];
+
+	g_applied = profile;
+	wifiPower_setPs();
+
+#ifdef CONFIG_PM_ENABLE
+	esp_err_t err;
+	esp_pm_config_t pm_config =
+	{
+		.max_freq_mhz		= settings_p->cpu_max_mhz,
+		.min_freq_mhz		= settings_p->cpu_min_mhz,
+		.light_sleep_enable	= settings_p->light_sleep,
+	};
+	err = esp_pm_configure(&pm_config);
+	if (err != ESP_OK)
+	{
+		ESP_LOGW(TAG, "wifiPower_apply: esp_pm_configure failed (%s)", esp_err_to_name(err));
+	}
+#endif
+
+	ap_config_p->beacon_interval = settings_p->beacon_interval;
+
+	ESP_LOGI(TAG, "wifiPower_apply: %s", settings_p->name);
+}
+
+// Sets the power save mode the SoftAP state allows
+void wifiPower_setApEnabled(bool ap_enabled)
+{
+	g_ap_enabled = ap_enabled;
+	wifiPower_setPs();
+}
+
+// Returns true when the modem sleeps
+bool wifiPower_isModemSleeping(void)
+{
+	return (g_ps != WIFI_PS_NONE);
+}
+
+// Returns the listen interval of the selected profile
+uint16_t wifiPower_getListenInterval(void)
+{
+	return wifi_power_profiles[g_profile].listen_interval;
+}
+
+// Starts a measurement sweep over every profile
+esp_err_t wifiPower_measureStart(void)
+{
+	if (g_measuring || wifiApp_getConnState() != WIFI_CONN_CONNECTED)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	g_measure_step = -1;
+	g_measuring = true;
+	wifiApp_sendMessage(WIFI_APP_POWER_MEASURE);
+
+	ESP_LOGI(TAG, "wifiPower_measureStart");
+	return ESP_OK;
+}
+
+// Moves the sweep to the next profile
+bool wifiPower_measureNext(wifi_power_profile_e * profile_p)
+{
+	if (g_ping_session != NULL)
+	{
+		esp_ping_delete_session(g_ping_session);
+		g_ping_session = NULL;
+	}
+
+	if (!g_measuring || ++g_measure_step >= WIFI_POWER_PROFILE_MAX)
+	{
+		g_measuring = false;
+		return false;
+	}
+
+	taskENTER_CRITICAL(&wifi_power_rtt_mux);
+	memset(&g_rtt[g_measure_step], 0x00, sizeof(wifi_power_rtt_t));
+	g_rtt_total_ms[g_measure_step] = 0;
+	taskEXIT_CRITICAL(&wifi_power_rtt_mux);
+
+	*profile_p = g_measure_step;
+	return true;
+}
+
+// Pings the gateway under the profile just applied
+esp_err_t wifiPower_measurePing(const esp_ip4_addr_t * gateway_p)
+{
+	esp_ping_config_t ping_config = ESP_PING_DEFAULT_CONFIG();
+	esp_ping_callbacks_t callbacks =
+	{
+		.cb_args			= NULL,
+		.on_ping_success	= wifiPower_ping_success,
+		.on_ping_timeout	= wifiPower_ping_timeout,
+		.on_ping_end		= wifiPower_ping_end,
+	};
+	esp_err_t err;
+
+	ping_config.target_addr.type = IPADDR_TYPE_V4;
+	ping_config.target_addr.u_addr.ip4.addr = gateway_p->addr;
+	ping_config.count = WIFI_POWER_MEASURE_PINGS;
+	ping_config.interval_ms = WIFI_POWER_MEASURE_INTERVAL_MS;
+	// Sleeping over WIFI_PS_MAX_MODEM listen intervals is slower than the default timeout
+	ping_config.timeout_ms = WIFI_POWER_MEASURE_TIMEOUT_MS;
+
+	err = esp_ping_new_session(&ping_config, &callbacks, &g_ping_session);
+	if (err == ESP_OK)
+	{
+		err = esp_ping_start(g_ping_session);
+	}
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "wifiPower_measurePing: failed (%s)", esp_err_to_name(err));
+		wifiPower_measureAbort();
+	}
+
+	return err;
+}
+
+// Stops a running sweep
+void wifiPower_measureAbort(void)
+{
+	if (g_ping_session != NULL)
+	{
+		esp_ping_stop(g_ping_session);
+		esp_ping_delete_session(g_ping_session);
+		g_ping_session = NULL;
+	}
+	g_measuring = false;
+}
+
+// Returns true while a sweep runs
+bool wifiPower_isMeasuring(void)
+{
+	return g_measuring;
+}
+
+// Copies the last round-trip time measured under a profile
+void wifiPower_getRtt(wifi_power_profile_e profile, wifi_power_rtt_t * rtt_p)
+{
+	taskENTER_CRITICAL(&wifi_power_rtt_mux);
+	*rtt_p = g_rtt[profile];
+	rtt_p->rtt_avg_ms = (rtt_p->replies > 0) ? g_rtt_total_ms[profile] / rtt_p->replies : 0;
+	taskEXIT_CRITICAL(&wifi_power_rtt_mux);
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief Writes the selected profile to NVS
+ * @return esp_err_t
+ */
+static esp_err_t wifiPower_save(void)
+{
+	nvs_handle_t handle;
+	esp_err_t err;
+
+	err = nvs_open(WIFI_POWER_NVS_NAMESPACE, NVS_READWRITE, &handle);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "wifiPower_save: nvs_open failed (%s)", esp_err_to_name(err));
+		return err;
+	}
+
+	err = nvs_set_u8(handle, WIFI_POWER_NVS_KEY, g_profile);
+	if (err == ESP_OK)
+	{
+		err = nvs_commit(handle);
+	}
+	nvs_close(handle);
+
+	return err;
+}
+
+/**
+ * @brief Sets the power save mode of the applied profile, or WIFI_PS_NONE
+ * while the SoftAP is up since APSTA ignores the modem sleep modes
+ */
+static void wifiPower_setPs(void)
+{
+	wifi_ps_type_t ps = g_ap_enabled ? WIFI_PS_NONE : wifi_power_profiles[g_applied].ps;
+	esp_err_t err = esp_wifi_set_ps(ps);
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGW(TAG, "wifiPower_setPs: esp_wifi_set_ps failed (%s)", esp_err_to_name(err));
+		return;
+	}
+	g_ps = ps;
+
+	if (g_ap_enabled && wifi_power_profiles[g_applied].ps != WIFI_PS_NONE)
+	{
+		ESP_LOGI(TAG, "wifiPower_setPs: %s modem sleep waits for the SoftAP shutdown", wifi_power_profiles[g_applied].name);
+	}
+}
+
+/**
+ * @brief Ping reply callback, runs on the ping task
+ * @param hdl
+ * @param args
+ */
+static void wifiPower_ping_success(esp_ping_handle_t hdl, void * args)
+{
+	uint32_t elapsed_ms;
+	wifi_power_rtt_t * rtt_p = &g_rtt[g_measure_step];
+
+	esp_ping_get_profile(hdl, ESP_PING_PROF_TIMEGAP, &elapsed_ms, sizeof(elapsed_ms));
+
+	taskENTER_CRITICAL(&wifi_power_rtt_mux);
+	if (rtt_p->replies == 0 || elapsed_ms < rtt_p->rtt_min_ms)
+	{
+		rtt_p->rtt_min_ms = elapsed_ms;
+	}
+	if (elapsed_ms > rtt_p->rtt_max_ms)
+	{
+		rtt_p->rtt_max_ms = elapsed_ms;
+	}
+	rtt_p->replies++;
+	g_rtt_total_ms[g_measure_step] += elapsed_ms;
+	taskEXIT_CRITICAL(&wifi_power_rtt_mux);
+}
+
+/**
+ * @brief Ping timeout callback, runs on the ping task
+ * @param hdl
+ * @param args
+ */
+static void wifiPower_ping_timeout(esp_ping_handle_t hdl, void * args)
+{
+	taskENTER_CRITICAL(&wifi_power_rtt_mux);
+	g_rtt[g_measure_step].timeouts++;
+	taskEXIT_CRITICAL(&wifi_power_rtt_mux);
+}
+
+/**
+ * @brief Ping session end callback, runs on the ping task
+ * @details the session can't be deleted from its own task, the WiFi task
+ * does it on [WIFI_APP_POWER_MEASURE]
+ * @param hdl
+ * @param args
+ */
+static void wifiPower_ping_end(esp_ping_handle_t hdl, void * args)
+{
+	wifi_power_rtt_t rtt;
+
+	wifiPower_getRtt(g_measure_step, &rtt);
+	ESP_LOGI(TAG, "%s: %lu/%lu replies, rtt min %lu avg %lu max %lu ms, ~%d mA",
+					wifi_power_profiles[g_measure_step].name, rtt.replies, rtt.replies + rtt.timeouts,
+					rtt.rtt_min_ms, rtt.rtt_avg_ms, rtt.rtt_max_ms, wifi_power_profiles[g_measure_step].est_ma);
+
+	wifiApp_sendMessage(WIFI_APP_POWER_MEASURE);
+}
@@ -0,0 +1,223 @@
+/**
+ * @file wifiPower.h
+ * @brief WiFi power and latency profiles
+ * @details
+ * A profile combines the station power save mode, its listen interval, the
+ * power management (DFS and light sleep) limits and the SoftAP beacon
+ * interval. The selected profile is kept on NVS and applied by the WiFi
+ * application task. A measurement sweep pings the uplink gateway under each
+ * profile to report the round-trip time next to the estimated current.
+ *
+ * The gateway runs in APSTA mode while the SoftAP is up, and in that mode
+ * the ESP32 ignores WIFI_PS_MIN_MODEM and WIFI_PS_MAX_MODEM. The power save
+ * mode of BALANCED and LOW_POWER is therefore held at WIFI_PS_NONE until
+ * the AP shuts down (WIFI_AP_SHUTDOWN_DELAY_S after the station connects)
+ * and goes back to it when the AP comes back; the DFS, light sleep and
+ * beacon settings apply at once. A sweep run while the AP is up measures
+ * every profile without modem sleep.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_WIFIPOWER_H_
+#define MAIN_WIFIPOWER_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+// ESP libraries
+#include "esp_err.h"
+#include "esp_netif_ip_addr.h"
+#include "esp_wifi_types_generic.h"
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+#define WIFI_POWER_NVS_NAMESPACE	"wifi_power"
+#define WIFI_POWER_NVS_KEY			"profile"
+
+/**
+ * @brief List of power profiles
+ * @details
+ * - PS: station power save mode, held at WIFI_PS_NONE while the SoftAP is up
+ * - LISTEN: beacon intervals slept with WIFI_PS_MAX_MODEM, applied on the next association
+ * - CPU_MAX/CPU_MIN: DFS limits in MHz, needs CONFIG_PM_ENABLE
+ * - LIGHT_SLEEP: automatic light sleep, needs CONFIG_PM_ENABLE and tickless idle
+ * - BEACON: SoftAP beacon interval in TU
+ * - EST_MA: average current estimated from the ESP32 datasheet, connected and idle
+ */
+#define X_MACRO_WIFI_POWER_PROFILE_LIST 																		\
+	/*ID, ENUM,					NAME,			PS,					LISTEN,	CPU_MAX,	CPU_MIN,	LIGHT_SLEEP,	BEACON,						EST_MA */	\
+	X(0, WIFI_POWER_LOW_LATENCY,	"low_latency",	WIFI_PS_NONE,		0,		240,		240,		false,			WIFI_AP_BEACON_INTERVAL,	120	) \
+	X(1, WIFI_POWER_BALANCED,		"balanced",		WIFI_PS_MIN_MODEM,	0,		240,		80,			false,			WIFI_AP_BEACON_INTERVAL,	30	) \
+	X(2, WIFI_POWER_LOW_POWER,		"low_power",	WIFI_PS_MAX_MODEM,	10,		160,		40,			true,			300,						5	)
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief Power profile IDs
+ * @details
+ */
+typedef enum
+{
+	#define X(ID, ENUM, NAME, PS, LISTEN, CPU_MAX, CPU_MIN, LIGHT_SLEEP, BEACON, EST_MA) ENUM=ID,
+		X_MACRO_WIFI_POWER_PROFILE_LIST
+	#undef X
+	WIFI_POWER_PROFILE_MAX,	///> number of profiles, must stay the last one
+} wifi_power_profile_e;
+
+/**
+ * @brief Settings of one power profile
+ * @details
+ */
+typedef struct wifi_power_profile_s
+{
+	const char *	name;
+	wifi_ps_type_t	ps;
+	uint16_t		listen_interval;
+	uint16_t		cpu_max_mhz;
+	uint16_t		cpu_min_mhz;
+	bool			light_sleep;
+	uint16_t		beacon_interval;
+	uint16_t		est_ma;
+} wifi_power_profile_t;
+
+/**
+ * @brief Round-trip time measured under one profile
+ * @details
+ */
+typedef struct wifi_power_rtt_s
+{
+	uint32_t replies;
+	uint32_t timeouts;
+	uint32_t rtt_min_ms;
+	uint32_t rtt_max_ms;
+	uint32_t rtt_avg_ms;
+} wifi_power_rtt_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Loads the selected profile from NVS
+ * @details NVS must already be initialized
+ */
+void wifiPower_init(void);
+
+/**
+ * @brief Returns the selected profile
+ * @return wifi_power_profile_e
+ */
+wifi_power_profile_e wifiPower_getProfile(void);
+
+/**
+ * @brief Returns the settings of a profile
+ * @param profile
+ * @return const wifi_power_profile_t * NULL when out of range
+ */
+const wifi_power_profile_t * wifiPower_getSettings(wifi_power_profile_e profile);
+
+/**
+ * @brief Finds a profile by its name
+ * @param name
+ * @return wifi_power_profile_e WIFI_POWER_PROFILE_MAX when not found
+ */
+wifi_power_profile_e wifiPower_find(const char * name);
+
+/**
+ * @brief Selects a profile, saves it on NVS and asks the WiFi task to apply it
+ * @param profile
+ * @return esp_err_t ESP_ERR_INVALID_ARG, ESP_ERR_INVALID_STATE during a
+ * measurement, ESP_ERR_TIMEOUT when the WiFi task wasn't reached, or the
+ * NVS error
+ */
+esp_err_t wifiPower_select(wifi_power_profile_e profile);
+
+/**
+ * @brief Applies the radio and CPU settings of a profile
+ * @details must run on the WiFi application task, the caller pushes the
+ * new beacon interval to the driver
+ * @param profile
+ * @param ap_config_p SoftAP configuration, its beacon interval is updated
+ */
+void wifiPower_apply(wifi_power_profile_e profile, wifi_ap_config_t * ap_config_p);
+
+/**
+ * @brief Sets the power save mode the SoftAP state allows
+ * @details must run on the WiFi application task, after each mode change
+ * @param ap_enabled true in APSTA mode, the modem sleep modes are held off
+ */
+void wifiPower_setApEnabled(bool ap_enabled);
+
+/**
+ * @brief Returns true when the modem sleeps, a profile with power save and no SoftAP
+ * @return bool
+ */
+bool wifiPower_isModemSleeping(void);
+
+/**
+ * @brief Returns the listen interval of the selected profile
+ * @details used on the station configuration before connecting
+ * @return uint16_t
+ */
+uint16_t wifiPower_getListenInterval(void);
+
+/**
+ * @brief Starts a measurement sweep over every profile
+ * @details the station must be connected, the selected profile is restored
+ * at the end
+ * @return esp_err_t ESP_ERR_INVALID_STATE when a sweep is already running
+ */
+esp_err_t wifiPower_measureStart(void);
+
+/**
+ * @brief Moves the sweep to the next profile
+ * @details runs on the WiFi application task after the previous ping
+ * session ended
+ * @param profile_p profile to be measured next
+ * @return true if there is a profile left, false when the sweep is over
+ */
+bool wifiPower_measureNext(wifi_power_profile_e * profile_p);
+
+/**
+ * @brief Pings the gateway under the profile just applied
+ * @param gateway_p uplink gateway address
+ * @return esp_err_t the sweep is aborted on error
+ */
+esp_err_t wifiPower_measurePing(const esp_ip4_addr_t * gateway_p);
+
+/**
+ * @brief Stops a running sweep
+ */
+void wifiPower_measureAbort(void);
+
+/**
+ * @brief Returns true while a sweep runs
+ * @return bool
+ */
+bool wifiPower_isMeasuring(void);
+
+/**
+ * @brief Copies the last round-trip time measured under a profile
+ * @param profile
+ * @param rtt_p destination
+ */
+void wifiPower_getRtt(wifi_power_profile_e profile, wifi_power_rtt_t * rtt_p);
+
+#endif /* MAIN_WIFIPOWER_H_ */
@@ -0,0 +1,116 @@
+/**
+ * @file wifiScan.c
+ * @brief Cache of the last WiFi scan
+ * @details
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <string.h>
+
+// ESP libraries
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+// Personal libraries
+#include "wifiScan.h"
+#include "wifiApp.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "wifi_scan";
+
+// Cached entries and when they were collected (esp_timer time, 0 = never)
+static wifi_scan_entry_t g_entries[WIFI_SCAN_MAX_RECORDS];
+static uint16_t g_entries_count;
+static int64_t g_timestamp_us;
+
+// A scan is running
+static volatile bool g_running;
+
+// Protects the cache, copies are short so a spinlock is enough
+static portMUX_TYPE wifi_scan_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Asks the WiFi application for a new scan
+bool wifiScan_request(void)
+{
+	if (g_running)
+	{
+		return true;
+	}
+	return (wifiApp_sendMessage(WIFI_APP_SCAN_START) == pdTRUE);
+}
+
+// Marks a scan as started/finished
+void wifiScan_setRunning(bool running)
+{
+	g_running = running;
+}
+
+// Returns true while a scan is running
+bool wifiScan_isRunning(void)
+{
+	return g_running;
+}
+
+// Replaces the cache with a new scan result
+void wifiScan_store(const wifi_ap_record_t * records, uint16_t count)
+{
+	if (count > WIFI_SCAN_MAX_RECORDS)
+	{
+		count = WIFI_SCAN_MAX_RECORDS;
+	}
+
+	taskENTER_CRITICAL(&wifi_scan_mux);
+	for (uint16_t i = 0; i < count; i++)
+	{
+		memcpy(g_entries[i].ssid, records[i].ssid, WIFI_SSID_LENGTH);
+		g_entries[i].ssid[WIFI_SSID_LENGTH] = '\0';
+		g_entries[i].rssi = records[i].rssi;
+		g_entries[i].channel = records[i].primary;
+		g_entries[i].authmode = records[i].authmode;
+	}
+	g_entries_count = count;
+	g_timestamp_us = esp_timer_get_time();
+	taskEXIT_CRITICAL(&wifi_scan_mux);
+
+	ESP_LOGI(TAG, "wifiScan_store: %d AP(s) cached", count);
+}
+
+// Copies the cached entries
+uint16_t wifiScan_get(wifi_scan_entry_t * entries, int64_t * age_ms_p)
+{
+	uint16_t count;
+	int64_t timestamp_us;
+
+	taskENTER_CRITICAL(&wifi_scan_mux);
+	count = g_entries_count;
+	timestamp_us = g_timestamp_us;
+	memcpy(entries, g_entries, count * sizeof(wifi_scan_entry_t));
+	taskEXIT_CRITICAL(&wifi_scan_mux);
+
+	if (age_ms_p != NULL)
+	{
+		*age_ms_p = (timestamp_us == 0) ? -1 : (esp_timer_get_time() - timestamp_us) / 1000;
+	}
+	return count;
+}
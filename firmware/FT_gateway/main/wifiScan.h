@@ -0,0 +1,87 @@
+/**
+ * @file wifiScan.h
+ * @brief Cache of the last WiFi scan
+ * @details
+ * Scans are started and collected by the WiFi application task only.
+ * Readers (e.g. the HTTP server) get the cached result immediately together
+ * with its age, so they never wait on the radio.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_WIFISCAN_H_
+#define MAIN_WIFISCAN_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stdint.h>
+
+// ESP libraries
+#include "esp_wifi_types_generic.h"
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief Compact scan entry, what the UI and the ranking need from wifi_ap_record_t
+ */
+typedef struct wifi_scan_entry_s
+{
+	char	ssid[WIFI_SSID_LENGTH + 1];
+	int8_t	rssi;
+	uint8_t	channel;
+	uint8_t	authmode;	///> wifi_auth_mode_t
+} wifi_scan_entry_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Asks the WiFi application for a new scan
+ * @details doesn't wait for the scan, does nothing if one is already running
+ * @return true if a scan was requested or is already running
+ */
+bool wifiScan_request(void);
+
+/**
+ * @brief Marks a scan as started/finished
+ * @details called by the WiFi application task only
+ * @param running
+ */
+void wifiScan_setRunning(bool running);
+
+/**
+ * @brief Returns true while a scan is running
+ * @return bool
+ */
+bool wifiScan_isRunning(void);
+
+/**
+ * @brief Replaces the cache with a new scan result
+ * @details called by the WiFi application task only, strongest APs first
+ * @param records scan records
+ * @param count number of records
+ */
+void wifiScan_store(const wifi_ap_record_t * records, uint16_t count);
+
+/**
+ * @brief Copies the cached entries
+ * @param entries destination, WIFI_SCAN_MAX_RECORDS entries
+ * @param age_ms_p age of the cache in milliseconds, -1 if nothing was scanned yet
+ * @return uint16_t number of entries copied
+ */
+uint16_t wifiScan_get(wifi_scan_entry_t * entries, int64_t * age_ms_p);
+
+#endif /* MAIN_WIFISCAN_H_ */
@@ -0,0 +1,845 @@
+/**
+ * @file zigbeeNcp.c
+ * @brief Host side of the link to the Zigbee network co-processor
+ * @details
+ * The UART driver moves the bytes between the FIFOs and its own ring
+ * buffers from the interrupt, the zigbeeNcp task only wakes up on its
+ * event queue when a burst has ended (RX timeout) or the FIFO is filling.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <string.h>
+#include <sys/param.h>
+
+// ESP libraries
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+// Personal libraries
+#include "tasks_common.h"
+#include "zigbeeNcp.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+// SLIP special bytes
+#define SLIP_END			0xC0
+#define SLIP_ESC			0xDB
+#define SLIP_ESC_END		0xDC
+#define SLIP_ESC_ESC		0xDD
+
+#define ZIGBEE_NCP_MAX_FRAME	(ZIGBEE_NCP_HEADER_LEN + ZIGBEE_NCP_MAX_PAYLOAD + ZIGBEE_NCP_CRC_LEN)
+
+	/* Structures */
+
+/**
+ * @brief Request waiting for its response
+ */
+typedef struct zigbee_ncp_pending_s
+{
+	bool						used;
+	uint8_t						sn;
+	int64_t						sent_us;
+	int64_t						deadline_us;
+	zigbee_ncp_response_cb_t	cb;
+	void *						ctx;
+} zigbee_ncp_pending_t;
+
+/**
+ * @brief SLIP decoder state
+ */
+typedef struct zigbee_ncp_decoder_s
+{
+	uint16_t	len;
+	bool		escaped;
+	bool		bad;				///> frame dropped at its END
+	uint8_t		frame[ZIGBEE_NCP_MAX_FRAME];
+} zigbee_ncp_decoder_t;
+
+/**
+ * @brief Caller of zigbeeNcp_request, on its stack
+ */
+typedef struct zigbee_ncp_sync_s
+{
+	SemaphoreHandle_t	done;
+	esp_err_t			err;
+	uint8_t *			response;
+	uint16_t *			response_len_p;
+} zigbee_ncp_sync_t;
+
+/**
+ * @brief Running benchmark
+ */
+typedef struct zigbee_ncp_bench_run_s
+{
+	SemaphoreHandle_t	done;
+	uint32_t			frames;
+	uint32_t			completed;
+	uint32_t			errors;
+	uint16_t			len;
+} zigbee_ncp_bench_run_t;
+
+
+	/* Variables */
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "zigbee_ncp";
+
+static uint16_t g_crc_table[256];
+static zigbee_ncp_pending_t g_pending[ZIGBEE_NCP_WINDOW];
+static uint8_t g_next_sn;
+static zigbee_ncp_stats_t g_stats;
+static zigbee_ncp_event_cb_t g_handlers[ZIGBEE_NCP_MAX_HANDLERS];
+
+// Only the zigbeeNcp task decodes, only the holder of zigbee_ncp_tx_mutex encodes
+static zigbee_ncp_decoder_t g_decoder;
+static uint8_t g_rx_chunk[256];
+static uint8_t g_tx_frame[ZIGBEE_NCP_MAX_FRAME];
+static uint8_t g_tx_slip[2 * ZIGBEE_NCP_MAX_FRAME + 2];
+
+// Payload of the benchmark echoes, checked on the way back
+static uint8_t g_bench_payload[ZIGBEE_NCP_MAX_PAYLOAD];
+
+
+	/* FreeRTOS Structures */
+
+TASK_STORAGE(zigbeeNcp_task, ZIGBEE_NCP_TASK_STACK_SIZE)
+static TaskHandle_t zigbee_ncp_task_handle;
+
+// UART driver events
+static QueueHandle_t zigbee_ncp_uart_queue;
+
+// Rooms left in the window
+static SemaphoreHandle_t zigbee_ncp_window;
+// Frames are written whole
+static SemaphoreHandle_t zigbee_ncp_tx_mutex;
+#if CONFIG_GW_STATIC_ALLOCATION
+static StaticSemaphore_t zigbee_ncp_window_struct;
+static StaticSemaphore_t zigbee_ncp_tx_mutex_struct;
+#endif
+
+// Pending requests, stats and handlers
+static portMUX_TYPE zigbee_ncp_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+	/* Static Functions */
+
+static uint16_t zigbeeNcp_crc16(const uint8_t * data, size_t len);
+static esp_err_t zigbeeNcp_submit(uint16_t id, const void * payload, uint16_t len,
+									zigbee_ncp_response_cb_t cb, void * ctx, uint32_t wait_ms, uint32_t timeout_ms);
+static esp_err_t zigbeeNcp_send(zigbee_ncp_frame_type_t type, uint8_t sn, uint16_t id, const void * payload, uint16_t len);
+static void zigbeeNcp_decode(const uint8_t * data, size_t len);
+static void zigbeeNcp_handleFrame(const uint8_t * frame, uint16_t len);
+static void zigbeeNcp_complete(uint8_t sn, esp_err_t err, const uint8_t * payload, uint16_t len);
+static void zigbeeNcp_expire(void);
+static void zigbeeNcp_syncDone(void * ctx, esp_err_t err, const uint8_t * payload, uint16_t len);
+static void zigbeeNcp_benchDone(void * ctx, esp_err_t err, const uint8_t * payload, uint16_t len);
+static void zigbeeNcp_task(void * pvParameters);
+
+
+
+/**************************
+**		APP FUNCTIONS	 **
+**************************/
+
+// Installs the UART driver and starts the receive task
+void zigbeeNcp_start(void)
+{
+	const uart_config_t uart_config =
+	{
+		.baud_rate = ZIGBEE_NCP_BAUD_RATE,
+		.data_bits = UART_DATA_8_BITS,
+		.parity = UART_PARITY_DISABLE,
+		.stop_bits = UART_STOP_BITS_1,
+		.flow_ctrl = (ZIGBEE_NCP_RTS_GPIO >= 0) ? UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE,
+		.rx_flow_ctrl_thresh = 100,
+		.source_clk = UART_SCLK_DEFAULT,
+	};
+
+	if (zigbee_ncp_task_handle != NULL)
+	{
+		return;
+	}
+
+	// CRC-16/CCITT-FALSE, polynomial 0x1021
+	for (int i = 0; i < 256; i++)
+	{
+		uint16_t crc = i << 8;
+		for (int bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+		g_crc_table[i] = crc;
+	}
+
+#if CONFIG_GW_STATIC_ALLOCATION
+	zigbee_ncp_window = xSemaphoreCreateCountingStatic(ZIGBEE_NCP_WINDOW, ZIGBEE_NCP_WINDOW, &zigbee_ncp_window_struct);
+	zigbee_ncp_tx_mutex = xSemaphoreCreateMutexStatic(&zigbee_ncp_tx_mutex_struct);
+#else
+	zigbee_ncp_window = xSemaphoreCreateCounting(ZIGBEE_NCP_WINDOW, ZIGBEE_NCP_WINDOW);
+	zigbee_ncp_tx_mutex = xSemaphoreCreateMutex();
+#endif
+
+	ESP_ERROR_CHECK(uart_driver_install(ZIGBEE_NCP_UART_PORT, ZIGBEE_NCP_RX_BUFFER, ZIGBEE_NCP_TX_BUFFER,
+										16, &zigbee_ncp_uart_queue, 0));
+	ESP_ERROR_CHECK(uart_param_config(ZIGBEE_NCP_UART_PORT, &uart_config));
+	ESP_ERROR_CHECK(uart_set_pin(ZIGBEE_NCP_UART_PORT, ZIGBEE_NCP_TX_GPIO, ZIGBEE_NCP_RX_GPIO,
+									ZIGBEE_NCP_RTS_GPIO, ZIGBEE_NCP_CTS_GPIO));
+	ESP_ERROR_CHECK(uart_set_rx_timeout(ZIGBEE_NCP_UART_PORT, ZIGBEE_NCP_RX_TIMEOUT_SYMBOLS));
+
+	TASK_CREATE(	zigbeeNcp_task,
+					&zigbeeNcp_task,
+					ZIGBEE_NCP_TASK_STACK_SIZE,
+					ZIGBEE_NCP_TASK_PRIORITY,
+					&zigbee_ncp_task_handle,
+					ZIGBEE_NCP_TASK_CORE_ID);
+
+	ESP_LOGI(TAG, "UART%d at %d baud, window %d", ZIGBEE_NCP_UART_PORT, ZIGBEE_NCP_BAUD_RATE, ZIGBEE_NCP_WINDOW);
+}
+
+// Sends a request without waiting for the response
+esp_err_t zigbeeNcp_requestAsync(uint16_t id, const void * payload, uint16_t len,
+									zigbee_ncp_response_cb_t cb, void * ctx, uint32_t timeout_ms)
+{
+	return zigbeeNcp_submit(id, payload, len, cb, ctx, timeout_ms, timeout_ms);
+}
+
+// Sends a request only when the window has a room
+esp_err_t zigbeeNcp_tryRequestAsync(uint16_t id, const void * payload, uint16_t len,
+									zigbee_ncp_response_cb_t cb, void * ctx, uint32_t timeout_ms)
+{
+	return zigbeeNcp_submit(id, payload, len, cb, ctx, 0, timeout_ms);
+}
+
+// Sends a request and waits for the response
+esp_err_t zigbeeNcp_request(uint16_t id, const void * payload, uint16_t len,
+							void * response, uint16_t * response_len_p, uint32_t timeout_ms)
+{
+	StaticSemaphore_t done_struct;
+	zigbee_ncp_sync_t sync =
+	{
+		.done = xSemaphoreCreateBinaryStatic(&done_struct),
+		.err = ESP_FAIL,
+		.response = response,
+		.response_len_p = response_len_p,
+	};
+	esp_err_t err;
+
+	if (xTaskGetCurrentTaskHandle() == zigbee_ncp_task_handle)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	err = zigbeeNcp_requestAsync(id, payload, len, zigbeeNcp_syncDone, &sync, timeout_ms);
+	if (err != ESP_OK)
+	{
+		return err;
+	}
+
+	// The task always completes the request, with ESP_ERR_TIMEOUT at the latest
+	xSemaphoreTake(sync.done, portMAX_DELAY);
+	vSemaphoreDelete(sync.done);
+
+	return sync.err;
+}
+
+// Adds an event handler
+esp_err_t zigbeeNcp_subscribe(zigbee_ncp_event_cb_t handler)
+{
+	esp_err_t err = ESP_ERR_NO_MEM;
+
+	taskENTER_CRITICAL(&zigbee_ncp_mux);
+	for (int i = 0; i < ZIGBEE_NCP_MAX_HANDLERS; i++)
+	{
+		if (g_handlers[i] == NULL)
+		{
+			g_handlers[i] = handler;
+			err = ESP_OK;
+			break;
+		}
+	}
+	taskEXIT_CRITICAL(&zigbee_ncp_mux);
+
+	return err;
+}
+
+// Copies the link counters
+void zigbeeNcp_getStats(zigbee_ncp_stats_t * stats_p)
+{
+	taskENTER_CRITICAL(&zigbee_ncp_mux);
+	memcpy(stats_p, &g_stats, sizeof(zigbee_ncp_stats_t));
+	taskEXIT_CRITICAL(&zigbee_ncp_mux);
+}
+
+// Sends echo requests keeping the window full and times them
+esp_err_t zigbeeNcp_benchmark(uint32_t frames, uint16_t len, zigbee_ncp_bench_t * result_p)
+{
+	StaticSemaphore_t done_struct;
+	zigbee_ncp_bench_run_t run =
+	{
+		.frames = frames,
+		.len = len,
+	};
+	zigbee_ncp_stats_t before;
+	zigbee_ncp_stats_t after;
+	uint32_t sent = 0;
+	int64_t start_us;
+
+	if (frames == 0 || frames > ZIGBEE_NCP_BENCH_MAX_FRAMES || len > ZIGBEE_NCP_MAX_PAYLOAD)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (zigbee_ncp_window == NULL)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	for (uint16_t i = 0; i < len; i++)
+	{
+		g_bench_payload[i] = i;
+	}
+	run.done = xSemaphoreCreateBinaryStatic(&done_struct);
+
+	taskENTER_CRITICAL(&zigbee_ncp_mux);
+	g_stats.rtt_max_us = 0;
+	taskEXIT_CRITICAL(&zigbee_ncp_mux);
+	zigbeeNcp_getStats(&before);
+	start_us = esp_timer_get_time();
+
+	// Blocks on the window, so there are always ZIGBEE_NCP_WINDOW in flight
+	for (; sent < frames; sent++)
+	{
+		if (zigbeeNcp_requestAsync(ZIGBEE_NCP_ECHO_ID, g_bench_payload, len,
+									zigbeeNcp_benchDone, &run, ZIGBEE_NCP_TIMEOUT_MS) != ESP_OK)
+		{
+			break;
+		}
+	}
+
+	taskENTER_CRITICAL(&zigbee_ncp_mux);
+	// Those not sent count as errors, and finish the run if the sent ones did
+	run.errors += frames - sent;
+	run.completed += frames - sent;
+	bool finished = (run.completed == frames);
+	taskEXIT_CRITICAL(&zigbee_ncp_mux);
+	if (!finished)
+	{
+		xSemaphoreTake(run.done, portMAX_DELAY);
+	}
+	vSemaphoreDelete(run.done);
+
+	zigbeeNcp_getStats(&after);
+	memset(result_p, 0x00, sizeof(zigbee_ncp_bench_t));
+	result_p->frames = frames;
+	result_p->errors = run.errors;
+	result_p->elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+	if (result_p->elapsed_ms > 0)
+	{
+		result_p->frames_per_s = (uint64_t)(frames - run.errors) * 1000 / result_p->elapsed_ms;
+	}
+	if (after.responses > before.responses)
+	{
+		result_p->rtt_avg_us = (after.rtt_sum_us - before.rtt_sum_us) / (after.responses - before.responses);
+	}
+	result_p->rtt_max_us = after.rtt_max_us;
+
+	ESP_LOGI(TAG, "benchmark: %lu frames of %u bytes, %lu errors, %lu frames/s, rtt avg %lu us max %lu us",
+					result_p->frames, len, result_p->errors, result_p->frames_per_s,
+					result_p->rtt_avg_us, result_p->rtt_max_us);
+
+	return ESP_OK;
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief CRC-16/CCITT-FALSE
+ * @param data
+ * @param len
+ * @return uint16_t
+ */
+static uint16_t zigbeeNcp_crc16(const uint8_t * data, size_t len)
+{
+	uint16_t crc = 0xFFFF;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		crc = (crc << 8) ^ g_crc_table[(crc >> 8) ^ data[i]];
+	}
+	return crc;
+}
+
+/**
+ * @brief Takes a room in the window, sends the request and keeps its callback
+ * @param id
+ * @param payload
+ * @param len
+ * @param cb
+ * @param ctx
+ * @param wait_ms for a room in the window, 0 doesn't wait
+ * @param timeout_ms for the response
+ * @return esp_err_t ESP_ERR_TIMEOUT when no room was free in time
+ */
+static esp_err_t zigbeeNcp_submit(uint16_t id, const void * payload, uint16_t len,
+									zigbee_ncp_response_cb_t cb, void * ctx, uint32_t wait_ms, uint32_t timeout_ms)
+{
+	zigbee_ncp_pending_t * pending_p = NULL;
+	esp_err_t err;
+	uint8_t sn;
+
+	if (len > ZIGBEE_NCP_MAX_PAYLOAD || cb == NULL)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (zigbee_ncp_window == NULL)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+	if (xSemaphoreTake(zigbee_ncp_window, pdMS_TO_TICKS(wait_ms)) != pdTRUE)
+	{
+		return ESP_ERR_TIMEOUT;
+	}
+
+	// A room in the window guarantees a free slot
+	taskENTER_CRITICAL(&zigbee_ncp_mux);
+	for (int i = 0; i < ZIGBEE_NCP_WINDOW; i++)
+	{
+		if (!g_pending[i].used)
+		{
+			pending_p = &g_pending[i];
+			break;
+		}
+	}
+	sn = g_next_sn++;
+	pending_p->used = true;
+	pending_p->sn = sn;
+	pending_p->cb = cb;
+	pending_p->ctx = ctx;
+	pending_p->sent_us = esp_timer_get_time();
+	pending_p->deadline_us = pending_p->sent_us + timeout_ms * 1000LL;
+	g_stats.in_flight++;
+	taskEXIT_CRITICAL(&zigbee_ncp_mux);
+
+	err = zigbeeNcp_send(ZIGBEE_NCP_FRAME_REQUEST, sn, id, payload, len);
+	if (err != ESP_OK)
+	{
+		bool ours;
+
+		// A write blocked past the deadline was already timed out by the task, cb included
+		taskENTER_CRITICAL(&zigbee_ncp_mux);
+		ours = pending_p->used && pending_p->sn == sn;
+		if (ours)
+		{
+			pending_p->used = false;
+			g_stats.in_flight--;
+		}
+		taskEXIT_CRITICAL(&zigbee_ncp_mux);
+		if (!ours)
+		{
+			return ESP_OK;
+		}
+		xSemaphoreGive(zigbee_ncp_window);
+	}
+
+	return err;
+}
+
+/**
+ * @brief Builds, encodes and writes a frame
+ * @param type
+ * @param sn
+ * @param id
+ * @param payload
+ * @param len
+ * @return esp_err_t ESP_FAIL when the UART driver refused it
+ */
+static esp_err_t zigbeeNcp_send(zigbee_ncp_frame_type_t type, uint8_t sn, uint16_t id, const void * payload, uint16_t len)
+{
+	size_t frame_len = ZIGBEE_NCP_HEADER_LEN + len;
+	size_t slip_len = 0;
+	uint16_t crc;
+	int written;
+
+	xSemaphoreTake(zigbee_ncp_tx_mutex, portMAX_DELAY);
+
+	g_tx_frame[0] = type;
+	g_tx_frame[1] = sn;
+	g_tx_frame[2] = id & 0xFF;
+	g_tx_frame[3] = id >> 8;
+	g_tx_frame[4] = len & 0xFF;
+	g_tx_frame[5] = len >> 8;
+	if (len > 0)
+	{
+		memcpy(&g_tx_frame[ZIGBEE_NCP_HEADER_LEN], payload, len);
+	}
+	crc = zigbeeNcp_crc16(g_tx_frame, frame_len);
+	g_tx_frame[frame_len++] = crc & 0xFF;
+	g_tx_frame[frame_len++] = crc >> 8;
+
+	// The leading END flushes any noise the NCP received before
+	g_tx_slip[slip_len++] = SLIP_END;
+	for (size_t i = 0; i < frame_len; i++)
+	{
+		if (g_tx_frame[i] == SLIP_END)
+		{
+			g_tx_slip[slip_len++] = SLIP_ESC;
+			g_tx_slip[slip_len++] = SLIP_ESC_END;
+		}
+		else if (g_tx_frame[i] == SLIP_ESC)
+		{
+			g_tx_slip[slip_len++] = SLIP_ESC;
+			g_tx_slip[slip_len++] = SLIP_ESC_ESC;
+		}
+		else
+		{
+			g_tx_slip[slip_len++] = g_tx_frame[i];
+		}
+	}
+	g_tx_slip[slip_len++] = SLIP_END;
+
+	// Returns once copied to the driver ring, or the FIFO when the ring is full
+	written = uart_write_bytes(ZIGBEE_NCP_UART_PORT, g_tx_slip, slip_len);
+	xSemaphoreGive(zigbee_ncp_tx_mutex);
+
+	if (written != (int)slip_len)
+	{
+		ESP_LOGE(TAG, "UART write failed (%d of %u)", written, slip_len);
+		return ESP_FAIL;
+	}
+
+	taskENTER_CRITICAL(&zigbee_ncp_mux);
+	g_stats.tx_frames++;
+	taskEXIT_CRITICAL(&zigbee_ncp_mux);
+
+	return ESP_OK;
+}
+
+/**
+ * @brief Feeds received bytes to the SLIP decoder
+ * @param data
+ * @param len
+ */
+static void zigbeeNcp_decode(const uint8_t * data, size_t len)
+{
+	zigbee_ncp_decoder_t * d = &g_decoder;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		uint8_t byte = data[i];
+
+		if (byte == SLIP_END)
+		{
+			// Back to back ENDs are empty frames, not errors
+			if (d->bad)
+			{
+				taskENTER_CRITICAL(&zigbee_ncp_mux);
+				g_stats.framing_errors++;
+				taskEXIT_CRITICAL(&zigbee_ncp_mux);
+			}
+			else if (d->len > 0)
+			{
+				zigbeeNcp_handleFrame(d->frame, d->len);
+			}
+			d->len = 0;
+			d->escaped = false;
+			d->bad = false;
+			continue;
+		}
+
+		if (d->escaped)
+		{
+			d->escaped = false;
+			if (byte == SLIP_ESC_END)
+			{
+				byte = SLIP_END;
+			}
+			else if (byte == SLIP_ESC_ESC)
+			{
+				byte = SLIP_ESC;
+			}
+			else
+			{
+				d->bad = true;
+			}
+		}
+		else if (byte == SLIP_ESC)
+		{
+			d->escaped = true;
+			continue;
+		}
+
+		if (d->len < sizeof(d->frame))
+		{
+			d->frame[d->len++] = byte;
+		}
+		else
+		{
+			d->bad = true;
+		}
+	}
+}
+
+/**
+ * @brief Checks a decoded frame and delivers it
+ * @param frame
+ * @param len
+ */
+static void zigbeeNcp_handleFrame(const uint8_t * frame, uint16_t len)
+{
+	zigbee_ncp_event_cb_t handlers[ZIGBEE_NCP_MAX_HANDLERS];
+	uint16_t payload_len;
+	uint16_t id;
+
+	if (len < ZIGBEE_NCP_HEADER_LEN + ZIGBEE_NCP_CRC_LEN)
+	{
+		taskENTER_CRITICAL(&zigbee_ncp_mux);
+		g_stats.framing_errors++;
+		taskEXIT_CRITICAL(&zigbee_ncp_mux);
+		return;
+	}
+	if (zigbeeNcp_crc16(frame, len - ZIGBEE_NCP_CRC_LEN) != (frame[len - 2] | (frame[len - 1] << 8)))
+	{
+		taskENTER_CRITICAL(&zigbee_ncp_mux);
+		g_stats.crc_errors++;
+		taskEXIT_CRITICAL(&zigbee_ncp_mux);
+		return;
+	}
+	id = frame[2] | (frame[3] << 8);
+	payload_len = frame[4] | (frame[5] << 8);
+	if (payload_len != len - ZIGBEE_NCP_HEADER_LEN - ZIGBEE_NCP_CRC_LEN)
+	{
+		taskENTER_CRITICAL(&zigbee_ncp_mux);
+		g_stats.framing_errors++;
+		taskEXIT_CRITICAL(&zigbee_ncp_mux);
+		return;
+	}
+
+	taskENTER_CRITICAL(&zigbee_ncp_mux);
+	g_stats.rx_frames++;
+	memcpy(handlers, g_handlers, sizeof(handlers));
+	taskEXIT_CRITICAL(&zigbee_ncp_mux);
+
+	switch (frame[0])
+	{
+		case ZIGBEE_NCP_FRAME_RESPONSE:
+			zigbeeNcp_complete(frame[1], ESP_OK, &frame[ZIGBEE_NCP_HEADER_LEN], payload_len);
+			break;
+
+		case ZIGBEE_NCP_FRAME_EVENT:
+			for (int i = 0; i < ZIGBEE_NCP_MAX_HANDLERS && handlers[i] != NULL; i++)
+			{
+				handlers[i](id, &frame[ZIGBEE_NCP_HEADER_LEN], payload_len);
+			}
+			break;
+
+		default:
+			ESP_LOGW(TAG, "frame type %u from the NCP ignored", frame[0]);
+			break;
+	}
+}
+
+/**
+ * @brief Hands a response or a timeout to the request and frees its room
+ * @param sn of the request
+ * @param err
+ * @param payload
+ * @param len
+ */
+static void zigbeeNcp_complete(uint8_t sn, esp_err_t err, const uint8_t * payload, uint16_t len)
+{
+	zigbee_ncp_pending_t pending = { 0 };
+	int64_t now_us = esp_timer_get_time();
+
+	taskENTER_CRITICAL(&zigbee_ncp_mux);
+	for (int i = 0; i < ZIGBEE_NCP_WINDOW; i++)
+	{
+		if (g_pending[i].used && g_pending[i].sn == sn)
+		{
+			pending = g_pending[i];
+			g_pending[i].used = false;
+			g_stats.in_flight--;
+			break;
+		}
+	}
+	if (!pending.used)
+	{
+		// Late response of a request that already timed out
+		g_stats.unmatched++;
+	}
+	else if (err == ESP_OK)
+	{
+		uint32_t rtt_us = now_us - pending.sent_us;
+		g_stats.responses++;
+		g_stats.rtt_sum_us += rtt_us;
+		if (rtt_us > g_stats.rtt_max_us)
+		{
+			g_stats.rtt_max_us = rtt_us;
+		}
+	}
+	else
+	{
+		g_stats.timeouts++;
+	}
+	taskEXIT_CRITICAL(&zigbee_ncp_mux);
+
+	if (pending.used)
+	{
+		pending.cb(pending.ctx, err, (err == ESP_OK) ? payload : NULL, (err == ESP_OK) ? len : 0);
+		xSemaphoreGive(zigbee_ncp_window);
+	}
+}
+
+/**
+ * @brief Times out the requests past their deadline
+ */
+static void zigbeeNcp_expire(void)
+{
+	int64_t now_us = esp_timer_get_time();
+
+	for (int i = 0; i < ZIGBEE_NCP_WINDOW; i++)
+	{
+		bool expired;
+		uint8_t sn;
+
+		taskENTER_CRITICAL(&zigbee_ncp_mux);
+		expired = g_pending[i].used && now_us >= g_pending[i].deadline_us;
+		sn = g_pending[i].sn;
+		taskEXIT_CRITICAL(&zigbee_ncp_mux);
+
+		if (expired)
+		{
+			ESP_LOGW(TAG, "request %u timed out", sn);
+			zigbeeNcp_complete(sn, ESP_ERR_TIMEOUT, NULL, 0);
+		}
+	}
+}
+
+/**
+ * @brief Response handler of zigbeeNcp_request
+ * @param ctx zigbee_ncp_sync_t of the caller
+ * @param err
+ * @param payload
+ * @param len
+ */
+static void zigbeeNcp_syncDone(void * ctx, esp_err_t err, const uint8_t * payload, uint16_t len)
+{
+	zigbee_ncp_sync_t * sync_p = (zigbee_ncp_sync_t *)ctx;
+
+	sync_p->err = err;
+	if (err == ESP_OK && sync_p->response_len_p != NULL)
+	{
+		if (len > *sync_p->response_len_p || (len > 0 && sync_p->response == NULL))
+		{
+			sync_p->err = ESP_ERR_INVALID_SIZE;
+		}
+		else if (len > 0)
+		{
+			memcpy(sync_p->response, payload, len);
+		}
+		*sync_p->response_len_p = len;
+	}
+	xSemaphoreGive(sync_p->done);
+}
+
+/**
+ * @brief Response handler of the benchmark echoes
+ * @param ctx zigbee_ncp_bench_run_t
+ * @param err
+ * @param payload
+ * @param len
+ */
+static void zigbeeNcp_benchDone(void * ctx, esp_err_t err, const uint8_t * payload, uint16_t len)
+{
+	zigbee_ncp_bench_run_t * run_p = (zigbee_ncp_bench_run_t *)ctx;
+	bool ok = (err == ESP_OK && len == run_p->len && memcmp(payload, g_bench_payload, len) == 0);
+	bool finished;
+
+	taskENTER_CRITICAL(&zigbee_ncp_mux);
+	if (!ok)
+	{
+		run_p->errors++;
+	}
+	finished = (++run_p->completed == run_p->frames);
+	taskEXIT_CRITICAL(&zigbee_ncp_mux);
+
+	if (finished)
+	{
+		xSemaphoreGive(run_p->done);
+	}
+}
+
+/**
+ * @brief Reads the UART events, decodes the frames and checks the timeouts
+ * @param pvParameters
+ */
+static void zigbeeNcp_task(void * pvParameters)
+{
+	uart_event_t event;
+
+	for (;;)
+	{
+		if (xQueueReceive(zigbee_ncp_uart_queue, &event, pdMS_TO_TICKS(ZIGBEE_NCP_POLL_MS)) == pdTRUE)
+		{
+			switch (event.type)
+			{
+				case UART_DATA:
+				{
+					size_t remaining = event.size;
+					while (remaining > 0)
+					{
+						int read = uart_read_bytes(ZIGBEE_NCP_UART_PORT, g_rx_chunk,
+													MIN(remaining, sizeof(g_rx_chunk)), 0);
+						if (read <= 0)
+						{
+							break;
+						}
+						zigbeeNcp_decode(g_rx_chunk, read);
+						remaining -= read;
+					}
+					break;
+				}
+
+				case UART_FIFO_OVF:
+				case UART_BUFFER_FULL:
+					// The frame in progress lost bytes, start over from the next END
+					ESP_LOGW(TAG, "UART overflow, input flushed");
+					uart_flush_input(ZIGBEE_NCP_UART_PORT);
+					xQueueReset(zigbee_ncp_uart_queue);
+					g_decoder.bad = true;
+					taskENTER_CRITICAL(&zigbee_ncp_mux);
+					g_stats.overflows++;
+					taskEXIT_CRITICAL(&zigbee_ncp_mux);
+					break;
+
+				case UART_FRAME_ERR:
+				case UART_PARITY_ERR:
+					g_decoder.bad = true;
+					break;
+
+				default:
+					break;
+			}
+		}
+
+		zigbeeNcp_expire();
+	}
+}
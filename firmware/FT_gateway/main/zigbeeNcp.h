@@ -0,0 +1,182 @@
+/**
+ * @file zigbeeNcp.h
+ * @brief Host side of the link to the Zigbee network co-processor
+ * @details
+ * The NCP (an ESP32-H2 with ESP-Zigbee NCP, or tools/ncp_standin.py) sits
+ * on a UART. Each frame is a header, the payload and a CRC-16/CCITT,
+ * SLIP encoded:
+ *
+ *     type(1) sn(1) id(2) len(2) payload(len) crc(2), little endian
+ *
+ * Up to ZIGBEE_NCP_WINDOW requests can wait for their responses at once,
+ * a response is matched to its request by the sequence number. Events sent
+ * by the NCP on its own go to the subscribed handlers. Responses and events
+ * are delivered on the zigbeeNcp task, the handlers must not block.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+#ifndef MAIN_ZIGBEENCP_H_
+#define MAIN_ZIGBEENCP_H_
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdint.h>
+
+// ESP libraries
+#include "esp_err.h"
+
+// Personal libraries
+#include "projectConfig.h"
+
+
+/**************************
+**		DEFINITIONS		 **
+**************************/
+
+#define ZIGBEE_NCP_HEADER_LEN		6
+#define ZIGBEE_NCP_CRC_LEN			2
+
+
+/**************************
+**		STRUCTURES		 **
+**************************/
+
+/**
+ * @brief Frame types
+ */
+typedef enum zigbee_ncp_frame_type_e
+{
+	ZIGBEE_NCP_FRAME_REQUEST = 0,
+	ZIGBEE_NCP_FRAME_RESPONSE,
+	ZIGBEE_NCP_FRAME_EVENT,
+} zigbee_ncp_frame_type_t;
+
+/**
+ * @brief Called once per request, on the zigbeeNcp task
+ * @param ctx given with the request
+ * @param err ESP_OK, ESP_ERR_TIMEOUT when no response came in time
+ * @param payload of the response, NULL on error
+ * @param len of the payload
+ */
+typedef void (*zigbee_ncp_response_cb_t)(void * ctx, esp_err_t err, const uint8_t * payload, uint16_t len);
+
+/**
+ * @brief Called for every event frame, on the zigbeeNcp task
+ * @param id command ID of the event
+ * @param payload
+ * @param len of the payload
+ */
+typedef void (*zigbee_ncp_event_cb_t)(uint16_t id, const uint8_t * payload, uint16_t len);
+
+/**
+ * @brief Link counters since the boot
+ */
+typedef struct zigbee_ncp_stats_s
+{
+	uint32_t	tx_frames;
+	uint32_t	rx_frames;
+	uint32_t	crc_errors;
+	uint32_t	framing_errors;		///> bad escapes, short or too long frames, UART frame errors
+	uint32_t	overflows;			///> UART buffer full, the received bytes were thrown away
+	uint32_t	timeouts;
+	uint32_t	unmatched;			///> responses with no request waiting
+	uint32_t	responses;
+	uint64_t	rtt_sum_us;			///> round trip of the responses, for the average
+	uint32_t	rtt_max_us;
+	uint8_t		in_flight;
+} zigbee_ncp_stats_t;
+
+/**
+ * @brief Benchmark result
+ */
+typedef struct zigbee_ncp_bench_s
+{
+	uint32_t	frames;
+	uint32_t	errors;
+	uint32_t	elapsed_ms;
+	uint32_t	frames_per_s;
+	uint32_t	rtt_avg_us;
+	uint32_t	rtt_max_us;
+} zigbee_ncp_bench_t;
+
+
+/**************************
+**		FUNCTIONS		 **
+**************************/
+
+/**
+ * @brief Installs the UART driver and starts the receive task
+ */
+void zigbeeNcp_start(void);
+
+/**
+ * @brief Sends a request without waiting for the response
+ * @details blocks while the window is full, up to timeout_ms
+ * @param id command ID
+ * @param payload may be NULL when len is 0
+ * @param len up to ZIGBEE_NCP_MAX_PAYLOAD
+ * @param cb called with the response or the timeout
+ * @param ctx passed to cb
+ * @param timeout_ms for a room in the window, then again for the response
+ * @return esp_err_t ESP_OK when sent, cb is not called otherwise
+ */
+esp_err_t zigbeeNcp_requestAsync(uint16_t id, const void * payload, uint16_t len,
+									zigbee_ncp_response_cb_t cb, void * ctx, uint32_t timeout_ms);
+
+/**
+ * @brief Sends a request when the window has a room, without waiting
+ * @param id command ID
+ * @param payload may be NULL when len is 0
+ * @param len up to ZIGBEE_NCP_MAX_PAYLOAD
+ * @param cb called with the response or the timeout
+ * @param ctx passed to cb
+ * @param timeout_ms for the response
+ * @return esp_err_t ESP_ERR_TIMEOUT when the window is full, cb is not called
+ * unless ESP_OK
+ */
+esp_err_t zigbeeNcp_tryRequestAsync(uint16_t id, const void * payload, uint16_t len,
+									zigbee_ncp_response_cb_t cb, void * ctx, uint32_t timeout_ms);
+
+/**
+ * @brief Sends a request and waits for the response
+ * @details not from the zigbeeNcp task (the handlers)
+ * @param id command ID
+ * @param payload may be NULL when len is 0
+ * @param len up to ZIGBEE_NCP_MAX_PAYLOAD
+ * @param response destination, may be NULL
+ * @param response_len_p size of the destination in, payload length out, may be NULL
+ * @param timeout_ms for a room in the window, then again for the response
+ * @return esp_err_t ESP_ERR_INVALID_SIZE when the response didn't fit
+ */
+esp_err_t zigbeeNcp_request(uint16_t id, const void * payload, uint16_t len,
+							void * response, uint16_t * response_len_p, uint32_t timeout_ms);
+
+/**
+ * @brief Adds an event handler
+ * @param handler
+ * @return esp_err_t ESP_ERR_NO_MEM past ZIGBEE_NCP_MAX_HANDLERS
+ */
+esp_err_t zigbeeNcp_subscribe(zigbee_ncp_event_cb_t handler);
+
+/**
+ * @brief Copies the link counters
+ * @param stats_p destination
+ */
+void zigbeeNcp_getStats(zigbee_ncp_stats_t * stats_p);
+
+/**
+ * @brief Sends echo requests keeping the window full and times them
+ * @details only the stand-in NCP answers ZIGBEE_NCP_ECHO_ID
+ * @param frames up to ZIGBEE_NCP_BENCH_MAX_FRAMES
+ * @param len payload of each one
+ * @param result_p destination
+ * @return esp_err_t ESP_ERR_INVALID_ARG on a bad count or length
+ */
+esp_err_t zigbeeNcp_benchmark(uint32_t frames, uint16_t len, zigbee_ncp_bench_t * result_p);
+
+#endif /* MAIN_ZIGBEENCP_H_ */
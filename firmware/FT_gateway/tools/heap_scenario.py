@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+"""
+Heap budget scenario for the gateway.
+
+Drives a device built with CONFIG_GW_HEAP_TRACE through connect,
+disconnect, status polls, NTP cycles and an OTA upload, one heap trace
+phase each (/sys/heap), then reports allocations per operation, peak heap
+use and the allocations left alive, grouped by module with the ELF file.
+Exits with 1 when a phase goes over its budget.
+
+The host must stay on the gateway SoftAP (default 192.168.0.1) for the
+whole run, a connected AP client keeps the SoftAP up.
+
+    python tools/heap_scenario.py --ssid MyNet --password secret \
+        --elf build/FT_gateway.elf --firmware build/FT_gateway.bin
+"""
+
+import argparse
+import http.client
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+import urllib.error
+import urllib.request
+import uuid
+
+
+# Budget of each phase: allocations per operation, peak bytes, bytes left alive.
+# The warmup phase takes what the WiFi driver keeps after its first connection.
+BUDGETS = {
+	"disconnect":	{"allocs_per_op": 400,	"peak_bytes": 32768,	"leaked_bytes": 1024},
+	"connect":		{"allocs_per_op": 600,	"peak_bytes": 49152,	"leaked_bytes": 2048},
+	"status_polls":	{"allocs_per_op": 16,	"peak_bytes": 16384,	"leaked_bytes": 0},
+	"ntp":			{"allocs_per_op": 64,	"peak_bytes": 16384,	"leaked_bytes": 512},
+	"ota":			{"allocs_per_op": 4000,	"peak_bytes": 65536,	"leaked_bytes": 1024},
+}
+
+WIFI_STATUS_CONNECT_FAILED = 2
+WIFI_STATUS_CONNECT_SUCCESS = 3
+OTA_UPDATE_SUCCESSFUL = 1
+
+
+class Gateway:
+	def __init__(self, host, timeout):
+		self.base = "http://" + host
+		self.timeout = timeout
+
+	def request(self, method, path, body=None, headers=None):
+		if isinstance(body, dict):
+			body = json.dumps(body).encode()
+			headers = {"Content-Type": "application/json"}
+		req = urllib.request.Request(self.base + path, data=body, method=method, headers=headers or {})
+		with urllib.request.urlopen(req, timeout=self.timeout) as resp:
+			data = resp.read()
+		return json.loads(data) if data else None
+
+	def phase(self, name):
+		return self.request("POST", "/sys/heap", {"phase": name} if name else {})
+
+	def wifi_status(self):
+		return self.request("POST", "/wifiConnectStatus", b"")["wifi_connect_status_json"]
+
+	def wait_status(self, done, timeout_s):
+		end = time.monotonic() + timeout_s
+		status = None
+		while time.monotonic() < end:
+			status = self.wifi_status()
+			if done(status):
+				return status
+			time.sleep(0.5)
+		raise TimeoutError("WiFi status stuck on %s" % status)
+
+
+def op_connect(gw, args):
+	gw.request("POST", "/wifiConnect.json", {"c_ssid": args.ssid, "c_pwd": args.password})
+	status = gw.wait_status(lambda s: s in (WIFI_STATUS_CONNECT_SUCCESS, WIFI_STATUS_CONNECT_FAILED), 30)
+	if status != WIFI_STATUS_CONNECT_SUCCESS:
+		raise RuntimeError("connection to %s failed" % args.ssid)
+
+
+def op_disconnect(gw, args):
+	gw.request("DELETE", "/wifiDisconnect.json")
+	gw.wait_status(lambda s: s != WIFI_STATUS_CONNECT_SUCCESS, 10)
+
+
+def op_status_poll(gw, args):
+	gw.wifi_status()
+
+
+def op_ntp_cycle(gw, args):
+	polls = gw.request("GET", "/ntpStatus.json")["polls"]
+	end = time.monotonic() + args.ntp_timeout
+	while time.monotonic() < end:
+		time.sleep(1)
+		if gw.request("GET", "/ntpStatus.json")["polls"] > polls:
+			return
+	raise TimeoutError("no NTP poll in %d s" % args.ntp_timeout)
+
+
+def op_ota(gw, args):
+	# Same multipart body as the web page
+	boundary = uuid.uuid4().hex
+	with open(args.firmware, "rb") as f:
+		image = f.read()
+	body = (("--%s\r\nContent-Disposition: form-data; name=\"file_input\"; filename=\"%s\"\r\n"
+				"Content-Type: application/octet-stream\r\n\r\n") % (boundary, os.path.basename(args.firmware))).encode()
+	body += image + ("\r\n--%s--\r\n" % boundary).encode()
+	# The handler doesn't answer, the web page asks /OTAstatus afterwards
+	try:
+		gw.request("POST", "/OTAupdate", body, {"Content-Type": "multipart/form-data; boundary=" + boundary})
+	except (TimeoutError, urllib.error.URLError, http.client.HTTPException):
+		pass
+	if gw.request("POST", "/OTAstatus", b"")["ota_update_status"] != OTA_UPDATE_SUCCESSFUL:
+		raise RuntimeError("OTA update failed")
+
+
+def scenario(args):
+	"""Phases in order: name, operations, operation"""
+	phases = [
+		("warmup",			1,					op_connect),
+		("disconnect",		1,					op_disconnect),
+		("connect",			1,					op_connect),
+		("status_polls",	args.polls,			op_status_poll),
+		("ntp",				args.ntp_cycles,	op_ntp_cycle),
+	]
+	# Last, the gateway restarts a few seconds after a good upload
+	if args.firmware:
+		phases.append(("ota", 1, op_ota))
+	return phases
+
+
+class Symbolizer:
+	"""Turns return addresses into modules: main/<module>.c or the IDF component"""
+
+	def __init__(self, elf, tool):
+		self.elf = elf
+		self.tool = tool
+		self.cache = {}
+
+	def lookup(self, addrs):
+		todo = [a for a in addrs if a not in self.cache]
+		if todo and self.elf:
+			out = subprocess.run([self.tool, "-e", self.elf] + todo, capture_output=True, text=True, check=True).stdout
+			for addr, line in zip(todo, out.splitlines()):
+				self.cache[addr] = self.module(line.split(":")[0])
+		return [self.cache.get(a, (False, None)) for a in addrs]
+
+	@staticmethod
+	def module(path):
+		"""(is a gateway module, name), name is None when unknown"""
+		if path.startswith("??"):
+			return (False, None)
+		m = re.search(r"/main/([^/]+)\.c$", path)
+		if m:
+			return (True, m.group(1))
+		m = re.search(r"/components/([^/]+)/", path)
+		return (False, m.group(1) if m else os.path.basename(path))
+
+	def owner(self, callers):
+		"""First frame in the gateway code, otherwise the innermost known one"""
+		frames = self.lookup(callers)
+		for is_main, name in frames:
+			if is_main:
+				return name
+		for is_main, name in frames:
+			if name:
+				return name
+		return callers[0] if callers else "?"
+
+
+def report(stopped, ops, budget, symbolizer):
+	allocs_per_op = stopped["allocs"] / max(ops, 1)
+	figures = {"allocs_per_op": allocs_per_op, "peak_bytes": stopped["peak_bytes"], "leaked_bytes": stopped["leaked_bytes"]}
+
+	print("%-14s %6d ops %8.1f allocs/op %8d peak %6d leaked in %d%s" % (
+			stopped["phase"], ops, allocs_per_op, stopped["peak_bytes"], stopped["leaked_bytes"],
+			stopped["leaked_count"], " (records overflowed)" if stopped["overflowed"] else ""))
+
+	by_module = {}
+	for leak in stopped["leaks"]:
+		module = symbolizer.owner(leak[1:])
+		by_module.setdefault(module, [0, 0])
+		by_module[module][0] += 1
+		by_module[module][1] += leak[0]
+	for module, (count, size) in sorted(by_module.items(), key=lambda kv: -kv[1][1]):
+		print("    %-20s %4d allocations %7d bytes" % (module, count, size))
+
+	over = [k for k, limit in budget.items() if figures[k] > limit]
+	for k in over:
+		print("    OVER BUDGET %s: %s > %s" % (k, round(figures[k], 1), budget[k]))
+	return not over
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+	parser.add_argument("--host", default="192.168.0.1")
+	parser.add_argument("--ssid", required=True)
+	parser.add_argument("--password", default="")
+	parser.add_argument("--elf", help="build/FT_gateway.elf, to group the leaks by module")
+	parser.add_argument("--addr2line", default="xtensa-esp32-elf-addr2line")
+	parser.add_argument("--firmware", help="image for the OTA phase, skipped when not given")
+	parser.add_argument("--polls", type=int, default=1000)
+	parser.add_argument("--ntp-cycles", type=int, default=2)
+	parser.add_argument("--ntp-timeout", type=int, default=120, help="longest wait for one NTP poll (s)")
+	parser.add_argument("--budget", help="JSON file overriding BUDGETS, same layout")
+	parser.add_argument("--timeout", type=float, default=10, help="HTTP timeout (s)")
+	args = parser.parse_args()
+
+	budgets = dict(BUDGETS)
+	if args.budget:
+		with open(args.budget) as f:
+			for name, limits in json.load(f).items():
+				budgets[name] = dict(budgets.get(name, {}), **limits)
+
+	gw = Gateway(args.host, args.timeout)
+	symbolizer = Symbolizer(args.elf, args.addr2line)
+	phases = scenario(args)
+	ok = True
+
+	# Also drops a phase left running by an interrupted run
+	try:
+		gw.phase(phases[0][0])
+	except urllib.error.HTTPError:
+		print("/sys/heap refused, is CONFIG_GW_HEAP_TRACE enabled?")
+		return 2
+
+	for i, (name, ops, op) in enumerate(phases):
+		try:
+			for _ in range(ops):
+				op(gw, args)
+		except Exception as e:
+			print("%s: %s" % (name, e))
+			return 2
+		# Ending a phase starts the next one
+		answer = gw.phase(phases[i + 1][0] if i + 1 < len(phases) else None)
+		ok &= report(answer["stopped"], ops, budgets.get(name, {}), symbolizer)
+
+	return 0 if ok else 1
+
+
+if __name__ == "__main__":
+	sys.exit(main())
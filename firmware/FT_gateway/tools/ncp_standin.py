@@ -0,0 +1,244 @@
+#!/usr/bin/env python3
+"""
+Stand-in Zigbee NCP for the gateway UART link.
+
+Speaks the zigbeeNcp framing (SLIP, header, CRC-16/CCITT), answers the
+echo requests of /sys/ncp/bench with the same payload, every other request
+with an empty response, and can send events on its own. Run it on a USB
+serial adapter wired to the gateway NCP pins in place of the ESP32-H2:
+
+    python tools/ncp_standin.py --port /dev/ttyUSB0
+    curl -s -X POST -d '{"frames":2000,"len":32}' http://192.168.0.1/sys/ncp/bench
+
+Without --port it opens a pseudo-terminal and prints its path, for another
+host program to connect to. --loopback runs a pipelined host against the
+stand-in over a pseudo-terminal pair and reports frames per second and the
+round trip times, it checks the framing and the stand-in on Linux without
+a board.
+"""
+
+import argparse
+import os
+import select
+import struct
+import sys
+import termios
+import threading
+import time
+import tty
+
+SLIP_END = 0xC0
+SLIP_ESC = 0xDB
+SLIP_ESC_END = 0xDC
+SLIP_ESC_ESC = 0xDD
+
+FRAME_REQUEST = 0
+FRAME_RESPONSE = 1
+FRAME_EVENT = 2
+
+# Same as ZIGBEE_NCP_ECHO_ID and ZIGBEE_NCP_MAX_PAYLOAD on projectConfig.h
+ECHO_ID = 0xFFFE
+MAX_PAYLOAD = 256
+HEADER = struct.Struct("<BBHH")
+
+
+def crc16(data):
+	"""CRC-16/CCITT-FALSE, as zigbeeNcp_crc16"""
+	crc = 0xFFFF
+	for byte in data:
+		crc ^= byte << 8
+		for _ in range(8):
+			crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+		crc &= 0xFFFF
+	return crc
+
+
+def encode(frame_type, sn, cmd_id, payload=b""):
+	raw = HEADER.pack(frame_type, sn, cmd_id, len(payload)) + payload
+	raw += struct.pack("<H", crc16(raw))
+	out = bytearray([SLIP_END])
+	for byte in raw:
+		if byte == SLIP_END:
+			out += bytes([SLIP_ESC, SLIP_ESC_END])
+		elif byte == SLIP_ESC:
+			out += bytes([SLIP_ESC, SLIP_ESC_ESC])
+		else:
+			out.append(byte)
+	out.append(SLIP_END)
+	return bytes(out)
+
+
+class Decoder:
+	"""SLIP decoder, gives (type, sn, id, payload) for each good frame"""
+
+	def __init__(self):
+		self.buf = bytearray()
+		self.escaped = False
+		self.bad = False
+		self.errors = 0
+
+	def feed(self, data):
+		frames = []
+		for byte in data:
+			if byte == SLIP_END:
+				if self.bad:
+					self.errors += 1
+				elif self.buf:
+					frame = self.check(bytes(self.buf))
+					if frame:
+						frames.append(frame)
+				self.buf.clear()
+				self.escaped = self.bad = False
+				continue
+			if self.escaped:
+				self.escaped = False
+				if byte == SLIP_ESC_END:
+					byte = SLIP_END
+				elif byte == SLIP_ESC_ESC:
+					byte = SLIP_ESC
+				else:
+					self.bad = True
+			elif byte == SLIP_ESC:
+				self.escaped = True
+				continue
+			self.buf.append(byte)
+		return frames
+
+	def check(self, raw):
+		if len(raw) < HEADER.size + 2 or crc16(raw[:-2]) != struct.unpack("<H", raw[-2:])[0]:
+			self.errors += 1
+			return None
+		frame_type, sn, cmd_id, length = HEADER.unpack(raw[:HEADER.size])
+		payload = raw[HEADER.size:-2]
+		if length != len(payload):
+			self.errors += 1
+			return None
+		return frame_type, sn, cmd_id, payload
+
+
+def raw_mode(fd, baud=None):
+	tty.setraw(fd)
+	if baud:
+		attrs = termios.tcgetattr(fd)
+		speed = getattr(termios, "B%d" % baud)
+		attrs[4] = attrs[5] = speed
+		termios.tcsetattr(fd, termios.TCSANOW, attrs)
+
+
+def standin(fd, args, stop):
+	decoder = Decoder()
+	event_sn = 0
+	next_event = time.monotonic()
+	served = 0
+	while not stop.is_set():
+		timeout = 0.1
+		if args.event_hz:
+			timeout = max(0, min(timeout, next_event - time.monotonic()))
+		ready, _, _ = select.select([fd], [], [], timeout)
+		if ready:
+			try:
+				data = os.read(fd, 4096)
+			except OSError:
+				return
+			for frame_type, sn, cmd_id, payload in decoder.feed(data):
+				if frame_type != FRAME_REQUEST:
+					continue
+				answer = payload if cmd_id == ECHO_ID else b""
+				os.write(fd, encode(FRAME_RESPONSE, sn, cmd_id, answer))
+				served += 1
+				if args.verbose and cmd_id != ECHO_ID:
+					print("request 0x%04x sn %d, %d bytes" % (cmd_id, sn, len(payload)))
+		if args.event_hz and time.monotonic() >= next_event:
+			os.write(fd, encode(FRAME_EVENT, event_sn & 0xFF, args.event_id, struct.pack("<I", event_sn)))
+			event_sn += 1
+			next_event += 1.0 / args.event_hz
+	if args.verbose:
+		print("served %d requests, %d bad frames" % (served, decoder.errors))
+
+
+def loopback(args):
+	"""Pipelined host against the stand-in, over a pseudo-terminal pair"""
+	host_fd, ncp_fd = os.openpty()
+	raw_mode(host_fd)
+	raw_mode(ncp_fd)
+	stop = threading.Event()
+	args.event_hz = 0
+	thread = threading.Thread(target=standin, args=(ncp_fd, args, stop), daemon=True)
+	thread.start()
+
+	assert crc16(b"123456789") == 0x29B1
+	payload = bytes(i & 0xFF for i in range(args.len))
+	decoder = Decoder()
+	sent_at = {}
+	rtts = []
+	errors = 0
+	sent = 0
+	start = time.monotonic()
+	while len(rtts) + errors < args.frames:
+		# Keeps the window full
+		while sent < args.frames and len(sent_at) < args.window:
+			sn = sent & 0xFF
+			sent_at[sn] = time.monotonic()
+			os.write(host_fd, encode(FRAME_REQUEST, sn, ECHO_ID, payload))
+			sent += 1
+		ready, _, _ = select.select([host_fd], [], [], 1.0)
+		if not ready:
+			print("no response for 1 s, %d in flight" % len(sent_at))
+			errors += len(sent_at)
+			sent_at.clear()
+			continue
+		for frame_type, sn, cmd_id, answer in decoder.feed(os.read(host_fd, 4096)):
+			if frame_type != FRAME_RESPONSE or sn not in sent_at:
+				errors += 1
+				continue
+			rtts.append(time.monotonic() - sent_at.pop(sn))
+			if answer != payload:
+				errors += 1
+	elapsed = time.monotonic() - start
+	stop.set()
+	thread.join()
+
+	rtts.sort()
+	print("%d frames of %d bytes, window %d: %.0f frames/s, rtt avg %.0f us p99 %.0f us max %.0f us, %d errors" % (
+			args.frames, args.len, args.window, len(rtts) / elapsed,
+			1e6 * sum(rtts) / max(len(rtts), 1), 1e6 * rtts[int(len(rtts) * 0.99) - 1] if rtts else 0,
+			1e6 * rtts[-1] if rtts else 0, errors + decoder.errors))
+	return 0 if errors + decoder.errors == 0 else 1
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+	parser.add_argument("--port", help="serial device wired to the gateway, a pseudo-terminal otherwise")
+	parser.add_argument("--baud", type=int, default=460800, help="ZIGBEE_NCP_BAUD_RATE")
+	parser.add_argument("--event-hz", type=float, default=0, help="events sent per second")
+	parser.add_argument("--event-id", type=lambda v: int(v, 0), default=0x1000)
+	parser.add_argument("--loopback", action="store_true", help="benchmark a host against the stand-in, no board")
+	parser.add_argument("--frames", type=int, default=10000)
+	parser.add_argument("--len", type=int, default=32)
+	parser.add_argument("--window", type=int, default=4, help="ZIGBEE_NCP_WINDOW")
+	parser.add_argument("-v", "--verbose", action="store_true")
+	args = parser.parse_args()
+
+	if not 0 <= args.len <= MAX_PAYLOAD:
+		parser.error("--len must be 0 to %d" % MAX_PAYLOAD)
+	if args.loopback:
+		return loopback(args)
+
+	if args.port:
+		fd = os.open(args.port, os.O_RDWR | os.O_NOCTTY)
+		raw_mode(fd, args.baud)
+	else:
+		fd, peer = os.openpty()
+		raw_mode(fd)
+		print("stand-in NCP on %s" % os.ttyname(peer))
+
+	stop = threading.Event()
+	try:
+		standin(fd, args, stop)
+	except KeyboardInterrupt:
+		pass
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())
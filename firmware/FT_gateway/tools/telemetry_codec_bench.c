@@ -0,0 +1,323 @@
+/**
+ * @file telemetry_codec_bench.c
+ * @brief Host timings of telemetryCodec.c on the traces of telemetry_decode.py
+ * @details
+ * Builds with the firmware source, no ESP-IDF, from firmware/FT_gateway:
+ *
+ *     gcc -O2 -Wall -I main tools/telemetry_codec_bench.c main/telemetryCodec.c -o telemetry_codec_bench
+ *     python tools/telemetry_decode.py --bench --days 30 --traces /tmp/traces
+ *     ./telemetry_codec_bench /tmp/traces/[a-z]*.trace
+ *
+ * Each trace is encoded with telemetryCodec_encode, compared byte for byte
+ * with the .bin the Python port wrote next to it, then decoded back with
+ * telemetryCodec_decode and compared with the samples. Both passes are
+ * repeated for at least BENCH_MIN_NS and the best run is kept. The figures
+ * are the host's, an ESP32 at 240 MHz is some 10 to 20 times slower.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Personal libraries
+#include "telemetryCodec.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+#define BENCH_SAMPLE_BYTES		8				// uint32 time, int32 value, little endian
+#define BENCH_MIN_NS			200000000ULL	// repeats each pass for this long
+
+/**
+ * @brief Samples of a trace, one column
+ */
+typedef struct bench_trace_s
+{
+	uint32_t *	ts;
+	int32_t *	values;
+	size_t		count;
+} bench_trace_t;
+
+	/* Static Functions */
+
+static uint64_t bench_nowNs(void);
+static uint8_t * bench_readFile(const char * path, size_t * len_p);
+static bool bench_loadTrace(const char * path, bench_trace_t * trace_p);
+static size_t bench_encode(const bench_trace_t * trace_p, uint8_t * out_p, size_t size);
+static bool bench_decode(const bench_trace_t * trace_p, const uint8_t * in_p, size_t len, bool check);
+static bool bench_run(const char * path);
+static void bench_time(const char * name, const char * python, const bench_trace_t * trace_p,
+						uint8_t * out_p, size_t size, size_t len);
+
+
+
+/**************************
+**		  MAIN			 **
+**************************/
+
+int main(int argc, char ** argv)
+{
+	bool ok = true;
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s TRACE... (python tools/telemetry_decode.py --bench --traces DIR)\n", argv[0]);
+		return 2;
+	}
+
+	printf("%-14s %8s %10s %10s %8s %10s %8s %12s %12s\n", "trace", "samples", "bytes", "B/sample", "python",
+			"enc ns", "dec ns", "C enc/s", "C dec/s");
+	for (int i = 1; i < argc; i++)
+	{
+		ok &= bench_run(argv[i]);
+	}
+	return ok ? 0 : 1;
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+static uint64_t bench_nowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Reads a whole file
+ * @param path
+ * @param len_p destination of the length
+ * @return uint8_t * to free, NULL when it can't be read
+ */
+static uint8_t * bench_readFile(const char * path, size_t * len_p)
+{
+	FILE * f = fopen(path, "rb");
+	uint8_t * data_p = NULL;
+	long len;
+
+	if (f == NULL)
+	{
+		return NULL;
+	}
+	if (fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0)
+	{
+		data_p = malloc(len ? len : 1);
+		if (data_p != NULL && fread(data_p, 1, len, f) != (size_t)len)
+		{
+			free(data_p);
+			data_p = NULL;
+		}
+		*len_p = len;
+	}
+	fclose(f);
+	return data_p;
+}
+
+/**
+ * @brief Loads the samples of a .trace file
+ * @param path
+ * @param trace_p destination, its arrays to free
+ * @return true when loaded
+ */
+static bool bench_loadTrace(const char * path, bench_trace_t * trace_p)
+{
+	size_t len;
+	uint8_t * data_p = bench_readFile(path, &len);
+
+	if (data_p == NULL || len == 0 || len % BENCH_SAMPLE_BYTES != 0)
+	{
+		fprintf(stderr, "%s: not a trace of telemetry_decode.py --traces\n", path);
+		free(data_p);
+		return false;
+	}
+
+	trace_p->count = len / BENCH_SAMPLE_BYTES;
+	trace_p->ts = malloc(trace_p->count * sizeof(uint32_t));
+	trace_p->values = malloc(trace_p->count * sizeof(int32_t));
+	if (trace_p->ts == NULL || trace_p->values == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		free(trace_p->ts);
+		free(trace_p->values);
+		free(data_p);
+		return false;
+	}
+	for (size_t i = 0; i < trace_p->count; i++)
+	{
+		const uint8_t * p = &data_p[i * BENCH_SAMPLE_BYTES];
+
+		trace_p->ts[i] = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+		trace_p->values[i] = (int32_t)(p[4] | p[5] << 8 | p[6] << 16 | (uint32_t)p[7] << 24);
+	}
+	free(data_p);
+	return true;
+}
+
+/**
+ * @brief Encodes a trace from the time of its first sample, as the Python port
+ * @param trace_p
+ * @param out_p
+ * @param size room at out_p
+ * @return size_t bytes written, 0 when it didn't fit
+ */
+static size_t bench_encode(const bench_trace_t * trace_p, uint8_t * out_p, size_t size)
+{
+	telemetry_codec_t codec;
+	size_t pos = 0;
+
+	telemetryCodec_init(&codec, trace_p->ts[0], 1);
+	for (size_t i = 0; i < trace_p->count; i++)
+	{
+		size_t written = telemetryCodec_encode(&codec, trace_p->ts[i], &trace_p->values[i], &out_p[pos], size - pos);
+
+		if (written == 0)
+		{
+			return 0;
+		}
+		pos += written;
+	}
+	return pos;
+}
+
+/**
+ * @brief Decodes a trace
+ * @param trace_p samples expected
+ * @param in_p
+ * @param len
+ * @param check compares every sample, off while timing
+ * @return bool false when a sample is cut, or differs
+ */
+static bool bench_decode(const bench_trace_t * trace_p, const uint8_t * in_p, size_t len, bool check)
+{
+	telemetry_codec_t codec;
+	size_t pos = 0;
+	uint32_t ts = 0;
+	int32_t value = 0;
+	uint32_t sum = 0;
+
+	telemetryCodec_init(&codec, trace_p->ts[0], 1);
+	for (size_t i = 0; i < trace_p->count; i++)
+	{
+		size_t read = telemetryCodec_decode(&codec, &in_p[pos], len - pos, &ts, &value);
+
+		if (read == 0 || (check && (ts != trace_p->ts[i] || value != trace_p->values[i])))
+		{
+			fprintf(stderr, "sample %zu decoded as %u %d, was %u %d\n", i, ts, value, trace_p->ts[i], trace_p->values[i]);
+			return false;
+		}
+		pos += read;
+		sum += ts ^ value;
+	}
+
+	// Keeps the unchecked loop from being optimized away
+	__asm__ volatile("" : : "r"(sum));
+	return pos == len;
+}
+
+/**
+ * @brief Checks and times one trace, prints its line
+ * @param path .trace file, the .bin next to it is the Python encoding
+ * @return true when the C codec agrees with the Python port and decodes back
+ */
+static bool bench_run(const char * path)
+{
+	bench_trace_t trace = { 0 };
+	char name[64];
+	char bin_path[1024];
+	const char * base_p = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+	size_t name_len = strcspn(base_p, ".");
+	uint8_t * out_p = NULL;
+	uint8_t * python_p;
+	size_t python_len = 0;
+	const char * python = "-";
+	size_t size;
+	size_t len;
+
+	snprintf(name, sizeof(name), "%.*s", (int)name_len, base_p);
+	if (!bench_loadTrace(path, &trace))
+	{
+		return false;
+	}
+	size = trace.count * TELEMETRY_CODEC_MAX_BYTES(1);
+	out_p = malloc(size);
+	len = (out_p != NULL) ? bench_encode(&trace, out_p, size) : 0;
+	if (len == 0 || !bench_decode(&trace, out_p, len, true))
+	{
+		fprintf(stderr, "%s: doesn't decode back\n", name);
+		free(out_p);
+		free(trace.ts);
+		free(trace.values);
+		return false;
+	}
+
+	// Same bytes as the Python port, when its encoding is there
+	snprintf(bin_path, sizeof(bin_path), "%.*s.bin", (int)(base_p - path + name_len), path);
+	python_p = bench_readFile(bin_path, &python_len);
+	if (python_p != NULL)
+	{
+		python = (python_len == len && memcmp(python_p, out_p, len) == 0) ? "same" : "DIFFERS";
+		free(python_p);
+	}
+
+	bench_time(name, python, &trace, out_p, size, len);
+	free(out_p);
+	free(trace.ts);
+	free(trace.values);
+	return strcmp(python, "DIFFERS") != 0;
+}
+
+/**
+ * @brief Best encode and decode runs over BENCH_MIN_NS each, prints the line
+ * @param name
+ * @param python comparison with the Python encoding
+ * @param trace_p
+ * @param out_p encoding of the trace, rewritten while timing
+ * @param size room at out_p
+ * @param len its length
+ */
+static void bench_time(const char * name, const char * python, const bench_trace_t * trace_p,
+						uint8_t * out_p, size_t size, size_t len)
+{
+	uint64_t enc_ns = UINT64_MAX;
+	uint64_t dec_ns = UINT64_MAX;
+	uint64_t spent_ns;
+	uint64_t run_ns;
+	uint64_t t0;
+
+	for (spent_ns = 0; spent_ns < BENCH_MIN_NS; spent_ns += run_ns)
+	{
+		t0 = bench_nowNs();
+		bench_encode(trace_p, out_p, size);
+		run_ns = bench_nowNs() - t0;
+		enc_ns = (run_ns < enc_ns) ? run_ns : enc_ns;
+	}
+	for (spent_ns = 0; spent_ns < BENCH_MIN_NS; spent_ns += run_ns)
+	{
+		t0 = bench_nowNs();
+		bench_decode(trace_p, out_p, len, false);
+		run_ns = bench_nowNs() - t0;
+		dec_ns = (run_ns < dec_ns) ? run_ns : dec_ns;
+	}
+
+	printf("%-14s %8zu %10zu %10.2f %8s %10.1f %8.1f %12.0f %12.0f\n", name, trace_p->count, len,
+			(double)len / trace_p->count, python, (double)enc_ns / trace_p->count, (double)dec_ns / trace_p->count,
+			trace_p->count * 1e9 / enc_ns, trace_p->count * 1e9 / dec_ns);
+}
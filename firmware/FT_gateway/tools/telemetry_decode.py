@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""
+Decoder of the gateway telemetry codec.
+
+Reads the compressed points of /telemetry.bin, from the gateway or from a
+saved file, and prints them as CSV: ts, min, max, avg, count. The format
+is the one of telemetryCodec.h: per sample a zigzag varint of the delta of
+delta of the time, then one zigzag varint per column of the delta from
+its previous value.
+
+    python tools/telemetry_decode.py \
+        "http://192.168.0.1/telemetry.bin?ieee=00124b0001020304&attr=flow_ml_min&step=300"
+    python tools/telemetry_decode.py saved.bin
+
+--bench encodes synthetic valve and sensor traces, checks they decode
+back and reports bytes per sample against the 8 byte records the store
+used before the codec. The samples per second are this Python port's,
+not the firmware's. For the C codec, write the traces and time them with
+tools/telemetry_codec_bench.c:
+
+    python tools/telemetry_decode.py --bench --days 30 --traces /tmp/traces
+    ./telemetry_codec_bench /tmp/traces/[a-z]*.trace
+
+A .trace file holds the samples, a little endian uint32 time and int32
+value each. The .bin file next to it holds their encoding by this port,
+which the C codec must reproduce byte for byte.
+"""
+
+import argparse
+import os
+import random
+import struct
+import sys
+import time
+import urllib.request
+
+MASK = 0xFFFFFFFF
+VARINT_MAX = 5
+RAW_RECORD_BYTES = 8
+# Device position and attribute before each sample on the store blocks
+STORE_RECORD_HEADER = 2
+
+
+def zigzag(value):
+	value &= MASK
+	return ((value << 1) ^ (MASK if value & 0x80000000 else 0)) & MASK
+
+
+def unzigzag(value):
+	return (value >> 1) ^ (MASK if value & 1 else 0)
+
+
+def signed(value):
+	value &= MASK
+	return value - (1 << 32) if value & 0x80000000 else value
+
+
+def put_varint(value, out):
+	while True:
+		byte = value & 0x7F
+		value >>= 7
+		out.append(byte | (0x80 if value else 0))
+		if not value:
+			return
+
+
+def get_varint(buf, pos):
+	value = 0
+	for i in range(VARINT_MAX):
+		if pos + i >= len(buf):
+			break
+		value |= (buf[pos + i] & 0x7F) << (7 * i)
+		if not buf[pos + i] & 0x80:
+			return value & MASK, pos + i + 1
+	raise ValueError("varint cut or too long at byte %d" % pos)
+
+
+class Codec:
+	"""State of a stream, the same for encoding and decoding."""
+
+	def __init__(self, base_ts, columns):
+		self.ts = base_ts & MASK
+		self.delta = 0
+		self.values = [0] * columns
+
+	def encode(self, ts, values, out):
+		delta = (ts - self.ts) & MASK
+		put_varint(zigzag(delta - self.delta), out)
+		for c, value in enumerate(values):
+			put_varint(zigzag(value - self.values[c]), out)
+		self.ts = ts & MASK
+		self.delta = delta
+		self.values = [v & MASK for v in values]
+
+	def decode(self, buf, pos):
+		word, pos = get_varint(buf, pos)
+		self.delta = (self.delta + unzigzag(word)) & MASK
+		self.ts = (self.ts + self.delta) & MASK
+		for c in range(len(self.values)):
+			word, pos = get_varint(buf, pos)
+			self.values[c] = (self.values[c] + unzigzag(word)) & MASK
+		return self.ts, [signed(v) for v in self.values], pos
+
+
+def decode_export(data):
+	"""Points of a /telemetry.bin answer."""
+	if len(data) < 8 or data[:2] != b"TC" or data[2] != 1:
+		raise ValueError("not a telemetry.bin stream")
+	codec = Codec(int.from_bytes(data[4:8], "little"), data[3])
+	pos = 8
+	while pos < len(data):
+		ts, values, pos = codec.decode(data, pos)
+		yield ts, values
+
+
+def valve_trace(days, rng):
+	"""Open 20 min at 06:00 and 18:00, reported on change and every 10 min."""
+	samples = []
+	windows = [(6 * 3600, 6 * 3600 + 1200), (18 * 3600, 18 * 3600 + 1200)]
+	edges = {t for window in windows for t in window}
+	for day in range(days):
+		for t in sorted(set(range(0, 86400, 600)) | edges):
+			state = any(start <= t < end for start, end in windows)
+			samples.append((1790000000 + day * 86400 + t + rng.randint(-2, 2), int(state)))
+	return samples
+
+
+def sensor_trace(days, period, base, noise, drift, rng):
+	"""Reported every period seconds with a little jitter, slow drift and noise."""
+	samples = []
+	level = base
+	for i in range(days * 86400 // period):
+		level += rng.uniform(-drift, drift)
+		samples.append((1790000000 + i * period + rng.randint(-1, 1), int(level + rng.gauss(0, noise))))
+	return samples
+
+
+def bench(args):
+	rng = random.Random(1)
+	traces = {
+		"valve":		valve_trace(args.days, rng),
+		"flow_ml_min":	sensor_trace(args.days, 60, 1200, 20, 5, rng),
+		"pressure_mbar": sensor_trace(args.days, 30, 2500, 3, 1, rng),
+		"battery_pct":	sensor_trace(args.days, 3600, 100, 0, 0.05, rng),
+	}
+	if args.traces:
+		os.makedirs(args.traces, exist_ok=True)
+	print("%-14s %8s %10s %10s %8s %10s %12s %12s" % ("trace", "samples", "bytes", "B/sample",
+													"store B", "ratio", "py enc/s", "py dec/s"))
+	for name, samples in traces.items():
+		out = bytearray()
+		codec = Codec(samples[0][0], 1)
+		start = time.perf_counter()
+		for ts, value in samples:
+			codec.encode(ts, [value], out)
+		encode_s = time.perf_counter() - start
+
+		codec = Codec(samples[0][0], 1)
+		pos = 0
+		decoded = []
+		start = time.perf_counter()
+		for _ in samples:
+			got_ts, got, pos = codec.decode(out, pos)
+			decoded.append((got_ts, got[0]))
+		decode_s = time.perf_counter() - start
+		for (got_ts, got), (ts, value) in zip(decoded, samples):
+			if got_ts != ts or got != value:
+				print("%s: sample decoded as %d %d, was %d %d" % (name, got_ts, got, ts, value))
+				return 1
+
+		if args.traces:
+			path = os.path.join(args.traces, name)
+			with open(path + ".trace", "wb") as f:
+				f.write(b"".join(struct.pack("<Ii", ts & MASK, value) for ts, value in samples))
+			with open(path + ".bin", "wb") as f:
+				f.write(out)
+
+		per_sample = len(out) / len(samples)
+		store = per_sample + STORE_RECORD_HEADER
+		print("%-14s %8d %10d %10.2f %8.2f %9.2fx %12.0f %12.0f" % (name, len(samples), len(out), per_sample,
+															store, RAW_RECORD_BYTES / store,
+															len(samples) / encode_s, len(samples) / decode_s))
+	return 0
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+	parser.add_argument("source", nargs="?", help="telemetry.bin URL or file")
+	parser.add_argument("--bench", action="store_true", help="compress synthetic traces, no board")
+	parser.add_argument("--days", type=int, default=7, help="length of the synthetic traces")
+	parser.add_argument("--traces", metavar="DIR", help="with --bench, write the traces and their encoding for telemetry_codec_bench")
+	args = parser.parse_args()
+
+	if args.bench:
+		return bench(args)
+	if not args.source:
+		parser.error("a URL or a file is needed without --bench")
+
+	if args.source.startswith("http://"):
+		with urllib.request.urlopen(args.source, timeout=30) as answer:
+			data = answer.read()
+	else:
+		with open(args.source, "rb") as f:
+			data = f.read()
+
+	print("ts,min,max,avg,count")
+	for ts, values in decode_export(data):
+		print("%d,%s" % (ts, ",".join(str(v) for v in values)))
+	return 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())
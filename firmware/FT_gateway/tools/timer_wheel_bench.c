@@ -0,0 +1,366 @@
+/**
+ * @file timer_wheel_bench.c
+ * @brief Host check and timings of timerWheel.c
+ * @details
+ * Builds with the firmware source, no ESP-IDF, from firmware/FT_gateway:
+ *
+ *     gcc -O2 -Wall -I main tools/timer_wheel_bench.c main/timerWheel.c -o timer_wheel_bench
+ *     ./timer_wheel_bench [timers] [seed]
+ *
+ * The check adds the timers (5000 by default) on every level and past the
+ * wheel span, moves and removes some, and advances the wheel by single
+ * seconds and by jumps of up to a month. Each timer must fire once, on
+ * its exact second, and a removed one never. Some callbacks add their
+ * timer again or remove another one of the same second, as the valve
+ * schedule does.
+ *
+ * The timings follow /schedules/bench: random weekly timers, each added
+ * again one hour to a week after it fires, over 28 simulated days; once
+ * in a single advance, once ticking every second like the schedule task.
+ * The figures are the host's, an ESP32 at 240 MHz is some 10 to 20 times
+ * slower.
+ * @date 2026-10-18
+ * @author Luiz Carlos
+ */
+
+
+/**************************
+**		  INCLUDES	 	 **
+**************************/
+
+// C libraries
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Personal libraries
+#include "timerWheel.h"
+
+
+/**************************
+**		DECLARATIONS	 **
+**************************/
+
+#define BENCH_DAY_S				86400UL
+#define BENCH_WEEK_S			(7 * BENCH_DAY_S)
+#define BENCH_SPAN_S			(1UL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+#define BENCH_START_S			1700000000UL	// any time, the wheel only sees differences
+#define BENCH_REARMS			3				// times a check timer is added again from its callback
+
+/**
+ * @brief Check timer, the node first so the callback casts it back
+ */
+typedef struct check_timer_s
+{
+	timer_wheel_node_t	node;
+	uint32_t			due;		///> second it must fire at
+	uint8_t				rearms;		///> still to add again from the callback
+	bool				removed;
+	uint32_t			fired;
+} check_timer_t;
+
+typedef struct check_run_s
+{
+	timer_wheel_t *		wheel_p;
+	check_timer_t *		timers_p;
+	uint32_t			count;
+	uint32_t			seed;
+	uint32_t			last_s;		///> second of the previous fire, they come in order
+	uint32_t			last_due;	///> latest second a timer was set to, the check ends there
+	uint32_t			errors;
+} check_run_t;
+
+typedef struct bench_run_s
+{
+	timer_wheel_t *		wheel_p;
+	uint32_t			seed;
+} bench_run_t;
+
+	/* Static Functions */
+
+static uint32_t bench_rand(uint32_t * seed_p);
+static uint32_t bench_delay(uint32_t * seed_p);
+static uint64_t bench_nowNs(void);
+static void bench_checkFire(timer_wheel_node_t * node_p, void * ctx);
+static void bench_setDue(check_run_t * run_p, check_timer_t * timer_p);
+static bool bench_check(uint32_t count, uint32_t seed);
+static void bench_fire(timer_wheel_node_t * node_p, void * ctx);
+static void bench_time(uint32_t count, uint32_t seed);
+
+
+
+/**************************
+**		  MAIN			 **
+**************************/
+
+int main(int argc, char ** argv)
+{
+	uint32_t count = (argc > 1) ? strtoul(argv[1], NULL, 0) : 5000;
+	uint32_t seed = (argc > 2) ? strtoul(argv[2], NULL, 0) : 0x2545F491;
+
+	if (count == 0 || seed == 0)
+	{
+		fprintf(stderr, "usage: %s [timers] [seed], both above 0\n", argv[0]);
+		return 2;
+	}
+
+	if (!bench_check(count, seed))
+	{
+		return 1;
+	}
+
+	printf("%8s %10s %10s %12s %10s %12s\n", "timers", "insert ns", "fired", "advance ns", "ticks", "tick ns");
+	bench_time(count / 5 ? count / 5 : 1, seed);
+	bench_time(count, seed);
+	bench_time(count * 10, seed);
+	return 0;
+}
+
+
+
+/**************************
+**	  STATIC FUNCTIONS	 **
+**************************/
+
+/**
+ * @brief xorshift32, same as the firmware benchmark
+ * @param seed_p not 0
+ * @return uint32_t
+ */
+static uint32_t bench_rand(uint32_t * seed_p)
+{
+	uint32_t x = *seed_p;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*seed_p = x;
+	return x;
+}
+
+/**
+ * @brief Delay landing on a random level, or past the span of the wheel
+ * @param seed_p
+ * @return uint32_t seconds, above 0
+ */
+static uint32_t bench_delay(uint32_t * seed_p)
+{
+	uint32_t level = bench_rand(seed_p) % (TIMER_WHEEL_LEVELS + 1);
+	uint32_t range = (level < TIMER_WHEEL_LEVELS) ? 1UL << (TIMER_WHEEL_SLOT_BITS * (level + 1)) : 2 * BENCH_SPAN_S;
+
+	return 1 + bench_rand(seed_p) % range;
+}
+
+static uint64_t bench_nowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Check callback: exact second, in order, not removed, then maybe
+ * adds itself again or removes another timer
+ * @param node_p
+ * @param ctx check_run_t
+ */
+static void bench_checkFire(timer_wheel_node_t * node_p, void * ctx)
+{
+	check_run_t * run_p = ctx;
+	check_timer_t * timer_p = (check_timer_t *)node_p;
+	uint32_t now = run_p->wheel_p->now;
+
+	timer_p->fired++;
+	if (timer_p->removed || now != timer_p->due || node_p->expires != timer_p->due || (int32_t)(now - run_p->last_s) < 0)
+	{
+		if (run_p->errors++ < 10)
+		{
+			fprintf(stderr, "timer %ld: fired at +%lu, due +%lu%s\n", (long)(timer_p - run_p->timers_p),
+							(unsigned long)(now - BENCH_START_S), (unsigned long)(timer_p->due - BENCH_START_S),
+							timer_p->removed ? ", removed" : "");
+		}
+	}
+	run_p->last_s = now;
+
+	if (timer_p->rearms > 0)
+	{
+		timer_p->rearms--;
+		timer_p->fired--;
+		timer_p->due = now + bench_delay(&run_p->seed);
+		bench_setDue(run_p, timer_p);
+	}
+
+	// Another timer, possibly of this same second
+	if (bench_rand(&run_p->seed) % 8 == 0)
+	{
+		check_timer_t * other_p = &run_p->timers_p[bench_rand(&run_p->seed) % run_p->count];
+
+		if (other_p != timer_p && timerWheel_isPending(&other_p->node))
+		{
+			timerWheel_remove(run_p->wheel_p, &other_p->node);
+			other_p->removed = true;
+		}
+	}
+}
+
+/**
+ * @brief Adds a check timer on its due second
+ * @param run_p
+ * @param timer_p
+ */
+static void bench_setDue(check_run_t * run_p, check_timer_t * timer_p)
+{
+	if ((int32_t)(timer_p->due - run_p->last_due) > 0)
+	{
+		run_p->last_due = timer_p->due;
+	}
+	timerWheel_add(run_p->wheel_p, &timer_p->node, timer_p->due);
+}
+
+/**
+ * @brief Every timer fires once on its second, the removed ones never
+ * @param count timers
+ * @param seed
+ * @return true when correct
+ */
+static bool bench_check(uint32_t count, uint32_t seed)
+{
+	static timer_wheel_t wheel;
+	check_run_t run = { .wheel_p = &wheel, .count = count, .seed = seed, .last_s = BENCH_START_S, .last_due = BENCH_START_S };
+	uint32_t advances = 0;
+	uint32_t fired = 0;
+	uint32_t removed = 0;
+
+	run.timers_p = calloc(count, sizeof(check_timer_t));
+	if (run.timers_p == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		return false;
+	}
+
+	timerWheel_init(&wheel, BENCH_START_S);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		check_timer_t * timer_p = &run.timers_p[i];
+
+		timerWheel_nodeInit(&timer_p->node);
+		timer_p->due = BENCH_START_S + bench_delay(&run.seed);
+		timer_p->rearms = (bench_rand(&run.seed) % 4 == 0) ? BENCH_REARMS : 0;
+		bench_setDue(&run, timer_p);
+	}
+
+	// Moved while pending, and removed before firing
+	for (uint32_t i = 0; i < count; i += 7)
+	{
+		run.timers_p[i].due = BENCH_START_S + bench_delay(&run.seed);
+		bench_setDue(&run, &run.timers_p[i]);
+	}
+	for (uint32_t i = 3; i < count; i += 10)
+	{
+		timerWheel_remove(&wheel, &run.timers_p[i].node);
+		run.timers_p[i].removed = true;
+	}
+
+	// Single seconds and jumps of up to a month, to the last due second; a lost timer doesn't stop it
+	while (wheel.pending > 0 && (int32_t)(wheel.now - run.last_due) < 0)
+	{
+		uint32_t step = (bench_rand(&run.seed) % 2 == 0) ? 1 : 1 + bench_rand(&run.seed) % (30 * BENCH_DAY_S);
+
+		fired += timerWheel_advance(&wheel, wheel.now + step, bench_checkFire, &run);
+		advances++;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		check_timer_t * timer_p = &run.timers_p[i];
+		uint32_t expected = timer_p->removed ? 0 : 1;
+
+		removed += timer_p->removed;
+		if (timer_p->fired != expected)
+		{
+			if (run.errors++ < 10)
+			{
+				fprintf(stderr, "timer %lu: fired %lu times, expected %lu\n", (unsigned long)i,
+								(unsigned long)timer_p->fired, (unsigned long)expected);
+			}
+		}
+	}
+
+	printf("check: %lu timers, %lu removed, %lu fires over %lu days in %lu advances: %s\n",
+			(unsigned long)count, (unsigned long)removed, (unsigned long)fired,
+			(unsigned long)((run.last_due - BENCH_START_S) / BENCH_DAY_S), (unsigned long)advances,
+			run.errors ? "FAILED" : "ok");
+	free(run.timers_p);
+	return run.errors == 0;
+}
+
+/**
+ * @brief Benchmark callback, added again one hour to a week later
+ * @param node_p
+ * @param ctx bench_run_t
+ */
+static void bench_fire(timer_wheel_node_t * node_p, void * ctx)
+{
+	bench_run_t * run_p = ctx;
+
+	timerWheel_add(run_p->wheel_p, node_p, run_p->wheel_p->now + 3600 + bench_rand(&run_p->seed) % BENCH_WEEK_S);
+}
+
+/**
+ * @brief Times the inserts and 28 days of fires, in one advance then by seconds
+ * @param count timers
+ * @param seed
+ */
+static void bench_time(uint32_t count, uint32_t seed)
+{
+	static timer_wheel_t wheel;
+	bench_run_t run = { .wheel_p = &wheel, .seed = seed };
+	timer_wheel_node_t * nodes_p = calloc(count, sizeof(timer_wheel_node_t));
+	uint32_t end_s = BENCH_START_S + 28 * BENCH_DAY_S;
+	uint64_t insert_ns;
+	uint64_t advance_ns;
+	uint64_t tick_ns;
+	uint32_t fired;
+	uint64_t t0;
+
+	if (nodes_p == NULL)
+	{
+		fprintf(stderr, "out of memory\n");
+		return;
+	}
+
+	timerWheel_init(&wheel, BENCH_START_S);
+	t0 = bench_nowNs();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		timerWheel_nodeInit(&nodes_p[i]);
+		timerWheel_add(&wheel, &nodes_p[i], BENCH_START_S + bench_rand(&run.seed) % BENCH_WEEK_S);
+	}
+	insert_ns = bench_nowNs() - t0;
+
+	t0 = bench_nowNs();
+	fired = timerWheel_advance(&wheel, end_s, bench_fire, &run);
+	advance_ns = bench_nowNs() - t0;
+
+	// Same timers from the start, the schedule task advances once a second
+	run.seed = seed;
+	timerWheel_init(&wheel, BENCH_START_S);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		timerWheel_nodeInit(&nodes_p[i]);
+		timerWheel_add(&wheel, &nodes_p[i], BENCH_START_S + bench_rand(&run.seed) % BENCH_WEEK_S);
+	}
+	t0 = bench_nowNs();
+	for (uint32_t s = BENCH_START_S + 1; s <= end_s; s++)
+	{
+		timerWheel_advance(&wheel, s, bench_fire, &run);
+	}
+	tick_ns = bench_nowNs() - t0;
+
+	printf("%8lu %10.1f %10lu %12.1f %10lu %12.1f\n", (unsigned long)count, (double)insert_ns / count,
+			(unsigned long)fired, fired ? (double)advance_ns / fired : 0.0,
+			(unsigned long)(end_s - BENCH_START_S), (double)tick_ns / (end_s - BENCH_START_S));
+	free(nodes_p);
+}
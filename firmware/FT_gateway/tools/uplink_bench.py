@@ -0,0 +1,407 @@
+#!/usr/bin/env python3
+"""
+Listener and benchmarks of the gateway MQTT uplink.
+
+Needs only a broker, a local mosquitto will do. The batches are the ones
+of mqttUplink.h: "TB", version 1, 1 column and the base time, then per
+sample a varint series index and a telemetryCodec.h sample of that
+series; a new series index is followed by a varint device index and the
+attribute, a new device index by the IEEE address.
+
+    python tools/uplink_bench.py listen --broker 192.168.0.10
+
+subscribes to the topics of every gateway, decodes the batches and
+prints every few seconds the messages, samples, bytes per sample and the
+age of the newest sample, then the duplicates at the end (Ctrl-C). The
+age drops once a backlog is drained.
+
+    python tools/uplink_bench.py drain --broker localhost --days 2 --window 1,4,8 --rtt-ms 80
+
+stands in for the gateway, no board: builds the backlog of some days of
+synthetic valve and sensor traces (as telemetry_decode.py --bench),
+batches it the way mqttUplink.c does and publishes it with QoS 1, with
+up to --window messages awaiting their PUBACK and at most --rate batches
+per second. A second connection subscribes and checks every sample
+arrives once. --rtt-ms holds each PUBACK back, the round trip of the
+gateway to a remote broker.
+"""
+
+import argparse
+import random
+import socket
+import struct
+import sys
+import threading
+import time
+
+from telemetry_decode import Codec, get_varint, put_varint, sensor_trace, valve_trace
+
+ATTRS = ["valve", "flow_ml_min", "pressure_mbar", "battery_pct"]
+BATCH_HEADER = 8
+SAMPLE_MAX = 2 * 5 + 8 + 1 + 2 * 5
+
+
+def decode_batch(data):
+	"""(ieee, attr, ts, value) of a telemetry batch."""
+	if len(data) < BATCH_HEADER or data[:2] != b"TB" or data[2] != 1 or data[3] != 1:
+		raise ValueError("not a telemetry batch")
+	base_ts = int.from_bytes(data[4:8], "little")
+	devices = []
+	series = []
+	pos = BATCH_HEADER
+	while pos < len(data):
+		index, pos = get_varint(data, pos)
+		if index == len(series):
+			device, pos = get_varint(data, pos)
+			if device == len(devices):
+				devices.append(int.from_bytes(data[pos:pos + 8], "little"))
+				pos += 8
+			elif device > len(devices):
+				raise ValueError("device %d before %d" % (device, len(devices)))
+			series.append((devices[device], data[pos], Codec(base_ts, 1)))
+			pos += 1
+		elif index > len(series):
+			raise ValueError("series %d before %d" % (index, len(series)))
+		ieee, attr, codec = series[index]
+		ts, values, pos = codec.decode(data, pos)
+		yield ieee, attr, ts, values[0]
+
+
+class Batch:
+	"""Telemetry batch being built, as mqttUplink_addSample."""
+
+	def __init__(self, limit, max_series=256, max_devices=64):
+		self.limit = limit
+		self.max_series = max_series
+		self.max_devices = max_devices
+		self.out = bytearray(b"TB\x01\x01\x00\x00\x00\x00")
+		self.devices = {}
+		self.series = {}
+		self.samples = 0
+
+	def add(self, ieee, attr, ts, value):
+		"""False when full, the sample goes in the next one."""
+		device = self.devices.get(ieee)
+		key = (ieee, attr)
+		if ((key not in self.series and len(self.series) >= self.max_series)
+				or (device is None and len(self.devices) >= self.max_devices)
+				or len(self.out) + SAMPLE_MAX > self.limit):
+			return False
+		if self.samples == 0:
+			self.base_ts = ts
+			self.out[4:8] = struct.pack("<I", ts)
+		if key not in self.series:
+			put_varint(len(self.series), self.out)
+			if device is None:
+				device = self.devices[ieee] = len(self.devices)
+				put_varint(device, self.out)
+				self.out += struct.pack("<Q", ieee)
+			else:
+				put_varint(device, self.out)
+			self.out.append(attr)
+			self.series[key] = (len(self.series), Codec(self.base_ts, 1))
+		else:
+			put_varint(self.series[key][0], self.out)
+		self.series[key][1].encode(ts, [value], self.out)
+		self.samples += 1
+		return True
+
+
+class Mqtt:
+	"""MQTT 3.1.1 client, just what the benchmarks use."""
+
+	def __init__(self, host, port, client_id, keepalive=60):
+		self.sock = socket.create_connection((host, port), timeout=10)
+		self.keepalive = keepalive
+		self.sent_at = time.monotonic()
+		self.lock = threading.Lock()
+		body = (self._str("MQTT") + bytes([4, 0x02]) + struct.pack(">H", keepalive) + self._str(client_id))
+		self._send(0x10, body)
+		ptype, body = self.read()
+		if ptype != 0x20 or body[1] != 0:
+			raise ConnectionError("connection refused, code %d" % body[1])
+		self.sock.settimeout(None)
+
+	@staticmethod
+	def _str(text):
+		data = text.encode()
+		return struct.pack(">H", len(data)) + data
+
+	def _send(self, first, body):
+		length = bytearray()
+		put_varint(len(body), length)
+		with self.lock:
+			self.sock.sendall(bytes([first]) + bytes(length) + body)
+			self.sent_at = time.monotonic()
+
+	def _read_exact(self, size):
+		data = bytearray()
+		while len(data) < size:
+			chunk = self.sock.recv(size - len(data))
+			if not chunk:
+				raise ConnectionError("broker closed the connection")
+			data += chunk
+		return bytes(data)
+
+	def read(self):
+		"""(packet type, body), the flags of PUBLISH are in the type."""
+		first = self._read_exact(1)[0]
+		length = 0
+		for i in range(4):
+			byte = self._read_exact(1)[0]
+			length |= (byte & 0x7F) << (7 * i)
+			if not byte & 0x80:
+				break
+		return first, self._read_exact(length)
+
+	def subscribe(self, topics):
+		"""Returns once the broker acknowledged, nothing published before is missed."""
+		body = struct.pack(">H", 1) + b"".join(self._str(t) + b"\x01" for t in topics)
+		self._send(0x82, body)
+		while self.read()[0] != 0x90:
+			pass
+
+	def publish(self, topic, payload, qos=1, packet_id=0):
+		body = self._str(topic) + (struct.pack(">H", packet_id) if qos else b"") + payload
+		self._send(0x30 | (qos << 1), body)
+
+	def puback(self, packet_id):
+		self._send(0x40, struct.pack(">H", packet_id))
+
+	def ping_if_idle(self):
+		if time.monotonic() - self.sent_at > self.keepalive / 2:
+			self._send(0xC0, b"")
+
+	def close(self):
+		self._send(0xE0, b"")
+		self.sock.close()
+
+	@staticmethod
+	def parse_publish(first, body):
+		"""(topic, packet id or 0, payload)."""
+		size = struct.unpack(">H", body[:2])[0]
+		topic = body[2:2 + size].decode()
+		pos = 2 + size
+		packet_id = 0
+		if first & 0x06:
+			packet_id = struct.unpack(">H", body[pos:pos + 2])[0]
+			pos += 2
+		return topic, packet_id, body[pos:]
+
+
+class Receiver(threading.Thread):
+	"""Subscribes and decodes the telemetry batches of the topic filter."""
+
+	def __init__(self, args, client_id, topics, on_event=None):
+		super().__init__(daemon=True)
+		self.mqtt = Mqtt(args.broker, args.port, client_id)
+		self.mqtt.subscribe(topics)
+		self.on_event = on_event
+		self.lock = threading.Lock()
+		self.messages = 0
+		self.bytes = 0
+		self.samples = 0
+		self.duplicates = 0
+		self.invalid = 0
+		self.newest_ts = 0
+		self.last_at = None
+		self.seen = set()
+
+	def run(self):
+		try:
+			while True:
+				first, body = self.mqtt.read()
+				if first & 0xF0 != 0x30:
+					continue
+				topic, packet_id, payload = Mqtt.parse_publish(first, body)
+				if packet_id:
+					self.mqtt.puback(packet_id)
+				if topic.endswith("/telemetry"):
+					self.take(payload)
+				elif self.on_event:
+					self.on_event(topic, payload)
+		except (ConnectionError, OSError):
+			pass
+
+	def take(self, payload):
+		try:
+			samples = list(decode_batch(payload))
+		except ValueError:
+			with self.lock:
+				self.invalid += 1
+			return
+		with self.lock:
+			self.messages += 1
+			self.bytes += len(payload)
+			for sample in samples:
+				key = sample[:3]
+				if key in self.seen:
+					self.duplicates += 1
+				else:
+					self.seen.add(key)
+				self.newest_ts = max(self.newest_ts, sample[2])
+			self.samples += len(samples)
+			self.last_at = time.monotonic()
+
+
+def listen(args):
+	def event(topic, payload):
+		print("%s %s" % (topic, payload.decode(errors="replace")))
+
+	prefix = args.prefix
+	receiver = Receiver(args, "uplink-bench-%d" % random.randrange(1 << 16),
+						["%s/+/telemetry" % prefix, "%s/+/events" % prefix, "%s/+/status" % prefix], event)
+	receiver.start()
+	print("%8s %8s %10s %8s %10s" % ("s", "msgs", "samples", "B/smp", "age s"))
+	start = time.monotonic()
+	caught_up = None
+	try:
+		while receiver.is_alive():
+			time.sleep(args.interval)
+			receiver.mqtt.ping_if_idle()
+			with receiver.lock:
+				age = time.time() - receiver.newest_ts if receiver.newest_ts else float("nan")
+				print("%8.0f %8d %10d %8.2f %10.0f" % (time.monotonic() - start, receiver.messages, receiver.samples,
+														receiver.bytes / max(receiver.samples, 1), age))
+				if caught_up is None and receiver.samples and age <= args.caught_up:
+					caught_up = receiver.last_at - start
+					print("backlog drained after %.1f s, %d samples" % (caught_up, receiver.samples))
+	except KeyboardInterrupt:
+		pass
+	print("%d messages, %d samples, %d duplicates, %d not decoded" % (receiver.messages, receiver.samples,
+																	receiver.duplicates, receiver.invalid))
+	return 0
+
+
+def backlog(days, devices, rng):
+	"""Samples of the synthetic traces, in time order like the store log."""
+	samples = []
+	for d in range(devices):
+		ieee = 0x00124B0000000000 + d * 7919
+		traces = [valve_trace(days, rng), sensor_trace(days, 60, 1200, 20, 5, rng),
+					sensor_trace(days, 30, 2500, 3, 1, rng), sensor_trace(days, 3600, 100, 0, 0.05, rng)]
+		for attr, trace in enumerate(traces):
+			samples += [(ts, ieee, attr, value) for ts, value in trace]
+	samples.sort()
+	return [(ieee, attr, ts, value) for ts, ieee, attr, value in samples]
+
+
+def batches_of(samples, limit):
+	batches = []
+	batch = Batch(limit)
+	for sample in samples:
+		if not batch.add(*sample):
+			batches.append(bytes(batch.out))
+			batch = Batch(limit)
+			batch.add(*sample)
+	if batch.samples:
+		batches.append(bytes(batch.out))
+	return batches
+
+
+def drain_run(args, batches, samples, window, rate):
+	"""Publishes the batches like the uplink task, returns its figures."""
+	topic = "%s/uplink-bench/telemetry" % args.prefix
+	receiver = Receiver(args, "uplink-bench-rx", [topic])
+	receiver.start()
+	mqtt = Mqtt(args.broker, args.port, "uplink-bench-tx")
+	acked = {}
+	cond = threading.Condition()
+	rtt_s = args.rtt_ms / 1000
+
+	def pubacks():
+		try:
+			while True:
+				first, body = mqtt.read()
+				if first & 0xF0 == 0x40:
+					with cond:
+						acked[struct.unpack(">H", body[:2])[0]] = time.monotonic() + rtt_s
+						cond.notify()
+		except (ConnectionError, OSError):
+			pass
+
+	threading.Thread(target=pubacks, daemon=True).start()
+	inflight = []
+	tokens = window
+	refill = start = time.monotonic()
+	sent = 0
+	while sent < len(batches) or inflight:
+		with cond:
+			now = time.monotonic()
+			# The acknowledged ones at the front leave the window, after the round trip
+			while inflight and acked.get(inflight[0], now + 1) <= now:
+				acked.pop(inflight.pop(0))
+			if rate:
+				tokens = min(window, tokens + (now - refill) * rate)
+			else:
+				tokens = window
+			refill = now
+			if sent < len(batches) and len(inflight) < window and tokens >= 1:
+				packet_id = sent % 65535 + 1
+				mqtt.publish(topic, batches[sent], 1, packet_id)
+				inflight.append(packet_id)
+				tokens -= 1
+				sent += 1
+				continue
+			cond.wait(0.001)
+	drained = time.monotonic() - start
+
+	deadline = time.monotonic() + 10
+	while receiver.samples < len(samples) and time.monotonic() < deadline:
+		time.sleep(0.01)
+	mqtt.close()
+	receiver.mqtt.close()
+	missing = len(samples) - len(receiver.seen)
+	return drained, receiver.samples, receiver.duplicates, missing
+
+
+def drain(args):
+	rng = random.Random(1)
+	samples = backlog(args.days, args.devices, rng)
+	batches = batches_of(samples, args.batch_bytes)
+	total = sum(len(b) for b in batches)
+	print("backlog: %d samples of %d devices over %d days, %d batches of up to %d bytes, %.2f B/sample"
+			% (len(samples), args.devices, args.days, len(batches), args.batch_bytes, total / len(samples)))
+
+	decoded = [s for b in batches for s in decode_batch(b)]
+	if decoded != samples:
+		print("the batches don't decode back to the backlog")
+		return 1
+
+	print("%6s %6s %6s %9s %10s %10s %6s %7s" % ("window", "rate", "rtt", "drain s", "samples/s", "msgs/s",
+												"dups", "missing"))
+	errors = 0
+	for window in [int(w) for w in args.window.split(",")]:
+		drained, received, duplicates, missing = drain_run(args, batches, samples, window, args.rate)
+		print("%6d %6s %6.0f %9.2f %10.0f %10.1f %6d %7d" % (window, args.rate or "-", args.rtt_ms, drained,
+															len(samples) / drained, len(batches) / drained,
+															duplicates, missing))
+		errors += missing
+	return 1 if errors else 0
+
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+	parser.add_argument("mode", choices=["listen", "drain"])
+	parser.add_argument("--broker", default="localhost")
+	parser.add_argument("--port", type=int, default=1883)
+	parser.add_argument("--prefix", default="ft", help="MQTT_UPLINK_TOPIC_PREFIX")
+	parser.add_argument("--interval", type=float, default=5, help="listen: seconds between the lines")
+	parser.add_argument("--caught-up", type=float, default=60, help="listen: sample age of a drained backlog")
+	parser.add_argument("--days", type=int, default=2, help="drain: backlog length")
+	parser.add_argument("--devices", type=int, default=40, help="drain: devices, 4 attributes each")
+	parser.add_argument("--batch-bytes", type=int, default=4096, help="MQTT_UPLINK_BATCH_BYTES")
+	parser.add_argument("--window", default="4", help="MQTT_UPLINK_INFLIGHT, a list is swept")
+	parser.add_argument("--rate", type=float, default=4, help="MQTT_UPLINK_DRAIN_BATCHES_S, 0 without limit")
+	parser.add_argument("--rtt-ms", type=float, default=0, help="drain: PUBACK delay")
+	args = parser.parse_args()
+
+	try:
+		return listen(args) if args.mode == "listen" else drain(args)
+	except (ConnectionError, OSError) as err:
+		print("broker %s:%d: %s" % (args.broker, args.port, err))
+		return 1
+
+
+if __name__ == "__main__":
+	sys.exit(main())